@@ -0,0 +1,134 @@
+#!/usr/bin/python3
+
+# Reader for fsrip's binary record format (--format=binary). Records are
+# decoded into dicts shaped like the JSON records, except that flags and
+# types are left as raw TSK numbers and IDs are raw bytes.
+
+import struct
+
+MAGIC = b'FSRB'
+VERSION = 2
+
+def varintSize(first):
+  if first < 241:
+    return 1
+  elif first < 249:
+    return 2
+  return first - 246
+
+def decodeVarint(buf, pos):
+  first = buf[pos]
+  if first < 241:
+    return first, pos + 1
+  elif first < 249:
+    return 240 + 256 * (first - 241) + buf[pos + 1], pos + 2
+  elif first == 249:
+    return 2288 + 256 * buf[pos + 1] + buf[pos + 2], pos + 3
+  n = varintSize(first)
+  val = 0
+  for b in buf[pos + 1:pos + n]:
+    val = (val << 8) | b
+  return val, pos + n
+
+def readVarint(input):
+  first = input.read(1)
+  if not first:
+    return None
+  n = varintSize(first[0])
+  buf = bytearray(first + input.read(n - 1))
+  if len(buf) != n:
+    raise EOFError('truncated varint')
+  return decodeVarint(buf, 0)[0]
+
+class Decoder:
+  def __init__(self, buf):
+    self.buf = bytearray(buf)
+    self.pos = 0
+
+  def vint(self):
+    val, self.pos = decodeVarint(self.buf, self.pos)
+    return val
+
+  def bytes(self):
+    n = self.vint()
+    val = bytes(self.buf[self.pos:self.pos + n])
+    self.pos += n
+    return val
+
+  def string(self):
+    return self.bytes().decode('utf-8', 'replace')
+
+  def ts(self):
+    secs, nanos = struct.unpack_from('<qI', self.buf, self.pos)
+    self.pos += 12
+    return secs + nanos / 1e9
+
+def decodeAttr(d, version):
+  a = {}
+  for f in ('flags', 'id'):
+    a[f] = d.vint()
+  a['name'] = d.string()
+  for f in ('size', 'type', 'rd_buf_size', 'nrd_allocsize', 'nrd_compsize', 'nrd_initsize', 'nrd_skiplen'):
+    a[f] = d.vint()
+  if version >= 2:
+    a['physical_size'] = d.vint()
+    a['slack_size'] = d.vint()
+  a['rd_buf'] = d.bytes()
+  a['nrd_runs'] = [dict((f, d.vint()) for f in ('addr', 'flags', 'len', 'offset')) for i in range(d.vint())]
+  return a
+
+def decodeRecord(buf, version=VERSION):
+  d = Decoder(buf)
+  if d.vint() != 0:
+    raise ValueError('not a file record')
+  rec = {'id': d.bytes(), 'parent': d.bytes(), 'children': d.bytes()}
+  rec['fs'] = {'byteOffset': d.vint(), 'blockSize': d.vint(), 'fsID': d.bytes(), 'volName': d.string(), 'volIndex': d.vint()}
+  rec['path'] = d.string()
+  present = d.vint()
+  if present & 1:
+    n = {}
+    for f in ('flags', 'meta_addr', 'meta_seq'):
+      n[f] = d.vint()
+    n['name'] = d.string()
+    for f in ('par_addr', 'par_seq'):
+      n[f] = d.vint()
+    n['shrt_name'] = d.string()
+    n['type'] = d.vint()
+    rec['name'] = n
+  if present & 2:
+    m = {'addr': d.vint(), 'accessed': d.ts(), 'content_len': d.vint(), 'created': d.ts(), 'metadata': d.ts(),
+         'flags': d.vint(), 'gid': d.vint(), 'link': d.string()}
+    kind = d.vint()
+    if kind == 1:
+      m['dtime'] = d.ts()
+    elif kind == 2:
+      m['bkup_time'] = d.ts()
+    m['mode'] = d.vint()
+    m['modified'] = d.ts()
+    for f in ('nlink', 'seq', 'size', 'type', 'uid'):
+      m[f] = d.vint()
+    m['attrs'] = [decodeAttr(d, version) for i in range(d.vint())]
+    rec['meta'] = m
+  return rec
+
+def readHeader(input):
+  if input.read(4) != MAGIC:
+    raise ValueError('not an fsrip binary record stream')
+  version = readVarint(input)
+  if version is None or version > VERSION:
+    raise ValueError('unsupported fsrip binary record version')
+  schema = input.read(readVarint(input))
+  return version, schema
+
+def readRecord(input, version=VERSION):
+  size = readVarint(input)
+  if size is None:
+    return None
+  buf = input.read(size)
+  if len(buf) != size:
+    raise EOFError('truncated record')
+  return decodeRecord(buf, version)
+
+def isBinary(input):
+  # input must support peek(), e.g., Python 3's sys.stdin.buffer
+  return input.peek(4)[:4] == MAGIC
@@ -0,0 +1,22 @@
+#!/usr/bin/python3
+
+# Expands `fsrip dumpfs --dir-table` output back into full dumpfs records,
+# restoring the fs and path fields from the fs and dir records.
+
+import sys
+import json
+
+dirs = {}
+filesystems = {}
+
+for line in sys.stdin:
+  rec = json.loads(line)
+  if 'dir' in rec:
+    dirs[rec['dir']['id']] = rec['dir']['path']
+  elif 'fs' in rec:
+    filesystems[rec['fs']['volIndex']] = rec['fs']
+  else:
+    fsmd = rec['t']['fsmd']
+    fsmd['fs'] = filesystems[fsmd.pop('volIndex')]
+    fsmd['path'] = dirs[rec['parent']]
+    print(json.dumps(rec, separators=(',', ':')))
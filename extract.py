@@ -1,12 +1,15 @@
-#!/bin/python
+#!/usr/bin/python3
 
 import sys
 import json
 import re
 import struct
 import os
+import shutil
 
-input = sys.stdin
+import binrec
+
+input = getattr(sys.stdin, 'buffer', sys.stdin)
 
 def getHashSize(physicalSize, metadata):
   size = physicalSize
@@ -18,29 +21,69 @@ def getPath(metadata):
   name = metadata['name']['name']
   return metadata['path'] + name, name
 
-def exportFile(path, data):
+def makeDirs(path):
   dir = os.path.dirname(path)
   if (False == os.path.exists(dir)):
     os.makedirs(dir)
-  with open(path, 'w') as f:
+
+def exportFile(path, data):
+  makeDirs(path)
+  with open(path, 'wb') as f:
     f.write(data)
 
+def copyFile(src, path):
+  makeDirs(path)
+  shutil.copyfile(src, path)
+
+binary = binrec.isBinary(input)
+if binary:
+  version, schema = binrec.readHeader(input)
+
+def readMetadata():
+  if binary:
+    return binrec.readRecord(input, version)
+  line = input.readline()
+  if not line:
+    return None
+  # the fields of interest are under t.fsmd in JSON records
+  rec = json.loads(line)
+  if 'index' in rec:
+    return None # trailer of --order=physical
+  if 't' not in rec:
+    return rec
+  md = rec['t']['fsmd']
+  md['id'] = rec['id'] # for resolving dumpfiles --dedup content_ref
+  return md
+
+def isFile(metadata):
+  # binary records carry TSK_FS_NAME_TYPE_REG as a number, JSON as its name
+  return metadata['name']['type'] in (5, 'File')
+
 search = re.compile(sys.argv[1])
 
-line = input.readline()
+exported = {} # record ID -> path, for dumpfiles --dedup content_ref
+metadata = readMetadata()
 filesRead = 0
-while line:
+while metadata:
   try:
-    metadata = json.loads(line)
     path, name = getPath(metadata)
     sizeData = input.read(8)
     size = struct.unpack('<Q', sizeData)[0]
     data = input.read(size)
 
     size = getHashSize(size, metadata)
-    if (None != search.search(path) and 5 == metadata['name']['type'] and not (name == '.' or name == '..')):
-      exportFile(path, data[:size])
-    line = input.readline()
+    if (None != search.search(path) and isFile(metadata) and not (name == '.' or name == '..')):
+      if 'content_ref' in metadata:
+        # dumpfiles --dedup wrote the contents with an earlier record
+        refID = metadata['content_ref']['id']
+        if refID in exported:
+          copyFile(exported[refID], path)
+        else:
+          print("contents of %s are with %s, which was not extracted" % (path, refID))
+      else:
+        exportFile(path, data[:size])
+        exported[metadata.get('id')] = path
+    metadata = readMetadata()
   except struct.error as e:
     print("%s with len(sizeData) == %s on %s" % (e, str(len(sizeData)), path))
     raise
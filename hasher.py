@@ -1,32 +1,60 @@
-#!/bin/python
+#!/usr/bin/python3
 
 import sys
 import json
 import hashlib
 import struct
 
+import binrec
+
 def getHashSize(physicalSize, metadata):
   size = physicalSize
   if ('meta' in metadata):
     size = min(size, metadata['meta']['size'])
   return size
 
-input = sys.stdin
+input = getattr(sys.stdin, 'buffer', sys.stdin)
 
-line = input.readline()
-filesRead = 0
-while line:
-  metadata = json.loads(line)
+binary = binrec.isBinary(input)
+if binary:
+  version, schema = binrec.readHeader(input)
+
+def readMetadata():
+  if binary:
+    return binrec.readRecord(input, version)
+  line = input.readline()
+  if not line:
+    return None
+  # the fields of interest are under t.fsmd in JSON records
+  rec = json.loads(line)
+  if 'index' in rec:
+    return None # trailer of --order=physical
+  if 't' not in rec:
+    return rec
+  md = rec['t']['fsmd']
+  md['id'] = rec['id'] # for resolving dumpfiles --dedup content_ref
+  return md
 
+hashed = {} # record ID -> (size, digest), for dumpfiles --dedup content_ref
+metadata = readMetadata()
+filesRead = 0
+while metadata:
   sizeData = input.read(8)
   size = struct.unpack('<Q', sizeData)[0]
   data = input.read(size)
 
-  size = getHashSize(size, metadata)
-  hasher = hashlib.md5()
-  hasher.update(data[:size])
+  if 'content_ref' in metadata:
+    # contents were written with an earlier record
+    size, digest = hashed[metadata['content_ref']['id']]
+  else:
+    size = getHashSize(size, metadata)
+    hasher = hashlib.md5()
+    hasher.update(data[:size])
+    digest = hasher.hexdigest()
+    if 'id' in metadata:
+      hashed[metadata['id']] = (size, digest)
 
-  print("%s\t%s\t%s\t%s" % (metadata['path'], metadata['name']['name'], str(size), hasher.hexdigest()))
+  print("%s\t%s\t%s\t%s" % (metadata['path'], metadata['name']['name'], str(size), digest))
   filesRead += 1
-  line = input.readline()
+  metadata = readMetadata()
 print("read %s files" % (filesRead))
@@ -0,0 +1,132 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Capacity is rounded up to a power of two.
+template<class T>
+class SpscRing {
+public:
+  SpscRing(size_t capacity): Head(0), Tail(0) {
+    size_t n = 1;
+    while (n < capacity) {
+      n <<= 1;
+    }
+    Slots.resize(n);
+    Mask = n - 1;
+  }
+
+  size_t capacity() const { return Slots.size(); }
+
+  bool tryPush(const T& val) {
+    const size_t tail = Tail.load(std::memory_order_relaxed);
+    if (tail - Head.load(std::memory_order_acquire) == Slots.size()) {
+      return false;
+    }
+    Slots[tail & Mask] = val;
+    Tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool tryPop(T& val) {
+    const size_t head = Head.load(std::memory_order_relaxed);
+    if (head == Tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    val = Slots[head & Mask];
+    Head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  std::vector<T> Slots;
+  size_t         Mask;
+
+  // padded onto separate cache lines, so the two threads don't contend on
+  // them (padding rather than alignas, as C++11 new ignores over-alignment)
+  char                Pad0[64];
+  std::atomic<size_t> Head; // next to pop, written by consumer
+  char                Pad1[64 - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> Tail; // next to push, written by producer
+  char                Pad2[64 - sizeof(std::atomic<size_t>)];
+};
+
+/*************************************************************************/
+
+struct AsyncWriterStats {
+  uint64_t Bytes,
+           Chunks,
+           Writes;        // number of writev calls
+  double   Elapsed,       // seconds from creation to close
+           WalkBlocked,   // seconds the producer waited for a free chunk
+           WriterIdle,    // seconds the writer waited for a full chunk
+           WriterBusy;    // seconds the writer spent in writev
+
+  std::string toString() const;
+};
+
+// Output stage between the walk and a file descriptor. Writes are copied
+// into fixed-size chunks, which are handed over a ring to a writer thread
+// that drains as many as are ready with a single writev. Chunks come back
+// over a second ring, so when the output stalls the producer blocks only
+// once every chunk is in flight. Flushing does not hand over a partial
+// chunk; call close() to finish.
+class AsyncWriterStreambuf: public std::streambuf {
+public:
+  AsyncWriterStreambuf(int fd, size_t chunkSize = 1 << 16, size_t numChunks = 64);
+  virtual ~AsyncWriterStreambuf();
+
+  // hands over remaining data, waits for the writer; throws std::runtime_error on a write error
+  void close();
+
+  AsyncWriterStats stats() const;
+
+protected:
+  virtual int_type overflow(int_type c);
+  virtual std::streamsize xsputn(const char* s, std::streamsize n);
+
+private:
+  struct Chunk {
+    std::vector<char> Data;
+    size_t            Len;
+  };
+
+  bool handOff();
+  void run();
+  void writeChunks(std::vector<Chunk*>& chunks);
+
+  int    Fd;
+  Chunk* Cur;
+
+  std::vector<std::unique_ptr<Chunk>> Chunks;
+
+  SpscRing<Chunk*> Full, // producer -> writer
+                   Free; // writer -> producer
+
+  std::atomic<bool> Done,
+                    Failed;
+  int               WriteErr;
+  bool              Closed;
+
+  uint64_t Bytes,
+           NumChunks,
+           Writes;
+  double   WalkBlocked,
+           Elapsed;
+  std::chrono::steady_clock::time_point Started;
+  std::atomic<uint64_t> WriterIdleNs,
+                        WriterBusyNs;
+
+  std::thread Writer;
+};
@@ -0,0 +1,69 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include "threadpool.h"
+
+#include <cinttypes>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// BGZF: a series of independent gzip members of at most 64KB each, with the
+// member size in a gzip extra field. Any gzip reader can decompress it, and
+// a reader can seek straight to any block's compressed offset.
+
+static const unsigned int BGZF_MAX_BLOCK_DATA = 0xff00;  // uncompressed bytes per block
+static const unsigned int BGZF_MAX_BLOCK_SIZE = 0x10000; // compressed bytes per block
+
+std::string bgzfCompressBlock(const char* data, size_t len, int level);
+
+// decompresses the block at the start of buf, appending to out; returns the
+// block's compressed size, throws std::runtime_error if the block is bad
+size_t bgzfDecompressBlock(std::string& out, const unsigned char* buf, size_t len);
+
+const std::string& bgzfEofBlock();
+
+// Compresses everything written to it with a thread pool, writing the blocks
+// to the sink in order. Blocks are only cut when full, so flushing the
+// stream does not produce runt blocks; call close() to finish.
+class BgzfStreambuf: public std::streambuf {
+public:
+  typedef std::pair<uint64_t, uint64_t> IndexEntry; // compressed, uncompressed offsets
+
+  BgzfStreambuf(std::streambuf* sink, ThreadPool& pool, int level = 6);
+  virtual ~BgzfStreambuf();
+
+  void close(); // compresses remaining data, writes the EOF block
+
+  const std::vector<IndexEntry>& index() const { return Index; }
+
+  // writes a bgzip-compatible .gzi index of the block offsets
+  void writeIndex(std::ostream& out) const;
+
+protected:
+  virtual int_type overflow(int_type c);
+  virtual std::streamsize xsputn(const char* s, std::streamsize n);
+
+private:
+  void submitBlock();
+  void drain(size_t maxPending);
+
+  std::streambuf* Sink;
+  ThreadPool&     Pool;
+  int             Level;
+
+  std::vector<char>                   Buf;
+  std::deque<std::future<std::string>> Pending;
+
+  uint64_t CompressedOffset,
+           UncompressedOffset;
+  bool     Closed;
+
+  std::vector<IndexEntry> Index;
+};
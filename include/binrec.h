@@ -0,0 +1,50 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include "records.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Binary dumpfs records. A stream starts with the magic "FSRB", a varint
+// version, and a varint-length JSON schema describing field order. Each
+// record is then a varint payload length followed by the payload. Integers
+// are util.h varints, timestamps are little-endian int64 seconds + uint32
+// nanoseconds, and strings/IDs are a varint length followed by raw bytes.
+
+static const char         BINREC_MAGIC[] = "FSRB";
+static const unsigned int BINREC_VERSION = 2; // 2 added attr physical_size, slack_size
+
+const std::string& binRecSchema();
+
+void writeBinRecHeader(std::ostream& out);
+void writeBinRecord(std::ostream& out, const std::string& payload);
+
+void encodeFileRecord(std::string& out, const FileRecord& rec);
+
+// returns the position following the record; throws std::runtime_error if malformed
+const unsigned char* decodeFileRecord(FileRecord& rec, const unsigned char* beg, const unsigned char* end,
+                                      unsigned int version = BINREC_VERSION);
+
+class BinRecReader {
+public:
+  BinRecReader(std::istream& in); // reads and validates the stream header
+
+  unsigned int       version() const { return Version; }
+  const std::string& schema() const { return Schema; }
+
+  // false on a clean end of stream; throws std::runtime_error on a truncated record
+  bool next(FileRecord& rec);
+
+private:
+  bool readVarint(uint64_t& val);
+
+  std::istream&              In;
+  unsigned int               Version;
+  std::string                Schema;
+  std::vector<unsigned char> Buf;
+};
@@ -0,0 +1,71 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include "search.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A file type the carver knows: its header, and either a footer or a size
+// in its header. Objects end at the first footer after the header (or, with
+// LastFooter, the last before the next header of the type), within MaxSize.
+struct CarveSignature {
+  enum SIZE_FROM {
+    FOOTER,
+    ZIP_FOOTER,    // the end of central directory record, and its comment
+    SQLITE_HEADER, // page size * page count
+    EVTX_HEADER    // header block + chunk count * 64KB
+  };
+
+  std::string Type,
+              Header,
+              Footer;
+  SIZE_FROM   SizeFrom;
+  uint64_t    MaxSize;
+  bool        LastFooter;
+};
+
+// JPEG, PNG, PDF, ZIP (and OOXML, a ZIP starting with [Content_Types].xml),
+// SQLite, and EVTX
+const std::vector<CarveSignature>& carveSignatures();
+
+struct CarvedObject {
+  std::string Type;
+  uint64_t    Offset,
+              Size;
+  bool        Complete; // false if the end wasn't found, and Size is a guess
+};
+
+// Carves objects from the headers and footers found by its matcher. The
+// matcher does the scanning, so that it can be done in parallel; carve()
+// then pairs up the hits, reading only the few header bytes it needs.
+class Carver {
+public:
+  // returns the bytes of the image at offset, or fewer if they can't be read
+  typedef std::function<std::string(uint64_t offset, size_t len)> Reader;
+
+  Carver(const std::vector<CarveSignature>& sigs = carveSignatures());
+
+  std::shared_ptr<PatternMatcher> matcher() const { return Matcher; }
+
+  // The objects starting in [beg, end), in order, from the matcher's hits
+  // there (which must be in order). Objects don't extend past end. Headers
+  // inside an object of the same type, like the local file headers of a ZIP,
+  // don't start objects of their own.
+  std::vector<CarvedObject> carve(const std::vector<PatternMatcher::Hit>& hits,
+                                  uint64_t beg, uint64_t end, const Reader& read) const;
+
+private:
+  uint64_t findEnd(const CarveSignature& sig, uint64_t header, uint64_t stop, uint64_t limit,
+                   const std::vector<uint64_t>& footers, const Reader& read) const;
+
+  std::vector<CarveSignature>     Sigs;
+  std::shared_ptr<PatternMatcher> Matcher;
+  std::vector<uint32_t>           PatternSig;      // by pattern, index into Sigs
+  std::vector<char>               PatternIsFooter; // by pattern
+};
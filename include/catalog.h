@@ -0,0 +1,126 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include "mappedfile.h"
+#include "records.h"
+
+#include <cinttypes>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// What a catalog knows of an evidence segment. A catalog is current only
+// while the segments have the paths (as given), sizes, and modification
+// times they had when it was made.
+struct SegmentIdentity {
+  std::string Path;
+  uint64_t    Size;
+  int64_t     Modified; // seconds since the epoch
+
+  bool operator==(const SegmentIdentity& other) const {
+    return Path == other.Path && Size == other.Size && Modified == other.Modified;
+  }
+};
+
+// throws std::runtime_error if a segment can't be found
+std::vector<SegmentIdentity> segmentIdentities(const std::vector<std::string>& paths);
+
+enum CatalogSection {
+  CATALOG_INFO,        // "info": the output of info
+  CATALOG_RECORDS,     // record ID: inode volume index (4 bytes), then the binary record;
+                       // unkeyed: the fs and dir records of --dir-table, as JSON, in sequence
+  CATALOG_PATHS,       // path and name of a record: its ID
+  CATALOG_FILESYSTEMS, // volume index, in decimal: "fs":{...}
+  CATALOG_INODES,      // inode ID: its inode map line
+  CATALOG_DISK_MAP,    // disk map ID: its disk map line
+  NUM_CATALOG_SECTIONS
+};
+
+// A catalog holds what a walk of an image found, so that info, dumpfs, the
+// inode and disk maps, and lookups by ID or path can be answered without
+// walking it again. It's mmapped and searched in place. The file is, all
+// little-endian:
+//
+//   "FSCT", version, number of segments, number of sections   4 x 4 bytes
+//   each segment: size, modification time, path length, path  8 + 8 + 4 bytes + path
+//   each section: offset of its entries, their length, number of keys
+//                                                              3 x 8 bytes
+//   each section's entries, followed by its index
+//
+// An entry is its key length and value length (4 bytes each), its key, and
+// its value. Entries are in output order. The index holds the offsets, from
+// the start of the entries, of those with keys, sorted by key (8 bytes each).
+struct CatalogEntry {
+  const char* Key;
+  uint32_t    KeyLen;
+  const char* Value;
+  uint32_t    ValueLen;
+
+  std::string key() const { return std::string(Key, KeyLen); }
+  std::string value() const { return std::string(Value, ValueLen); }
+};
+
+// Collects the entries of a catalog in memory, then writes it.
+class CatalogBuilder {
+public:
+  void add(CatalogSection section, const std::string& key, const std::string& value);
+
+  uint64_t size(CatalogSection section) const { return Sections[section].Keyed.size(); }
+
+  // writes beside path, then renames over it, so that readers never see
+  // half a catalog; throws std::runtime_error if it can't
+  void write(const std::string& path, const std::vector<SegmentIdentity>& segments) const;
+
+private:
+  struct Section {
+    std::string           Entries;
+    std::vector<uint64_t> Keyed; // offsets of the entries with keys
+  };
+
+  Section Sections[NUM_CATALOG_SECTIONS];
+};
+
+class Catalog {
+public:
+  static const uint32_t VERSION = 1;
+
+  Catalog(const std::string& path); // throws std::runtime_error
+
+  const std::vector<SegmentIdentity>& segments() const { return Segments; }
+  bool current(const std::vector<SegmentIdentity>& segments) const { return segments == Segments; }
+
+  uint64_t size(CatalogSection section) const { return Sections[section].NumKeys; }
+
+  // every entry, in output order; throws std::runtime_error if one is malformed
+  void scan(CatalogSection section, const std::function<void(const CatalogEntry&)>& visit) const;
+
+  // the entries with the key, in output order
+  std::vector<CatalogEntry> find(CatalogSection section, const std::string& key) const;
+
+private:
+  struct Section {
+    const unsigned char* Entries;
+    uint64_t             Len,
+                         NumKeys;
+    const unsigned char* Index;
+  };
+
+  CatalogEntry entryAt(const Section& s, uint64_t offset) const;
+
+  std::string                  Path;
+  MappedFile                   File;
+  std::vector<SegmentIdentity> Segments;
+  Section                      Sections[NUM_CATALOG_SECTIONS];
+};
+
+// CATALOG_RECORDS values
+std::string encodeCatalogRecord(const FileRecord& rec, uint32_t inodeVol);
+void decodeCatalogRecord(const CatalogEntry& entry, FileRecord& rec, uint32_t& inodeVol);
+
+// writes the records as dumpfs would, with the given --format, --dir-table,
+// and --fields
+void writeCatalogRecords(std::ostream& out, const Catalog& catalog, bool binary, bool dirTable, unsigned int fields);
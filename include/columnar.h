@@ -0,0 +1,116 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include "records.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Columnar export of dumpfs name/meta fields. The file is a sequence of
+// fixed-size row groups, each holding one encoded chunk per column, followed
+// by a footer indexing every chunk with its min/max so that scans can read
+// only the columns and row groups they need.
+//
+// layout: "FSRC" version | row group* | footer | footer offset (uint64le) "FSRC"
+
+static const char         COLUMNAR_MAGIC[] = "FSRC";
+static const unsigned int COLUMNAR_VERSION = 1;
+
+namespace ColumnEncodings {
+  enum ColumnEncodings {
+    PLAIN_UINT   = 0, // varint per row
+    DELTA_INT    = 1, // zigzag varint difference from the previous row
+    PLAIN_STRING = 2, // varint length + bytes per row
+    DICT_STRING  = 3, // dictionary of distinct values, then a varint index per row
+    DELTA_TIME   = 4  // DELTA_INT seconds, then varint nanoseconds, per row
+  };
+}
+
+struct ColumnDesc {
+  std::string  Name;
+  unsigned int Encoding;
+};
+
+const std::vector<ColumnDesc>& columnarSchema();
+
+struct ColumnChunk {
+  uint64_t Offset, // from start of row group
+           Length;
+  int64_t  Min,    // numeric columns only; seconds for times, and for uint
+           Max;    // columns the bits of the uint64_t values, compared unsigned
+};
+
+struct RowGroupInfo {
+  uint64_t                 Offset,
+                           NumRows;
+  std::vector<ColumnChunk> Columns;
+};
+
+// Encodes one row group into buf, filling in the chunk index.
+void encodeRowGroup(std::string& buf, RowGroupInfo& info, const std::vector<FileRecord>& rows);
+
+class ColumnarWriter {
+public:
+  ColumnarWriter(const std::string& path, unsigned int rowGroupSize = 65536, unsigned int maxQueuedGroups = 4);
+  ~ColumnarWriter();
+
+  // called from the walk; hands off full row groups to the writer thread
+  void push(const FileRecord& rec);
+
+  // flushes the last row group, writes the footer, and joins the writer thread
+  void close();
+
+private:
+  void run();
+  void enqueue();
+  bool queueCur(std::unique_lock<std::mutex>& lock); // false if the writer thread has failed
+
+  std::ofstream File;
+  unsigned int  RowGroupSize,
+                MaxQueuedGroups;
+
+  std::vector<FileRecord> Cur;
+
+  std::mutex                            Mutex;
+  std::condition_variable               NotEmpty,
+                                        NotFull;
+  std::deque<std::vector<FileRecord>>   Queue;
+  bool                                  Done;
+  std::exception_ptr                    Error;
+
+  std::vector<RowGroupInfo> Groups;
+  uint64_t                  Written;
+
+  std::thread Writer;
+};
+
+class ColumnarReader {
+public:
+  ColumnarReader(std::istream& in); // reads and validates the footer
+
+  const std::vector<RowGroupInfo>& rowGroups() const { return Groups; }
+
+  int column(const std::string& name) const; // -1 if not found
+
+  void readUInts(unsigned int group, unsigned int col, std::vector<uint64_t>& vals);
+  void readInts(unsigned int group, unsigned int col, std::vector<int64_t>& vals);
+  void readStrings(unsigned int group, unsigned int col, std::vector<std::string>& vals);
+  void readTimes(unsigned int group, unsigned int col, std::vector<Timestamp>& vals);
+
+private:
+  const std::string& chunk(unsigned int group, unsigned int col, unsigned int encoding);
+
+  std::istream&             In;
+  std::vector<RowGroupInfo> Groups;
+  std::string               Buf;
+};
@@ -0,0 +1,42 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include "records.h"
+
+// Byte statistics of data fed in pieces: entropy, zero and text ratios, and
+// a coarse histogram. Bytes are counted into several tables in turn, so
+// that consecutive equal bytes don't wait on each other's increments, and
+// the tables are only summed by finish().
+class ContentStats {
+public:
+  ContentStats();
+
+  void update(const char* data, size_t len);
+
+  StatsRecord finish() const;
+
+private:
+  enum { NUM_TABLES = 4 };
+
+  uint64_t Counts[NUM_TABLES][256];
+};
+
+StatsRecord statsData(const char* data, size_t len);
+
+// What a region of the disk holds, judged from its bytes alone
+enum BlockClass {
+  ZERO_BLOCK,
+  CONSTANT_BLOCK,     // one nonzero byte, repeated
+  LOW_ENTROPY_BLOCK,
+  TEXT_BLOCK,         // at least 95% printable ASCII
+  HIGH_ENTROPY_BLOCK, // at least 7.5 bits per byte: compressed or encrypted
+  UNREADABLE_BLOCK,   // not classified from its bytes, but for read errors
+  NUM_BLOCK_CLASSES
+};
+
+BlockClass classifyBlock(const char* data, size_t len);
+
+const char* blockClassName(BlockClass c);
@@ -0,0 +1,41 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include "records.h"
+
+#include <memory>
+#include <string>
+
+// A --filter expression, evaluated against a file's name and meta before any
+// attribute or content work. Terms:
+//
+//   path = GLOB, path != GLOB   full path, including the volume directory;
+//   name = GLOB, name != GLOB   * and ? stop at '/', ** doesn't; ignores case
+//   path ~ REGEX, name !~ REGEX ECMAScript regex search
+//   type = TYPE, type != TYPE   name type as in JSON records (File, Folder,
+//                               ...), or reg, dir, link
+//   size OP N                   meta size; N may end in K, M, or G
+//   modified OP TIME            also accessed, created, metadata; TIME is
+//                               YYYY-MM-DD[THH:MM[:SS]][Z] (UTC) or seconds
+//   allocated, deleted
+//
+// where OP is one of = != < <= > >=. Terms combine with and, or, not, and
+// parentheses; values with spaces or parentheses can be quoted.
+class FileFilter {
+public:
+  FileFilter(const std::string& expr); // throws std::invalid_argument
+
+  bool matches(const FileRecord& rec) const;
+
+  // false if nothing in the directory (a path ending in '/') or beneath
+  // it can match, so it can be skipped
+  bool mayMatchUnder(const std::string& dir) const;
+
+  struct Node;
+
+private:
+  std::shared_ptr<Node> Root;
+};
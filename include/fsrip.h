@@ -1,18 +1,143 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// struct ImageHandle;
+// The C interface to libfsrip, for embedding it without spawning fsrip and
+// parsing its output. Functions returning int give 0 on success and -1 on
+// failure, when sf_last_error() says why. A handle may be used from several
+// threads at once; it must not be closed while in use.
+
+struct ImageHandle;
+
+typedef struct ImageHandle* SF_HIMAGE;
+
+// opens an image from its segments, in order; NULL on failure
+SF_HIMAGE sf_open_img(const char* const* segments, unsigned int numSegments);
+
+void sf_close_img(SF_HIMAGE img);
+
+uint64_t sf_img_size(SF_HIMAGE img);
+
+unsigned int sf_img_sector_size(SF_HIMAGE img);
+
+// Reads up to len bytes at offset into buf, returning the number read, or
+// -1. Reads don't move any position, so threads needn't coordinate them.
+int64_t sf_img_read(SF_HIMAGE img, uint64_t offset, void* buf, size_t len);
+
+// the message of the calling thread's last failure, or "" if none
+const char* sf_last_error(void);
+
+// A volume of the volume system, or, for an image that's just a filesystem,
+// the whole image. Strings last as long as the handle.
+typedef struct {
+  unsigned int Index;       // as in sf_get_volume() and SF_RECORD.VolIndex
+  uint64_t     StartSector,
+               NumSectors;
+  unsigned int Flags;       // TSK_VS_PART_FLAG_ENUM; 0 for a whole image
+  const char*  Description;
+  int          HasFs;       // whether the rest is set
+  uint64_t     FsByteOffset,
+               FsNumBlocks;
+  unsigned int FsBlockSize,
+               FsType;      // TSK_FS_TYPE_ENUM
+  const char*  FsName;
+} SF_VOLUME;
+
+unsigned int sf_num_volumes(SF_HIMAGE img);
+
+int sf_get_volume(SF_HIMAGE img, unsigned int index, SF_VOLUME* vol);
+
+// The records of sf_walk() hold the fields of dumpfs records, with flags,
+// types, and modes as their raw TSK values. Their pointers are only good
+// during the callback.
+
+typedef struct {
+  int64_t  Secs;
+  uint32_t Nanos;
+} SF_TIME;
+
+typedef struct {
+  uint64_t Addr,   // in blocks
+           Len,    // in blocks
+           Offset; // in blocks, within the attribute
+  uint32_t Flags;  // TSK_FS_ATTR_RUN_FLAG_ENUM
+} SF_RUN;
+
+typedef struct {
+  uint32_t      Flags,
+                ID,
+                Type;
+  const char*   Name;
+  uint64_t      Size,
+                AllocSize,
+                InitSize,
+                CompSize,
+                SkipLen,
+                PhysicalSize, // allocated bytes, data and slack
+                SlackSize;
+  const void*   ResidentData;
+  size_t        ResidentLen;
+  const SF_RUN* Runs;
+  size_t        NumRuns;
+} SF_ATTR;
+
+typedef struct {
+  uint32_t    Flags,
+              Type;
+  const char* Name;
+  const char* ShortName;
+  uint64_t    MetaAddr,
+              ParAddr;
+  uint32_t    MetaSeq,
+              ParSeq;
+} SF_NAME;
 
-// typedef struct ImageHandle* SF_HIMAGE;
+typedef struct {
+  uint64_t       Addr,
+                 Size;
+  uint32_t       Flags,
+                 Type,
+                 Mode,
+                 Uid,
+                 Gid,
+                 NLink,
+                 Seq;
+  SF_TIME        Accessed,
+                 Created,
+                 Metadata,
+                 Modified;
+  const char*    Link;
+  const SF_ATTR* Attrs;
+  size_t         NumAttrs;
+} SF_META;
 
-// SF_HIMAGE sf_open_img();
+typedef struct {
+  const char*    ID;     // as dumpfs has it, and the inode and disk maps refer to it
+  const char*    Path;   // of the directory holding it, starting with the volume's name
+  unsigned int   VolIndex;
+  uint64_t       FsByteOffset;
+  uint32_t       FsBlockSize;
+  const SF_NAME* Name;   // NULL if it has none
+  const SF_META* Meta;   // NULL if it has none
+} SF_RECORD;
 
-// void sf_close_img(SF_HIMAGE img);
+// returns nonzero to stop the walk
+typedef int (*SF_RECORD_CB)(const SF_RECORD* rec, void* user);
 
-// size_t sf_img_read(SF_HIMAGE img, void* buf, size_t toRead);
+// Walks every volume and filesystem, allocated and deleted files alike,
+// giving the callback a record for each, in the order of dumpfs. Stopping
+// early isn't a failure. Walks of a handle may run concurrently, each
+// reading the image on its own.
+int sf_walk(SF_HIMAGE img, SF_RECORD_CB callback, void* user);
 
 int sf_run_fsrip(int argc, char* argv[]);
 
@@ -0,0 +1,57 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include "records.h"
+#include "threadpool.h"
+
+#include <string>
+
+struct evp_md_ctx_st; // libcrypto's EVP_MD_CTX
+
+// A running message digest, computed with libcrypto.
+class Digest {
+public:
+  enum ALGORITHM {
+    MD5,
+    SHA1,
+    SHA256
+  };
+
+  Digest(ALGORITHM alg);
+  ~Digest();
+
+  Digest(const Digest&) = delete;
+  Digest& operator=(const Digest&) = delete;
+
+  void update(const char* data, size_t len);
+
+  std::string finish(); // raw bytes; no more updates after this
+
+private:
+  evp_md_ctx_st* Ctx;
+};
+
+// MD5, SHA-1, and SHA-256 of data fed in pieces, as hashfiles reports them.
+class Hasher {
+public:
+  Hasher();
+
+  void update(const char* data, size_t len);
+
+  // updates the three digests in parallel on the pool, returning once all
+  // are done with data; don't call it from one of the pool's threads
+  void update(const char* data, size_t len, ThreadPool& pool);
+
+  HashRecord finish();
+
+private:
+  uint64_t Size;
+  Digest   Md5,
+           Sha1,
+           Sha256;
+};
+
+HashRecord hashData(const char* data, size_t len);
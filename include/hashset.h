@@ -0,0 +1,63 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include "mappedfile.h"
+#include "records.h"
+
+#include <cinttypes>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A set of known digests (e.g., NSRL), all of one length, in a prebuilt file
+// that's mmapped rather than loaded. The file is, all little-endian:
+//
+//   "FSHS", version, digest length, bloom hash count  4 x 4 bytes
+//   number of digests, bloom filter bits              2 x 8 bytes
+//   fanout: index of the first digest with each 2-byte prefix, then the count
+//                                                      65537 x 8 bytes
+//   bloom filter                                       bits / 8 bytes
+//   sorted, unique digests                             count x length bytes
+//
+// Bloom bit i of a digest is (a + i * (b | 1)) mod bits, where a and b are its
+// first and second 8 bytes; bits is a power of two. Most misses are answered
+// by the bloom filter alone, and a hit's search is confined to one fanout
+// bucket. mkhashset.py builds these files.
+class HashSet {
+public:
+  static const uint32_t VERSION = 1;
+
+  HashSet(const std::string& path, const std::string& name); // throws std::runtime_error
+
+  const std::string& name() const { return Name; }
+  uint32_t digestLength() const { return DigestLen; }
+  uint64_t size() const { return Count; }
+
+  bool contains(const std::string& digest) const; // raw bytes; safe to call from any thread
+
+  // writes a set file of digests, which must all have the same length (at
+  // least 16 bytes); any order, duplicates allowed
+  static void write(const std::string& path, std::vector<std::string> digests);
+
+private:
+  bool bloomContains(const unsigned char* digest) const;
+
+  std::string Name;
+  MappedFile  File;
+  uint32_t    DigestLen,
+              NumBloomHashes;
+  uint64_t    Count,
+              BloomBits;
+
+  const unsigned char *Fanout,
+                      *Bloom,
+                      *Digests;
+};
+
+typedef std::vector<std::shared_ptr<HashSet>> HashSets;
+
+// name of the first set holding one of the digests, or empty
+std::string findKnown(const HashSets& sets, const HashRecord& hashes);
@@ -0,0 +1,87 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include <cinttypes>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Just enough HTTP/1.1 for the REST service: persistent connections, each
+// served on its own thread, and bodies either held in memory or written in
+// pieces by a callback, so that file and sector ranges aren't buffered.
+
+struct HttpRequest {
+  std::string Method,
+              Target,  // the path as sent, still encoded, without the query
+              Version,
+              Body;
+  std::map<std::string, std::string> Query,   // decoded
+                                     Headers; // names lower-cased
+
+  std::string header(const std::string& name) const; // "" if it's absent
+
+  bool keepAlive() const;
+};
+
+struct HttpResponse {
+  // writes len bytes of body; false if the connection's gone
+  typedef std::function<bool(const char* data, size_t len)> Sink;
+  // writes ContentLength bytes to the sink; false if it couldn't
+  typedef std::function<bool(const Sink& sink)> BodyWriter;
+
+  HttpResponse(unsigned int status = 200, const std::string& body = "",
+               const std::string& contentType = "application/json");
+
+  unsigned int Status;
+  std::string  ContentType,
+               Body;
+  BodyWriter   Writer;        // if set, writes the body in place of Body
+  uint64_t     ContentLength; // of Writer's body
+  std::vector<std::pair<std::string, std::string>> Headers;
+};
+
+// a response with a {"error":"..."} body, as HttpProtocol.txt gives errors
+HttpResponse errorResponse(unsigned int status, const std::string& msg);
+
+// Decodes %XX escapes, and, in query strings, + as a space. Throws
+// std::invalid_argument on a bad escape.
+std::string urlDecode(const std::string& s, bool plusIsSpace = false);
+
+// Reads the request line and headers, up to and including the blank line,
+// leaving the body in the stream. Returns false if the stream ends first.
+// Throws std::invalid_argument if the request is malformed.
+bool readRequestHead(std::istream& in, HttpRequest& req);
+
+// the status line and headers, with Content-Length, through the blank line
+std::string responseHead(const HttpResponse& resp, bool keepAlive);
+
+enum RangeResult {
+  NO_RANGE,            // absent, or not one we handle; send everything
+  SATISFIABLE_RANGE,
+  UNSATISFIABLE_RANGE
+};
+
+// Parses a Range header of a single byte range ("bytes=0-499", "bytes=500-",
+// "bytes=-500") against a body of size bytes, giving [beg, end).
+RangeResult parseRange(const std::string& header, uint64_t size, uint64_t& beg, uint64_t& end);
+
+// writes len bytes of a body, starting at offset, to the sink
+typedef std::function<bool(uint64_t offset, uint64_t len, const HttpResponse::Sink& sink)> RangeReader;
+
+// A response of size bytes from read, or of the range the request's Range
+// header asks for, with a 206 or 416 status.
+HttpResponse rangeResponse(const HttpRequest& req, uint64_t size, const std::string& contentType,
+                           const RangeReader& read);
+
+typedef std::function<HttpResponse(const HttpRequest& req)> HttpHandler;
+
+// Listens on address:port, serving requests with handler, and never returns.
+// Exceptions from the handler become 500 responses. Throws if it can't
+// listen.
+void runHttpServer(const std::string& address, unsigned short port, const HttpHandler& handler);
@@ -0,0 +1,55 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include "httpserver.h"
+#include "tsk.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// The REST service of HttpProtocol.txt. An image is opened once, by PUT, and
+// kept open with its volume system and filesystems until DELETE, so later
+// requests cost only the TSK calls they make: directories are read as
+// they're listed, and file, sector, and block ranges are read as they're
+// sent.
+class ImageService {
+public:
+  HttpResponse handle(const HttpRequest& req);
+
+  // the "segments" array of a PUT body; throws std::invalid_argument if it
+  // has none
+  static std::vector<std::string> parseSegments(const std::string& body);
+
+private:
+  struct OpenImage {
+    std::shared_ptr<Image> Img;
+    std::mutex             Lock; // TSK's filesystem code isn't thread-safe
+  };
+  typedef std::shared_ptr<OpenImage> ImagePtr;
+
+  ImagePtr find(const std::string& id) const;
+
+  // the filesystem of a volume, by its index in the volume system, or "0"
+  // for an image that's just a filesystem
+  static TSK_FS_INFO* filesystem(const OpenImage& img, const std::string& volID);
+
+  HttpResponse putImage(const std::string& id, const std::string& body);
+  HttpResponse getImage(const std::string& id) const;
+  HttpResponse deleteImage(const std::string& id);
+
+  HttpResponse volumes(const ImagePtr& img) const;
+  HttpResponse sectors(const HttpRequest& req, const ImagePtr& img) const;
+  HttpResponse blocks(const HttpRequest& req, const ImagePtr& img, TSK_FS_INFO* fs) const;
+  HttpResponse dir(const ImagePtr& img, TSK_FS_INFO* fs, const std::string& path) const;
+  HttpResponse entry(const ImagePtr& img, TSK_FS_INFO* fs, const std::string& path, uint64_t inum) const;
+  HttpResponse file(const HttpRequest& req, const ImagePtr& img, TSK_FS_INFO* fs, const std::string& path) const;
+
+  mutable std::mutex              Lock; // of Images
+  std::map<std::string, ImagePtr> Images;
+};
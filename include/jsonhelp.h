@@ -19,6 +19,10 @@ const T* j(const T* x) {
 
 std::string j(const std::string& x);
 
+// quoted, like j(), but with quotes, backslashes, and control characters
+// escaped, for arbitrary text such as error messages
+std::string jEscaped(const std::string& x);
+
 // template<>
 // std::string j<char>(const char* x);
 
@@ -0,0 +1,46 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include "records.h"
+
+#include <iostream>
+#include <string>
+
+// JSON dumpfs records, written from captured records rather than TSK's
+// structures so that formatting can happen off the walk thread.
+
+// Field groups of a record, for dumpfs --fields. id, parent, children, and
+// __link are always written. ATTRS_FIELD writes the attributes without their
+// resident data and data runs, which RD_BUF_FIELD and RUNS_FIELD add.
+enum RecordFields {
+  FS_FIELD     = 1,
+  PATH_FIELD   = 1 << 1,
+  NAME_FIELD   = 1 << 2,
+  META_FIELD   = 1 << 3,
+  ATTRS_FIELD  = 1 << 4,
+  RUNS_FIELD   = 1 << 5,
+  RD_BUF_FIELD = 1 << 6,
+  ALL_FIELDS   = (1 << 7) - 1
+};
+
+// Parses a comma-separated list of fs, path, name, meta, attrs, runs, and
+// rd_buf. runs and rd_buf imply attrs. Throws std::invalid_argument on an
+// unknown name.
+unsigned int parseFields(const std::string& list);
+
+void writeFsInfo(std::ostream& out, const FsRecord& fs); // "fs":{...}
+
+// inodeVol is the volume index used for the record's __link inode ID. With
+// dirTable, the fs and path fields are replaced by volIndex. fields is a
+// mask of RecordFields.
+void writeFile(std::ostream& out, const FileRecord& rec, uint32_t inodeVol, bool dirTable, unsigned int fields = ALL_FIELDS);
+
+void writeNameRecord(std::ostream& out, const NameRecord& n);
+void writeMetaRecord(std::ostream& out, const MetaRecord& m, unsigned int fields = ALL_FIELDS);
+void writeAttr(std::ostream& out, const AttrRecord& a, unsigned int fields = ALL_FIELDS);
+void writeHashRecord(std::ostream& out, const HashRecord& h);
+void writeSniffRecord(std::ostream& out, const SniffRecord& s);
+void writeStatsRecord(std::ostream& out, const StatsRecord& s);
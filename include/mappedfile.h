@@ -0,0 +1,31 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include <cinttypes>
+#include <string>
+
+// A whole file, mapped read-only, for the prebuilt files that are searched
+// in place rather than loaded (hash sets, catalogs).
+class MappedFile {
+public:
+  // what names the kind of file in errors; throws std::runtime_error if the
+  // file can't be opened, or is empty
+  MappedFile(const std::string& path, const std::string& what);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const unsigned char* data() const { return static_cast<const unsigned char*>(Map); }
+  uint64_t size() const { return MapLen; }
+
+private:
+  void*    Map;
+  uint64_t MapLen;
+#if defined(_WIN32)
+  void*    MapHandle;
+#endif
+};
@@ -0,0 +1,144 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include <cinttypes>
+#include <string>
+#include <vector>
+
+// Plain copies of the TSK structures that a dumpfs record describes.
+// Flags and types are kept as their raw TSK values; IDs are raw bytes,
+// not the hex strings used in JSON output.
+
+struct Timestamp {
+  int64_t  Secs;
+  uint32_t Nanos;
+};
+
+struct RunRecord {
+  uint64_t Addr,
+           Len,
+           Offset;
+  uint32_t Flags;
+};
+
+struct AttrRecord {
+  uint32_t    Flags,
+              ID,
+              Type;
+  std::string Name;
+  uint64_t    Size,
+              RdBufSize,
+              AllocSize,
+              CompSize,
+              InitSize,
+              SkipLen,
+              PhysicalSize, // allocated bytes, data and slack, from the runs
+              SlackSize;
+  std::string ResidentData; // raw bytes
+
+  std::vector<RunRecord> Runs;
+};
+
+struct NameRecord {
+  uint32_t    Flags;
+  uint64_t    MetaAddr;
+  uint32_t    MetaSeq;
+  std::string Name;
+  uint64_t    ParAddr;
+  uint32_t    ParSeq;
+  std::string ShortName;
+  uint32_t    Type;
+};
+
+struct MetaRecord {
+  enum FsTimeKinds {
+    NO_FS_TIME   = 0,
+    EXT_DTIME    = 1,
+    HFS_BKUPTIME = 2
+  };
+
+  uint64_t    Addr;
+  Timestamp   Accessed;
+  uint64_t    ContentLen;
+  Timestamp   Created,
+              Metadata;
+  uint32_t    Flags,
+              Gid;
+  std::string Link;
+  uint32_t    FsTimeKind;
+  Timestamp   FsTime; // dtime or bkup_time, per FsTimeKind
+  uint32_t    Mode;
+  Timestamp   Modified;
+  uint32_t    NLink,
+              Seq;
+  uint64_t    Size;
+  uint32_t    Type,
+              Uid;
+
+  std::vector<AttrRecord> Attrs;
+};
+
+struct FsRecord {
+  uint64_t    ByteOffset;
+  uint32_t    BlockSize;
+  std::string FsID; // raw bytes
+  std::string VolName;
+  uint32_t    VolIndex;
+};
+
+struct HashRecord {
+  uint64_t    Size;   // bytes hashed
+  std::string MD5,    // raw bytes
+              SHA1,
+              SHA256,
+              Known;  // name of a known-file hash set holding it, if any
+};
+
+// byte statistics of the contents hashed, for finding encrypted or
+// compressed data
+struct StatsRecord {
+  uint64_t    Size;      // bytes counted
+  double      Entropy,   // bits per byte, 0 to 8
+              ZeroRatio, // fraction of bytes that are 0
+              TextRatio; // fraction that are printable ASCII, tab, CR, or LF
+  std::string Histogram; // 16 bytes: the share of bytes in each 16-value bin, scaled to 255
+};
+
+// dumpfiles --dedup: the contents are those written after another record
+struct ContentRefRecord {
+  std::string ID, // raw bytes
+              By; // "inode" or "sha256", whichever matched
+};
+
+// dumpfs --sniff: the type found from the first bytes of the contents
+struct SniffRecord {
+  std::string Type;
+  bool        Mismatch; // whether the name's extension isn't one of the type's
+};
+
+struct FileRecord {
+  FileRecord(): HasName(false), HasMeta(false), HasHashes(false), HasContentRef(false), HasSniff(false), HasStats(false) {}
+
+  std::string ID,       // raw bytes
+              Parent,   // raw bytes
+              Children; // raw bytes
+  FsRecord    Fs;
+  std::string Path;
+
+  bool        HasName,
+              HasMeta,
+              HasHashes,     // set by hashfiles; JSON output only
+              HasContentRef, // set by dumpfiles --dedup; JSON output only
+              HasSniff,      // set by dumpfs --sniff; JSON output only
+              HasStats;      // set by --stats; JSON output only
+  NameRecord  Name;
+  MetaRecord  Meta;
+  HashRecord  Hashes;
+  StatsRecord Stats;
+
+  ContentRefRecord ContentRef;
+  SniffRecord      Sniff;
+};
@@ -0,0 +1,48 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include <cinttypes>
+#include <string>
+#include <vector>
+
+// Finds every occurrence of a set of byte patterns in one pass over the data
+// (Aho-Corasick). The automaton is a dense table of 256 transitions per
+// state, so the scan is a single table lookup per byte, with no failure links
+// to chase. It isn't changed by searching, so any number of threads can
+// search with one matcher at once.
+class PatternMatcher {
+public:
+  struct Hit {
+    uint64_t Offset;  // of the first byte
+    uint32_t Pattern; // index into patterns()
+
+    bool operator<(const Hit& o) const {
+      return Offset < o.Offset || (Offset == o.Offset && Pattern < o.Pattern);
+    }
+  };
+
+  // with ignoreCase, ASCII letters match either case; throws
+  // std::invalid_argument if there are no patterns or one is empty
+  PatternMatcher(const std::vector<std::string>& patterns, bool ignoreCase = false);
+
+  const std::vector<std::string>& patterns() const { return Patterns; }
+
+  size_t maxLength() const { return MaxLen; }
+
+  // Appends the hits in data, with offsets counted from base, in the order
+  // their last bytes occur. Only hits whose last byte is at or after
+  // data + reportFrom are reported, so that data can begin with the end of
+  // the previous piece without reporting its hits twice.
+  void search(const char* data, size_t len, uint64_t base, std::vector<Hit>& hits, size_t reportFrom = 0) const;
+
+private:
+  std::vector<std::string> Patterns;
+  size_t                   MaxLen;
+
+  std::vector<uint32_t>              Next;    // state * 256 + byte -> state
+  std::vector<char>                  HasOut;  // by state
+  std::vector<std::vector<uint32_t>> Outputs; // by state, patterns ending there
+};
@@ -0,0 +1,28 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include <cinttypes>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A file type, identified by magic numbers at fixed offsets in its first
+// sector, and the extensions its files have. No extensions means any will
+// do; an empty extension is a name without one.
+struct FileSignature {
+  std::string                                  Type;
+  std::vector<std::pair<uint32_t, std::string>> Magic; // offset, bytes; all must match
+  std::vector<std::string>                     Extensions;
+};
+
+// the first matching signature wins, so more specific ones come first
+const std::vector<FileSignature>& fileSignatures();
+
+// the type of a file starting with data, or "" if it's not in the table
+std::string sniffType(const char* data, size_t len);
+
+// whether name's extension, ignoring case, isn't one that type has
+bool extensionMismatch(const std::string& type, const std::string& name);
@@ -0,0 +1,99 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include "records.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+// SQLite export of dumpfs records and the disk and inode maps. The tables
+// are:
+//
+//   files     id, vol, inode_vol, path, name, short_name, name_flags,
+//             name_type, par_addr, meta_addr, size, meta_flags, meta_type,
+//             mode, uid, gid, nlink, seq, accessed, created, metadata,
+//             modified, record
+//   inodes    id, vol, inum, record
+//   disk_map  id, offset, record
+//
+// IDs are hex, as in JSON output; flags and types are named as in JSON
+// output; times are seconds since the epoch, UTC; and record is the whole
+// dumpfs record or map line, as JSON. Name and meta columns are NULL for
+// records without them. inode_vol and meta_addr join files to inodes' vol
+// and inum.
+//
+// Rows are inserted in large transactions, with syncing off and a WAL
+// journal, and the indexes (IDs, path, inode, times, disk offset) are only
+// made once every row is in. The file is only consistent once close()
+// returns.
+class SqliteWriter {
+public:
+  // replaces any database at path; throws std::runtime_error if it can't
+  SqliteWriter(const std::string& path, unsigned int batchSize = 65536, unsigned int maxQueuedBatches = 4);
+  ~SqliteWriter();
+
+  SqliteWriter(const SqliteWriter&) = delete;
+  SqliteWriter& operator=(const SqliteWriter&) = delete;
+
+  // called from the walk; hands off full batches to the writer thread
+  void push(const FileRecord& rec, uint32_t inodeVol);
+
+  // lines as writeDiskMap() and writeInodeMap() give them
+  void pushDiskMap(const std::string& id, const std::string& line);
+  void pushInode(const std::string& id, const std::string& line);
+
+  // inserts the last batch, joins the writer thread, and makes the indexes
+  void close();
+
+private:
+  struct MapRow {
+    bool        DiskMap; // or inode
+    std::string ID,
+                Line;
+  };
+
+  struct Batch {
+    std::vector<std::pair<FileRecord, uint32_t>> Files; // with inode vols
+    std::vector<MapRow>                          Maps;
+
+    size_t size() const { return Files.size() + Maps.size(); }
+  };
+
+  void run();
+  void enqueue();
+  bool queueCur(std::unique_lock<std::mutex>& lock); // false if the writer thread has failed
+  void insert(const Batch& batch);
+  void insertRows(const Batch& batch);
+  void exec(const char* sql);
+
+  sqlite3*      Db;
+  sqlite3_stmt* InsertFile;
+  sqlite3_stmt* InsertInode;
+  sqlite3_stmt* InsertDiskMap;
+
+  unsigned int BatchSize,
+               MaxQueuedBatches;
+
+  Batch Cur;
+
+  std::mutex              Mutex;
+  std::condition_variable NotEmpty,
+                          NotFull;
+  std::deque<Batch>       Queue;
+  bool                    Done;
+  std::exception_ptr      Error;
+
+  std::thread Writer;
+};
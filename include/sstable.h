@@ -0,0 +1,157 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include "mappedfile.h"
+#include "threadpool.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A sorted string table: key-value entries in ascending key order, so that
+// a key-value store can bulk load it as is, without sorting. The file is,
+// with all integers little-endian:
+//
+//   data blocks  each a zlib stream of entries, cut after the entry that
+//                takes it to SSTABLE_BLOCK_SIZE
+//   index        for each block: its offset, compressed length, and
+//                uncompressed length (8 + 4 + 4 bytes), its first key's
+//                length (4 bytes), and its first key
+//   bloom filter number of hashes (4 bytes), number of bits (8 bytes), and
+//                the bits, least significant first in each byte
+//   footer       offsets of the index and bloom filter, number of blocks,
+//                and number of entries (4 x 8 bytes), version (4 bytes),
+//                and "FSST"
+//
+// An entry is its key length and value length (4 bytes each), its key, and
+// its value. A key's bits in the bloom filter are (h1 + i * h2) mod the
+// number of bits, for i below the number of hashes, where h1 is the key's
+// 64-bit FNV-1a hash and h2 is h1 with its halves swapped, times
+// 0x9E3779B97F4A7C15, with the low bit set.
+
+static const uint32_t SSTABLE_VERSION    = 1;
+static const size_t   SSTABLE_BLOCK_SIZE = 64 * 1024;
+
+typedef std::function<void(const std::string& key, const std::string& value)> EntrySink;
+
+// Writes the entries given to it, which must come in key order, compressing
+// blocks with a thread pool while the next are filled, and writing them to
+// the stream in order.
+class SSTableBuilder {
+public:
+  // numEntries sizes the bloom filter
+  SSTableBuilder(std::ostream& out, ThreadPool& pool, uint64_t numEntries);
+
+  // throws std::invalid_argument if key sorts before the last key
+  void add(const std::string& key, const std::string& value);
+
+  // writes the last block, the index, the bloom filter, and the footer;
+  // throws std::runtime_error if the output can't be written
+  void finish();
+
+private:
+  struct Block {
+    std::string              FirstKey;
+    uint32_t                 Len;
+    std::future<std::string> Compressed;
+  };
+
+  void submitBlock();
+  void drain(size_t maxPending);
+
+  std::ostream& Out;
+  ThreadPool&   Pool;
+
+  std::string       Buf,
+                    FirstKey, // of the block in Buf
+                    LastKey,
+                    Index;
+  std::deque<Block> Pending;
+  uint64_t          Offset,
+                    NumBlocks,
+                    NumEntries;
+
+  std::vector<uint8_t> Bloom;
+};
+
+// Sorts entries of any number, holding runs of about runBytes in memory.
+// Each full run is sorted on the pool and spilled to a temporary file while
+// the next is collected; the runs are merged at the end. Entries with the
+// same key stay in the order they were added.
+class ExternalSorter {
+public:
+  ExternalSorter(std::shared_ptr<ThreadPool> pool, size_t runBytes = 32 * 1024 * 1024);
+  ~ExternalSorter();
+
+  ExternalSorter(const ExternalSorter&) = delete;
+  ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+  void add(const std::string& key, const std::string& value);
+
+  uint64_t size() const { return NumEntries; }
+
+  // hands every entry to sink, in key order, and empties the sorter; throws
+  // std::runtime_error if a run can't be written or read back
+  void merge(const EntrySink& sink);
+
+private:
+  typedef std::vector<std::pair<std::string, std::string>> Run;
+
+  void spill();
+  void collectSpilled(size_t maxPending);
+
+  std::shared_ptr<ThreadPool> Pool;
+  size_t                      RunBytes,
+                              CurBytes;
+  uint64_t                    NumEntries;
+
+  std::shared_ptr<Run>           Cur;
+  std::deque<std::future<FILE*>> Spilling;
+  std::vector<FILE*>             Spilled; // in order of the runs
+};
+
+// Reads an SSTable, mmapped.
+class SSTable {
+public:
+  SSTable(const std::string& path); // throws std::runtime_error
+
+  uint64_t size() const { return NumEntries; }
+
+  // finds the first entry with the key, throwing std::runtime_error if its
+  // block is corrupt
+  bool get(const std::string& key, std::string& value) const;
+
+  // every entry, in key order
+  void scan(const EntrySink& visit) const;
+
+private:
+  struct BlockInfo {
+    uint64_t    Offset;
+    uint32_t    CompressedLen,
+                Len;
+    std::string FirstKey;
+  };
+
+  std::string readBlock(const BlockInfo& block) const;
+  // stops once visit returns false
+  void scanBlock(const BlockInfo& block, const std::function<bool(const std::string&, const std::string&)>& visit) const;
+  bool mayContain(const std::string& key) const;
+
+  std::string            Path;
+  MappedFile             File;
+  std::vector<BlockInfo> Blocks;
+  uint64_t               NumEntries,
+                         NumBits;
+  uint32_t               NumHashes;
+  const unsigned char*   Bits;
+};
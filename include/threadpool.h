@@ -0,0 +1,53 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads pulling tasks off a shared queue. Tasks still
+// queued when the pool is destroyed are run before the workers exit.
+class ThreadPool {
+public:
+  ThreadPool(unsigned int numThreads = defaultThreads());
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  unsigned int size() const { return Threads.size(); }
+
+  template<class F>
+  std::future<typename std::result_of<F()>::type> submit(F f) {
+    typedef typename std::result_of<F()>::type ResultType;
+    // std::function must be copyable, so hold the packaged_task by pointer
+    auto task = std::make_shared<std::packaged_task<ResultType()>>(std::move(f));
+    std::future<ResultType> ret(task->get_future());
+    {
+      std::lock_guard<std::mutex> lock(Mutex);
+      Tasks.emplace_back([task]{ (*task)(); });
+    }
+    NotEmpty.notify_one();
+    return ret;
+  }
+
+  static unsigned int defaultThreads();
+
+private:
+  void run();
+
+  std::vector<std::thread>          Threads;
+  std::deque<std::function<void()>> Tasks;
+  std::mutex                        Mutex;
+  std::condition_variable           NotEmpty;
+  bool                              Stop;
+};
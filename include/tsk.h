@@ -42,6 +42,8 @@ public:
   uint64 byteOffset() const;
   uint64 rootInum() const;
 
+  TSK_FS_INFO* tskInfo() const { return Fs; }
+
 private:
   Filesystem(TSK_FS_INFO* fs);
 
@@ -108,6 +110,8 @@ public:
 
   const std::vector< std::string >& files() const { return Files; }
 
+  TSK_IMG_INFO* tskInfo() const { return Img; }
+
   std::weak_ptr< VolumeSystem > volumeSystem() const;
   std::weak_ptr< Filesystem > filesystem() const;
 
@@ -11,6 +11,7 @@ static const unsigned int MAX_VINT_SIZE = 9;
 
 unsigned int vintEncode(unsigned char* buf, uint64_t val);
 unsigned int vintDecode(uint64_t& val, const unsigned char* buf);
+unsigned int vintSize(unsigned char firstByte); // total encoded length, from the first byte
 
 std::string appendVarint(const std::string& base, const unsigned int val);
 
@@ -18,6 +19,7 @@ std::string formatTimestamp(uint32_t unix, uint32_t ns);
 
 
 std::string bytesAsString(const unsigned char* idBeg, const unsigned char* idEnd);
+std::string bytesFromString(const std::string& hex); // inverse of bytesAsString
 
 std::string makeInodeID(uint32_t volIndex, uint64_t inum);
 std::string makeDiskMapID(uint64_t offset);
@@ -5,12 +5,29 @@ Copyright (c) 2010-2015, Stroz Friedberg, LLC
 #pragma once
 
 #include "tsk.h"
+#include "records.h"
+#include "carve.h"
+#include "catalog.h"
+#include "columnar.h"
+#include "filter.h"
+#include "hashset.h"
+#include "search.h"
+#include "sqlitewriter.h"
+#include "sstable.h"
+#include "threadpool.h"
 
 #include <boost/icl/interval_map.hpp>
 
+#include <deque>
+#include <functional>
+#include <future>
 #include <map>
+#include <set>
+#include <unordered_map>
 
 std::ostream& operator<<(std::ostream& out, const Image& img);
+std::string j(const std::weak_ptr< Volume >& vol); // as in info's volumeSystem
+void outputFS(std::ostream& buf, std::shared_ptr<Filesystem> fs); // ,"filesystem":{...}
 
 class DirInfo {
 public:
@@ -23,7 +40,7 @@ public:
   uint32_t           count() const { return Count; }
 
 
-  DirInfo     newChild(const std::string& path); // increments Count and returns a DirInfo
+  DirInfo     newChild(const std::string& path) const; // returns a DirInfo for the latest counted child
   std::string lastChild() const;
   uint32_t    childLevel() const;
   void        incCount();
@@ -44,9 +61,15 @@ public:
     SINGLE
   };
 
+  enum OUTPUT_FORMAT {
+    JSON,
+    BINARY
+  };
+
   virtual ~LbtTskAuto() {}
 
   virtual void setUnallocatedMode(const UNALLOCATED_HANDLING) {}
+  virtual void setOutputFormat(const OUTPUT_FORMAT) {}
   virtual void setMaxUnallocatedBlockSize(const uint64_t) {}
 
   virtual uint8_t start();
@@ -157,6 +180,31 @@ struct Run {
            End;
 };
 
+// A piece of an attribute's data runs, in absolute byte offsets. Slack
+// extents lie past the end of the attribute's data; their FileOffset counts
+// from the start of the slack.
+struct AttrExtent {
+  uint64_t Beg,
+           End,
+           FileOffset;
+  bool     Slack,
+           Sparse;
+};
+
+std::vector<AttrExtent> attrExtents(const AttrRecord& attr, uint64_t blockSize, uint64_t fsOffset);
+
+// sets PhysicalSize and SlackSize from the runs, without reading anything
+void setAttrSizes(AttrRecord& attr, uint64_t blockSize, uint64_t fsOffset);
+
+// Copies of TSK's structures, as dumpfs records have them, for use outside
+// a walk. Resident data is copied only withResident.
+void captureNameRecord(NameRecord& rec, const TSK_FS_NAME* name);
+void captureMetaRecord(MetaRecord& rec, const TSK_FS_FILE* file, const TSK_FS_INFO* fs, bool withAttrs, bool withResident);
+void captureAttrRecord(AttrRecord& rec, const TSK_FS_ATTR* attr, const TSK_FS_INFO* fs, bool withResident);
+
+std::vector<const TSK_FS_ATTR*> inUseAttrs(const TSK_FS_FILE* file); // loads them if need be
+bool hasUsableMeta(const TSK_FS_FILE* file);
+
 struct AttrInfo {
 
   AttrInfo(uint32_t id): ID(id), Type(0), Resident(false), Size(0), SlackSize(0) {}
@@ -202,6 +250,16 @@ struct InodeInfo {
   }
 };
 
+// A file record captured on the walk thread, awaiting formatting, or a
+// literal piece of output (fs and dir records, headers) to keep in sequence.
+static const size_t FORMAT_BATCH_SIZE = 256; // records per formatting task
+
+struct PendingRecord {
+  FileRecord  Rec;
+  uint32_t    InodeVol; // volume index for the record's inode ID
+  std::string Literal;  // written as-is in place of Rec, if not empty
+};
+
 class MetadataWriter: public FileCounter {
 public:
   typedef std::pair<TSK_DADDR_T, TSK_DADDR_T> Extent;
@@ -212,10 +270,39 @@ public:
 
   MetadataWriter(std::ostream& out);
 
-  virtual ~MetadataWriter() {}
+  virtual ~MetadataWriter();
 
   virtual void setUnallocatedMode(const UNALLOCATED_HANDLING mode) { UCMode = mode; }
   virtual void setMaxUnallocatedBlockSize(const uint64_t maxBlocks) { MaxUnallocatedBlockSize = maxBlocks; }
+  virtual void setOutputFormat(const OUTPUT_FORMAT fmt) { Format = fmt; }
+
+  void setColumnarOutput(std::shared_ptr<ColumnarWriter> columns) { Columns = columns; }
+
+  // also insert every record into the database; the maps and close() are
+  // left to the caller, after the walk
+  void setSqliteOutput(std::shared_ptr<SqliteWriter> db) { Sqlite = db; }
+
+  // emit fs and directory records once, and have file records refer to them
+  void setDirTable(bool dirTable) { DirTable = dirTable; }
+
+  // format records on the pool, rather than on the walk thread
+  void setFormatterPool(std::shared_ptr<ThreadPool> pool) { Formatters = pool; }
+
+  // only files matching the filter get records, attribute work, and
+  // contents; filesystems and directories it rules out are skipped
+  void setFilter(std::shared_ptr<FileFilter> filter) { Filter = filter; }
+
+  // add the type of each regular file, from the first sector of its
+  // contents; the sectors are read in batches, in disk order
+  void setSniff(bool sniff) { Sniff = sniff; }
+
+  // JSON records get only these RecordFields (see jsonrec.h)
+  void setFields(unsigned int fields) { Fields = fields; }
+
+  // whether the disk and inode maps will be output, which needs every file's
+  // attributes and resident data; otherwise attributes are loaded only for
+  // the fields or for unallocated handling
+  void setMapsNeeded(bool needed) { MapsNeeded = needed; }
 
   virtual uint8_t start();
 
@@ -229,8 +316,16 @@ public:
   virtual void finishWalk();
 
   DiskMap& diskMap() { return AllocatedRuns; }
+  const std::map<uint32_t, Extent>& fsExtents() const { return FsExtents; }
   ReverseInodeMapType& reverseMap() { return ReverseMap; }
 
+  // The disk and inode maps, as JSON lines, each given to the sink with its
+  // ID. The disk map adds each attribute's runs to the inode map, so it must
+  // be written first if the inode map's runs are wanted.
+  typedef std::function<void(const std::string& id, const std::string& line)> LineSink;
+  void writeDiskMap(const LineSink& sink);
+  void writeInodeMap(const LineSink& sink) const;
+
   uint64_t diskSize() const { return DiskSize; }
   uint32_t sectorSize() const { return SectorSize; }
 
@@ -253,25 +348,65 @@ protected:
   uint32_t    SectorSize,
               NumVols;
 
-  bool        InUnallocated;
+  bool        InUnallocated,
+              DirTable,
+              MapsNeeded,
+              Sniff;
+  unsigned int Fields;
 
   UNALLOCATED_HANDLING UCMode;
+  OUTPUT_FORMAT        Format;
 
   DiskMap AllocatedRuns; // FS index->interval->inodes
+  std::map<uint32_t, Extent> FsExtents; // FS index->byte range, for filesystems only
   std::map<uint32_t, unsigned int> NumRootEntries; // FS index->count
   decltype(AllocatedRuns.begin()) CurAllocatedItr;
 
   ReverseInodeMapType ReverseMap;
 
+  std::shared_ptr<ColumnarWriter> Columns;
+  std::shared_ptr<SqliteWriter>   Sqlite;
+  std::shared_ptr<FileFilter>     Filter;
+  FileRecord                      FilterScratch; // name and meta, to test against Filter
+
   void setCurDir(const char* path);
+  void pushDir(const std::string& path, bool emit);
+  void writeDirRecord(const DirInfo& dir);
   void setFsInfo(TSK_FS_INFO* fs, uint64_t startSector, uint64_t endSector);
   void resetPartitionRange();
   void setPartitionRange(uint64_t begin, uint64_t end);
 
-  void writeFile(std::ostream& out, const TSK_FS_FILE* file);
-  void writeNameRecord(std::ostream& out, const TSK_FS_NAME* n);
-  void writeMetaRecord(std::ostream& out, const TSK_FS_FILE* file, const TSK_FS_INFO* fs, InodeInfo& inode);
-  void writeAttr(std::ostream& out, InodeInfo& inode, TSK_INUM_T addr, const TSK_FS_ATTR* attr);
+  // output goes through these, so that it stays in order with records
+  // being formatted on the pool
+  virtual void emit(const std::string& output);
+  virtual void emitRecord(PendingRecord& pending);
+  void writeUInt64(uint64_t val); // 8 bytes, little-endian, for framing contents
+
+  // writes size bytes of the image from offset, reading into buf
+  void writeImage(uint64_t offset, uint64_t size, std::vector<char>& buf);
+
+  // Searches the extents of the image, in order, in large pieces that are
+  // searched on the pool while the next are read. Each piece's hits go to
+  // sink in order, with absolute offsets, along with the end of the piece.
+  typedef std::function<void(const std::vector<PatternMatcher::Hit>&, uint64_t)> HitSink;
+  void searchImage(const std::vector<Extent>& extents, std::shared_ptr<PatternMatcher> matcher,
+                   ThreadPool& pool, const HitSink& sink);
+  void formatPending(std::ostream& out, const PendingRecord& pending) const;
+  PendingRecord& nextPending();
+  void submitBatch();
+  void drainFormatted(size_t maxPending);
+  void flushFormatted();
+
+  // capture copies TSK's structures without touching the inode and disk maps;
+  // recordMeta does that bookkeeping
+  void captureFile(FileRecord& rec, const TSK_FS_FILE* file, bool withAttrs) const;
+  void captureMeta(MetaRecord& rec, const TSK_FS_FILE* file, const TSK_FS_INFO* fs, bool withAttrs) const;
+  void captureAttr(AttrRecord& rec, const TSK_FS_ATTR* attr, const TSK_FS_INFO* fs) const;
+
+  void       recordMeta(const FileRecord& rec, const std::string& id);
+  InodeInfo& recordInode(const FileRecord& rec, const std::string& id);
+  AttrInfo&  recordAttr(InodeInfo& inode, const AttrRecord& attr);
+  void markAttrRuns(TSK_INUM_T addr, const AttrRecord& attr, const FsRecord& fs);
 
   void markDataRun(uint64_t beg, uint64_t end, uint64_t offset, TSK_INUM_T addr, uint32_t attrID, bool slack);
 
@@ -281,6 +416,16 @@ protected:
   void flushUnallocated();
 
   bool atFSRootLevel(const std::string& path) const;
+  bool needAttrs() const;
+
+  struct SniffJob {
+    PendingRecord Pending;
+    uint64_t      Offset; // of the first sector
+    uint32_t      Len;    // 0 if there's nothing to read
+  };
+  void holdForSniff(PendingRecord& pending, const TSK_FS_FILE* file);
+  void flushSniffed();
+  bool passesFilter(const TSK_FS_FILE* file);
 
   TSK_FS_FILE       DummyFile;
   TSK_FS_NAME       DummyName;
@@ -292,22 +437,318 @@ protected:
   std::vector<DirInfo> Dirs;
 
 private:
-  std::string  FsInfo,
-               FsID;
+  typedef std::vector<PendingRecord> Batch;
+
+  FsRecord CurFs;
+
+  std::shared_ptr<ThreadPool> Formatters;
+  std::shared_ptr<Batch>      CurBatch;
+  size_t                      CurBatchLen;
+  PendingRecord               Scratch; // when formatting inline
+  std::vector<SniffJob>       Sniffing; // held in walk order until their sectors are read
+
+  std::deque<std::pair<std::shared_ptr<Batch>, std::future<std::string>>> Formatting;
+  std::vector<std::shared_ptr<Batch>> FreeBatches; // recycled, with their strings' storage
+
+  std::set<uint32_t> EmittedFs; // volume indices with fs records, for DirTable
 };
 
 class FileWriter: public MetadataWriter {
 public:
+  typedef std::function<void(const char*, size_t)> ContentSink;
+
   FileWriter(std::ostream& out);
 
-  virtual ~FileWriter() {}
+  virtual ~FileWriter();
+
+  // write records and contents in order of the contents' disk position,
+  // followed by an index of record positions
+  void setPhysicalOrder(bool physical) { PhysicalOrder = physical; }
+
+  // with false, only records are written: no sizes, contents, or index
+  void setContentOutput(bool contents) { ContentOutput = contents; }
+
+  // hash each file's contents, up to its meta size, adding the hashes to its
+  // record; files are read in disk order and hashed on the pool, so this
+  // needs physical order
+  void setHashPool(std::shared_ptr<ThreadPool> pool) { HashPool = pool; }
+
+  // files whose hashes are in one of these sets get a "known" tag on their
+  // hashes, and no contents; needs a hash pool
+  void setKnownHashes(const HashSets& sets) { KnownSets = sets; }
+
+  // compute the byte statistics of each file's contents along with its
+  // hashes, adding them to its record; needs a hash pool
+  void setStats(bool stats) { Stats = stats; }
+
+  // write each inode's contents once, and with hashing, each distinct
+  // content once; later records get a content_ref and a zero size
+  void setDedup(bool dedup) { Dedup = dedup; }
 
   virtual TSK_RETVAL_ENUM processFile(TSK_FS_FILE *fs_file, const char *path);
 
+  virtual void finishWalk();
+
+protected:
+  virtual void emitRecord(PendingRecord& pending);
+
 private:
-  virtual void processUnallocatedFile(TSK_FS_FILE* file);
+  struct DeferredFile {
+    enum CONTENTS {
+      NONE,
+      FILE,       // Addr is the inode
+      UNALLOCATED // Addr and Len are the run
+    };
+
+    uint64_t         DiskOffset; // sort key
+    PendingRecord    Pending;
+    CONTENTS         Contents;
+    uint64_t         FsOffset;
+    TSK_FS_TYPE_ENUM FsType;
+    uint64_t         Addr,
+                     Len;
+  };
+
+  struct HashJob {
+    DeferredFile*           File;
+    uint64_t                Len; // bytes held for hashing
+    std::future<HashRecord> Hashes; // not valid if the contents couldn't be read
+    std::future<StatsRecord> Stats; // valid only with Stats
+
+    std::shared_ptr<std::vector<char>> Contents; // as read for hashing, to write out without rereading
+  };
 
-  void writeMetadata(const TSK_FS_FILE* file);
+  typedef std::vector<std::pair<std::string, uint64_t>> RecordIndex; // record ID, position
+
+  void writeFileContents(TSK_FS_FILE* file);
+  void writeContents(TSK_FS_FILE* file);
+  void writeRun(TSK_FS_INFO* fs, TSK_DADDR_T addr, TSK_DADDR_T len, const char* name);
+  void padContents(uint64_t len); // zeros in place of data that couldn't be read
+
+  // these pass the data to sink in pieces, ending each read at a run
+  // boundary, and return how much was read before any error
+  uint64_t readContents(TSK_FS_FILE* file, const AttrRecord& attr, uint64_t size, const ContentSink& sink);
+  uint64_t readRun(TSK_FS_INFO* fs, TSK_DADDR_T addr, uint64_t size, const ContentSink& sink);
+
+  void deferFile(TSK_FS_FILE* file);
+  void writeDeferred();
+  void writeDeferredFile(DeferredFile& d, RecordIndex& index, const std::vector<char>* contents = nullptr);
+  bool dedupContents(PendingRecord& pending, bool fileContents); // true if already written
+  void hashDeferred(RecordIndex& index);
+  void startHash(HashJob& job);
+  void finishHash(HashJob& job, RecordIndex& index);
+  TSK_FS_INFO* openFs(uint64_t offset, TSK_FS_TYPE_ENUM type);
+
+  std::vector<char> Buffer; // reused for every read
+
+  bool          PhysicalOrder,
+                ContentOutput,
+                Dedup,
+                Stats,
+                Emitted,      // whether processFile produced a record
+                FileContents, // whether it has an inode's contents, for dedup
+                Deduped;      // whether those were already written
+  PendingRecord LastPending;
+
+  std::shared_ptr<ThreadPool> HashPool;
+  HashSets                    KnownSets;
+
+  std::map<std::pair<uint32_t, uint64_t>, std::string> WrittenInodes;  // inode vol, inum -> record ID
+  std::unordered_map<std::string, std::string>         WrittenDigests; // SHA-256 -> record ID
+
+  std::vector<DeferredFile>        Deferred;
+  std::map<uint64_t, TSK_FS_INFO*> OpenFs; // by byte offset
+};
+
+// Hands each file record to a callback, in walk order, in place of output.
+// The walk stops once the callback returns false.
+class RecordVisitor: public MetadataWriter {
+public:
+  typedef std::function<bool(const FileRecord& rec)> Visit;
+
+  RecordVisitor(std::ostream& out, const Visit& visit);
+
+  bool stopped() const { return Stopped; }
+
+  virtual TSK_FILTER_ENUM filterVol(const TSK_VS_PART_INFO* vs_part);
+  virtual TSK_FILTER_ENUM filterFs(TSK_FS_INFO *fs_info);
+
+  virtual TSK_RETVAL_ENUM processFile(TSK_FS_FILE *fs_file, const char *path);
+
+protected:
+  virtual void emitRecord(PendingRecord& pending);
+
+private:
+  Visit Callback;
+  bool  Stopped;
+};
+
+// Walks as dumpfs does, and keeps what it finds in a catalog (see catalog.h)
+// rather than writing it: the image's info, the records, with the fs and dir
+// records of --dir-table among them, the path of each, and, once the walk is
+// done, the disk and inode maps.
+class CatalogWriter: public MetadataWriter {
+public:
+  CatalogWriter(std::ostream& out, const std::vector<std::string>& files);
+
+  const CatalogBuilder& catalog() const { return Builder; }
+
+  virtual uint8_t start();
+
+  virtual void finishWalk();
+
+protected:
+  virtual void emit(const std::string& output);
+  virtual void emitRecord(PendingRecord& pending);
+
+private:
+  std::vector<std::string> Files;
+  CatalogBuilder           Builder;
+  std::set<uint32_t>       CatalogedFs; // volume indices
+};
+
+// Walks as dumpfs does, then writes the records, the inode map, and the disk
+// map as one SSTable (see sstable.h), keyed by their IDs, whose record type
+// prefixes keep the three apart. Values are the JSON that dumpfs and the map
+// files would have, without newlines. Everything is sorted on the pool, in
+// runs spilled to temporary files, as the walk goes.
+class SSTableWriter: public MetadataWriter {
+public:
+  SSTableWriter(std::ostream& out): MetadataWriter(out) {}
+
+  void setSortPool(std::shared_ptr<ThreadPool> pool);
+
+  virtual void finishWalk();
+
+protected:
+  virtual void emitRecord(PendingRecord& pending);
+
+private:
+  void add(const std::string& id, const std::string& json);
+
+  std::shared_ptr<ThreadPool>     SortPool;
+  std::unique_ptr<ExternalSorter> Sorter;
+};
+
+// Writes the unallocated space or the slack of every filesystem, rather than
+// records. Both come from the disk map once the walk is done: unallocated
+// space is what no data run covers, and slack is what only slack covers.
+// Adjacent extents are coalesced and read in ascending order, each framed
+// like dumpfiles contents, after a JSON line giving its disk offset.
+class SpaceWriter: public MetadataWriter {
+public:
+  enum SPACE {
+    UNALLOCATED,
+    SLACK
+  };
+
+  SpaceWriter(std::ostream& out, SPACE space);
+
+  virtual void finishWalk();
+
+  // the gaps between runs within [fsBeg, fsEnd), and the extents covered
+  // only by slack, coalesced and in ascending order
+  static std::vector<Extent> unallocatedExtents(const FsMap& runs, uint64_t fsBeg, uint64_t fsEnd);
+  static std::vector<Extent> slackExtents(const FsMap& runs);
+
+protected:
+  virtual void emitRecord(PendingRecord& pending);
+
+private:
+  void writeExtent(uint32_t volIndex, const Extent& extent);
+
+  SPACE Space;
+
+  std::vector<char> Buffer; // reused for every read
+};
+
+// Searches the whole image for a set of patterns once the walk is done, and
+// writes a JSON record for each hit, attributed with the disk map to the
+// attributes whose data runs (or slack) hold it. The image is read in large
+// pieces, in order, and searched on the pool while the next pieces are read.
+class SearchWriter: public MetadataWriter {
+public:
+  SearchWriter(std::ostream& out);
+
+  void setMatcher(std::shared_ptr<PatternMatcher> matcher) { Matcher = matcher; }
+  void setSearchPool(std::shared_ptr<ThreadPool> pool) { SearchPool = pool; }
+
+  virtual void finishWalk();
+
+protected:
+  virtual void emitRecord(PendingRecord& pending);
+
+private:
+  void writeHits(const std::vector<PatternMatcher::Hit>& hits);
+
+  std::shared_ptr<PatternMatcher> Matcher;
+  std::shared_ptr<ThreadPool>     SearchPool;
+};
+
+// Carves objects from the unallocated space of every filesystem once the
+// walk is done, and writes a JSON record for each, optionally followed by its
+// contents as in dumpfiles. The unallocated space is read once, in order,
+// and scanned for headers and footers on the pool.
+class CarveWriter: public MetadataWriter {
+public:
+  CarveWriter(std::ostream& out);
+
+  void setCarvePool(std::shared_ptr<ThreadPool> pool) { CarvePool = pool; }
+
+  // write each object's size and contents after its record
+  void setContentOutput(bool contents) { ContentOutput = contents; }
+
+  virtual void finishWalk();
+
+protected:
+  virtual void emitRecord(PendingRecord& pending);
+
+private:
+  typedef std::pair<uint32_t, Extent> VolExtent; // FS index, byte range
+
+  void carveExtent(const VolExtent& extent, const std::vector<PatternMatcher::Hit>& hits);
+  std::string readImage(uint64_t offset, size_t len);
+
+  Carver                      Carve;
+  std::shared_ptr<ThreadPool> CarvePool;
+  bool                        ContentOutput;
+  std::vector<char>           Buffer; // reused for contents
+};
+
+// Classifies every region of the image by its contents once the walk is
+// done (see classifyBlock()), and flags each with what the disk map says is
+// there. Writes a JSON line counting the regions of each class, then, framed
+// like dumpfiles contents, the map itself: a byte per region, its BlockClass
+// in the low 4 bits and REGION_FLAGS above. The image is read in large
+// pieces, in order, and classified on the pool while the next are read.
+class BlockMapWriter: public MetadataWriter {
+public:
+  enum REGION_FLAGS {
+    REGION_CLASS_MASK  = 0x0F,
+    REGION_ALLOCATED   = 0x10,
+    REGION_SLACK       = 0x20,
+    REGION_UNALLOCATED = 0x40  // none of these: outside every filesystem
+  };
+
+  BlockMapWriter(std::ostream& out);
+
+  void setRegionSize(uint64_t size) { RegionSize = size; }
+  void setClassifyPool(std::shared_ptr<ThreadPool> pool) { ClassifyPool = pool; }
+
+  virtual void finishWalk();
+
+  // sets the flags of the regions holding a filesystem's runs, and of those
+  // holding the gaps between them within [fsBeg, fsEnd)
+  static void markRegions(const FsMap& runs, uint64_t fsBeg, uint64_t fsEnd,
+                          uint64_t regionSize, std::vector<uint8_t>& regions);
+
+protected:
+  virtual void emitRecord(PendingRecord& pending);
+
+private:
+  void classifyImage(std::vector<uint8_t>& regions);
+  void writeSummary(const std::vector<uint8_t>& regions);
 
-  std::vector<char> Buffer;
+  uint64_t                    RegionSize;
+  std::shared_ptr<ThreadPool> ClassifyPool;
 };
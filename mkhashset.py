@@ -0,0 +1,74 @@
+#!/usr/bin/python3
+
+# Builds a hash set file for fsrip's --known-hashes from hex digests, one
+# per line on stdin. Only the first field of each line is used, so NSRL
+# style CSV works once the wanted column comes first; lines that don't start
+# with a digest (headers) are skipped. All digests must be MD5, SHA-1, or
+# SHA-256 alike. See hashset.h for the file format.
+#
+#   python3 mkhashset.py nsrl.fshs < sha1s.txt
+
+import re
+import struct
+import sys
+
+MAGIC = b'FSHS'
+VERSION = 1
+BLOOM_HASHES = 6
+
+DIGEST = re.compile(r'^"?([0-9a-fA-F]{32}|[0-9a-fA-F]{40}|[0-9a-fA-F]{64})"?([,\s]|$)')
+
+def bloomBit(digest, i, bits):
+  a, b = struct.unpack('<QQ', digest[:16])
+  return (a + i * (b | 1)) & (bits - 1)
+
+def readDigests(input):
+  digests = []
+  for line in input:
+    m = DIGEST.match(line)
+    if m:
+      digests.append(bytes(bytearray.fromhex(m.group(1))))
+  return digests
+
+def writeHashSet(output, digests):
+  digests = sorted(set(digests))
+  length = len(digests[0]) if digests else 16
+  if any(len(d) != length for d in digests):
+    raise ValueError('digests must all be the same kind')
+
+  # 8 to 16 bits per digest
+  bits = 64
+  while bits < 8 * len(digests):
+    bits <<= 1
+
+  output.write(MAGIC)
+  output.write(struct.pack('<IIIQQ', VERSION, length, BLOOM_HASHES, len(digests), bits))
+
+  fanout = []
+  cur = 0
+  for p in range(65536):
+    while cur < len(digests) and (digests[cur][0] << 8 | digests[cur][1]) < p:
+      cur += 1
+    fanout.append(cur)
+  fanout.append(len(digests))
+  output.write(struct.pack('<%dQ' % len(fanout), *fanout))
+
+  bloom = bytearray(bits // 8)
+  for d in digests:
+    for i in range(BLOOM_HASHES):
+      bit = bloomBit(d, i, bits)
+      bloom[bit >> 3] |= 1 << (bit & 7)
+  output.write(bloom)
+
+  for d in digests:
+    output.write(d)
+  return len(digests)
+
+if __name__ == '__main__':
+  if len(sys.argv) != 2:
+    sys.stderr.write('usage: mkhashset.py <output file> < digests\n')
+    sys.exit(1)
+  digests = readDigests(sys.stdin)
+  with open(sys.argv[1], 'wb') as output:
+    n = writeHashSet(output, digests)
+  print('wrote %d digests' % n)
@@ -0,0 +1,256 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "asyncwriter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(_WIN32)
+  #include <io.h>
+#else
+  #include <climits>
+  #include <sys/uio.h>
+  #include <unistd.h>
+#endif
+
+namespace {
+  typedef std::chrono::steady_clock Clock;
+
+  uint64_t nsSince(const Clock::time_point& start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+  }
+
+  // spin briefly, then back off to sleeping, up to 1ms
+  void backoff(unsigned int& attempt) {
+    if (attempt < 64) {
+      std::this_thread::yield();
+    }
+    else {
+      std::this_thread::sleep_for(std::chrono::microseconds(std::min(1000u, 10u << std::min(attempt - 64, 6u))));
+    }
+    ++attempt;
+  }
+
+#if !defined(_WIN32)
+  #if defined(IOV_MAX)
+    const size_t MAX_IOV = IOV_MAX;
+  #else
+    const size_t MAX_IOV = 16;
+  #endif
+#endif
+}
+
+std::string AsyncWriterStats::toString() const {
+  std::stringstream buf;
+  const double mbps = Elapsed > 0 ? Bytes / (1024.0 * 1024.0) / Elapsed: 0;
+  buf << "output: " << Bytes << " bytes in " << Elapsed << "s (" << mbps << " MB/s), "
+      << Chunks << " chunks, " << Writes << " writes; "
+      << "walk blocked " << WalkBlocked << "s, writer idle " << WriterIdle << "s, writer busy " << WriterBusy << "s";
+  return buf.str();
+}
+
+AsyncWriterStreambuf::AsyncWriterStreambuf(int fd, size_t chunkSize, size_t numChunks):
+  Fd(fd), Cur(nullptr), Full(numChunks), Free(numChunks), Done(false), Failed(false),
+  WriteErr(0), Closed(false), Bytes(0), NumChunks(0), Writes(0), WalkBlocked(0.0),
+  Elapsed(0.0), Started(Clock::now()), WriterIdleNs(0), WriterBusyNs(0)
+{
+  for (size_t i = 0; i < Free.capacity(); ++i) {
+    Chunks.emplace_back(new Chunk);
+    Chunks.back()->Data.resize(chunkSize);
+    Chunks.back()->Len = 0;
+    Free.tryPush(Chunks.back().get());
+  }
+  Free.tryPop(Cur);
+  setp(Cur->Data.data(), Cur->Data.data() + Cur->Data.size());
+  Writer = std::thread(&AsyncWriterStreambuf::run, this);
+}
+
+AsyncWriterStreambuf::~AsyncWriterStreambuf() {
+  try {
+    close();
+  }
+  catch (std::exception& e) {
+    std::cerr << "Error finishing output: " << e.what() << std::endl;
+  }
+}
+
+AsyncWriterStreambuf::int_type AsyncWriterStreambuf::overflow(int_type c) {
+  if (Closed || !handOff()) {
+    return traits_type::eof();
+  }
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+std::streamsize AsyncWriterStreambuf::xsputn(const char* s, std::streamsize n) {
+  if (Closed) {
+    return 0;
+  }
+  std::streamsize written = 0;
+  while (written < n) {
+    if (pptr() == epptr() && !handOff()) {
+      break;
+    }
+    const std::streamsize toCopy = std::min(n - written, static_cast<std::streamsize>(epptr() - pptr()));
+    std::memcpy(pptr(), s + written, toCopy);
+    pbump(toCopy);
+    written += toCopy;
+  }
+  return written;
+}
+
+bool AsyncWriterStreambuf::handOff() {
+  if (Failed) {
+    return false;
+  }
+  Cur->Len = pptr() - pbase();
+  if (Cur->Len) {
+    Bytes += Cur->Len;
+    ++NumChunks;
+    // Full has room for every chunk, so this can't fail
+    Full.tryPush(Cur);
+
+    if (!Free.tryPop(Cur)) {
+      const Clock::time_point start(Clock::now());
+      unsigned int attempt = 0;
+      while (!Free.tryPop(Cur)) {
+        if (Failed) {
+          Cur = nullptr;
+          WalkBlocked += nsSince(start) / 1e9;
+          return false;
+        }
+        backoff(attempt);
+      }
+      WalkBlocked += nsSince(start) / 1e9;
+    }
+  }
+  setp(Cur->Data.data(), Cur->Data.data() + Cur->Data.size());
+  return true;
+}
+
+void AsyncWriterStreambuf::run() {
+  std::vector<Chunk*> ready;
+  unsigned int attempt = 0;
+  Clock::time_point idleStart(Clock::now());
+  while (true) {
+    Chunk* c;
+    while (Full.tryPop(c)) {
+      ready.push_back(c);
+    }
+    if (ready.empty()) {
+      if (Done) {
+        // Done is set after the last push, so check once more
+        if (!Full.tryPop(c)) {
+          break;
+        }
+        ready.push_back(c);
+      }
+      else {
+        backoff(attempt);
+        continue;
+      }
+    }
+    WriterIdleNs += nsSince(idleStart);
+    attempt = 0;
+
+    const Clock::time_point busyStart(Clock::now());
+    if (!Failed) {
+      writeChunks(ready);
+    }
+    WriterBusyNs += nsSince(busyStart);
+
+    for (Chunk* r: ready) {
+      Free.tryPush(r);
+    }
+    ready.clear();
+    idleStart = Clock::now();
+  }
+  WriterIdleNs += nsSince(idleStart);
+}
+
+void AsyncWriterStreambuf::writeChunks(std::vector<Chunk*>& chunks) {
+#if defined(_WIN32)
+  for (Chunk* c: chunks) {
+    size_t off = 0;
+    while (off < c->Len) {
+      const int ret = _write(Fd, c->Data.data() + off, c->Len - off);
+      if (ret < 0) {
+        WriteErr = errno;
+        Failed = true;
+        return;
+      }
+      off += ret;
+    }
+    ++Writes;
+  }
+#else
+  std::vector<struct iovec> iov;
+  for (Chunk* c: chunks) {
+    struct iovec v;
+    v.iov_base = c->Data.data();
+    v.iov_len = c->Len;
+    iov.push_back(v);
+  }
+  size_t i = 0;
+  while (i < iov.size()) {
+    const ssize_t ret = ::writev(Fd, &iov[i], std::min(iov.size() - i, MAX_IOV));
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      WriteErr = errno;
+      Failed = true;
+      return;
+    }
+    ++Writes;
+    // skip what was written; a short write can stop partway into a chunk
+    size_t left = ret;
+    while (i < iov.size() && left >= iov[i].iov_len) {
+      left -= iov[i].iov_len;
+      ++i;
+    }
+    if (left) {
+      iov[i].iov_base = static_cast<char*>(iov[i].iov_base) + left;
+      iov[i].iov_len -= left;
+    }
+  }
+#endif
+}
+
+void AsyncWriterStreambuf::close() {
+  if (Closed) {
+    return;
+  }
+  if (Cur) {
+    handOff();
+  }
+  Closed = true;
+  Done = true;
+  Writer.join();
+  Elapsed = nsSince(Started) / 1e9;
+  setp(nullptr, nullptr);
+  if (Failed) {
+    throw std::runtime_error(std::string("Could not write output: ") + std::strerror(WriteErr));
+  }
+}
+
+AsyncWriterStats AsyncWriterStreambuf::stats() const {
+  AsyncWriterStats ret;
+  ret.Bytes = Bytes;
+  ret.Chunks = NumChunks;
+  ret.Writes = Closed ? Writes: 0; // Writes belongs to the writer thread until it's joined
+  ret.Elapsed = Closed ? Elapsed: nsSince(Started) / 1e9;
+  ret.WalkBlocked = WalkBlocked;
+  ret.WriterIdle = WriterIdleNs / 1e9;
+  ret.WriterBusy = WriterBusyNs / 1e9;
+  return ret;
+}
@@ -0,0 +1,210 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "bgzf.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <zlib.h>
+
+namespace {
+  const unsigned int HEADER_SIZE = 18,
+                     FOOTER_SIZE = 8;
+
+  const unsigned char Header[HEADER_SIZE] = {
+    0x1f, 0x8b, 8, 4, // gzip magic, deflate, FEXTRA
+    0, 0, 0, 0,       // mtime
+    0, 0xff,          // xfl, OS unknown
+    6, 0,             // XLEN
+    'B', 'C', 2, 0,   // BGZF subfield, 2 bytes long
+    0, 0              // BSIZE - 1, filled in
+  };
+
+  void putLE(std::string& s, uint64_t val, unsigned int n) {
+    for (unsigned int i = 0; i < n; ++i) {
+      s.push_back(static_cast<char>((val >> (8 * i)) & 0xFF));
+    }
+  }
+
+  uint32_t getLE32(const unsigned char* buf) {
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | (static_cast<uint32_t>(buf[3]) << 24);
+  }
+
+  bool deflateBlock(std::string& out, const char* data, size_t len, int level) {
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      throw std::runtime_error("Could not initialize zlib for compression");
+    }
+    const size_t maxData = BGZF_MAX_BLOCK_SIZE - HEADER_SIZE - FOOTER_SIZE;
+    out.resize(HEADER_SIZE + maxData);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs.avail_in = len;
+    zs.next_out = reinterpret_cast<Bytef*>(&out[HEADER_SIZE]);
+    zs.avail_out = maxData;
+    const int ret = deflate(&zs, Z_FINISH);
+    const size_t used = maxData - zs.avail_out;
+    deflateEnd(&zs);
+    out.resize(HEADER_SIZE + used);
+    return ret == Z_STREAM_END;
+  }
+}
+
+std::string bgzfCompressBlock(const char* data, size_t len, int level) {
+  if (len > BGZF_MAX_BLOCK_DATA) {
+    throw std::invalid_argument("Too much data for a BGZF block");
+  }
+  std::string ret;
+  if (!deflateBlock(ret, data, len, level)) {
+    // incompressible; stored deflate blocks always fit
+    deflateBlock(ret, data, len, Z_NO_COMPRESSION);
+  }
+  std::memcpy(&ret[0], Header, HEADER_SIZE);
+  const size_t blockSize = ret.size() + FOOTER_SIZE;
+  ret[16] = static_cast<char>((blockSize - 1) & 0xFF);
+  ret[17] = static_cast<char>(((blockSize - 1) >> 8) & 0xFF);
+  putLE(ret, crc32(crc32(0, Z_NULL, 0), reinterpret_cast<const Bytef*>(data), len), 4);
+  putLE(ret, len, 4);
+  return ret;
+}
+
+size_t bgzfDecompressBlock(std::string& out, const unsigned char* buf, size_t len) {
+  if (len < HEADER_SIZE + FOOTER_SIZE || std::memcmp(buf, Header, 16)) {
+    throw std::runtime_error("Not a BGZF block");
+  }
+  const size_t blockSize = (buf[16] | (buf[17] << 8)) + 1;
+  if (blockSize > len || blockSize < HEADER_SIZE + FOOTER_SIZE) {
+    throw std::runtime_error("Truncated BGZF block");
+  }
+  const uint32_t crc   = getLE32(&buf[blockSize - 8]),
+                 isize = getLE32(&buf[blockSize - 4]);
+  const size_t   start = out.size();
+  out.resize(start + isize);
+
+  z_stream zs;
+  std::memset(&zs, 0, sizeof(zs));
+  if (inflateInit2(&zs, -15) != Z_OK) {
+    throw std::runtime_error("Could not initialize zlib for decompression");
+  }
+  zs.next_in = const_cast<Bytef*>(&buf[HEADER_SIZE]);
+  zs.avail_in = blockSize - HEADER_SIZE - FOOTER_SIZE;
+  // zlib won't finish an empty stream with no room to write, so give it a byte
+  Bytef dummy;
+  zs.next_out = isize ? reinterpret_cast<Bytef*>(&out[start]): &dummy;
+  zs.avail_out = isize ? isize: 1;
+  const int ret = inflate(&zs, Z_FINISH);
+  inflateEnd(&zs);
+  if (ret != Z_STREAM_END || zs.avail_out != (isize ? 0: 1)
+      || crc32(crc32(0, Z_NULL, 0), reinterpret_cast<const Bytef*>(out.data() + start), isize) != crc)
+  {
+    throw std::runtime_error("Corrupt BGZF block");
+  }
+  return blockSize;
+}
+
+const std::string& bgzfEofBlock() {
+  static const std::string eof(bgzfCompressBlock("", 0, Z_DEFAULT_COMPRESSION));
+  return eof;
+}
+/*************************************************************************/
+
+BgzfStreambuf::BgzfStreambuf(std::streambuf* sink, ThreadPool& pool, int level):
+  Sink(sink), Pool(pool), Level(level), Buf(BGZF_MAX_BLOCK_DATA),
+  CompressedOffset(0), UncompressedOffset(0), Closed(false)
+{
+  setp(Buf.data(), Buf.data() + Buf.size());
+}
+
+BgzfStreambuf::~BgzfStreambuf() {
+  try {
+    close();
+  }
+  catch (std::exception& e) {
+    std::cerr << "Error finishing compressed output: " << e.what() << std::endl;
+  }
+}
+
+BgzfStreambuf::int_type BgzfStreambuf::overflow(int_type c) {
+  if (Closed) {
+    return traits_type::eof();
+  }
+  submitBlock();
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+std::streamsize BgzfStreambuf::xsputn(const char* s, std::streamsize n) {
+  if (Closed) {
+    return 0;
+  }
+  std::streamsize written = 0;
+  while (written < n) {
+    if (pptr() == epptr()) {
+      submitBlock();
+    }
+    const std::streamsize toCopy = std::min(n - written, static_cast<std::streamsize>(epptr() - pptr()));
+    std::memcpy(pptr(), s + written, toCopy);
+    pbump(toCopy);
+    written += toCopy;
+  }
+  return written;
+}
+
+void BgzfStreambuf::submitBlock() {
+  const size_t len = pptr() - pbase();
+  if (len == 0) {
+    return;
+  }
+  Index.push_back(IndexEntry(0, UncompressedOffset)); // compressed offset known once written
+  UncompressedOffset += len;
+
+  std::shared_ptr<std::vector<char>> data(new std::vector<char>(pbase(), pptr()));
+  const int level = Level;
+  Pending.push_back(Pool.submit([data, level]{ return bgzfCompressBlock(data->data(), data->size(), level); }));
+  setp(Buf.data(), Buf.data() + Buf.size());
+
+  // bound memory use, but keep every thread busy
+  drain(2 * Pool.size());
+}
+
+void BgzfStreambuf::drain(size_t maxPending) {
+  while (Pending.size() > maxPending) {
+    const std::string block(Pending.front().get());
+    Pending.pop_front();
+
+    Index[Index.size() - Pending.size() - 1].first = CompressedOffset;
+    if (Sink->sputn(block.data(), block.size()) != static_cast<std::streamsize>(block.size())) {
+      throw std::runtime_error("Could not write compressed output");
+    }
+    CompressedOffset += block.size();
+  }
+}
+
+void BgzfStreambuf::close() {
+  if (Closed) {
+    return;
+  }
+  submitBlock();
+  Closed = true;
+  drain(0);
+  const std::string& eof(bgzfEofBlock());
+  Sink->sputn(eof.data(), eof.size());
+  Sink->pubsync();
+}
+
+void BgzfStreambuf::writeIndex(std::ostream& out) const {
+  // bgzip's .gzi omits the implicit first block at (0, 0)
+  std::string buf;
+  const uint64_t num = Index.empty() ? 0: Index.size() - 1;
+  putLE(buf, num, 8);
+  for (size_t i = 1; i < Index.size(); ++i) {
+    putLE(buf, Index[i].first, 8);
+    putLE(buf, Index[i].second, 8);
+  }
+  out.write(buf.data(), buf.size());
+}
@@ -0,0 +1,352 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "binrec.h"
+
+#include "enums.h"
+#include "util.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+  const std::string Schema(
+    "{\"record\":[\"type\",\"id:bytes\",\"parent:bytes\",\"children:bytes\","
+      "\"fs:{byteOffset,blockSize,fsID:bytes,volName:string,volIndex}\",\"path:string\",\"present\","
+      "\"name?:{flags,meta_addr,meta_seq,name:string,par_addr,par_seq,shrt_name:string,type}\","
+      "\"meta?:{addr,accessed:ts,content_len,created:ts,metadata:ts,flags,gid,link:string,fs_time_kind,fs_time?:ts,"
+        "mode,modified:ts,nlink,seq,size,type,uid,attrs:[attr]}\"],"
+     "\"attr\":[\"flags\",\"id\",\"name:string\",\"size\",\"type\",\"rd_buf_size\",\"nrd_allocsize\",\"nrd_compsize\","
+      "\"nrd_initsize\",\"nrd_skiplen\",\"physical_size\",\"slack_size\",\"rd_buf:bytes\",\"nrd_runs:[run]\"],"
+     "\"run\":[\"addr\",\"flags\",\"len\",\"offset\"],"
+     "\"present\":{\"name\":1,\"meta\":2},"
+     "\"fs_time_kind\":{\"none\":0,\"dtime\":1,\"bkup_time\":2},"
+     "\"encoding\":{\"int\":\"varint\",\"bytes\":\"varint length + raw\",\"string\":\"varint length + utf8\","
+      "\"ts\":\"int64le seconds + uint32le nanoseconds\"}}"
+  );
+
+  enum PresenceBits {
+    HAS_NAME = 1,
+    HAS_META = 2
+  };
+
+  class Encoder {
+  public:
+    Encoder(std::string& out): Out(out) {}
+
+    void vint(uint64_t val) {
+      unsigned char buf[MAX_VINT_SIZE];
+      Out.append(reinterpret_cast<const char*>(buf), vintEncode(buf, val));
+    }
+
+    void bytes(const std::string& s) {
+      vint(s.size());
+      Out += s;
+    }
+
+    void ts(const Timestamp& t) {
+      fixed(static_cast<uint64_t>(t.Secs), 8);
+      fixed(t.Nanos, 4);
+    }
+
+  private:
+    void fixed(uint64_t val, unsigned int n) {
+      for (unsigned int i = 0; i < n; ++i) {
+        Out.push_back(static_cast<char>((val >> (8 * i)) & 0xFF));
+      }
+    }
+
+    std::string& Out;
+  };
+
+  class Decoder {
+  public:
+    Decoder(const unsigned char* beg, const unsigned char* end): Cur(beg), End(end) {}
+
+    const unsigned char* pos() const { return Cur; }
+
+    uint64_t vint() {
+      need(1);
+      need(vintSize(*Cur));
+      uint64_t val = 0;
+      Cur += vintDecode(val, Cur);
+      return val;
+    }
+
+    std::string bytes() {
+      const uint64_t len = vint();
+      need(len);
+      std::string ret(reinterpret_cast<const char*>(Cur), len);
+      Cur += len;
+      return ret;
+    }
+
+    // a count of things taking a byte or more each, so that a corrupt one
+    // can't make the caller allocate far more than the input holds
+    uint64_t count() {
+      const uint64_t n = vint();
+      need(n);
+      return n;
+    }
+
+    Timestamp ts() {
+      Timestamp t;
+      t.Secs = static_cast<int64_t>(fixed(8));
+      t.Nanos = static_cast<uint32_t>(fixed(4));
+      return t;
+    }
+
+  private:
+    void need(uint64_t n) const {
+      if (static_cast<uint64_t>(End - Cur) < n) {
+        throw std::runtime_error("Truncated binary record");
+      }
+    }
+
+    uint64_t fixed(unsigned int n) {
+      need(n);
+      uint64_t val = 0;
+      for (unsigned int i = 0; i < n; ++i) {
+        val |= static_cast<uint64_t>(Cur[i]) << (8 * i);
+      }
+      Cur += n;
+      return val;
+    }
+
+    const unsigned char* Cur;
+    const unsigned char* End;
+  };
+
+  void encodeAttr(Encoder& e, const AttrRecord& a) {
+    e.vint(a.Flags);
+    e.vint(a.ID);
+    e.bytes(a.Name);
+    e.vint(a.Size);
+    e.vint(a.Type);
+    e.vint(a.RdBufSize);
+    e.vint(a.AllocSize);
+    e.vint(a.CompSize);
+    e.vint(a.InitSize);
+    e.vint(a.SkipLen);
+    e.vint(a.PhysicalSize);
+    e.vint(a.SlackSize);
+    e.bytes(a.ResidentData);
+    e.vint(a.Runs.size());
+    for (auto& r: a.Runs) {
+      e.vint(r.Addr);
+      e.vint(r.Flags);
+      e.vint(r.Len);
+      e.vint(r.Offset);
+    }
+  }
+
+  void decodeAttr(Decoder& d, AttrRecord& a, unsigned int version) {
+    a.Flags = d.vint();
+    a.ID = d.vint();
+    a.Name = d.bytes();
+    a.Size = d.vint();
+    a.Type = d.vint();
+    a.RdBufSize = d.vint();
+    a.AllocSize = d.vint();
+    a.CompSize = d.vint();
+    a.InitSize = d.vint();
+    a.SkipLen = d.vint();
+    if (version >= 2) {
+      a.PhysicalSize = d.vint();
+      a.SlackSize = d.vint();
+    }
+    else {
+      a.PhysicalSize = a.SlackSize = 0;
+    }
+    a.ResidentData = d.bytes();
+    a.Runs.resize(d.count());
+    for (auto& r: a.Runs) {
+      r.Addr = d.vint();
+      r.Flags = d.vint();
+      r.Len = d.vint();
+      r.Offset = d.vint();
+    }
+  }
+}
+
+const std::string& binRecSchema() {
+  return Schema;
+}
+
+void writeBinRecHeader(std::ostream& out) {
+  std::string hdr(BINREC_MAGIC, 4);
+  Encoder e(hdr);
+  e.vint(BINREC_VERSION);
+  e.bytes(Schema);
+  out.write(hdr.data(), hdr.size());
+}
+
+void writeBinRecord(std::ostream& out, const std::string& payload) {
+  unsigned char len[MAX_VINT_SIZE];
+  out.write(reinterpret_cast<const char*>(len), vintEncode(len, payload.size()));
+  out.write(payload.data(), payload.size());
+}
+
+void encodeFileRecord(std::string& out, const FileRecord& rec) {
+  Encoder e(out);
+  e.vint(RecordTypes::FILE);
+  e.bytes(rec.ID);
+  e.bytes(rec.Parent);
+  e.bytes(rec.Children);
+
+  e.vint(rec.Fs.ByteOffset);
+  e.vint(rec.Fs.BlockSize);
+  e.bytes(rec.Fs.FsID);
+  e.bytes(rec.Fs.VolName);
+  e.vint(rec.Fs.VolIndex);
+
+  e.bytes(rec.Path);
+  e.vint((rec.HasName ? HAS_NAME: 0) | (rec.HasMeta ? HAS_META: 0));
+
+  if (rec.HasName) {
+    const NameRecord& n(rec.Name);
+    e.vint(n.Flags);
+    e.vint(n.MetaAddr);
+    e.vint(n.MetaSeq);
+    e.bytes(n.Name);
+    e.vint(n.ParAddr);
+    e.vint(n.ParSeq);
+    e.bytes(n.ShortName);
+    e.vint(n.Type);
+  }
+  if (rec.HasMeta) {
+    const MetaRecord& m(rec.Meta);
+    e.vint(m.Addr);
+    e.ts(m.Accessed);
+    e.vint(m.ContentLen);
+    e.ts(m.Created);
+    e.ts(m.Metadata);
+    e.vint(m.Flags);
+    e.vint(m.Gid);
+    e.bytes(m.Link);
+    e.vint(m.FsTimeKind);
+    if (m.FsTimeKind != MetaRecord::NO_FS_TIME) {
+      e.ts(m.FsTime);
+    }
+    e.vint(m.Mode);
+    e.ts(m.Modified);
+    e.vint(m.NLink);
+    e.vint(m.Seq);
+    e.vint(m.Size);
+    e.vint(m.Type);
+    e.vint(m.Uid);
+    e.vint(m.Attrs.size());
+    for (auto& a: m.Attrs) {
+      encodeAttr(e, a);
+    }
+  }
+}
+
+const unsigned char* decodeFileRecord(FileRecord& rec, const unsigned char* beg, const unsigned char* end, unsigned int version) {
+  Decoder d(beg, end);
+  if (d.vint() != RecordTypes::FILE) {
+    throw std::runtime_error("Binary record is not a file record");
+  }
+  rec.ID = d.bytes();
+  rec.Parent = d.bytes();
+  rec.Children = d.bytes();
+
+  rec.Fs.ByteOffset = d.vint();
+  rec.Fs.BlockSize = d.vint();
+  rec.Fs.FsID = d.bytes();
+  rec.Fs.VolName = d.bytes();
+  rec.Fs.VolIndex = d.vint();
+
+  rec.Path = d.bytes();
+  const uint64_t present = d.vint();
+  rec.HasName = present & HAS_NAME;
+  rec.HasMeta = present & HAS_META;
+
+  if (rec.HasName) {
+    NameRecord& n(rec.Name);
+    n.Flags = d.vint();
+    n.MetaAddr = d.vint();
+    n.MetaSeq = d.vint();
+    n.Name = d.bytes();
+    n.ParAddr = d.vint();
+    n.ParSeq = d.vint();
+    n.ShortName = d.bytes();
+    n.Type = d.vint();
+  }
+  if (rec.HasMeta) {
+    MetaRecord& m(rec.Meta);
+    m.Addr = d.vint();
+    m.Accessed = d.ts();
+    m.ContentLen = d.vint();
+    m.Created = d.ts();
+    m.Metadata = d.ts();
+    m.Flags = d.vint();
+    m.Gid = d.vint();
+    m.Link = d.bytes();
+    m.FsTimeKind = d.vint();
+    if (m.FsTimeKind != MetaRecord::NO_FS_TIME) {
+      m.FsTime = d.ts();
+    }
+    m.Mode = d.vint();
+    m.Modified = d.ts();
+    m.NLink = d.vint();
+    m.Seq = d.vint();
+    m.Size = d.vint();
+    m.Type = d.vint();
+    m.Uid = d.vint();
+    m.Attrs.resize(d.count());
+    for (auto& a: m.Attrs) {
+      decodeAttr(d, a, version);
+    }
+  }
+  return d.pos();
+}
+/*************************************************************************/
+
+BinRecReader::BinRecReader(std::istream& in): In(in), Version(0) {
+  char magic[4];
+  if (!In.read(magic, sizeof(magic)) || std::memcmp(magic, BINREC_MAGIC, sizeof(magic))) {
+    throw std::runtime_error("Input is not an fsrip binary record stream");
+  }
+  uint64_t val = 0;
+  if (!readVarint(val) || val > BINREC_VERSION) {
+    throw std::runtime_error("Unsupported fsrip binary record version");
+  }
+  Version = val;
+  if (!readVarint(val)) {
+    throw std::runtime_error("Truncated binary record schema");
+  }
+  Schema.resize(val);
+  if (val && !In.read(&Schema[0], val)) {
+    throw std::runtime_error("Truncated binary record schema");
+  }
+}
+
+bool BinRecReader::readVarint(uint64_t& val) {
+  unsigned char buf[MAX_VINT_SIZE];
+  int first = In.get();
+  if (first == std::char_traits<char>::eof()) {
+    return false;
+  }
+  buf[0] = static_cast<unsigned char>(first);
+  const unsigned int size = vintSize(buf[0]);
+  if (size > 1 && !In.read(reinterpret_cast<char*>(&buf[1]), size - 1)) {
+    throw std::runtime_error("Truncated varint in binary record stream");
+  }
+  vintDecode(val, buf);
+  return true;
+}
+
+bool BinRecReader::next(FileRecord& rec) {
+  uint64_t len = 0;
+  if (!readVarint(len)) {
+    return false;
+  }
+  Buf.resize(len);
+  if (len && !In.read(reinterpret_cast<char*>(Buf.data()), len)) {
+    throw std::runtime_error("Truncated binary record");
+  }
+  decodeFileRecord(rec, Buf.data(), Buf.data() + len, Version);
+  return true;
+}
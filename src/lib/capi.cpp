@@ -0,0 +1,279 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "fsrip.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "jsonrec.h"
+#include "util.h"
+#include "walkers.h"
+
+struct ImageHandle {
+  std::shared_ptr<Image>   Img;
+  std::mutex               Lock;    // of reads
+  std::vector<SF_VOLUME>   Volumes;
+  std::vector<std::string> Strings; // Volumes' strings; not resized after they're set
+};
+
+namespace {
+  thread_local std::string LastError;
+
+  int fail(const std::string& msg) {
+    LastError = msg;
+    return -1;
+  }
+
+  void setFs(SF_VOLUME& vol, const std::shared_ptr<Filesystem>& fs, std::string& name) {
+    vol.HasFs = 1;
+    vol.FsByteOffset = fs->byteOffset();
+    vol.FsNumBlocks = fs->numBlocks();
+    vol.FsBlockSize = fs->blockSize();
+    vol.FsType = fs->fsType();
+    name = fs->fsName();
+  }
+
+  void listVolumes(ImageHandle& h) {
+    // two strings per volume, so that they can be pointed to once all are in
+    if (std::shared_ptr<VolumeSystem> vs = h.Img->volumeSystem().lock()) {
+      h.Strings.resize(2 * vs->numVolumes());
+      for (unsigned int i = 0; i < vs->numVolumes(); ++i) {
+        SF_VOLUME vol = SF_VOLUME();
+        vol.Index = i;
+        if (std::shared_ptr<Volume> v = vs->getVol(i).lock()) {
+          vol.StartSector = v->startBlock();
+          vol.NumSectors = v->numBlocks();
+          vol.Flags = v->flags();
+          h.Strings[2 * i] = v->desc();
+          if (std::shared_ptr<Filesystem> fs = v->filesystem().lock()) {
+            setFs(vol, fs, h.Strings[2 * i + 1]);
+          }
+        }
+        h.Volumes.push_back(vol);
+      }
+    }
+    else if (std::shared_ptr<Filesystem> fs = h.Img->filesystem().lock()) {
+      h.Strings.resize(2);
+      SF_VOLUME vol = SF_VOLUME();
+      vol.NumSectors = h.Img->size() / h.Img->sectorSize();
+      h.Strings[0] = h.Img->desc();
+      setFs(vol, fs, h.Strings[1]);
+      h.Volumes.push_back(vol);
+    }
+    for (unsigned int i = 0; i < h.Volumes.size(); ++i) {
+      h.Volumes[i].Description = h.Strings[2 * i].c_str();
+      h.Volumes[i].FsName = h.Strings[2 * i + 1].c_str();
+    }
+  }
+
+  SF_TIME toTime(const Timestamp& t) {
+    SF_TIME ret = {t.Secs, t.Nanos};
+    return ret;
+  }
+
+  // a FileRecord as an SF_RECORD, pointing into rec and the scratch space
+  class RecordConverter {
+  public:
+    const SF_RECORD& convert(const FileRecord& rec) {
+      ID = bytesAsString(reinterpret_cast<const unsigned char*>(rec.ID.data()),
+                         reinterpret_cast<const unsigned char*>(rec.ID.data()) + rec.ID.size());
+      Rec = SF_RECORD();
+      Rec.ID = ID.c_str();
+      Rec.Path = rec.Path.c_str();
+      Rec.VolIndex = rec.Fs.VolIndex;
+      Rec.FsByteOffset = rec.Fs.ByteOffset;
+      Rec.FsBlockSize = rec.Fs.BlockSize;
+      if (rec.HasName) {
+        convertName(rec.Name);
+        Rec.Name = &Name;
+      }
+      if (rec.HasMeta) {
+        convertMeta(rec.Meta);
+        Rec.Meta = &Meta;
+      }
+      return Rec;
+    }
+
+  private:
+    void convertName(const NameRecord& n) {
+      Name.Flags = n.Flags;
+      Name.Type = n.Type;
+      Name.Name = n.Name.c_str();
+      Name.ShortName = n.ShortName.c_str();
+      Name.MetaAddr = n.MetaAddr;
+      Name.ParAddr = n.ParAddr;
+      Name.MetaSeq = n.MetaSeq;
+      Name.ParSeq = n.ParSeq;
+    }
+
+    void convertMeta(const MetaRecord& m) {
+      Meta.Addr = m.Addr;
+      Meta.Size = m.Size;
+      Meta.Flags = m.Flags;
+      Meta.Type = m.Type;
+      Meta.Mode = m.Mode;
+      Meta.Uid = m.Uid;
+      Meta.Gid = m.Gid;
+      Meta.NLink = m.NLink;
+      Meta.Seq = m.Seq;
+      Meta.Accessed = toTime(m.Accessed);
+      Meta.Created = toTime(m.Created);
+      Meta.Metadata = toTime(m.Metadata);
+      Meta.Modified = toTime(m.Modified);
+      Meta.Link = m.Link.c_str();
+
+      // runs go in one array, so that the attributes can point into it
+      Attrs.resize(m.Attrs.size());
+      Runs.clear();
+      for (const AttrRecord& a: m.Attrs) {
+        for (const RunRecord& r: a.Runs) {
+          SF_RUN run = {r.Addr, r.Len, r.Offset, r.Flags};
+          Runs.push_back(run);
+        }
+      }
+      size_t run = 0;
+      for (unsigned int i = 0; i < m.Attrs.size(); ++i) {
+        const AttrRecord& a(m.Attrs[i]);
+        SF_ATTR& attr(Attrs[i]);
+        attr.Flags = a.Flags;
+        attr.ID = a.ID;
+        attr.Type = a.Type;
+        attr.Name = a.Name.c_str();
+        attr.Size = a.Size;
+        attr.AllocSize = a.AllocSize;
+        attr.InitSize = a.InitSize;
+        attr.CompSize = a.CompSize;
+        attr.SkipLen = a.SkipLen;
+        attr.PhysicalSize = a.PhysicalSize;
+        attr.SlackSize = a.SlackSize;
+        attr.ResidentData = a.ResidentData.data();
+        attr.ResidentLen = a.ResidentData.size();
+        attr.Runs = a.Runs.empty() ? nullptr: &Runs[run];
+        attr.NumRuns = a.Runs.size();
+        run += a.Runs.size();
+      }
+      Meta.Attrs = Attrs.empty() ? nullptr: &Attrs[0];
+      Meta.NumAttrs = Attrs.size();
+    }
+
+    SF_RECORD            Rec;
+    SF_NAME              Name;
+    SF_META              Meta;
+    std::string          ID;
+    std::vector<SF_ATTR> Attrs;
+    std::vector<SF_RUN>  Runs;
+  };
+}
+
+SF_HIMAGE sf_open_img(const char* const* segments, unsigned int numSegments) {
+  if (!segments || !numSegments) {
+    fail("no evidence files given");
+    return nullptr;
+  }
+  try {
+    std::unique_ptr<ImageHandle> h(new ImageHandle);
+    h->Img = Image::open(std::vector<std::string>(segments, segments + numSegments));
+    if (!h->Img) {
+      fail("could not open the evidence files");
+      return nullptr;
+    }
+    listVolumes(*h);
+    LastError.clear();
+    return h.release();
+  }
+  catch (std::exception& e) {
+    fail(e.what());
+    return nullptr;
+  }
+}
+
+void sf_close_img(SF_HIMAGE img) {
+  delete img;
+}
+
+uint64_t sf_img_size(SF_HIMAGE img) {
+  return img ? img->Img->size(): 0;
+}
+
+unsigned int sf_img_sector_size(SF_HIMAGE img) {
+  return img ? img->Img->sectorSize(): 0;
+}
+
+int64_t sf_img_read(SF_HIMAGE img, uint64_t offset, void* buf, size_t len) {
+  if (!img || !buf) {
+    return fail("no image or buffer");
+  }
+  if (offset >= img->Img->size()) {
+    return fail("offset is past the end of the image");
+  }
+  std::lock_guard<std::mutex> lock(img->Lock);
+  const ssize_t rlen = tsk_img_read(img->Img->tskInfo(), offset, static_cast<char*>(buf), len);
+  if (rlen < 0) {
+    return fail(tsk_error_get() ? tsk_error_get(): "could not read the image");
+  }
+  return rlen;
+}
+
+const char* sf_last_error(void) {
+  return LastError.c_str();
+}
+
+unsigned int sf_num_volumes(SF_HIMAGE img) {
+  return img ? img->Volumes.size(): 0;
+}
+
+int sf_get_volume(SF_HIMAGE img, unsigned int index, SF_VOLUME* vol) {
+  if (!img || !vol) {
+    return fail("no image or volume");
+  }
+  if (index >= img->Volumes.size()) {
+    return fail("no volume " + std::to_string(index));
+  }
+  *vol = img->Volumes[index];
+  return 0;
+}
+
+int sf_walk(SF_HIMAGE img, SF_RECORD_CB callback, void* user) {
+  if (!img || !callback) {
+    return fail("no image or callback");
+  }
+  try {
+    // the walk opens the image itself, so that it needn't share TSK's state
+    // with reads or other walks
+    const std::vector<std::string>& files(img->Img->files());
+    std::vector<const char*> segments;
+    for (const std::string& f: files) {
+      segments.push_back(f.c_str());
+    }
+
+    std::ostream        nowhere(nullptr);
+    RecordConverter     converter;
+    RecordVisitor       walker(nowhere, [callback, user, &converter](const FileRecord& rec) {
+      return 0 == callback(&converter.convert(rec), user);
+    });
+    if (0 != walker.openImageUtf8(segments.size(), &segments[0], TSK_IMG_TYPE_DETECT, 0)) {
+      return fail("could not open the evidence files");
+    }
+    walker.setVolFilterFlags((TSK_VS_PART_FLAG_ENUM)(TSK_VS_PART_FLAG_ALLOC | TSK_VS_PART_FLAG_UNALLOC | TSK_VS_PART_FLAG_META));
+    walker.setFileFilterFlags((TSK_FS_DIR_WALK_FLAG_ENUM)(TSK_FS_DIR_WALK_FLAG_RECURSE | TSK_FS_DIR_WALK_FLAG_UNALLOC | TSK_FS_DIR_WALK_FLAG_ALLOC));
+    // no disk or inode maps are kept, but resident data is still wanted
+    walker.setFields(RD_BUF_FIELD | ATTRS_FIELD);
+    walker.setMapsNeeded(false);
+    if (0 != walker.start() && !walker.stopped()) {
+      std::string msg("had an error parsing the filesystem");
+      for (auto& err: walker.getErrorList()) {
+        msg += "; " + err.msg1 + " " + err.msg2;
+      }
+      return fail(msg);
+    }
+    walker.finishWalk();
+    LastError.clear();
+    return 0;
+  }
+  catch (std::exception& e) {
+    return fail(e.what());
+  }
+}
@@ -0,0 +1,152 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "carve.h"
+
+#include <algorithm>
+
+namespace {
+  const uint64_t MB = 1024 * 1024;
+
+  uint32_t getLE16(const std::string& b, size_t pos) {
+    return static_cast<unsigned char>(b[pos]) | (static_cast<unsigned char>(b[pos + 1]) << 8);
+  }
+
+  uint32_t getBE16(const std::string& b, size_t pos) {
+    return (static_cast<unsigned char>(b[pos]) << 8) | static_cast<unsigned char>(b[pos + 1]);
+  }
+
+  uint32_t getBE32(const std::string& b, size_t pos) {
+    return (getBE16(b, pos) << 16) | getBE16(b, pos + 2);
+  }
+
+  const std::string OOXML_FIRST_ENTRY("[Content_Types].xml");
+}
+
+const std::vector<CarveSignature>& carveSignatures() {
+  static const std::vector<CarveSignature> sigs{
+    {"jpeg",   std::string("\xff\xd8\xff", 3),      std::string("\xff\xd9", 2),         CarveSignature::FOOTER,        32 * MB,   false},
+    {"png",    std::string("\x89PNG\r\n\x1a\n", 8), std::string("IEND\xae\x42\x60\x82", 8), CarveSignature::FOOTER,   64 * MB,   false},
+    {"pdf",    "%PDF-",                             "%%EOF",                            CarveSignature::FOOTER,        256 * MB,  true},
+    {"zip",    std::string("PK\x03\x04", 4),        std::string("PK\x05\x06", 4),       CarveSignature::ZIP_FOOTER,    1024 * MB, false},
+    {"sqlite", std::string("SQLite format 3\0", 16), "",                                CarveSignature::SQLITE_HEADER, 1024 * MB, false},
+    {"evtx",   std::string("ElfFile\0", 8),         "",                                 CarveSignature::EVTX_HEADER,   1024 * MB, false}
+  };
+  return sigs;
+}
+
+Carver::Carver(const std::vector<CarveSignature>& sigs): Sigs(sigs) {
+  std::vector<std::string> patterns;
+  for (uint32_t s = 0; s < Sigs.size(); ++s) {
+    patterns.push_back(Sigs[s].Header);
+    PatternSig.push_back(s);
+    PatternIsFooter.push_back(false);
+    if (!Sigs[s].Footer.empty()) {
+      patterns.push_back(Sigs[s].Footer);
+      PatternSig.push_back(s);
+      PatternIsFooter.push_back(true);
+    }
+  }
+  Matcher = std::make_shared<PatternMatcher>(patterns);
+}
+
+std::vector<CarvedObject> Carver::carve(const std::vector<PatternMatcher::Hit>& hits,
+                                        uint64_t beg, uint64_t end, const Reader& read) const
+{
+  std::vector<std::vector<uint64_t>> headers(Sigs.size()),
+                                     footers(Sigs.size());
+  for (const PatternMatcher::Hit& hit: hits) {
+    if (beg <= hit.Offset && hit.Offset < end) {
+      (PatternIsFooter[hit.Pattern] ? footers: headers)[PatternSig[hit.Pattern]].push_back(hit.Offset);
+    }
+  }
+
+  std::vector<CarvedObject> ret;
+  for (uint32_t s = 0; s < Sigs.size(); ++s) {
+    const CarveSignature& sig(Sigs[s]);
+    uint64_t covered = beg;
+    for (auto h = headers[s].begin(); h != headers[s].end(); ++h) {
+      if (*h < covered) {
+        continue;
+      }
+      const uint64_t limit = std::min(end, *h + sig.MaxSize),
+                     next  = h + 1 == headers[s].end() ? limit: std::min(*(h + 1), limit);
+
+      CarvedObject obj{sig.Type, *h, 0, false};
+      const uint64_t objEnd = findEnd(sig, *h, sig.LastFooter ? next: limit, limit, footers[s], read);
+      if (objEnd > *h && objEnd <= limit) {
+        obj.Size = objEnd - *h;
+        obj.Complete = true;
+      }
+      else {
+        // as far as the next header of the type
+        obj.Size = next - *h;
+      }
+      if (CarveSignature::ZIP_FOOTER == sig.SizeFrom) {
+        const std::string local(read(*h, 30 + OOXML_FIRST_ENTRY.size()));
+        if (local.size() == 30 + OOXML_FIRST_ENTRY.size() && getLE16(local, 26) == OOXML_FIRST_ENTRY.size()
+            && local.compare(30, std::string::npos, OOXML_FIRST_ENTRY) == 0)
+        {
+          obj.Type = "ooxml";
+        }
+      }
+      covered = *h + obj.Size;
+      ret.push_back(obj);
+    }
+  }
+  std::stable_sort(ret.begin(), ret.end(),
+    [](const CarvedObject& a, const CarvedObject& b) { return a.Offset < b.Offset; });
+  return ret;
+}
+
+uint64_t Carver::findEnd(const CarveSignature& sig, uint64_t header, uint64_t stop, uint64_t limit,
+                         const std::vector<uint64_t>& footers, const Reader& read) const
+{
+  switch (sig.SizeFrom) {
+    case CarveSignature::FOOTER:
+    case CarveSignature::ZIP_FOOTER:
+      {
+        // footers must start after the header and end within the limit
+        uint64_t ret = 0;
+        for (auto f = std::upper_bound(footers.begin(), footers.end(), header); f != footers.end() && *f < stop; ++f) {
+          uint64_t footerEnd = *f + sig.Footer.size();
+          if (CarveSignature::ZIP_FOOTER == sig.SizeFrom) {
+            // 22 bytes, then a comment whose length is the last 2
+            const std::string eocd(read(*f, 22));
+            footerEnd = *f + 22 + (eocd.size() == 22 ? getLE16(eocd, 20): 0);
+          }
+          if (footerEnd <= limit) {
+            ret = footerEnd;
+            if (!sig.LastFooter) {
+              break;
+            }
+          }
+        }
+        return ret;
+      }
+    case CarveSignature::SQLITE_HEADER:
+      {
+        // the in-header database size; 0 from SQLite versions older than 3.7
+        const std::string h(read(header, 32));
+        if (h.size() < 32) {
+          return 0;
+        }
+        const uint64_t pageSize  = getBE16(h, 16) == 1 ? 65536: getBE16(h, 16),
+                       pageCount = getBE32(h, 28);
+        if (pageSize < 512 || (pageSize & (pageSize - 1))) {
+          return 0;
+        }
+        return header + pageSize * pageCount;
+      }
+    case CarveSignature::EVTX_HEADER:
+      {
+        const std::string h(read(header, 44));
+        if (h.size() < 44 || getLE16(h, 40) != 4096) {
+          return 0;
+        }
+        return header + 4096 + getLE16(h, 42) * 65536ull;
+      }
+  }
+  return 0;
+}
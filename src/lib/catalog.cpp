@@ -0,0 +1,254 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "catalog.h"
+
+#include "binrec.h"
+#include "jsonrec.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+namespace {
+  const char     MAGIC[4]     = {'F', 'S', 'C', 'T'};
+  const uint64_t HEADER_SIZE  = 16,
+                 SECTION_SIZE = 24,
+                 ENTRY_SIZE   = 8; // key and value lengths
+
+  uint32_t getLE32(const unsigned char* buf) {
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | (static_cast<uint32_t>(buf[3]) << 24);
+  }
+
+  uint64_t getLE64(const unsigned char* buf) {
+    return getLE32(buf) | (static_cast<uint64_t>(getLE32(buf + 4)) << 32);
+  }
+
+  void putLE(std::string& s, uint64_t val, unsigned int n) {
+    for (unsigned int i = 0; i < n; ++i) {
+      s.push_back(static_cast<char>((val >> (8 * i)) & 0xFF));
+    }
+  }
+
+  int compareKeys(const char* a, size_t aLen, const char* b, size_t bLen) {
+    const int cmp = std::memcmp(a, b, std::min(aLen, bLen));
+    return cmp ? cmp: (aLen < bLen ? -1: (aLen > bLen ? 1: 0));
+  }
+
+  int compareKey(const CatalogEntry& e, const std::string& key) {
+    return compareKeys(e.Key, e.KeyLen, key.data(), key.size());
+  }
+
+  CatalogEntry entryFrom(const unsigned char* buf) {
+    const char* key = reinterpret_cast<const char*>(buf) + ENTRY_SIZE;
+    const CatalogEntry ret = {key, getLE32(buf), key + getLE32(buf), getLE32(buf + 4)};
+    return ret;
+  }
+}
+
+std::vector<SegmentIdentity> segmentIdentities(const std::vector<std::string>& paths) {
+  std::vector<SegmentIdentity> ret;
+  for (const std::string& path: paths) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+      throw std::runtime_error("Could not find " + path);
+    }
+    ret.push_back(SegmentIdentity{path, static_cast<uint64_t>(st.st_size), static_cast<int64_t>(st.st_mtime)});
+  }
+  return ret;
+}
+
+void CatalogBuilder::add(CatalogSection section, const std::string& key, const std::string& value) {
+  Section& s(Sections[section]);
+  if (!key.empty()) {
+    s.Keyed.push_back(s.Entries.size());
+  }
+  putLE(s.Entries, key.size(), 4);
+  putLE(s.Entries, value.size(), 4);
+  s.Entries += key;
+  s.Entries += value;
+}
+
+void CatalogBuilder::write(const std::string& path, const std::vector<SegmentIdentity>& segments) const {
+  std::string header(MAGIC, sizeof(MAGIC));
+  putLE(header, Catalog::VERSION, 4);
+  putLE(header, segments.size(), 4);
+  putLE(header, NUM_CATALOG_SECTIONS, 4);
+  for (const SegmentIdentity& seg: segments) {
+    putLE(header, seg.Size, 8);
+    putLE(header, seg.Modified, 8);
+    putLE(header, seg.Path.size(), 4);
+    header += seg.Path;
+  }
+
+  uint64_t offset = header.size() + NUM_CATALOG_SECTIONS * SECTION_SIZE;
+  for (const Section& s: Sections) {
+    putLE(header, offset, 8);
+    putLE(header, s.Entries.size(), 8);
+    putLE(header, s.Keyed.size(), 8);
+    offset += s.Entries.size() + s.Keyed.size() * 8;
+  }
+
+  const std::string tmpPath(path + ".tmp");
+  {
+    std::ofstream file(tmpPath.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+    file.write(header.data(), header.size());
+    for (const Section& s: Sections) {
+      file.write(s.Entries.data(), s.Entries.size());
+
+      // stable, so that entries with the same key stay in output order
+      std::vector<uint64_t> keyed(s.Keyed);
+      std::stable_sort(keyed.begin(), keyed.end(), [&s](uint64_t a, uint64_t b) {
+        const unsigned char* entries = reinterpret_cast<const unsigned char*>(s.Entries.data());
+        const CatalogEntry ea(entryFrom(entries + a)),
+                           eb(entryFrom(entries + b));
+        return compareKeys(ea.Key, ea.KeyLen, eb.Key, eb.KeyLen) < 0;
+      });
+      std::string index;
+      index.reserve(keyed.size() * 8);
+      for (uint64_t k: keyed) {
+        putLE(index, k, 8);
+      }
+      file.write(index.data(), index.size());
+    }
+    if (!file) {
+      throw std::runtime_error("Could not write catalog " + tmpPath);
+    }
+  }
+  // rename() won't replace a file on Windows
+  std::remove(path.c_str());
+  if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+    throw std::runtime_error("Could not rename " + tmpPath + " to " + path);
+  }
+}
+
+Catalog::Catalog(const std::string& path):
+  Path(path), File(path, "catalog")
+{
+  const unsigned char* buf = File.data();
+  const uint64_t       len = File.size();
+  if (len < HEADER_SIZE || std::memcmp(buf, MAGIC, sizeof(MAGIC)) || getLE32(buf + 4) != VERSION
+      || getLE32(buf + 12) != NUM_CATALOG_SECTIONS)
+  {
+    throw std::runtime_error(path + " is not a catalog");
+  }
+  uint64_t pos = HEADER_SIZE;
+  const uint32_t numSegments = getLE32(buf + 8);
+  for (uint32_t i = 0; i < numSegments; ++i) {
+    if (pos + 20 > len || pos + 20 + getLE32(buf + pos + 16) > len) {
+      throw std::runtime_error(path + " is not a valid catalog");
+    }
+    const uint32_t pathLen = getLE32(buf + pos + 16);
+    Segments.push_back(SegmentIdentity{std::string(reinterpret_cast<const char*>(buf) + pos + 20, pathLen),
+                                       getLE64(buf + pos), static_cast<int64_t>(getLE64(buf + pos + 8))});
+    pos += 20 + pathLen;
+  }
+  for (Section& s: Sections) {
+    if (pos + SECTION_SIZE > len) {
+      throw std::runtime_error(path + " is not a valid catalog");
+    }
+    const uint64_t offset = getLE64(buf + pos);
+    s.Len     = getLE64(buf + pos + 8);
+    s.NumKeys = getLE64(buf + pos + 16);
+    if (offset > len || s.Len > len - offset || s.NumKeys > (len - offset - s.Len) / 8) {
+      throw std::runtime_error(path + " is not a valid catalog");
+    }
+    s.Entries = buf + offset;
+    s.Index   = s.Entries + s.Len;
+    pos += SECTION_SIZE;
+  }
+}
+
+CatalogEntry Catalog::entryAt(const Section& s, uint64_t offset) const {
+  if (offset > s.Len || s.Len - offset < ENTRY_SIZE) {
+    throw std::runtime_error(Path + " has a malformed entry");
+  }
+  const CatalogEntry ret(entryFrom(s.Entries + offset));
+  if (static_cast<uint64_t>(ret.KeyLen) + ret.ValueLen > s.Len - offset - ENTRY_SIZE) {
+    throw std::runtime_error(Path + " has a malformed entry");
+  }
+  return ret;
+}
+
+void Catalog::scan(CatalogSection section, const std::function<void(const CatalogEntry&)>& visit) const {
+  const Section& s(Sections[section]);
+  uint64_t offset = 0;
+  while (offset < s.Len) {
+    const CatalogEntry e(entryAt(s, offset));
+    visit(e);
+    offset += ENTRY_SIZE + e.KeyLen + e.ValueLen;
+  }
+}
+
+std::vector<CatalogEntry> Catalog::find(CatalogSection section, const std::string& key) const {
+  const Section& s(Sections[section]);
+  uint64_t lo = 0,
+           hi = s.NumKeys;
+  while (lo < hi) {
+    const uint64_t mid = lo + (hi - lo) / 2;
+    if (compareKey(entryAt(s, getLE64(s.Index + 8 * mid)), key) < 0) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  std::vector<CatalogEntry> ret;
+  for (; lo < s.NumKeys; ++lo) {
+    const CatalogEntry e(entryAt(s, getLE64(s.Index + 8 * lo)));
+    if (compareKey(e, key) != 0) {
+      break;
+    }
+    ret.push_back(e);
+  }
+  return ret;
+}
+
+std::string encodeCatalogRecord(const FileRecord& rec, uint32_t inodeVol) {
+  std::string ret;
+  putLE(ret, inodeVol, 4);
+  encodeFileRecord(ret, rec);
+  return ret;
+}
+
+void decodeCatalogRecord(const CatalogEntry& entry, FileRecord& rec, uint32_t& inodeVol) {
+  if (entry.ValueLen < 4) {
+    throw std::runtime_error("Catalog record is truncated");
+  }
+  const unsigned char* buf = reinterpret_cast<const unsigned char*>(entry.Value);
+  inodeVol = getLE32(buf);
+  decodeFileRecord(rec, buf + 4, buf + entry.ValueLen);
+}
+
+void writeCatalogRecords(std::ostream& out, const Catalog& catalog, bool binary, bool dirTable, unsigned int fields) {
+  if (binary) {
+    writeBinRecHeader(out);
+  }
+  FileRecord rec;
+  uint32_t   inodeVol = 0;
+  catalog.scan(CATALOG_RECORDS, [&](const CatalogEntry& e) {
+    if (!e.KeyLen) {
+      if (dirTable) {
+        out.write(e.Value, e.ValueLen);
+      }
+    }
+    else if (binary) {
+      if (e.ValueLen < 4) {
+        throw std::runtime_error("Catalog record is truncated");
+      }
+      // already encoded as binary output wants it
+      writeBinRecord(out, std::string(e.Value + 4, e.ValueLen - 4));
+    }
+    else {
+      decodeCatalogRecord(e, rec, inodeVol);
+      writeFile(out, rec, inodeVol, dirTable, fields);
+      out << '\n';
+    }
+  });
+}
@@ -0,0 +1,505 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "columnar.h"
+
+#include "enums.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+  using namespace ColumnEncodings;
+
+  enum Columns {
+    ID = 0, PARENT, PATH, VOL_NAME, VOL_INDEX,
+    NAME, SHRT_NAME, NAME_FLAGS, NAME_TYPE, META_ADDR, META_SEQ, PAR_ADDR,
+    HAS_META, ADDR, META_FLAGS, META_TYPE, SIZE, UID, GID, MODE, NLINK, SEQ,
+    ACCESSED, CREATED, METADATA, MODIFIED,
+    NUM_COLUMNS
+  };
+
+  const std::vector<ColumnDesc> Schema = {
+    {"id", PLAIN_STRING}, {"parent", DICT_STRING}, {"path", DICT_STRING}, {"volName", DICT_STRING}, {"volIndex", PLAIN_UINT},
+    {"name", PLAIN_STRING}, {"shrt_name", PLAIN_STRING}, {"name_flags", DICT_STRING}, {"name_type", DICT_STRING},
+    {"meta_addr", DELTA_INT}, {"meta_seq", PLAIN_UINT}, {"par_addr", DELTA_INT},
+    {"has_meta", PLAIN_UINT}, {"addr", DELTA_INT}, {"flags", DICT_STRING}, {"type", DICT_STRING},
+    {"size", PLAIN_UINT}, {"uid", PLAIN_UINT}, {"gid", PLAIN_UINT}, {"mode", PLAIN_UINT}, {"nlink", PLAIN_UINT}, {"seq", PLAIN_UINT},
+    {"accessed", DELTA_TIME}, {"created", DELTA_TIME}, {"metadata", DELTA_TIME}, {"modified", DELTA_TIME}
+  };
+
+  uint64_t zigzag(int64_t val) {
+    return (static_cast<uint64_t>(val) << 1) ^ static_cast<uint64_t>(val >> 63);
+  }
+
+  int64_t unzigzag(uint64_t val) {
+    return static_cast<int64_t>(val >> 1) ^ -static_cast<int64_t>(val & 1);
+  }
+
+  void putVarint(std::string& out, uint64_t val) {
+    unsigned char buf[MAX_VINT_SIZE];
+    out.append(reinterpret_cast<const char*>(buf), vintEncode(buf, val));
+  }
+
+  void putBytes(std::string& out, const std::string& s) {
+    putVarint(out, s.size());
+    out += s;
+  }
+
+  uint64_t getVarint(const unsigned char*& cur, const unsigned char* end) {
+    if (cur >= end || static_cast<unsigned int>(end - cur) < vintSize(*cur)) {
+      throw std::runtime_error("Truncated columnar chunk");
+    }
+    uint64_t val = 0;
+    cur += vintDecode(val, cur);
+    return val;
+  }
+
+  std::string getBytes(const unsigned char*& cur, const unsigned char* end) {
+    const uint64_t len = getVarint(cur, end);
+    if (static_cast<uint64_t>(end - cur) < len) {
+      throw std::runtime_error("Truncated columnar chunk");
+    }
+    std::string ret(reinterpret_cast<const char*>(cur), len);
+    cur += len;
+    return ret;
+  }
+
+  uint64_t uintField(const FileRecord& r, unsigned int col) {
+    switch (col) {
+      case VOL_INDEX: return r.Fs.VolIndex;
+      case META_ADDR: return r.HasName ? r.Name.MetaAddr: 0;
+      case META_SEQ:  return r.HasName ? r.Name.MetaSeq: 0;
+      case PAR_ADDR:  return r.HasName ? r.Name.ParAddr: 0;
+      case HAS_META:  return r.HasMeta;
+      case ADDR:      return r.HasMeta ? r.Meta.Addr: 0;
+      case SIZE:      return r.HasMeta ? r.Meta.Size: 0;
+      case UID:       return r.HasMeta ? r.Meta.Uid: 0;
+      case GID:       return r.HasMeta ? r.Meta.Gid: 0;
+      case MODE:      return r.HasMeta ? r.Meta.Mode: 0;
+      case NLINK:     return r.HasMeta ? r.Meta.NLink: 0;
+      case SEQ:       return r.HasMeta ? r.Meta.Seq: 0;
+    }
+    return 0;
+  }
+
+  std::string strField(const FileRecord& r, unsigned int col) {
+    switch (col) {
+      case ID:         return r.ID;
+      case PARENT:     return r.Parent;
+      case PATH:       return r.Path;
+      case VOL_NAME:   return r.Fs.VolName;
+      case NAME:       return r.HasName ? r.Name.Name: "";
+      case SHRT_NAME:  return r.HasName ? r.Name.ShortName: "";
+      case NAME_FLAGS: return r.HasName ? nameFlags(r.Name.Flags): "";
+      case NAME_TYPE:  return r.HasName ? nameType(r.Name.Type): "";
+      case META_FLAGS: return r.HasMeta ? metaFlags(r.Meta.Flags): "";
+      case META_TYPE:  return r.HasMeta ? metaType(r.Meta.Type): "";
+    }
+    return "";
+  }
+
+  Timestamp timeField(const FileRecord& r, unsigned int col) {
+    if (r.HasMeta) {
+      switch (col) {
+        case ACCESSED: return r.Meta.Accessed;
+        case CREATED:  return r.Meta.Created;
+        case METADATA: return r.Meta.Metadata;
+        case MODIFIED: return r.Meta.Modified;
+      }
+    }
+    return Timestamp{0, 0};
+  }
+
+  void encodeColumn(std::string& out, ColumnChunk& chunk, const std::vector<FileRecord>& rows, unsigned int col) {
+    uint64_t prev = 0; // deltas are taken modulo 2^64, so huge addresses can't overflow
+
+    chunk.Min = chunk.Max = 0; // strings, or no rows
+    switch (Schema[col].Encoding) {
+      case PLAIN_UINT:
+      case DELTA_INT:
+        {
+          // compared unsigned, so that values of 2^63 and up sort last
+          uint64_t minVal = std::numeric_limits<uint64_t>::max(),
+                   maxVal = 0;
+          for (auto& r: rows) {
+            const uint64_t val = uintField(r, col);
+            if (Schema[col].Encoding == PLAIN_UINT) {
+              putVarint(out, val);
+            }
+            else {
+              putVarint(out, zigzag(static_cast<int64_t>(val - prev)));
+              prev = val;
+            }
+            minVal = std::min(minVal, val);
+            maxVal = std::max(maxVal, val);
+          }
+          if (!rows.empty()) {
+            chunk.Min = static_cast<int64_t>(minVal);
+            chunk.Max = static_cast<int64_t>(maxVal);
+          }
+        }
+        break;
+      case DELTA_TIME:
+        {
+          int64_t minVal = std::numeric_limits<int64_t>::max(),
+                  maxVal = std::numeric_limits<int64_t>::min();
+          for (auto& r: rows) {
+            const Timestamp t = timeField(r, col);
+            putVarint(out, zigzag(static_cast<int64_t>(static_cast<uint64_t>(t.Secs) - prev)));
+            putVarint(out, t.Nanos);
+            prev = static_cast<uint64_t>(t.Secs);
+            minVal = std::min(minVal, t.Secs);
+            maxVal = std::max(maxVal, t.Secs);
+          }
+          if (!rows.empty()) {
+            chunk.Min = minVal;
+            chunk.Max = maxVal;
+          }
+        }
+        break;
+      case PLAIN_STRING:
+        for (auto& r: rows) {
+          putBytes(out, strField(r, col));
+        }
+        break;
+      case DICT_STRING:
+        {
+          std::unordered_map<std::string, uint64_t> dict;
+          std::vector<const std::string*> entries;
+          std::vector<uint64_t> indices;
+          indices.reserve(rows.size());
+          for (auto& r: rows) {
+            auto itr = dict.insert(std::make_pair(strField(r, col), entries.size())).first;
+            if (itr->second == entries.size()) {
+              entries.push_back(&itr->first);
+            }
+            indices.push_back(itr->second);
+          }
+          putVarint(out, entries.size());
+          for (auto e: entries) {
+            putBytes(out, *e);
+          }
+          for (auto i: indices) {
+            putVarint(out, i);
+          }
+        }
+        break;
+    }
+  }
+}
+
+const std::vector<ColumnDesc>& columnarSchema() {
+  return Schema;
+}
+
+void encodeRowGroup(std::string& buf, RowGroupInfo& info, const std::vector<FileRecord>& rows) {
+  info.NumRows = rows.size();
+  info.Columns.resize(NUM_COLUMNS);
+  for (unsigned int col = 0; col < NUM_COLUMNS; ++col) {
+    ColumnChunk& chunk(info.Columns[col]);
+    chunk.Offset = buf.size();
+    encodeColumn(buf, chunk, rows, col);
+    chunk.Length = buf.size() - chunk.Offset;
+  }
+}
+/*************************************************************************/
+
+ColumnarWriter::ColumnarWriter(const std::string& path, unsigned int rowGroupSize, unsigned int maxQueuedGroups):
+  File(path.c_str(), std::ios::out | std::ios::trunc | std::ios::binary),
+  RowGroupSize(rowGroupSize), MaxQueuedGroups(maxQueuedGroups), Done(false), Written(0)
+{
+  if (!File) {
+    throw std::runtime_error("Could not open columnar output file " + path);
+  }
+  std::string hdr(COLUMNAR_MAGIC, 4);
+  putVarint(hdr, COLUMNAR_VERSION);
+  File.write(hdr.data(), hdr.size());
+  Written = hdr.size();
+
+  Cur.reserve(RowGroupSize);
+  Writer = std::thread(&ColumnarWriter::run, this);
+}
+
+ColumnarWriter::~ColumnarWriter() {
+  try {
+    close();
+  }
+  catch (std::exception& e) {
+    std::cerr << "Error writing columnar output: " << e.what() << std::endl;
+  }
+}
+
+void ColumnarWriter::push(const FileRecord& rec) {
+  // columns only cover name and meta fields, so attrs and their resident
+  // data aren't copied
+  Cur.push_back(FileRecord());
+  FileRecord& row(Cur.back());
+  row.ID = rec.ID;
+  row.Parent = rec.Parent;
+  row.Fs = rec.Fs;
+  row.Path = rec.Path;
+  row.HasName = rec.HasName;
+  if (rec.HasName) {
+    row.Name = rec.Name;
+  }
+  row.HasMeta = rec.HasMeta;
+  if (rec.HasMeta) {
+    const MetaRecord& m(rec.Meta);
+    row.Meta.Addr = m.Addr;
+    row.Meta.Flags = m.Flags;
+    row.Meta.Type = m.Type;
+    row.Meta.Size = m.Size;
+    row.Meta.Uid = m.Uid;
+    row.Meta.Gid = m.Gid;
+    row.Meta.Mode = m.Mode;
+    row.Meta.NLink = m.NLink;
+    row.Meta.Seq = m.Seq;
+    row.Meta.Accessed = m.Accessed;
+    row.Meta.Created = m.Created;
+    row.Meta.Metadata = m.Metadata;
+    row.Meta.Modified = m.Modified;
+  }
+  if (Cur.size() == RowGroupSize) {
+    enqueue();
+  }
+}
+
+void ColumnarWriter::enqueue() {
+  std::unique_lock<std::mutex> lock(Mutex);
+  if (!queueCur(lock)) {
+    std::rethrow_exception(Error);
+  }
+}
+
+bool ColumnarWriter::queueCur(std::unique_lock<std::mutex>& lock) {
+  NotFull.wait(lock, [this]{ return Queue.size() < MaxQueuedGroups || Error; });
+  if (Error) {
+    return false;
+  }
+  Queue.push_back(std::vector<FileRecord>());
+  Queue.back().swap(Cur);
+  Cur.reserve(RowGroupSize);
+  NotEmpty.notify_one();
+  return true;
+}
+
+void ColumnarWriter::close() {
+  if (!Writer.joinable()) {
+    return;
+  }
+  {
+    // the writer thread is always joined, even once it has failed, so that
+    // its error is rethrown rather than the thread left running
+    std::unique_lock<std::mutex> lock(Mutex);
+    if (!Cur.empty()) {
+      queueCur(lock);
+    }
+    Done = true;
+    NotEmpty.notify_one();
+  }
+  Writer.join();
+  if (Error) {
+    std::rethrow_exception(Error);
+  }
+
+  // footer
+  std::string footer;
+  putVarint(footer, Schema.size());
+  for (auto& c: Schema) {
+    putBytes(footer, c.Name);
+    putVarint(footer, c.Encoding);
+  }
+  putVarint(footer, Groups.size());
+  for (auto& g: Groups) {
+    putVarint(footer, g.Offset);
+    putVarint(footer, g.NumRows);
+    for (auto& c: g.Columns) {
+      putVarint(footer, c.Offset);
+      putVarint(footer, c.Length);
+      putVarint(footer, zigzag(c.Min));
+      putVarint(footer, zigzag(c.Max));
+    }
+  }
+  const uint64_t footerOffset = Written;
+  for (unsigned int i = 0; i < 8; ++i) {
+    footer.push_back(static_cast<char>((footerOffset >> (8 * i)) & 0xFF));
+  }
+  footer.append(COLUMNAR_MAGIC, 4);
+  File.write(footer.data(), footer.size());
+  File.close();
+  if (!File) {
+    throw std::runtime_error("Could not write columnar footer");
+  }
+}
+
+void ColumnarWriter::run() {
+  try {
+    std::string buf;
+    while (true) {
+      std::vector<FileRecord> rows;
+      {
+        std::unique_lock<std::mutex> lock(Mutex);
+        NotEmpty.wait(lock, [this]{ return !Queue.empty() || Done; });
+        if (Queue.empty()) {
+          return;
+        }
+        rows.swap(Queue.front());
+        Queue.pop_front();
+        NotFull.notify_one();
+      }
+      RowGroupInfo info;
+      info.Offset = Written;
+      buf.clear();
+      encodeRowGroup(buf, info, rows);
+      File.write(buf.data(), buf.size());
+      if (!File) {
+        throw std::runtime_error("Could not write columnar row group");
+      }
+      Written += buf.size();
+      Groups.push_back(info);
+    }
+  }
+  catch (...) {
+    std::lock_guard<std::mutex> lock(Mutex);
+    Error = std::current_exception();
+    NotFull.notify_all();
+  }
+}
+/*************************************************************************/
+
+ColumnarReader::ColumnarReader(std::istream& in): In(in) {
+  char trailer[12];
+  In.seekg(-12, std::ios::end);
+  const uint64_t footerEnd = In.tellg();
+  if (!In.read(trailer, sizeof(trailer)) || std::memcmp(&trailer[8], COLUMNAR_MAGIC, 4)) {
+    throw std::runtime_error("Input is not an fsrip columnar file");
+  }
+  uint64_t footerOffset = 0;
+  for (unsigned int i = 0; i < 8; ++i) {
+    footerOffset |= static_cast<uint64_t>(static_cast<unsigned char>(trailer[i])) << (8 * i);
+  }
+  if (footerOffset > footerEnd) {
+    throw std::runtime_error("Corrupt columnar footer offset");
+  }
+  std::string footer(footerEnd - footerOffset, '\0');
+  In.seekg(footerOffset);
+  if (!In.read(&footer[0], footer.size())) {
+    throw std::runtime_error("Truncated columnar footer");
+  }
+  const unsigned char* cur = reinterpret_cast<const unsigned char*>(footer.data());
+  const unsigned char* end = cur + footer.size();
+
+  const uint64_t numCols = getVarint(cur, end);
+  if (numCols != Schema.size()) {
+    throw std::runtime_error("Columnar file has an unexpected schema");
+  }
+  for (uint64_t i = 0; i < numCols; ++i) {
+    if (getBytes(cur, end) != Schema[i].Name || getVarint(cur, end) != Schema[i].Encoding) {
+      throw std::runtime_error("Columnar file has an unexpected schema");
+    }
+  }
+  Groups.resize(getVarint(cur, end));
+  for (auto& g: Groups) {
+    g.Offset = getVarint(cur, end);
+    g.NumRows = getVarint(cur, end);
+    g.Columns.resize(numCols);
+    for (auto& c: g.Columns) {
+      c.Offset = getVarint(cur, end);
+      c.Length = getVarint(cur, end);
+      c.Min = unzigzag(getVarint(cur, end));
+      c.Max = unzigzag(getVarint(cur, end));
+    }
+  }
+}
+
+int ColumnarReader::column(const std::string& name) const {
+  for (unsigned int i = 0; i < Schema.size(); ++i) {
+    if (Schema[i].Name == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+const std::string& ColumnarReader::chunk(unsigned int group, unsigned int col, unsigned int encoding) {
+  const RowGroupInfo& g(Groups.at(group));
+  const ColumnChunk& c(g.Columns.at(col));
+  if (Schema[col].Encoding != encoding) {
+    throw std::runtime_error("Column " + Schema[col].Name + " read with the wrong type");
+  }
+  Buf.resize(c.Length);
+  In.clear();
+  In.seekg(g.Offset + c.Offset);
+  if (c.Length && !In.read(&Buf[0], c.Length)) {
+    throw std::runtime_error("Truncated columnar chunk");
+  }
+  return Buf;
+}
+
+void ColumnarReader::readUInts(unsigned int group, unsigned int col, std::vector<uint64_t>& vals) {
+  const bool delta = Schema.at(col).Encoding == DELTA_INT;
+  const std::string& data(chunk(group, col, delta ? DELTA_INT: PLAIN_UINT));
+  const unsigned char* cur = reinterpret_cast<const unsigned char*>(data.data());
+  const unsigned char* end = cur + data.size();
+
+  vals.resize(Groups[group].NumRows);
+  uint64_t prev = 0;
+  for (auto& v: vals) {
+    if (delta) {
+      prev += static_cast<uint64_t>(unzigzag(getVarint(cur, end)));
+      v = prev;
+    }
+    else {
+      v = getVarint(cur, end);
+    }
+  }
+}
+
+void ColumnarReader::readInts(unsigned int group, unsigned int col, std::vector<int64_t>& vals) {
+  std::vector<uint64_t> u;
+  readUInts(group, col, u);
+  vals.assign(u.begin(), u.end());
+}
+
+void ColumnarReader::readStrings(unsigned int group, unsigned int col, std::vector<std::string>& vals) {
+  const bool dict = Schema.at(col).Encoding == DICT_STRING;
+  const std::string& data(chunk(group, col, dict ? DICT_STRING: PLAIN_STRING));
+  const unsigned char* cur = reinterpret_cast<const unsigned char*>(data.data());
+  const unsigned char* end = cur + data.size();
+
+  vals.resize(Groups[group].NumRows);
+  if (dict) {
+    std::vector<std::string> entries(getVarint(cur, end));
+    for (auto& e: entries) {
+      e = getBytes(cur, end);
+    }
+    for (auto& v: vals) {
+      v = entries.at(getVarint(cur, end));
+    }
+  }
+  else {
+    for (auto& v: vals) {
+      v = getBytes(cur, end);
+    }
+  }
+}
+
+void ColumnarReader::readTimes(unsigned int group, unsigned int col, std::vector<Timestamp>& vals) {
+  const std::string& data(chunk(group, col, DELTA_TIME));
+  const unsigned char* cur = reinterpret_cast<const unsigned char*>(data.data());
+  const unsigned char* end = cur + data.size();
+
+  vals.resize(Groups[group].NumRows);
+  uint64_t prev = 0;
+  for (auto& v: vals) {
+    prev += static_cast<uint64_t>(unzigzag(getVarint(cur, end)));
+    v.Secs = static_cast<int64_t>(prev);
+    v.Nanos = getVarint(cur, end);
+  }
+}
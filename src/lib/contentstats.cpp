@@ -0,0 +1,100 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "contentstats.h"
+
+#include <cmath>
+#include <cstring>
+
+ContentStats::ContentStats() {
+  std::memset(Counts, 0, sizeof(Counts));
+}
+
+void ContentStats::update(const char* data, size_t len) {
+  const unsigned char* b = reinterpret_cast<const unsigned char*>(data);
+  const unsigned char* end = b + len;
+  for (; b + NUM_TABLES <= end; b += NUM_TABLES) {
+    ++Counts[0][b[0]];
+    ++Counts[1][b[1]];
+    ++Counts[2][b[2]];
+    ++Counts[3][b[3]];
+  }
+  for (; b < end; ++b) {
+    ++Counts[0][*b];
+  }
+}
+
+StatsRecord ContentStats::finish() const {
+  uint64_t counts[256];
+  uint64_t size = 0;
+  for (unsigned int c = 0; c < 256; ++c) {
+    counts[c] = 0;
+    for (unsigned int t = 0; t < NUM_TABLES; ++t) {
+      counts[c] += Counts[t][c];
+    }
+    size += counts[c];
+  }
+
+  StatsRecord ret;
+  ret.Size = size;
+  ret.Entropy = ret.ZeroRatio = ret.TextRatio = 0;
+  ret.Histogram.assign(16, '\0');
+  if (!size) {
+    return ret;
+  }
+
+  uint64_t text = counts['\t'] + counts['\n'] + counts['\r'];
+  uint64_t bins[16] = {0};
+  for (unsigned int c = 0; c < 256; ++c) {
+    if (counts[c]) {
+      const double p = static_cast<double>(counts[c]) / size;
+      ret.Entropy -= p * std::log2(p);
+    }
+    if (0x20 <= c && c < 0x7f) {
+      text += counts[c];
+    }
+    bins[c >> 4] += counts[c];
+  }
+  ret.ZeroRatio = static_cast<double>(counts[0]) / size;
+  ret.TextRatio = static_cast<double>(text) / size;
+  for (unsigned int i = 0; i < 16; ++i) {
+    ret.Histogram[i] = static_cast<char>((bins[i] * 255 + size / 2) / size);
+  }
+  return ret;
+}
+
+StatsRecord statsData(const char* data, size_t len) {
+  ContentStats s;
+  s.update(data, len);
+  return s.finish();
+}
+
+namespace {
+  const double TEXT_BLOCK_MIN_RATIO = 0.95,
+               HIGH_ENTROPY_MIN     = 7.5;
+}
+
+BlockClass classifyBlock(const char* data, size_t len) {
+  // most of a disk is often zeros, which needn't be counted
+  if (!len || std::memcmp(data, data + 1, len - 1) == 0) {
+    return !len || !data[0] ? ZERO_BLOCK: CONSTANT_BLOCK;
+  }
+  const StatsRecord s(statsData(data, len));
+  if (s.TextRatio >= TEXT_BLOCK_MIN_RATIO) {
+    return TEXT_BLOCK;
+  }
+  return s.Entropy >= HIGH_ENTROPY_MIN ? HIGH_ENTROPY_BLOCK: LOW_ENTROPY_BLOCK;
+}
+
+const char* blockClassName(BlockClass c) {
+  switch (c) {
+    case ZERO_BLOCK:         return "zero";
+    case CONSTANT_BLOCK:     return "constant";
+    case LOW_ENTROPY_BLOCK:  return "low_entropy";
+    case TEXT_BLOCK:         return "text";
+    case HIGH_ENTROPY_BLOCK: return "high_entropy";
+    case UNREADABLE_BLOCK:   return "unreadable";
+    default:                 return "unknown";
+  }
+}
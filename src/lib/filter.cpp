@@ -0,0 +1,456 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "filter.h"
+
+#include "enums.h"
+#include "tsk.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <regex>
+#include <stdexcept>
+
+struct FileFilter::Node {
+  enum KIND {
+    AND,
+    OR,
+    NOT,
+    ALLOCATED,
+    DELETED,
+    PATH,
+    NAME,
+    TYPE,
+    SIZE,
+    MODIFIED,
+    ACCESSED,
+    CREATED,
+    METADATA
+  };
+
+  enum OP {
+    EQ,
+    NE,
+    LT,
+    LE,
+    GT,
+    GE,
+    MATCH,   // regex
+    NO_MATCH
+  };
+
+  KIND        Kind;
+  OP          Op;
+  std::string Value;
+  std::regex  Re;
+  int64_t     Num;
+
+  std::shared_ptr<Node> Left,
+                        Right;
+};
+
+namespace {
+  typedef FileFilter::Node Node;
+
+  char lower(char c) {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+
+  bool iequals(const std::string& a, const std::string& b) {
+    if (a.size() != b.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+      if (lower(a[i]) != lower(b[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool globMatch(const char* g, const char* s) {
+    while (*g) {
+      if (*g == '*') {
+        const bool crossesDirs = g[1] == '*';
+        g += crossesDirs ? 2: 1;
+        for (const char* t = s; ; ++t) {
+          if (globMatch(g, t)) {
+            return true;
+          }
+          if (!*t || (!crossesDirs && *t == '/')) {
+            return false;
+          }
+        }
+      }
+      if (!*s || (*g == '?' ? *s == '/': lower(*g) != lower(*s))) {
+        return false;
+      }
+      ++g;
+      ++s;
+    }
+    return !*s;
+  }
+
+  // days since 1970-01-01 of a proleptic Gregorian date
+  int64_t daysFromCivil(int64_t y, unsigned int m, unsigned int d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y: y - 399) / 400;
+    const unsigned int yoe = static_cast<unsigned int>(y - era * 400),
+                       doy = (153 * (m + (m > 2 ? -3: 9)) + 2) / 5 + d - 1,
+                       doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+  }
+
+  int64_t parseTime(const std::string& val) {
+    unsigned int y = 0, mo = 0, d = 0, h = 0, mi = 0, sec = 0;
+    char trail = 0;
+    if (val.find('-') == std::string::npos) {
+      size_t used = 0;
+      const int64_t ret = std::stoll(val, &used);
+      if (used != val.size()) {
+        throw std::invalid_argument("bad time " + val);
+      }
+      return ret;
+    }
+    const int n = std::sscanf(val.c_str(), "%4u-%2u-%2u%*[T ]%2u:%2u:%2u%c", &y, &mo, &d, &h, &mi, &sec, &trail);
+    if (n < 3 || mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59 || sec > 60
+        || (n == 7 && trail != 'Z'))
+    {
+      throw std::invalid_argument("bad time " + val);
+    }
+    return daysFromCivil(y, mo, d) * 86400 + h * 3600 + mi * 60 + sec;
+  }
+
+  int64_t parseSize(const std::string& val) {
+    size_t used = 0;
+    int64_t ret = std::stoll(val, &used);
+    const std::string suffix(val.substr(used));
+    if (suffix == "K" || suffix == "k") {
+      ret <<= 10;
+    }
+    else if (suffix == "M" || suffix == "m") {
+      ret <<= 20;
+    }
+    else if (suffix == "G" || suffix == "g") {
+      ret <<= 30;
+    }
+    else if (!suffix.empty()) {
+      throw std::invalid_argument("bad size " + val);
+    }
+    return ret;
+  }
+
+  template<class T>
+  bool compare(Node::OP op, const T& a, const T& b) {
+    switch (op) {
+      case Node::EQ: return a == b;
+      case Node::NE: return !(a == b);
+      case Node::LT: return a < b;
+      case Node::LE: return !(b < a);
+      case Node::GT: return b < a;
+      case Node::GE: return !(a < b);
+      default:       return false;
+    }
+  }
+
+  class Parser {
+  public:
+    Parser(const std::string& expr): Expr(expr), Pos(0) {}
+
+    std::shared_ptr<Node> parse() {
+      std::shared_ptr<Node> ret(parseOr());
+      skipSpace();
+      if (Pos != Expr.size()) {
+        fail("unexpected '" + Expr.substr(Pos) + "'");
+      }
+      return ret;
+    }
+
+  private:
+    void fail(const std::string& msg) const {
+      throw std::invalid_argument("Bad filter: " + msg);
+    }
+
+    void skipSpace() {
+      while (Pos < Expr.size() && std::isspace(static_cast<unsigned char>(Expr[Pos]))) {
+        ++Pos;
+      }
+    }
+
+    bool isWordChar(char c) const {
+      return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    }
+
+    std::string peekWord() {
+      skipSpace();
+      size_t end = Pos;
+      while (end < Expr.size() && isWordChar(Expr[end])) {
+        ++end;
+      }
+      return Expr.substr(Pos, end - Pos);
+    }
+
+    bool acceptWord(const std::string& w) {
+      if (peekWord() == w) {
+        Pos += w.size();
+        return true;
+      }
+      return false;
+    }
+
+    bool accept(char c) {
+      skipSpace();
+      if (Pos < Expr.size() && Expr[Pos] == c) {
+        ++Pos;
+        return true;
+      }
+      return false;
+    }
+
+    std::shared_ptr<Node> makeNode(Node::KIND kind, std::shared_ptr<Node> left = nullptr, std::shared_ptr<Node> right = nullptr) {
+      std::shared_ptr<Node> ret(new Node());
+      ret->Kind = kind;
+      ret->Op = Node::EQ;
+      ret->Num = 0;
+      ret->Left = left;
+      ret->Right = right;
+      return ret;
+    }
+
+    std::shared_ptr<Node> parseOr() {
+      std::shared_ptr<Node> ret(parseAnd());
+      while (acceptWord("or")) {
+        ret = makeNode(Node::OR, ret, parseAnd());
+      }
+      return ret;
+    }
+
+    std::shared_ptr<Node> parseAnd() {
+      std::shared_ptr<Node> ret(parseUnary());
+      while (acceptWord("and")) {
+        ret = makeNode(Node::AND, ret, parseUnary());
+      }
+      return ret;
+    }
+
+    std::shared_ptr<Node> parseUnary() {
+      if (acceptWord("not")) {
+        return makeNode(Node::NOT, parseUnary());
+      }
+      if (accept('(')) {
+        std::shared_ptr<Node> ret(parseOr());
+        if (!accept(')')) {
+          fail("missing ')'");
+        }
+        return ret;
+      }
+      return parseTerm();
+    }
+
+    Node::OP parseOp() {
+      skipSpace();
+      static const std::pair<const char*, Node::OP> ops[] = {
+        {"<=", Node::LE}, {">=", Node::GE}, {"!=", Node::NE}, {"!~", Node::NO_MATCH},
+        {"<", Node::LT}, {">", Node::GT}, {"=", Node::EQ}, {"~", Node::MATCH}
+      };
+      for (auto& op: ops) {
+        if (Expr.compare(Pos, std::strlen(op.first), op.first) == 0) {
+          Pos += std::strlen(op.first);
+          return op.second;
+        }
+      }
+      fail("expected an operator at '" + Expr.substr(Pos) + "'");
+      return Node::EQ;
+    }
+
+    std::string parseValue() {
+      skipSpace();
+      if (Pos < Expr.size() && (Expr[Pos] == '\'' || Expr[Pos] == '"')) {
+        const char quote = Expr[Pos++];
+        const size_t end = Expr.find(quote, Pos);
+        if (end == std::string::npos) {
+          fail("unterminated quote");
+        }
+        std::string ret(Expr.substr(Pos, end - Pos));
+        Pos = end + 1;
+        return ret;
+      }
+      const size_t beg = Pos;
+      while (Pos < Expr.size() && !std::isspace(static_cast<unsigned char>(Expr[Pos])) && Expr[Pos] != ')') {
+        ++Pos;
+      }
+      if (beg == Pos) {
+        fail("expected a value");
+      }
+      return Expr.substr(beg, Pos - beg);
+    }
+
+    std::shared_ptr<Node> parseTerm() {
+      static const std::pair<const char*, Node::KIND> fields[] = {
+        {"path", Node::PATH}, {"name", Node::NAME}, {"type", Node::TYPE}, {"size", Node::SIZE},
+        {"modified", Node::MODIFIED}, {"accessed", Node::ACCESSED}, {"created", Node::CREATED},
+        {"metadata", Node::METADATA}
+      };
+      const std::string word(peekWord());
+      Pos += word.size();
+      if (word == "allocated") {
+        return makeNode(Node::ALLOCATED);
+      }
+      else if (word == "deleted") {
+        return makeNode(Node::DELETED);
+      }
+      for (auto& field: fields) {
+        if (word == field.first) {
+          std::shared_ptr<Node> ret(makeNode(field.second));
+          ret->Op = parseOp();
+          ret->Value = parseValue();
+          checkTerm(*ret);
+          return ret;
+        }
+      }
+      fail(word.empty() ? "expected a term at '" + Expr.substr(Pos) + "'": "unknown field '" + word + "'");
+      return nullptr;
+    }
+
+    void checkTerm(Node& n) {
+      const bool ordered = n.Op != Node::EQ && n.Op != Node::NE && n.Op != Node::MATCH && n.Op != Node::NO_MATCH,
+                 regex = n.Op == Node::MATCH || n.Op == Node::NO_MATCH;
+      switch (n.Kind) {
+        case Node::PATH:
+        case Node::NAME:
+          if (ordered) {
+            fail("path and name take =, !=, ~, or !~");
+          }
+          if (regex) {
+            try {
+              n.Re = std::regex(n.Value);
+            }
+            catch (std::regex_error& e) {
+              fail("bad regex '" + n.Value + "'");
+            }
+          }
+          break;
+        case Node::TYPE:
+          if (ordered || regex) {
+            fail("type takes = or !=");
+          }
+          break;
+        case Node::SIZE:
+          if (regex) {
+            fail("size takes a comparison");
+          }
+          try {
+            n.Num = parseSize(n.Value);
+          }
+          catch (std::logic_error&) {
+            fail("bad size '" + n.Value + "'");
+          }
+          break;
+        default: // times
+          if (regex) {
+            fail("times take a comparison");
+          }
+          try {
+            n.Num = parseTime(n.Value);
+          }
+          catch (std::logic_error&) {
+            fail("bad time '" + n.Value + "'");
+          }
+          break;
+      }
+    }
+
+    const std::string& Expr;
+    size_t             Pos;
+  };
+
+  bool isAllocated(const FileRecord& rec) {
+    if (rec.HasName) {
+      return rec.Name.Flags & TSK_FS_NAME_FLAG_ALLOC;
+    }
+    return rec.HasMeta && (rec.Meta.Flags & TSK_FS_META_FLAG_ALLOC);
+  }
+
+  bool typeMatches(const std::string& val, const FileRecord& rec) {
+    const std::string type(rec.HasName ? nameType(rec.Name.Type): (rec.HasMeta ? metaType(rec.Meta.Type): ""));
+    return iequals(val, type)
+      || (type == "File" && iequals(val, "reg"))
+      || (type == "Folder" && iequals(val, "dir"))
+      || (type == "Symbolic Link" && iequals(val, "link"));
+  }
+
+  bool stringMatches(const Node& n, const std::string& s) {
+    switch (n.Op) {
+      case Node::EQ:       return globMatch(n.Value.c_str(), s.c_str());
+      case Node::NE:       return !globMatch(n.Value.c_str(), s.c_str());
+      case Node::MATCH:    return std::regex_search(s, n.Re);
+      case Node::NO_MATCH: return !std::regex_search(s, n.Re);
+      default:             return false;
+    }
+  }
+
+  bool timeMatches(const Node& n, const FileRecord& rec) {
+    if (!rec.HasMeta) {
+      return false;
+    }
+    const Timestamp* ts = nullptr;
+    switch (n.Kind) {
+      case Node::MODIFIED: ts = &rec.Meta.Modified; break;
+      case Node::ACCESSED: ts = &rec.Meta.Accessed; break;
+      case Node::CREATED:  ts = &rec.Meta.Created; break;
+      default:             ts = &rec.Meta.Metadata; break;
+    }
+    return compare(n.Op, ts->Secs, n.Num);
+  }
+
+  bool evaluate(const Node& n, const FileRecord& rec) {
+    switch (n.Kind) {
+      case Node::AND:       return evaluate(*n.Left, rec) && evaluate(*n.Right, rec);
+      case Node::OR:        return evaluate(*n.Left, rec) || evaluate(*n.Right, rec);
+      case Node::NOT:       return !evaluate(*n.Left, rec);
+      case Node::ALLOCATED: return isAllocated(rec);
+      case Node::DELETED:   return !isAllocated(rec);
+      case Node::PATH:      return stringMatches(n, rec.Path + (rec.HasName ? rec.Name.Name: ""));
+      case Node::NAME:      return rec.HasName && stringMatches(n, rec.Name.Name);
+      case Node::TYPE:      return typeMatches(n.Value, rec) == (n.Op == Node::EQ);
+      case Node::SIZE:      return rec.HasMeta && compare(n.Op, static_cast<int64_t>(rec.Meta.Size), n.Num);
+      default:              return timeMatches(n, rec);
+    }
+  }
+
+  bool mayMatchUnder(const Node& n, const std::string& dir) {
+    switch (n.Kind) {
+      case Node::AND:
+        return mayMatchUnder(*n.Left, dir) && mayMatchUnder(*n.Right, dir);
+      case Node::OR:
+        return mayMatchUnder(*n.Left, dir) || mayMatchUnder(*n.Right, dir);
+      case Node::PATH:
+        if (n.Op == Node::EQ) {
+          // every path under dir starts with it, so it has to agree with
+          // the glob up to the first wildcard
+          const size_t literal = std::min(n.Value.find_first_of("*?"), n.Value.size());
+          const size_t len = std::min(literal, dir.size());
+          for (size_t i = 0; i < len; ++i) {
+            if (lower(n.Value[i]) != lower(dir[i])) {
+              return false;
+            }
+          }
+        }
+        return true;
+      default:
+        return true; // depends on the file, or too hard to tell
+    }
+  }
+}
+
+FileFilter::FileFilter(const std::string& expr): Root(Parser(expr).parse()) {}
+
+bool FileFilter::matches(const FileRecord& rec) const {
+  return evaluate(*Root, rec);
+}
+
+bool FileFilter::mayMatchUnder(const std::string& dir) const {
+  return ::mayMatchUnder(*Root, dir);
+}
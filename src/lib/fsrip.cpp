@@ -1,5 +1,6 @@
 #include "fsrip.h"
 
+#include <cstdio>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -14,20 +15,52 @@
 #include <boost/scoped_array.hpp>
 
 #include "walkers.h"
+#include "hashset.h"
+#include "asyncwriter.h"
+#include "bgzf.h"
+#include "threadpool.h"
 #include "enums.h"
 #include "util.h"
 #include "jsonhelp.h"
+#include "jsonrec.h"
+#include "imageservice.h"
 
 namespace po = boost::program_options;
 
 struct Options {
   std::string Command,
               UCMode,
+              Format,
+              Order,
               VolMode,
               OverviewFile,
               InodeMapFile,
-              DiskMapFile;
-  uint64_t    MaxUcBlockSize;
+              DiskMapFile,
+              ColumnarFile,
+              Filter,
+              Fields,
+              KeywordFile,
+              Address,
+              CatalogFile,
+              SqliteFile;
+  uint64_t    MaxUcBlockSize,
+              RegionSize;
+  bool        DirTable,
+              Compress,
+              OutputStats,
+              Hash,
+              Dedup,
+              IgnoreCase,
+              CarveContents,
+              Sniff,
+              Stats;
+  int         CompressLevel;
+  std::string CompressIndexFile;
+  unsigned int NumThreads;
+  unsigned short Port;
+  std::vector<std::string> KnownHashes,
+                           Keywords,
+                           Keys;
 };
 
 
@@ -55,137 +88,108 @@ std::shared_ptr<LbtTskAuto> createVisitor(const std::string& cmd, std::ostream&
   else if (cmd == "dumpfs") {
     return std::shared_ptr<LbtTskAuto>(new MetadataWriter(out));
   }
-  else if (cmd == "dumpfiles") {
+  else if (cmd == "dumpfiles" || cmd == "hashfiles") {
     return std::shared_ptr<LbtTskAuto>(new FileWriter(out));
   }
+  else if (cmd == "dumpunalloc") {
+    return std::shared_ptr<LbtTskAuto>(new SpaceWriter(out, SpaceWriter::UNALLOCATED));
+  }
+  else if (cmd == "dumpslack") {
+    return std::shared_ptr<LbtTskAuto>(new SpaceWriter(out, SpaceWriter::SLACK));
+  }
+  else if (cmd == "search") {
+    return std::shared_ptr<LbtTskAuto>(new SearchWriter(out));
+  }
+  else if (cmd == "carve") {
+    return std::shared_ptr<LbtTskAuto>(new CarveWriter(out));
+  }
+  else if (cmd == "blockmap") {
+    return std::shared_ptr<LbtTskAuto>(new BlockMapWriter(out));
+  }
+  else if (cmd == "sstable") {
+    return std::shared_ptr<LbtTskAuto>(new SSTableWriter(out));
+  }
   else {
     return std::shared_ptr<LbtTskAuto>();
   }
 }
 
 
-void outputDiskMap(const std::string& diskMapFile, std::shared_ptr<LbtTskAuto> w) {
-  // std::cerr << "outputDiskMap" << std::endl;
+void outputDiskMap(const std::string& diskMapFile, std::shared_ptr<LbtTskAuto> w, std::shared_ptr<SqliteWriter> db) {
   auto walker(std::dynamic_pointer_cast<MetadataWriter>(w));
   if (walker) {
-    std::ofstream file(diskMapFile, std::ios::out | std::ios::trunc);
-
-    auto map(walker->diskMap());
-    auto& reverseMap(walker->reverseMap());
-    for (auto fsMapInfo: map) {
-      auto layout = fsMapInfo.second.Runs;
-      for (auto frag: layout) {
-        uint64_t begin = frag.first.lower(),
-                 end   = frag.first.upper();
-        file  << "{" << j("id", makeDiskMapID(frag.first.lower()), true)
-              << ",\"t\": { \"i\": { "
-              << j("b", begin, true)
-              << j("l", end - frag.first.lower())
-              << ", \"f\":[";
-        bool firstFile = true;
-        for (auto f: frag.second) {
-          if (frag.second.size() > 1) {
-            // conflict!
-          }
-          InodeInfo& inode(reverseMap[fsMapInfo.first][f.Inum]);
-          AttrInfo&  attr(inode.getOrInsertAttr(f.AttrID));
-          attr.addRun(f.Slack, Run{f.Offset + (begin - f.DRBeg), begin, end});
-
-          if (!firstFile) {
-            file << ", ";
-          }
-          file  << "{"
-                << j("vol", fsMapInfo.first, true)
-                << j("inum", static_cast<int64_t>(f.Inum))
-                << j("attrId", f.AttrID)
-                << j("s", f.Slack)
-                << j("drbeg", f.DRBeg)
-                << j("fo", f.Offset)
-                << "}";
-          firstFile = false;
-        }
-        file << "]}}}\n";
-      }
+    // --sqlite may want the map without the file
+    std::unique_ptr<std::ofstream> file;
+    if (!diskMapFile.empty()) {
+      file.reset(new std::ofstream(diskMapFile, std::ios::out | std::ios::trunc));
     }
-    file.close();
+    walker->writeDiskMap([&file, &db](const std::string& id, const std::string& line) {
+      if (file) {
+        *file << line;
+      }
+      if (db) {
+        db->pushDiskMap(id, line);
+      }
+    });
   }
 }
 
 
-void outputInodeMap(const std::string& inodeMapFile, std::shared_ptr<LbtTskAuto> w) {
+void outputInodeMap(const std::string& inodeMapFile, std::shared_ptr<LbtTskAuto> w, std::shared_ptr<SqliteWriter> db) {
   auto walker(std::dynamic_pointer_cast<MetadataWriter>(w));
   if (walker) {
-    std::ofstream file(inodeMapFile, std::ios::out | std::ios::trunc);
-
-    const auto& reverseMap(walker->reverseMap());
-    for (auto fsReverseMap: reverseMap) {
-      uint32_t volIndex(fsReverseMap.first);
-
-      for (auto inodeMap: fsReverseMap.second) {
-        std::string s = makeInodeID(volIndex, inodeMap.first);
-
-        file << "{ \"id\":\"" << s
-             << "\", \"t\": { \"hardlinks\":[";
+    // --sqlite may want the map without the file
+    std::unique_ptr<std::ofstream> file;
+    if (!inodeMapFile.empty()) {
+      file.reset(new std::ofstream(inodeMapFile, std::ios::out | std::ios::trunc));
+    }
+    walker->writeInodeMap([&file, &db](const std::string& id, const std::string& line) {
+      if (file) {
+        *file << line;
+      }
+      if (db) {
+        db->pushInode(id, line);
+      }
+    });
+  }
+}
 
-        bool first = true;
-        for (auto fileID: inodeMap.second.DirentIDs) {
-          if (!first) {
-            file << ", ";
-          }
-          file << "\"" << fileID << "\"";
-          first = false;
-        }
-        file << "], \"attrData\":[";
-        first = true;
-        for (auto attr: inodeMap.second.Attrs) {
-          if (!first) {
-            file << ", ";
-          }
-          file << "{";
-          file << j("id", attr.ID, true)
-               << j("type", attr.Type)
-               << j("size", attr.Size)
-               << j("slack_size", attr.SlackSize)
-               << j("resident", attr.Resident)
-               << j("resident_data", attr.ResidentData);
-          file << ",\"runs\":[";
-          bool firstRun = true;
-          for (auto run: attr.Runs) {
-            if (!firstRun) {
-              file << ",";
-            }
-            file << "{";
-            file << j("fo", run.FileOffset, true);
-            file << j("start", run.Start);
-            file << j("end", run.End);
-            file << "}";
-            firstRun = false;
-          }
-          file << "],\"slack_runs\":[";
-          firstRun = true;
-          for (auto run: attr.SlackRuns) {
-            if (!firstRun) {
-              file << ",";
-            }
-            file << "{";
-            file << j("fo", run.FileOffset, true);
-            file << j("start", run.Start);
-            file << j("end", run.End);
-            file << "}";
-            firstRun = false;
-          }
-          file << "]";
-          file << "}";
-          first = false;
-        }
-        file << "]}}\n";
+std::vector<std::string> loadKeywords(const Options& opts) {
+  std::vector<std::string> ret(opts.Keywords);
+  if (!opts.KeywordFile.empty()) {
+    std::ifstream file(opts.KeywordFile.c_str(), std::ios::in | std::ios::binary);
+    if (!file) {
+      throw std::runtime_error("could not open " + opts.KeywordFile);
+    }
+    // one per line; blank lines are skipped
+    std::string line;
+    while (std::getline(file, line)) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      if (!line.empty()) {
+        ret.push_back(line);
       }
     }
-    file.close();
   }
+  return ret;
 }
 
-int process(std::shared_ptr<LbtTskAuto> walker, const std::vector< std::string >&  imgSegs, const po::variables_map& vm, const Options& opts) {
+HashSets loadHashSets(const std::vector<std::string>& paths) {
+  HashSets ret;
+  for (const std::string& path: paths) {
+    // records are tagged with the file's name, minus directory and extension
+    std::string name(path.substr(path.find_last_of("/\\") + 1));
+    name = name.substr(0, name.find('.'));
+    if (name.empty()) {
+      name = path;
+    }
+    ret.push_back(std::make_shared<HashSet>(path, name));
+  }
+  return ret;
+}
+
+int process(std::shared_ptr<LbtTskAuto> walker, const std::vector< std::string >&  imgSegs, const Options& opts, std::shared_ptr<ThreadPool> pool) {
   // convert to C string array
   boost::scoped_array< const char* >  segments(new const char*[imgSegs.size()]);
   for (unsigned int i = 0; i < imgSegs.size(); ++i) {
@@ -210,14 +214,87 @@ int process(std::shared_ptr<LbtTskAuto> walker, const std::vector< std::string >
     else {
       walker->setUnallocatedMode(LbtTskAuto::NONE);
     }
+    std::shared_ptr<SqliteWriter> db;
+    if (opts.Format == "binary") {
+      walker->setOutputFormat(LbtTskAuto::BINARY);
+    }
+    else {
+      walker->setOutputFormat(LbtTskAuto::JSON);
+    }
+    if (auto mw = std::dynamic_pointer_cast<MetadataWriter>(walker)) {
+      if (!opts.ColumnarFile.empty()) {
+        mw->setColumnarOutput(std::make_shared<ColumnarWriter>(opts.ColumnarFile));
+      }
+      if (!opts.SqliteFile.empty()) {
+        db = std::make_shared<SqliteWriter>(opts.SqliteFile);
+        mw->setSqliteOutput(db);
+      }
+      mw->setDirTable(opts.DirTable);
+      mw->setSniff(opts.Sniff);
+      if (!opts.Filter.empty()) {
+        mw->setFilter(std::make_shared<FileFilter>(opts.Filter));
+      }
+      if (!opts.Fields.empty()) {
+        mw->setFields(parseFields(opts.Fields));
+        mw->setMapsNeeded(!opts.DiskMapFile.empty() || !opts.InodeMapFile.empty() || db);
+      }
+      if (auto fw = std::dynamic_pointer_cast<FileWriter>(walker)) {
+        if (opts.Command == "hashfiles") {
+          // records only, with hashes, reading the disk front to back
+          fw->setPhysicalOrder(true);
+          fw->setContentOutput(false);
+          fw->setHashPool(pool);
+        }
+        else {
+          fw->setPhysicalOrder(opts.Order == "physical");
+          fw->setDedup(opts.Dedup);
+          if (opts.Hash) {
+            fw->setHashPool(pool);
+          }
+        }
+        if (opts.Stats) {
+          // counted while the contents are read for hashing
+          fw->setHashPool(pool);
+          fw->setStats(true);
+        }
+        if (!opts.KnownHashes.empty()) {
+          // dumpfiles needs the hashes too, to know what to leave out
+          fw->setHashPool(pool);
+          fw->setKnownHashes(loadHashSets(opts.KnownHashes));
+        }
+      }
+      if (auto sw = std::dynamic_pointer_cast<SearchWriter>(walker)) {
+        sw->setMatcher(std::make_shared<PatternMatcher>(loadKeywords(opts), opts.IgnoreCase));
+        sw->setSearchPool(pool);
+      }
+      if (auto cw = std::dynamic_pointer_cast<CarveWriter>(walker)) {
+        cw->setCarvePool(pool);
+        cw->setContentOutput(opts.CarveContents);
+      }
+      if (auto bw = std::dynamic_pointer_cast<BlockMapWriter>(walker)) {
+        bw->setRegionSize(opts.RegionSize);
+        bw->setClassifyPool(pool);
+      }
+      if (auto stw = std::dynamic_pointer_cast<SSTableWriter>(walker)) {
+        stw->setSortPool(pool);
+      }
+      if (opts.NumThreads > 1 && opts.Command == "dumpfs") {
+        // dumpfiles interleaves contents with records, so formats inline
+        mw->setFormatterPool(pool);
+      }
+    }
     if (0 == walker->start()) {
       walker->startUnallocated();
       walker->finishWalk();
-      if (vm.count("disk-map-file") && opts.Command == "dumpfs") {
-        outputDiskMap(opts.DiskMapFile, walker);
+      if ((!opts.DiskMapFile.empty() || db) && opts.Command == "dumpfs") {
+        outputDiskMap(opts.DiskMapFile, walker, db);
       }
-      if (vm.count("inode-map-file") && opts.Command == "dumpfs") {
-        outputInodeMap(opts.InodeMapFile, walker);
+      if ((!opts.InodeMapFile.empty() || db) && opts.Command == "dumpfs") {
+        outputInodeMap(opts.InodeMapFile, walker, db);
+      }
+      if (db) {
+        // after the maps, which go in with the records
+        db->close();
       }
       return 0;
     }
@@ -238,6 +315,116 @@ int process(std::shared_ptr<LbtTskAuto> walker, const std::vector< std::string >
   return 1;
 }
 
+// Walks the evidence to make a catalog of it anew. Segment identities are
+// taken first, so that a change during the walk leaves the catalog stale.
+std::shared_ptr<Catalog> buildCatalog(const std::string& path, const std::vector<std::string>& imgSegs) {
+  const std::vector<SegmentIdentity> ids(segmentIdentities(imgSegs));
+
+  std::ostream  nowhere(nullptr);
+  CatalogWriter walker(nowhere, imgSegs);
+  boost::scoped_array< const char* >  segments(new const char*[imgSegs.size()]);
+  for (unsigned int i = 0; i < imgSegs.size(); ++i) {
+    segments[i] = imgSegs[i].c_str();
+  }
+  if (0 != walker.openImageUtf8(imgSegs.size(), segments.get(), TSK_IMG_TYPE_DETECT, 0)) {
+    throw std::runtime_error("could not open the evidence files");
+  }
+  walker.setVolFilterFlags((TSK_VS_PART_FLAG_ENUM)(TSK_VS_PART_FLAG_ALLOC | TSK_VS_PART_FLAG_UNALLOC | TSK_VS_PART_FLAG_META));
+  walker.setFileFilterFlags((TSK_FS_DIR_WALK_FLAG_ENUM)(TSK_FS_DIR_WALK_FLAG_RECURSE | TSK_FS_DIR_WALK_FLAG_UNALLOC | TSK_FS_DIR_WALK_FLAG_ALLOC));
+  if (0 != walker.start()) {
+    std::string msg("had an error parsing filesystem");
+    for (auto& err: walker.getErrorList()) {
+      msg += "; " + err.msg1 + " " + err.msg2;
+    }
+    throw std::runtime_error(msg);
+  }
+  walker.finishWalk();
+  walker.catalog().write(path, ids);
+  return std::make_shared<Catalog>(path);
+}
+
+// the catalog at path, if it's current for the evidence, or else a new one
+std::shared_ptr<Catalog> openCatalog(const std::string& path, const std::vector<std::string>& imgSegs) {
+  try {
+    auto ret = std::make_shared<Catalog>(path);
+    if (ret->current(segmentIdentities(imgSegs))) {
+      return ret;
+    }
+    std::cerr << path << " is out of date; walking the evidence again" << std::endl;
+  }
+  catch (std::runtime_error&) {
+    // missing, or not a catalog
+  }
+  return buildCatalog(path, imgSegs);
+}
+
+void outputCatalogSection(const std::string& file, const Catalog& catalog, CatalogSection section) {
+  std::ofstream out(file, std::ios::out | std::ios::trunc);
+  catalog.scan(section, [&out](const CatalogEntry& e) { out.write(e.Value, e.ValueLen); });
+}
+
+// Each key is a record, inode, or disk map ID, a volume index, or a path; a
+// path may find several records, deleted ones among them.
+int lookupKeys(std::ostream& out, const Catalog& catalog, const std::vector<std::string>& keys) {
+  int ret = 0;
+  FileRecord rec;
+  uint32_t   inodeVol = 0;
+  for (const std::string& key: keys) {
+    std::vector<CatalogEntry> records(catalog.find(CATALOG_RECORDS, key));
+    for (const CatalogEntry& path: catalog.find(CATALOG_PATHS, key)) {
+      const std::vector<CatalogEntry> byPath(catalog.find(CATALOG_RECORDS, path.value()));
+      records.insert(records.end(), byPath.begin(), byPath.end());
+    }
+    bool found = false;
+    for (const CatalogEntry& e: records) {
+      decodeCatalogRecord(e, rec, inodeVol);
+      writeFile(out, rec, inodeVol, false);
+      out << '\n';
+      found = true;
+    }
+    for (CatalogSection section: {CATALOG_INODES, CATALOG_DISK_MAP}) {
+      for (const CatalogEntry& e: catalog.find(section, key)) {
+        out.write(e.Value, e.ValueLen);
+        found = true;
+      }
+    }
+    for (const CatalogEntry& e: catalog.find(CATALOG_FILESYSTEMS, key)) {
+      out.write(e.Value, e.ValueLen);
+      out << '\n';
+      found = true;
+    }
+    if (!found) {
+      std::cerr << "Nothing in the catalog has key " << key << std::endl;
+      ret = 1;
+    }
+  }
+  return ret;
+}
+
+// info, dumpfs, and lookups, answered from the catalog, which is made first
+// if it's missing or the evidence has changed
+int answerFromCatalog(std::ostream& out, const std::vector<std::string>& imgSegs, const Options& opts) {
+  const std::shared_ptr<Catalog> catalog(opts.Command == "catalog" ? buildCatalog(opts.CatalogFile, imgSegs):
+                                                                     openCatalog(opts.CatalogFile, imgSegs));
+  if (opts.Command == "info") {
+    catalog->scan(CATALOG_INFO, [&out](const CatalogEntry& e) { out.write(e.Value, e.ValueLen); });
+  }
+  else if (opts.Command == "dumpfs") {
+    writeCatalogRecords(out, *catalog, opts.Format == "binary", opts.DirTable,
+                        opts.Fields.empty() ? static_cast<unsigned int>(ALL_FIELDS): parseFields(opts.Fields));
+    if (!opts.DiskMapFile.empty()) {
+      outputCatalogSection(opts.DiskMapFile, *catalog, CATALOG_DISK_MAP);
+    }
+    if (!opts.InodeMapFile.empty()) {
+      outputCatalogSection(opts.InodeMapFile, *catalog, CATALOG_INODES);
+    }
+  }
+  else if (opts.Command == "lookup") {
+    return lookupKeys(out, *catalog, opts.Keys);
+  }
+  return 0;
+}
+
 void printHelp(const po::options_description& desc) {
   std::cout << "fsrip, Copyright (c) 2010-2015, Stroz Friedberg, LLC" << std::endl;
   std::cout << "Built " << __DATE__ << std::endl;
@@ -245,16 +432,6 @@ void printHelp(const po::options_description& desc) {
   std::cout << desc << std::endl;
 }
 
-// SF_HIMAGE sf_open_img() {
-//   return 0;
-// }
-
-// void sf_close_img(SF_HIMAGE) {}
-
-// size_t sf_img_read(SF_HIMAGE, void*, size_t ) {
-//   return -1;
-// }
-
 int sf_run_fsrip(int argc, char* argv[]) {
   Options opts;
 
@@ -264,19 +441,136 @@ int sf_run_fsrip(int argc, char* argv[]) {
   posOpts.add("ev-files", -1);
   desc.add_options()
     ("help", "produce help message")
-    ("command", po::value< std::string >(&opts.Command), "command to perform [info|dumpimg|dumpfs|dumpfiles]")
+    ("command", po::value< std::string >(&opts.Command), "command to perform [info|dumpimg|dumpfs|dumpfiles|hashfiles|dumpunalloc|dumpslack|search|carve|blockmap|sstable|serve|catalog|lookup]")
     ("overview-file", po::value< std::string >(&opts.OverviewFile), "output disk overview information")
+    ("format", po::value< std::string >(&opts.Format)->default_value("json"), "record output format [json|binary]")
+    ("order", po::value< std::string >(&opts.Order)->default_value("walk"), "order of dumpfiles output [walk|physical]; physical reads contents in disk order and ends with an index (json only)")
+    ("filter", po::value<std::string>(&opts.Filter)->default_value(""), "only output files matching the expression, e.g. \"path = 'part-*/Users/**.doc*' and size > 10K and not deleted\"; see filter.h")
+    ("fields", po::value<std::string>(&opts.Fields)->default_value(""), "only output these dumpfs fields, comma-separated [fs,path,name,meta,attrs,runs,rd_buf] (json only)")
+    ("sniff", po::bool_switch(&opts.Sniff), "add each regular file's type, from the first sector of its contents, and whether its extension matches (dumpfs, json only)")
+    ("dir-table", po::bool_switch(&opts.DirTable), "output directory and filesystem records once, instead of path and fs on every record (dumpfs and json only)")
     ("unallocated", po::value< std::string >(&opts.UCMode)->default_value("none"), "how to handle unallocated [none|fragment|block]")
     ("max-unallocated-block-size", po::value< uint64_t >(&opts.MaxUcBlockSize)->default_value(std::numeric_limits<uint64_t>::max()), "Maximum size of an unallocated entry, in blocks")
     ("ev-files", po::value< std::vector< std::string > >(), "evidence files")
     ("inode-map-file", po::value<std::string>(&opts.InodeMapFile)->default_value(""), "optional file to output containing directory entry to inode map")
-    ("disk-map-file", po::value<std::string>(&opts.DiskMapFile)->default_value(""), "optional file to output containing disk data to inode map");
+    ("disk-map-file", po::value<std::string>(&opts.DiskMapFile)->default_value(""), "optional file to output containing disk data to inode map")
+    ("columnar-file", po::value<std::string>(&opts.ColumnarFile)->default_value(""), "optional file to output containing name and meta fields in columnar form")
+    ("sqlite", po::value<std::string>(&opts.SqliteFile)->default_value(""), "optional SQLite database to output containing the dumpfs records and the disk and inode maps, indexed")
+    ("compress", po::bool_switch(&opts.Compress), "compress output as BGZF (gzip-compatible, block-seekable)")
+    ("compress-level", po::value<int>(&opts.CompressLevel)->default_value(6), "zlib compression level for --compress [0-9]")
+    ("compress-index", po::value<std::string>(&opts.CompressIndexFile)->default_value(""), "optional file to output containing the bgzip .gzi index for --compress")
+    ("hash", po::bool_switch(&opts.Hash), "add MD5, SHA-1, and SHA-256 hashes to dumpfiles records, as hashfiles does (needs --order=physical)")
+    ("dedup", po::bool_switch(&opts.Dedup), "write each inode's contents once in dumpfiles, and with --hash, each distinct content once; later copies refer back with content_ref (json only)")
+    ("stats", po::bool_switch(&opts.Stats), "add the entropy, zero and text ratios, and a byte histogram of each file's contents to hashfiles records, and to dumpfiles records with --order=physical (which are then hashed too)")
+    ("known-hashes", po::value<std::vector<std::string>>(&opts.KnownHashes)->composing(), "hash set file of known files, from mkhashset.py; hashfiles tags their records, and dumpfiles also leaves out their contents (may be repeated)")
+    ("keyword", po::value<std::vector<std::string>>(&opts.Keywords)->composing(), "pattern for search to find (may be repeated)")
+    ("keyword-file", po::value<std::string>(&opts.KeywordFile)->default_value(""), "file of patterns for search to find, one per line")
+    ("ignore-case", po::bool_switch(&opts.IgnoreCase), "search matches ASCII letters regardless of case")
+    ("carve-contents", po::bool_switch(&opts.CarveContents), "write the contents of each object carve finds after its record, as dumpfiles does")
+    ("region-size", po::value<uint64_t>(&opts.RegionSize)->default_value(64 * 1024), "size of the regions blockmap classifies, in bytes (a multiple of 512)")
+    ("catalog", po::value<std::string>(&opts.CatalogFile)->default_value(""), "catalog file, which catalog makes and info, dumpfs, and lookup answer from, walking the evidence only if it's changed")
+    ("key", po::value<std::vector<std::string>>(&opts.Keys)->composing(), "record, inode, or disk map ID, volume index, or path for lookup to find (may be repeated)")
+    ("address", po::value<std::string>(&opts.Address)->default_value("127.0.0.1"), "address for serve to listen on")
+    ("port", po::value<unsigned short>(&opts.Port)->default_value(8080), "port for serve to listen on")
+    ("threads", po::value<unsigned int>(&opts.NumThreads)->default_value(ThreadPool::defaultThreads()), "number of worker threads")
+    ("output-stats", po::bool_switch(&opts.OutputStats), "print output throughput and backpressure statistics to stderr");
 
   po::variables_map vm;
   try {
     po::store(po::command_line_parser(argc, argv).options(desc).positional(posOpts).run(), vm);
     po::notify(vm);
 
+    if (opts.DirTable && (opts.Command != "dumpfs" || opts.Format != "json")) {
+      // the fs and dir records have no contents after them, so they'd break
+      // the framing of dumpfiles and hashfiles output
+      throw std::runtime_error("--dir-table requires dumpfs and --format=json");
+    }
+    if (!opts.Fields.empty()) {
+      if (opts.Command != "dumpfs" || opts.Format != "json") {
+        throw std::runtime_error("--fields requires dumpfs and --format=json");
+      }
+      parseFields(opts.Fields); // throws on an unknown field
+    }
+    if (opts.Order != "walk" && opts.Order != "physical") {
+      throw std::runtime_error("--order must be walk or physical");
+    }
+    if (opts.Order == "physical" && (opts.Command != "dumpfiles" || opts.Format != "json")) {
+      throw std::runtime_error("--order=physical requires dumpfiles and --format=json");
+    }
+    if (opts.Command == "hashfiles" && opts.Format != "json") {
+      throw std::runtime_error("hashfiles requires --format=json");
+    }
+    if (!opts.Filter.empty() && opts.UCMode != "none") {
+      // unallocated space is what's left after every file's runs are marked
+      throw std::runtime_error("--filter can't be used with --unallocated");
+    }
+    if (opts.Command == "dumpunalloc" || opts.Command == "dumpslack" || opts.Command == "search" || opts.Command == "carve" || opts.Command == "blockmap") {
+      if (opts.Format != "json" || opts.DirTable || opts.UCMode != "none") {
+        throw std::runtime_error(opts.Command + " can't be used with --format=binary, --dir-table, or --unallocated");
+      }
+      if (opts.Command != "dumpslack" && !opts.Filter.empty()) {
+        // every file's runs are needed to know what's unallocated
+        throw std::runtime_error("--filter can't be used with " + opts.Command);
+      }
+    }
+    if (opts.Command == "sstable") {
+      if (opts.Format != "json" || opts.DirTable || opts.Compress) {
+        // every value stands alone, and the blocks are compressed already
+        throw std::runtime_error("sstable can't be used with --format=binary, --dir-table, or --compress");
+      }
+    }
+    if (opts.Command == "catalog" || opts.Command == "lookup") {
+      if (opts.CatalogFile.empty()) {
+        throw std::runtime_error(opts.Command + " requires --catalog");
+      }
+      if (opts.Command == "lookup" && opts.Keys.empty()) {
+        throw std::runtime_error("lookup requires --key");
+      }
+    }
+    if (!opts.CatalogFile.empty()) {
+      if (opts.Command != "catalog" && opts.Command != "lookup" && opts.Command != "info" && opts.Command != "dumpfs") {
+        throw std::runtime_error("--catalog requires catalog, lookup, info, or dumpfs");
+      }
+      if (!opts.Filter.empty() || opts.Sniff || opts.UCMode != "none" || !opts.ColumnarFile.empty() || !opts.OverviewFile.empty()) {
+        // the catalog holds every record as a plain walk finds it
+        throw std::runtime_error("--catalog can't be used with --filter, --sniff, --unallocated, --columnar-file, or --overview-file");
+      }
+    }
+    if (!opts.SqliteFile.empty() && (opts.Command != "dumpfs" || !opts.CatalogFile.empty())) {
+      throw std::runtime_error("--sqlite requires dumpfs, without --catalog");
+    }
+    if (!opts.RegionSize || opts.RegionSize % 512) {
+      throw std::runtime_error("--region-size must be a positive multiple of 512");
+    }
+    if (opts.Sniff && (opts.Command != "dumpfs" || opts.Format != "json")) {
+      throw std::runtime_error("--sniff requires dumpfs and --format=json");
+    }
+    if (opts.CarveContents && opts.Command != "carve") {
+      throw std::runtime_error("--carve-contents requires carve");
+    }
+    if (opts.Command == "search" && opts.Keywords.empty() && opts.KeywordFile.empty()) {
+      throw std::runtime_error("search requires --keyword or --keyword-file");
+    }
+    if (opts.Hash && (opts.Command != "dumpfiles" || opts.Order != "physical")) {
+      throw std::runtime_error("--hash requires dumpfiles and --order=physical");
+    }
+    if (opts.Stats && opts.Command != "hashfiles" && (opts.Command != "dumpfiles" || opts.Order != "physical")) {
+      throw std::runtime_error("--stats requires hashfiles, or dumpfiles with --order=physical");
+    }
+    if (opts.Dedup && (opts.Command != "dumpfiles" || opts.Format != "json")) {
+      throw std::runtime_error("--dedup requires dumpfiles and --format=json");
+    }
+    if (!opts.KnownHashes.empty() && opts.Command != "hashfiles" && (opts.Command != "dumpfiles" || opts.Order != "physical")) {
+      throw std::runtime_error("--known-hashes requires hashfiles, or dumpfiles with --order=physical");
+    }
+
+    // all output goes through out, which may compress, and is written to
+    // stdout on its own thread so that output stalls don't stall the walk
+    std::unique_ptr<AsyncWriterStreambuf> writer;
+    std::shared_ptr<ThreadPool>           pool;
+    std::unique_ptr<BgzfStreambuf>        compressor;
+    std::ostream                          out(std::cout.rdbuf());
+
     std::shared_ptr<LbtTskAuto> walker;
 
     std::vector< std::string > imgSegs;
@@ -286,10 +580,39 @@ int sf_run_fsrip(int argc, char* argv[]) {
     if (vm.count("help")) {
       printHelp(desc);
     }
-    else if (vm.count("command") && vm.count("ev-files") && (walker = createVisitor(opts.Command, std::cout, imgSegs))) {
+    else if (opts.Command == "serve") {
+      // the REST service of HttpProtocol.txt; images are PUT, not given here
+      ImageService service;
+      runHttpServer(opts.Address, opts.Port, [&service](const HttpRequest& req) { return service.handle(req); });
+    }
+    else if (vm.count("command") && vm.count("ev-files")
+             && (!opts.CatalogFile.empty() || (walker = createVisitor(opts.Command, out, imgSegs))))
+    {
       std_binary_io();
 
-      return process(walker, imgSegs, vm, opts);
+      std::cout.flush();
+      writer.reset(new AsyncWriterStreambuf(fileno(stdout)));
+      out.rdbuf(writer.get());
+      pool = std::make_shared<ThreadPool>(opts.NumThreads);
+      if (opts.Compress) {
+        compressor.reset(new BgzfStreambuf(writer.get(), *pool, opts.CompressLevel));
+        out.rdbuf(compressor.get());
+      }
+
+      int ret = walker ? process(walker, imgSegs, opts, pool): answerFromCatalog(out, imgSegs, opts);
+      out.flush();
+      if (compressor) {
+        compressor->close();
+        if (!opts.CompressIndexFile.empty()) {
+          std::ofstream file(opts.CompressIndexFile.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+          compressor->writeIndex(file);
+        }
+      }
+      writer->close();
+      if (opts.OutputStats) {
+        std::cerr << writer->stats().toString() << std::endl;
+      }
+      return ret;
     }
     else {
       std::cerr << "Error: did not understand arguments\n\n";
@@ -0,0 +1,93 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "hashing.h"
+
+#include <stdexcept>
+
+#include <openssl/evp.h>
+
+namespace {
+  const EVP_MD* algorithm(Digest::ALGORITHM alg) {
+    switch (alg) {
+      case Digest::MD5:
+        return EVP_md5();
+      case Digest::SHA1:
+        return EVP_sha1();
+      case Digest::SHA256:
+        return EVP_sha256();
+    }
+    return nullptr;
+  }
+}
+
+Digest::Digest(ALGORITHM alg): Ctx(EVP_MD_CTX_create()) {
+  if (!Ctx || !EVP_DigestInit_ex(Ctx, algorithm(alg), nullptr)) {
+    EVP_MD_CTX_destroy(Ctx);
+    throw std::runtime_error("Could not initialize libcrypto digest");
+  }
+}
+
+Digest::~Digest() {
+  EVP_MD_CTX_destroy(Ctx);
+}
+
+void Digest::update(const char* data, size_t len) {
+  if (!EVP_DigestUpdate(Ctx, data, len)) {
+    throw std::runtime_error("Could not update libcrypto digest");
+  }
+}
+
+std::string Digest::finish() {
+  unsigned char buf[EVP_MAX_MD_SIZE];
+  unsigned int len = 0;
+  if (!EVP_DigestFinal_ex(Ctx, buf, &len)) {
+    throw std::runtime_error("Could not finish libcrypto digest");
+  }
+  return std::string(reinterpret_cast<const char*>(buf), len);
+}
+
+/*************************************************************************/
+
+Hasher::Hasher(): Size(0), Md5(Digest::MD5), Sha1(Digest::SHA1), Sha256(Digest::SHA256) {}
+
+void Hasher::update(const char* data, size_t len) {
+  Md5.update(data, len);
+  Sha1.update(data, len);
+  Sha256.update(data, len);
+  Size += len;
+}
+
+void Hasher::update(const char* data, size_t len, ThreadPool& pool) {
+  // SHA-256 is the slowest, so this thread takes it
+  std::future<void> md5(pool.submit([this, data, len]{ Md5.update(data, len); })),
+                    sha1(pool.submit([this, data, len]{ Sha1.update(data, len); }));
+  try {
+    Sha256.update(data, len);
+  }
+  catch (...) {
+    // the others still refer to data
+    md5.wait();
+    sha1.wait();
+    throw;
+  }
+  md5.get();
+  sha1.get();
+  Size += len;
+}
+
+HashRecord Hasher::finish() {
+  HashRecord ret;
+  ret.Size   = Size;
+  ret.MD5    = Md5.finish();
+  ret.SHA1   = Sha1.finish();
+  ret.SHA256 = Sha256.finish();
+  return ret;
+}
+
+HashRecord hashData(const char* data, size_t len) {
+  Hasher h;
+  h.update(data, len);
+  return h.finish();
+}
@@ -0,0 +1,190 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "hashset.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+  const char     MAGIC[4]     = {'F', 'S', 'H', 'S'};
+  const uint64_t HEADER_SIZE  = 32,
+                 FANOUT_SIZE  = 65537 * 8;
+  const uint32_t BLOOM_HASHES = 6;
+
+  uint32_t getLE32(const unsigned char* buf) {
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | (static_cast<uint32_t>(buf[3]) << 24);
+  }
+
+  uint64_t getLE64(const unsigned char* buf) {
+    return getLE32(buf) | (static_cast<uint64_t>(getLE32(buf + 4)) << 32);
+  }
+
+  void putLE(std::string& s, uint64_t val, unsigned int n) {
+    for (unsigned int i = 0; i < n; ++i) {
+      s.push_back(static_cast<char>((val >> (8 * i)) & 0xFF));
+    }
+  }
+
+  uint64_t bloomBit(const unsigned char* digest, uint32_t i, uint64_t bits) {
+    return (getLE64(digest) + i * (getLE64(digest + 8) | 1)) & (bits - 1);
+  }
+
+  unsigned int prefix(const unsigned char* digest) {
+    return (digest[0] << 8) | digest[1];
+  }
+}
+
+HashSet::HashSet(const std::string& path, const std::string& name):
+  Name(name), File(path, "hash set")
+{
+  const unsigned char* buf = File.data();
+  if (File.size() < HEADER_SIZE + FANOUT_SIZE || std::memcmp(buf, MAGIC, sizeof(MAGIC))) {
+    throw std::runtime_error(path + " is not a hash set");
+  }
+  DigestLen      = getLE32(buf + 8);
+  NumBloomHashes = getLE32(buf + 12);
+  Count          = getLE64(buf + 16);
+  BloomBits      = getLE64(buf + 24);
+  // sized without overflow: whatever follows the bloom filter must be
+  // exactly Count digests
+  const uint64_t rest = File.size() - HEADER_SIZE - FANOUT_SIZE;
+  if (getLE32(buf + 4) != VERSION || DigestLen < 16 || BloomBits < 64 || (BloomBits & (BloomBits - 1))
+      || BloomBits / 8 > rest || (rest - BloomBits / 8) / DigestLen != Count
+      || (rest - BloomBits / 8) % DigestLen)
+  {
+    throw std::runtime_error(path + " is not a valid hash set");
+  }
+  Fanout  = buf + HEADER_SIZE;
+  Bloom   = Fanout + FANOUT_SIZE;
+  Digests = Bloom + BloomBits / 8;
+
+  // contains() searches between fanout entries without checking them
+  uint64_t prev = 0;
+  for (unsigned int p = 0; p < 65537; ++p) {
+    const uint64_t cur = getLE64(Fanout + 8 * p);
+    if (cur < prev) {
+      throw std::runtime_error(path + " is not a valid hash set");
+    }
+    prev = cur;
+  }
+  if (prev != Count) {
+    throw std::runtime_error(path + " is not a valid hash set");
+  }
+}
+
+bool HashSet::bloomContains(const unsigned char* digest) const {
+  for (uint32_t i = 0; i < NumBloomHashes; ++i) {
+    const uint64_t bit = bloomBit(digest, i, BloomBits);
+    if (!(Bloom[bit >> 3] & (1 << (bit & 7)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool HashSet::contains(const std::string& digest) const {
+  if (digest.size() != DigestLen) {
+    return false;
+  }
+  const unsigned char* d = reinterpret_cast<const unsigned char*>(digest.data());
+  if (!bloomContains(d)) {
+    return false;
+  }
+  const unsigned int p = prefix(d);
+  uint64_t lo = getLE64(Fanout + 8 * p),
+           hi = getLE64(Fanout + 8 * (p + 1));
+  while (lo < hi) {
+    const uint64_t mid = lo + (hi - lo) / 2;
+    const int cmp = std::memcmp(Digests + mid * DigestLen, d, DigestLen);
+    if (cmp == 0) {
+      return true;
+    }
+    else if (cmp < 0) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return false;
+}
+
+void HashSet::write(const std::string& path, std::vector<std::string> digests) {
+  const uint32_t len = digests.empty() ? 16: digests.front().size();
+  for (const std::string& d: digests) {
+    if (d.size() != len || len < 16) {
+      throw std::invalid_argument("Hash set digests must all be the same length, at least 16 bytes");
+    }
+  }
+  std::sort(digests.begin(), digests.end());
+  digests.erase(std::unique(digests.begin(), digests.end()), digests.end());
+
+  // 8 to 16 bits per digest
+  uint64_t bits = 64;
+  while (bits < 8 * digests.size()) {
+    bits <<= 1;
+  }
+
+  std::string header(MAGIC, sizeof(MAGIC));
+  putLE(header, VERSION, 4);
+  putLE(header, len, 4);
+  putLE(header, BLOOM_HASHES, 4);
+  putLE(header, digests.size(), 8);
+  putLE(header, bits, 8);
+
+  std::string fanout;
+  size_t cur = 0;
+  for (unsigned int p = 0; p < 65536; ++p) {
+    while (cur < digests.size() && prefix(reinterpret_cast<const unsigned char*>(digests[cur].data())) < p) {
+      ++cur;
+    }
+    putLE(fanout, cur, 8);
+  }
+  putLE(fanout, digests.size(), 8);
+
+  std::string bloom(bits / 8, '\0');
+  for (const std::string& d: digests) {
+    for (uint32_t i = 0; i < BLOOM_HASHES; ++i) {
+      const uint64_t bit = bloomBit(reinterpret_cast<const unsigned char*>(d.data()), i, bits);
+      bloom[bit >> 3] |= static_cast<char>(1 << (bit & 7));
+    }
+  }
+
+  std::ofstream file(path.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+  file.write(header.data(), header.size());
+  file.write(fanout.data(), fanout.size());
+  file.write(bloom.data(), bloom.size());
+  for (const std::string& d: digests) {
+    file.write(d.data(), d.size());
+  }
+  if (!file) {
+    throw std::runtime_error("Could not write hash set " + path);
+  }
+}
+
+std::string findKnown(const HashSets& sets, const HashRecord& hashes) {
+  for (const auto& set: sets) {
+    switch (set->digestLength()) {
+      case 16:
+        if (set->contains(hashes.MD5)) {
+          return set->name();
+        }
+        break;
+      case 20:
+        if (set->contains(hashes.SHA1)) {
+          return set->name();
+        }
+        break;
+      case 32:
+        if (set->contains(hashes.SHA256)) {
+          return set->name();
+        }
+        break;
+    }
+  }
+  return "";
+}
@@ -0,0 +1,314 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "httpserver.h"
+
+#include "jsonhelp.h"
+
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <boost/asio.hpp>
+
+namespace {
+  using boost::asio::ip::tcp;
+
+  const size_t MAX_HEAD_SIZE = 64 * 1024,
+               MAX_BODY_SIZE = 1024 * 1024;
+
+  std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+    return s;
+  }
+
+  std::string trim(const std::string& s) {
+    const size_t beg = s.find_first_not_of(" \t"),
+                 end = s.find_last_not_of(" \t\r");
+    return beg == std::string::npos ? "": s.substr(beg, end - beg + 1);
+  }
+
+  int hexValue(char c) {
+    if ('0' <= c && c <= '9') {
+      return c - '0';
+    }
+    c = std::tolower(static_cast<unsigned char>(c));
+    return 'a' <= c && c <= 'f' ? c - 'a' + 10: -1;
+  }
+
+  bool parseUInt(const std::string& s, uint64_t& val) {
+    if (s.empty() || s.size() > 19 || s.find_first_not_of("0123456789") != std::string::npos) {
+      return false;
+    }
+    val = std::stoull(s);
+    return true;
+  }
+
+  const char* reason(unsigned int status) {
+    switch (status) {
+      case 200: return "OK";
+      case 201: return "Created";
+      case 204: return "No Content";
+      case 206: return "Partial Content";
+      case 400: return "Bad Request";
+      case 404: return "Not Found";
+      case 405: return "Method Not Allowed";
+      case 409: return "Conflict";
+      case 413: return "Payload Too Large";
+      case 416: return "Range Not Satisfiable";
+      case 500: return "Internal Server Error";
+      default:  return "Unknown";
+    }
+  }
+
+  void serveConnection(std::shared_ptr<tcp::socket> sock, HttpHandler handler) {
+    boost::asio::streambuf buf(MAX_HEAD_SIZE + MAX_BODY_SIZE);
+    std::istream in(&buf);
+    const HttpResponse::Sink sink = [&sock](const char* data, size_t len) {
+      boost::system::error_code err;
+      boost::asio::write(*sock, boost::asio::buffer(data, len), err);
+      return !err;
+    };
+
+    while (true) {
+      boost::system::error_code err;
+      boost::asio::read_until(*sock, buf, "\r\n\r\n", err);
+      if (err) {
+        // closed, or a head too big for the buffer
+        return;
+      }
+
+      in.clear();
+      HttpRequest req;
+      HttpResponse resp;
+      bool keepAlive = false;
+      try {
+        readRequestHead(in, req);
+        keepAlive = req.keepAlive();
+
+        uint64_t len = 0;
+        const std::string lenHeader(req.header("content-length"));
+        if (!lenHeader.empty() && !parseUInt(lenHeader, len)) {
+          throw std::invalid_argument("bad Content-Length");
+        }
+        if (len > MAX_BODY_SIZE) {
+          resp = errorResponse(413, "request body too large");
+          keepAlive = false;
+        }
+        else {
+          if (buf.size() < len) {
+            boost::asio::read(*sock, buf, boost::asio::transfer_exactly(len - buf.size()), err);
+            if (err) {
+              return;
+            }
+          }
+          req.Body.resize(len);
+          in.read(&req.Body[0], len);
+          try {
+            resp = handler(req);
+          }
+          catch (std::invalid_argument& e) {
+            resp = errorResponse(400, e.what());
+          }
+          catch (std::exception& e) {
+            resp = errorResponse(500, e.what());
+          }
+        }
+      }
+      catch (std::invalid_argument& e) {
+        resp = errorResponse(400, e.what());
+        keepAlive = false;
+      }
+
+      const std::string head(responseHead(resp, keepAlive));
+      if (!sink(head.data(), head.size())) {
+        return;
+      }
+      if (resp.Writer) {
+        if (!resp.Writer(sink)) {
+          // the body is short of its Content-Length, so the connection's spoiled
+          return;
+        }
+      }
+      else if (!sink(resp.Body.data(), resp.Body.size())) {
+        return;
+      }
+      if (!keepAlive) {
+        boost::system::error_code ignored;
+        sock->shutdown(tcp::socket::shutdown_both, ignored);
+        return;
+      }
+    }
+  }
+}
+
+std::string HttpRequest::header(const std::string& name) const {
+  auto it = Headers.find(lower(name));
+  return it == Headers.end() ? "": it->second;
+}
+
+bool HttpRequest::keepAlive() const {
+  const std::string conn(lower(header("connection")));
+  return Version == "HTTP/1.1" ? conn != "close": conn == "keep-alive";
+}
+
+HttpResponse::HttpResponse(unsigned int status, const std::string& body, const std::string& contentType):
+  Status(status), ContentType(contentType), Body(body), ContentLength(0) {}
+
+HttpResponse errorResponse(unsigned int status, const std::string& msg) {
+  return HttpResponse(status, "{\"error\":" + jEscaped(msg) + "}");
+}
+
+std::string urlDecode(const std::string& s, bool plusIsSpace) {
+  std::string ret;
+  ret.reserve(s.size());
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (s[i] == '%') {
+      const int hi = i + 2 < s.size() ? hexValue(s[i + 1]): -1,
+                lo = i + 2 < s.size() ? hexValue(s[i + 2]): -1;
+      if (hi < 0 || lo < 0) {
+        throw std::invalid_argument("bad escape in URL");
+      }
+      ret += static_cast<char>(hi * 16 + lo);
+      i += 2;
+    }
+    else if (s[i] == '+' && plusIsSpace) {
+      ret += ' ';
+    }
+    else {
+      ret += s[i];
+    }
+  }
+  return ret;
+}
+
+bool readRequestHead(std::istream& in, HttpRequest& req) {
+  std::string line;
+  // tolerate blank lines ahead of the request line
+  do {
+    if (!std::getline(in, line)) {
+      return false;
+    }
+  } while (trim(line).empty());
+
+  std::istringstream reqLine(line);
+  std::string target;
+  if (!(reqLine >> req.Method >> target >> req.Version) || req.Version.compare(0, 5, "HTTP/")) {
+    throw std::invalid_argument("bad request line");
+  }
+
+  const size_t q = target.find('?');
+  req.Target = target.substr(0, q);
+  req.Query.clear();
+  if (q != std::string::npos) {
+    std::istringstream query(target.substr(q + 1));
+    std::string param;
+    while (std::getline(query, param, '&')) {
+      if (!param.empty()) {
+        const size_t eq = param.find('=');
+        req.Query[urlDecode(param.substr(0, eq), true)] =
+          eq == std::string::npos ? "": urlDecode(param.substr(eq + 1), true);
+      }
+    }
+  }
+
+  req.Headers.clear();
+  while (std::getline(in, line) && !trim(line).empty()) {
+    const size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+      throw std::invalid_argument("bad header");
+    }
+    req.Headers[lower(trim(line.substr(0, colon)))] = trim(line.substr(colon + 1));
+  }
+  return true;
+}
+
+std::string responseHead(const HttpResponse& resp, bool keepAlive) {
+  std::ostringstream buf;
+  buf << "HTTP/1.1 " << resp.Status << " " << reason(resp.Status) << "\r\n"
+      << "Content-Length: " << (resp.Writer ? resp.ContentLength: resp.Body.size()) << "\r\n";
+  if (!resp.ContentType.empty() && resp.Status != 204) {
+    buf << "Content-Type: " << resp.ContentType << "\r\n";
+  }
+  for (auto& h: resp.Headers) {
+    buf << h.first << ": " << h.second << "\r\n";
+  }
+  buf << "Connection: " << (keepAlive ? "keep-alive": "close") << "\r\n\r\n";
+  return buf.str();
+}
+
+RangeResult parseRange(const std::string& header, uint64_t size, uint64_t& beg, uint64_t& end) {
+  const std::string h(trim(header));
+  if (h.compare(0, 6, "bytes=") || h.find(',') != std::string::npos) {
+    return NO_RANGE;
+  }
+  const std::string spec(trim(h.substr(6)));
+  const size_t dash = spec.find('-');
+  if (dash == std::string::npos) {
+    return NO_RANGE;
+  }
+  const std::string first(spec.substr(0, dash)),
+                    last(spec.substr(dash + 1));
+  uint64_t a = 0,
+           b = 0;
+  if (first.empty()) {
+    // a suffix: the last b bytes
+    if (!parseUInt(last, b)) {
+      return NO_RANGE;
+    }
+    if (!b || !size) {
+      return UNSATISFIABLE_RANGE;
+    }
+    beg = size - std::min(b, size);
+    end = size;
+    return SATISFIABLE_RANGE;
+  }
+  if (!parseUInt(first, a) || (!last.empty() && (!parseUInt(last, b) || b < a))) {
+    return NO_RANGE;
+  }
+  if (a >= size) {
+    return UNSATISFIABLE_RANGE;
+  }
+  beg = a;
+  end = last.empty() ? size: std::min(b + 1, size);
+  return SATISFIABLE_RANGE;
+}
+
+HttpResponse rangeResponse(const HttpRequest& req, uint64_t size, const std::string& contentType,
+                           const RangeReader& read)
+{
+  uint64_t beg = 0,
+           end = size;
+  HttpResponse resp(200, "", contentType);
+  resp.Headers.push_back(std::make_pair("Accept-Ranges", "bytes"));
+  switch (parseRange(req.header("range"), size, beg, end)) {
+    case UNSATISFIABLE_RANGE:
+      resp.Status = 416;
+      resp.Headers.push_back(std::make_pair("Content-Range", "bytes */" + std::to_string(size)));
+      return resp;
+    case SATISFIABLE_RANGE:
+      resp.Status = 206;
+      resp.Headers.push_back(std::make_pair("Content-Range",
+        "bytes " + std::to_string(beg) + "-" + std::to_string(end - 1) + "/" + std::to_string(size)));
+      break;
+    case NO_RANGE:
+      break;
+  }
+  resp.ContentLength = end - beg;
+  resp.Writer = [read, beg, end](const HttpResponse::Sink& sink) { return read(beg, end - beg, sink); };
+  return resp;
+}
+
+void runHttpServer(const std::string& address, unsigned short port, const HttpHandler& handler) {
+  boost::asio::io_service service;
+  tcp::acceptor acceptor(service, tcp::endpoint(boost::asio::ip::address::from_string(address), port));
+  while (true) {
+    auto sock = std::make_shared<tcp::socket>(service);
+    acceptor.accept(*sock);
+    std::thread(serveConnection, sock, handler).detach();
+  }
+}
@@ -0,0 +1,445 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "imageservice.h"
+
+#include "jsonhelp.h"
+#include "jsonrec.h"
+#include "walkers.h"
+
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+  const size_t READ_CHUNK_SIZE = 1024 * 1024;
+  const char* const WHITESPACE = " \t\r\n";
+  const char* const BINARY_TYPE = "application/octet-stream";
+
+  HttpResponse notFound(const std::string& what) {
+    return errorResponse(404, what + " not found");
+  }
+
+  bool isNumber(const std::string& s) {
+    return !s.empty() && s.size() < 20 && s.find_first_not_of("0123456789") == std::string::npos;
+  }
+
+  uint64_t queryNumber(const HttpRequest& req, const std::string& name) {
+    auto it = req.Query.find(name);
+    if (it == req.Query.end() || !isNumber(it->second)) {
+      throw std::invalid_argument("missing or bad " + name + " parameter");
+    }
+    return std::stoull(it->second);
+  }
+
+  // the decoded segments of the target, so that an escaped slash stays in
+  // its name
+  std::vector<std::string> splitTarget(const std::string& target) {
+    std::vector<std::string> ret;
+    std::istringstream in(target);
+    std::string seg;
+    while (std::getline(in, seg, '/')) {
+      if (!seg.empty()) {
+        ret.push_back(urlDecode(seg));
+      }
+    }
+    return ret;
+  }
+
+  std::string joinPath(std::vector<std::string>::const_iterator beg, std::vector<std::string>::const_iterator end) {
+    std::string ret;
+    for (auto it = beg; it != end; ++it) {
+      ret += "/" + *it;
+    }
+    return ret.empty() ? "/": ret;
+  }
+
+  void appendUtf8(std::string& s, unsigned int cp) {
+    if (cp < 0x80) {
+      s += static_cast<char>(cp);
+    }
+    else if (cp < 0x800) {
+      s += static_cast<char>(0xC0 | (cp >> 6));
+      s += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    else {
+      s += static_cast<char>(0xE0 | (cp >> 12));
+      s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+      s += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+  }
+
+  // a JSON string starting at body[i], which is left just past it
+  std::string parseJsonString(const std::string& body, size_t& i) {
+    std::string ret;
+    for (++i; i < body.size() && body[i] != '"'; ++i) {
+      if (body[i] != '\\') {
+        ret += body[i];
+        continue;
+      }
+      if (++i == body.size()) {
+        break;
+      }
+      switch (body[i]) {
+        case 'b': ret += '\b'; break;
+        case 'f': ret += '\f'; break;
+        case 'n': ret += '\n'; break;
+        case 'r': ret += '\r'; break;
+        case 't': ret += '\t'; break;
+        case 'u':
+          if (i + 4 >= body.size() || !std::all_of(body.begin() + i + 1, body.begin() + i + 5, [](unsigned char c) { return std::isxdigit(c); })) {
+            throw std::invalid_argument("bad escape in the request body");
+          }
+          appendUtf8(ret, std::stoul(body.substr(i + 1, 4), nullptr, 16));
+          i += 4;
+          break;
+        default:
+          ret += body[i]; // quote, backslash, or slash
+      }
+    }
+    if (i >= body.size()) {
+      throw std::invalid_argument("unterminated string in the request body");
+    }
+    ++i;
+    return ret;
+  }
+
+  // Sends len bytes from read, in pieces. What can't be read is sent as
+  // zeros, as the length is already out.
+  typedef std::function<ssize_t(uint64_t offset, char* buf, size_t len)> Reader;
+
+  bool sendRange(uint64_t offset, uint64_t len, const Reader& read, const HttpResponse::Sink& sink) {
+    std::vector<char> buf(std::min(len, static_cast<uint64_t>(READ_CHUNK_SIZE)));
+    while (len) {
+      const size_t toRead = std::min(len, static_cast<uint64_t>(buf.size()));
+      ssize_t rlen = read(offset, buf.data(), toRead);
+      if (rlen <= 0) {
+        std::cerr << "Could not read " << toRead << " bytes at " << offset << std::endl;
+        std::fill(buf.begin(), buf.begin() + toRead, 0);
+        rlen = toRead;
+      }
+      if (!sink(buf.data(), rlen)) {
+        return false;
+      }
+      offset += rlen;
+      len -= rlen;
+    }
+    return true;
+  }
+
+  // {"name":{...},"meta":{...}}, as dumpfs has them
+  void writeEntry(std::ostream& out, const TSK_FS_FILE* file, const TSK_FS_INFO* fs, bool withAttrs) {
+    out << "{";
+    bool first = true;
+    if (file->name) {
+      NameRecord name;
+      captureNameRecord(name, file->name);
+      out << "\"name\":";
+      writeNameRecord(out, name);
+      first = false;
+    }
+    if (hasUsableMeta(file)) {
+      MetaRecord meta;
+      captureMetaRecord(meta, file, fs, withAttrs, withAttrs);
+      out << (first ? "": ", ") << "\"meta\":";
+      writeMetaRecord(out, meta, withAttrs ? ALL_FIELDS: META_FIELD);
+    }
+    out << "}";
+  }
+}
+
+std::vector<std::string> ImageService::parseSegments(const std::string& body) {
+  const std::string key("\"segments\"");
+  size_t i = body.find(key);
+  if (i != std::string::npos) {
+    i = body.find_first_not_of(WHITESPACE, i + key.size());
+  }
+  if (i != std::string::npos && body[i] == ':') {
+    i = body.find_first_not_of(WHITESPACE, i + 1);
+  }
+  if (i == std::string::npos || body[i] != '[') {
+    throw std::invalid_argument("no segments array in the request body");
+  }
+
+  std::vector<std::string> ret;
+  for (++i; ; ++i) {
+    i = body.find_first_not_of(WHITESPACE, i);
+    if (i != std::string::npos && body[i] == ']' && ret.empty()) {
+      break;
+    }
+    if (i == std::string::npos || body[i] != '"') {
+      throw std::invalid_argument("bad segments array in the request body");
+    }
+    ret.push_back(parseJsonString(body, i));
+    i = body.find_first_not_of(WHITESPACE, i);
+    if (i != std::string::npos && body[i] == ']') {
+      break;
+    }
+    if (i == std::string::npos || body[i] != ',') {
+      throw std::invalid_argument("bad segments array in the request body");
+    }
+  }
+  if (ret.empty()) {
+    throw std::invalid_argument("no segments in the request body");
+  }
+  return ret;
+}
+
+HttpResponse ImageService::handle(const HttpRequest& req) {
+  const std::vector<std::string> segs(splitTarget(req.Target));
+  if (segs.size() < 3 || segs[0] != "fsrip") {
+    return notFound("resource");
+  }
+  if (segs.size() == 3 && segs[1] == "image") {
+    if (req.Method == "PUT") {
+      return putImage(segs[2], req.Body);
+    }
+    else if (req.Method == "GET") {
+      return getImage(segs[2]);
+    }
+    else if (req.Method == "DELETE") {
+      return deleteImage(segs[2]);
+    }
+    return errorResponse(405, "use PUT, GET, or DELETE");
+  }
+  if (req.Method != "GET") {
+    return errorResponse(405, "use GET");
+  }
+
+  const ImagePtr img(find(segs[1]));
+  if (!img) {
+    return notFound("image");
+  }
+  if (segs.size() == 3 && segs[2] == "volumes") {
+    return volumes(img);
+  }
+  if (segs.size() == 3 && segs[2] == "sectors") {
+    return sectors(req, img);
+  }
+
+  TSK_FS_INFO* fs = filesystem(*img, segs[2]);
+  if (!fs) {
+    return notFound("filesystem");
+  }
+  if (segs.size() == 4 && isNumber(segs[3])) {
+    return entry(img, fs, "", std::stoull(segs[3]));
+  }
+  if (segs.size() == 4 && segs[3] == "blocks") {
+    return blocks(req, img, fs);
+  }
+  if (segs.size() >= 4) {
+    const std::string path(joinPath(segs.begin() + 4, segs.end()));
+    if (segs[3] == "dir") {
+      return dir(img, fs, path);
+    }
+    else if (segs[3] == "entry") {
+      return entry(img, fs, path, 0);
+    }
+    else if (segs[3] == "file") {
+      return file(req, img, fs, path);
+    }
+  }
+  return notFound("resource");
+}
+
+ImageService::ImagePtr ImageService::find(const std::string& id) const {
+  std::lock_guard<std::mutex> lock(Lock);
+  auto it = Images.find(id);
+  return it == Images.end() ? ImagePtr(): it->second;
+}
+
+TSK_FS_INFO* ImageService::filesystem(const OpenImage& img, const std::string& volID) {
+  if (!isNumber(volID)) {
+    return nullptr;
+  }
+  const uint64_t index = std::stoull(volID);
+  std::shared_ptr<Filesystem> fs;
+  if (std::shared_ptr<VolumeSystem> vs = img.Img->volumeSystem().lock()) {
+    if (index < vs->numVolumes()) {
+      if (std::shared_ptr<Volume> vol = vs->getVol(index).lock()) {
+        fs = vol->filesystem().lock();
+      }
+    }
+  }
+  else if (index == 0) {
+    fs = img.Img->filesystem().lock();
+  }
+  return fs ? fs->tskInfo(): nullptr;
+}
+
+HttpResponse ImageService::putImage(const std::string& id, const std::string& body) {
+  const std::vector<std::string> segments(parseSegments(body));
+  if (find(id)) {
+    return errorResponse(409, "image id already in use");
+  }
+
+  // opened outside the lock, as it's slow, so two PUTs of an id may race;
+  // the loser's image is closed
+  ImagePtr img(std::make_shared<OpenImage>());
+  img->Img = Image::open(segments);
+  if (!img->Img) {
+    return errorResponse(400, "could not open the evidence files");
+  }
+  {
+    std::lock_guard<std::mutex> lock(Lock);
+    if (!Images.insert(std::make_pair(id, img)).second) {
+      return errorResponse(409, "image id already in use");
+    }
+  }
+  std::ostringstream buf;
+  buf << *img->Img;
+  return HttpResponse(201, buf.str());
+}
+
+HttpResponse ImageService::getImage(const std::string& id) const {
+  const ImagePtr img(find(id));
+  if (!img) {
+    return notFound("image");
+  }
+  std::ostringstream buf;
+  buf << *img->Img;
+  return HttpResponse(200, buf.str());
+}
+
+HttpResponse ImageService::deleteImage(const std::string& id) {
+  // requests in flight keep their reference, so it's closed after them
+  std::lock_guard<std::mutex> lock(Lock);
+  if (!Images.erase(id)) {
+    return notFound("image");
+  }
+  return HttpResponse(204);
+}
+
+HttpResponse ImageService::volumes(const ImagePtr& img) const {
+  std::ostringstream buf;
+  buf << "[";
+  if (std::shared_ptr<VolumeSystem> vs = img->Img->volumeSystem().lock()) {
+    for (auto vol = vs->volBegin(); vol != vs->volEnd(); ++vol) {
+      buf << (vol == vs->volBegin() ? "": ",") << j(*vol);
+    }
+  }
+  else if (std::shared_ptr<Filesystem> fs = img->Img->filesystem().lock()) {
+    buf << "{" << j("startBlock", 0, true);
+    outputFS(buf, fs);
+    buf << "}";
+  }
+  buf << "]";
+  return HttpResponse(200, buf.str());
+}
+
+HttpResponse ImageService::sectors(const HttpRequest& req, const ImagePtr& img) const {
+  const uint64_t start = queryNumber(req, "start"),
+                 end   = queryNumber(req, "end"),
+                 sectorSize = img->Img->sectorSize();
+  if (start > end || end > img->Img->size() / sectorSize) {
+    throw std::invalid_argument("sector range is out of bounds");
+  }
+
+  const uint64_t beg = start * sectorSize;
+  TSK_IMG_INFO* info = img->Img->tskInfo();
+  return rangeResponse(req, (end - start) * sectorSize, BINARY_TYPE,
+    [img, info, beg](uint64_t offset, uint64_t len, const HttpResponse::Sink& sink) {
+      return sendRange(beg + offset, len, [&img, info](uint64_t pos, char* buf, size_t n) {
+        std::lock_guard<std::mutex> lock(img->Lock);
+        return tsk_img_read(info, pos, buf, n);
+      }, sink);
+    });
+}
+
+HttpResponse ImageService::blocks(const HttpRequest& req, const ImagePtr& img, TSK_FS_INFO* fs) const {
+  const uint64_t start = queryNumber(req, "start"),
+                 end   = queryNumber(req, "end");
+  if (start > end || end > fs->block_count) {
+    throw std::invalid_argument("block range is out of bounds");
+  }
+
+  const uint64_t beg = start * fs->block_size;
+  return rangeResponse(req, (end - start) * fs->block_size, BINARY_TYPE,
+    [img, fs, beg](uint64_t offset, uint64_t len, const HttpResponse::Sink& sink) {
+      return sendRange(beg + offset, len, [&img, fs](uint64_t pos, char* buf, size_t n) {
+        std::lock_guard<std::mutex> lock(img->Lock);
+        return tsk_fs_read(fs, pos, buf, n);
+      }, sink);
+    });
+}
+
+HttpResponse ImageService::dir(const ImagePtr& img, TSK_FS_INFO* fs, const std::string& path) const {
+  std::lock_guard<std::mutex> lock(img->Lock);
+  TSK_FS_DIR* d = tsk_fs_dir_open(fs, path.c_str());
+  if (!d) {
+    return notFound("directory");
+  }
+  std::ostringstream buf;
+  buf << "[";
+  bool first = true;
+  const size_t num = tsk_fs_dir_getsize(d);
+  for (size_t i = 0; i < num; ++i) {
+    if (TSK_FS_FILE* file = tsk_fs_dir_get(d, i)) {
+      buf << (first ? "": ",");
+      writeEntry(buf, file, fs, false);
+      tsk_fs_file_close(file);
+      first = false;
+    }
+  }
+  tsk_fs_dir_close(d);
+  buf << "]";
+  return HttpResponse(200, buf.str());
+}
+
+HttpResponse ImageService::entry(const ImagePtr& img, TSK_FS_INFO* fs, const std::string& path, uint64_t inum) const {
+  std::lock_guard<std::mutex> lock(img->Lock);
+  TSK_FS_FILE* file = path.empty() ? tsk_fs_file_open_meta(fs, nullptr, inum): tsk_fs_file_open(fs, nullptr, path.c_str());
+  if (!file) {
+    return notFound("entry");
+  }
+  std::ostringstream buf;
+  writeEntry(buf, file, fs, true);
+  tsk_fs_file_close(file);
+  return HttpResponse(200, buf.str());
+}
+
+HttpResponse ImageService::file(const HttpRequest& req, const ImagePtr& img, TSK_FS_INFO* fs, const std::string& path) const {
+  auto slackParam = req.Query.find("slack");
+  const bool slack = slackParam != req.Query.end() && slackParam->second == "true";
+  const bool hasStream = req.Query.count("stream");
+  const uint64_t stream = hasStream ? queryNumber(req, "stream"): 0;
+
+  TSK_FS_FILE* opened = nullptr;
+  const TSK_FS_ATTR* attr = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(img->Lock);
+    opened = tsk_fs_file_open(fs, nullptr, path.c_str());
+    if (!opened) {
+      return notFound("file");
+    }
+    if (hasStream) {
+      // numbered as in the entry's attrs
+      const std::vector<const TSK_FS_ATTR*> attrs(hasUsableMeta(opened) ? inUseAttrs(opened): std::vector<const TSK_FS_ATTR*>());
+      attr = stream < attrs.size() ? attrs[stream]: nullptr;
+    }
+    else {
+      attr = tsk_fs_file_attr_get(opened);
+    }
+    if (!attr) {
+      tsk_fs_file_close(opened);
+      return notFound("stream");
+    }
+  }
+
+  // closed once the body's been sent, under the lock
+  std::shared_ptr<TSK_FS_FILE> handle(opened, [img](TSK_FS_FILE* f) {
+    std::lock_guard<std::mutex> lock(img->Lock);
+    tsk_fs_file_close(f);
+  });
+  const uint64_t size = slack && (attr->flags & TSK_FS_ATTR_NONRES) ? attr->nrd.allocsize: attr->size;
+  const TSK_FS_FILE_READ_FLAG_ENUM flags = slack ? TSK_FS_FILE_READ_FLAG_SLACK: TSK_FS_FILE_READ_FLAG_NONE;
+  return rangeResponse(req, size, BINARY_TYPE,
+    [img, handle, attr, flags](uint64_t offset, uint64_t len, const HttpResponse::Sink& sink) {
+      return sendRange(offset, len, [&img, attr, flags](uint64_t pos, char* buf, size_t n) {
+        std::lock_guard<std::mutex> lock(img->Lock);
+        return tsk_fs_attr_read(attr, pos, buf, n, flags);
+      }, sink);
+    });
+}
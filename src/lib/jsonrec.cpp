@@ -0,0 +1,261 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "jsonrec.h"
+
+#include "tsk.h"
+#include "enums.h"
+#include "jsonhelp.h"
+#include "util.h"
+
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+  std::string hex(const std::string& bytes) {
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(bytes.data());
+    return bytesAsString(b, b + bytes.size());
+  }
+
+  std::string formatTime(const Timestamp& ts) {
+    return formatTimestamp(static_cast<uint32_t>(ts.Secs), ts.Nanos);
+  }
+
+  void writeMetaFields(std::ostream& out, const MetaRecord& m) {
+    out << j<int64_t>("addr", static_cast<int64_t>(m.Addr), true)
+        << j("accessed", formatTime(m.Accessed))
+        << j("content_len", m.ContentLen)
+        << j("created", formatTime(m.Created))
+        << j("metadata", formatTime(m.Metadata))
+        << j("flags", metaFlags(m.Flags))
+        << j("gid", m.Gid);
+    if (!m.Link.empty()) {
+      out << j("link", m.Link);
+    }
+    if (MetaRecord::EXT_DTIME == m.FsTimeKind) {
+      out << j("dtime", formatTime(m.FsTime));
+    }
+    else if (MetaRecord::HFS_BKUPTIME == m.FsTimeKind) {
+      out << j("bkup_time", formatTime(m.FsTime));
+    }
+    out << j("mode", m.Mode)
+        << j("modified", formatTime(m.Modified))
+        << j("nlink", m.NLink)
+        << j("seq", m.Seq)
+        << j<int64_t>("size", static_cast<int64_t>(m.Size))
+        << j("type", metaType(m.Type))
+        << j("uid", m.Uid);
+  }
+}
+
+unsigned int parseFields(const std::string& list) {
+  unsigned int fields = 0;
+  std::istringstream in(list);
+  std::string name;
+  while (std::getline(in, name, ',')) {
+    if (name == "fs") {
+      fields |= FS_FIELD;
+    }
+    else if (name == "path") {
+      fields |= PATH_FIELD;
+    }
+    else if (name == "name") {
+      fields |= NAME_FIELD;
+    }
+    else if (name == "meta") {
+      fields |= META_FIELD;
+    }
+    else if (name == "attrs") {
+      fields |= ATTRS_FIELD;
+    }
+    else if (name == "runs") {
+      fields |= ATTRS_FIELD | RUNS_FIELD;
+    }
+    else if (name == "rd_buf") {
+      fields |= ATTRS_FIELD | RD_BUF_FIELD;
+    }
+    else {
+      throw std::invalid_argument("unknown field '" + name + "'");
+    }
+  }
+  if (!fields) {
+    throw std::invalid_argument("no fields given");
+  }
+  return fields;
+}
+
+void writeFsInfo(std::ostream& out, const FsRecord& fs) {
+  out << j(std::string("fs")) << ":{"
+      << j("byteOffset", fs.ByteOffset, true)
+      << j("blockSize", fs.BlockSize)
+      << j("fsID", hex(fs.FsID))
+      << j("volName", fs.VolName)
+      << j("volIndex", fs.VolIndex)
+      << "}";
+}
+
+void writeFile(std::ostream& out, const FileRecord& rec, uint32_t inodeVol, bool dirTable, unsigned int fields) {
+  out << "{" << j("id", hex(rec.ID), true)
+      << j("parent", hex(rec.Parent))
+      << j("children", hex(rec.Children))
+      << ", \"t\":{ \"fsmd\":{ ";
+
+  // every field after the first one written needs a comma
+  bool first = true;
+  if (dirTable) {
+    // path and fs are recovered from the parent's dir record and the volume's fs record
+    out << j("volIndex", rec.Fs.VolIndex, true);
+    first = false;
+  }
+  else {
+    if (fields & FS_FIELD) {
+      writeFsInfo(out, rec.Fs);
+      first = false;
+    }
+    if (fields & PATH_FIELD) {
+      out << j("path", rec.Path, first);
+      first = false;
+    }
+  }
+
+  if (rec.HasName && (fields & NAME_FIELD)) {
+    out << (first ? "": ", ") << "\"name\":";
+    writeNameRecord(out, rec.Name);
+    first = false;
+  }
+  if (rec.HasMeta && (fields & (META_FIELD | ATTRS_FIELD))) {
+    out << (first ? "": ", ") << "\"meta\":";
+    writeMetaRecord(out, rec.Meta, fields);
+    first = false;
+  }
+  if (rec.HasSniff) {
+    out << (first ? "": ", ") << "\"sniff\":";
+    writeSniffRecord(out, rec.Sniff);
+    first = false;
+  }
+  if (rec.HasHashes) {
+    out << (first ? "": ", ") << "\"hashes\":";
+    writeHashRecord(out, rec.Hashes);
+    first = false;
+  }
+  if (rec.HasStats) {
+    out << (first ? "": ", ") << "\"stats\":";
+    writeStatsRecord(out, rec.Stats);
+    first = false;
+  }
+  if (rec.HasContentRef) {
+    out << (first ? "": ", ") << "\"content_ref\":{"
+        << j("id", hex(rec.ContentRef.ID), true)
+        << j("by", rec.ContentRef.By)
+        << "}";
+  }
+  out << "}";
+  if (rec.HasMeta) {
+    out << ", \"__link\":\"" << makeInodeID(inodeVol, rec.Meta.Addr) << "\"";
+  }
+
+  out << " } }";
+}
+
+void writeNameRecord(std::ostream& out, const NameRecord& n) {
+  out << "{"
+      << j("flags", nameFlags(n.Flags), true)
+      << j<int64_t>("meta_addr", static_cast<int64_t>(n.MetaAddr))
+      << j("meta_seq", n.MetaSeq)
+      << j("name", n.Name)
+      << j("par_addr", n.ParAddr)
+      << j("par_seq", n.ParSeq)
+      << j("shrt_name", n.ShortName)
+      << j("type", nameType(n.Type))
+      << "}";
+}
+
+void writeMetaRecord(std::ostream& out, const MetaRecord& m, unsigned int fields) {
+  out << "{";
+  if (fields & META_FIELD) {
+    writeMetaFields(out, m);
+  }
+  if (fields & ATTRS_FIELD) {
+    out << (fields & META_FIELD ? ", ": "") << "\"attrs\":[";
+    bool first = true;
+    for (const AttrRecord& a: m.Attrs) {
+      if (!first) {
+        out << ", ";
+      }
+      writeAttr(out, a, fields);
+      first = false;
+    }
+    out << "]";
+  }
+  out << "}";
+}
+
+void writeAttr(std::ostream& out, const AttrRecord& a, unsigned int fields) {
+  out << "{"
+      << j("flags", attrFlags(a.Flags), true)
+      << j("id", a.ID)
+      << j("name", a.Name)
+      << j<int64_t>("size", static_cast<int64_t>(a.Size))
+      << j("type", a.Type)
+      << j("rd_buf_size", a.RdBufSize)
+      << j("nrd_allocsize", a.AllocSize)
+      << j("nrd_compsize", a.CompSize)
+      << j("nrd_initsize", a.InitSize)
+      << j("nrd_skiplen", a.SkipLen)
+      << j("physical_size", a.PhysicalSize)
+      << j("slack_size", a.SlackSize);
+
+  if (fields & RD_BUF_FIELD && a.Flags & TSK_FS_ATTR_RES && a.RdBufSize) {
+    out << ", " << j(std::string("rd_buf")) << ":\"" << hex(a.ResidentData) << "\"";
+  }
+
+  if (fields & RUNS_FIELD && a.Flags & TSK_FS_ATTR_NONRES) {
+    // output data runs as json
+    out << ", \"nrd_runs\":[";
+    bool first = true;
+    for (const RunRecord& r: a.Runs) {
+      if (!first) {
+        out << ", ";
+      }
+      out << "{"
+          << j("addr", r.Addr, true)
+          << j("flags", r.Flags)
+          << j("len", r.Len)
+          << j("offset", r.Offset)
+          << "}";
+      first = false;
+    }
+    out << "]";
+  }
+  out << "}";
+}
+
+void writeHashRecord(std::ostream& out, const HashRecord& h) {
+  out << "{"
+      << j("size", h.Size, true)
+      << j("md5", hex(h.MD5))
+      << j("sha1", hex(h.SHA1))
+      << j("sha256", hex(h.SHA256));
+  if (!h.Known.empty()) {
+    out << j("known", h.Known);
+  }
+  out << "}";
+}
+
+void writeSniffRecord(std::ostream& out, const SniffRecord& s) {
+  out << "{"
+      << j("type", s.Type, true)
+      << ",\"mismatch\":" << (s.Mismatch ? "true": "false")
+      << "}";
+}
+
+void writeStatsRecord(std::ostream& out, const StatsRecord& s) {
+  out << "{"
+      << j("size", s.Size, true)
+      << j("entropy", s.Entropy)
+      << j("zero_ratio", s.ZeroRatio)
+      << j("text_ratio", s.TextRatio)
+      << j("histogram", hex(s.Histogram))
+      << "}";
+}
@@ -0,0 +1,64 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "mappedfile.h"
+
+#include <stdexcept>
+
+#if defined(_WIN32)
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path, const std::string& what):
+  Map(nullptr), MapLen(0)
+{
+#if defined(_WIN32)
+  MapHandle = nullptr;
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error("Could not open " + what + " " + path);
+  }
+  LARGE_INTEGER len;
+  GetFileSizeEx(file, &len);
+  MapLen = len.QuadPart;
+  MapHandle = MapLen ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr): nullptr;
+  CloseHandle(file);
+  Map = MapHandle ? MapViewOfFile(MapHandle, FILE_MAP_READ, 0, 0, 0): nullptr;
+  if (!Map) {
+    if (MapHandle) {
+      CloseHandle(MapHandle);
+    }
+    throw std::runtime_error("Could not map " + what + " " + path);
+  }
+#else
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Could not open " + what + " " + path);
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0) {
+    MapLen = st.st_size;
+  }
+  void* map = MapLen ? mmap(nullptr, MapLen, PROT_READ, MAP_SHARED, fd, 0): MAP_FAILED;
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error("Could not map " + what + " " + path);
+  }
+  Map = map;
+#endif
+}
+
+MappedFile::~MappedFile() {
+#if defined(_WIN32)
+  UnmapViewOfFile(Map);
+  CloseHandle(MapHandle);
+#else
+  munmap(Map, MapLen);
+#endif
+}
@@ -0,0 +1,97 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "search.h"
+
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <stdexcept>
+
+namespace {
+  const uint32_t NO_STATE = 0xFFFFFFFF;
+
+  unsigned char fold(unsigned char c, bool ignoreCase) {
+    return ignoreCase ? std::tolower(c): c;
+  }
+}
+
+PatternMatcher::PatternMatcher(const std::vector<std::string>& patterns, bool ignoreCase):
+  Patterns(patterns), MaxLen(0)
+{
+  if (Patterns.empty()) {
+    throw std::invalid_argument("no patterns to search for");
+  }
+
+  // the trie, with NO_STATE for missing edges
+  Next.assign(256, NO_STATE);
+  Outputs.resize(1);
+  for (uint32_t p = 0; p < Patterns.size(); ++p) {
+    const std::string& pattern(Patterns[p]);
+    if (pattern.empty()) {
+      throw std::invalid_argument("empty search pattern");
+    }
+    MaxLen = std::max(MaxLen, pattern.size());
+
+    uint32_t state = 0;
+    for (char ch: pattern) {
+      const unsigned char c = fold(ch, ignoreCase);
+      if (NO_STATE == Next[state * 256 + c]) {
+        Next[state * 256 + c] = Outputs.size();
+        Next.resize(Next.size() + 256, NO_STATE);
+        Outputs.resize(Outputs.size() + 1);
+      }
+      state = Next[state * 256 + c];
+    }
+    Outputs[state].push_back(p);
+  }
+
+  // Breadth first, so that a state's failure state, being shallower, is
+  // complete before it. Missing edges become the failure state's edges, and
+  // a state's outputs gain those of its failure state.
+  std::vector<uint32_t> fail(Outputs.size(), 0);
+  std::deque<uint32_t> queue(1, 0);
+  while (!queue.empty()) {
+    const uint32_t state = queue.front();
+    queue.pop_front();
+    for (unsigned int c = 0; c < 256; ++c) {
+      uint32_t& next(Next[state * 256 + c]);
+      const uint32_t failNext = state ? Next[fail[state] * 256 + c]: 0;
+      if (NO_STATE == next) {
+        next = failNext;
+      }
+      else {
+        fail[next] = failNext;
+        const std::vector<uint32_t>& inherited(Outputs[failNext]);
+        Outputs[next].insert(Outputs[next].end(), inherited.begin(), inherited.end());
+        queue.push_back(next);
+      }
+    }
+    if (ignoreCase) {
+      // patterns were folded, so upper case has no edges of its own
+      for (unsigned int c = 'A'; c <= 'Z'; ++c) {
+        Next[state * 256 + c] = Next[state * 256 + std::tolower(c)];
+      }
+    }
+  }
+
+  HasOut.resize(Outputs.size());
+  for (uint32_t state = 0; state < Outputs.size(); ++state) {
+    HasOut[state] = !Outputs[state].empty();
+  }
+}
+
+void PatternMatcher::search(const char* data, size_t len, uint64_t base, std::vector<Hit>& hits, size_t reportFrom) const {
+  const uint32_t* next = Next.data();
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+  uint32_t state = 0;
+  for (size_t i = 0; i < len; ++i) {
+    state = next[state * 256 + bytes[i]];
+    if (HasOut[state] && i >= reportFrom) {
+      for (uint32_t p: Outputs[state]) {
+        hits.push_back(Hit{base + i + 1 - Patterns[p].size(), p});
+      }
+    }
+  }
+}
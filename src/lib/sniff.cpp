@@ -0,0 +1,88 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "sniff.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace {
+  std::string bytes(const char* b, size_t len) {
+    return std::string(b, len);
+  }
+}
+
+const std::vector<FileSignature>& fileSignatures() {
+  static const std::vector<FileSignature> sigs{
+    {"ooxml",  {{0, bytes("PK\x03\x04", 4)}, {30, "[Content_Types].xml"}},
+                {"docx", "docm", "dotx", "xlsx", "xlsm", "xltx", "pptx", "pptm", "potx", "vsdx"}},
+    {"zip",    {{0, bytes("PK\x03\x04", 4)}},
+                {"zip", "jar", "apk", "odt", "ods", "odp", "epub", "xpi", "kmz",
+                 "docx", "docm", "dotx", "xlsx", "xlsm", "xltx", "pptx", "pptm", "potx", "vsdx"}},
+    {"jpeg",   {{0, bytes("\xff\xd8\xff", 3)}},                 {"jpg", "jpeg", "jpe", "jfif"}},
+    {"png",    {{0, bytes("\x89PNG\r\n\x1a\n", 8)}},            {"png"}},
+    {"gif",    {{0, "GIF8"}},                                   {"gif"}},
+    {"tiff",   {{0, bytes("II*\0", 4)}},                        {"tif", "tiff", "dng", "nef", "cr2", "arw"}},
+    {"tiff",   {{0, bytes("MM\0*", 4)}},                        {"tif", "tiff", "dng", "nef", "cr2", "arw"}},
+    {"pdf",    {{0, "%PDF-"}},                                  {"pdf"}},
+    {"rtf",    {{0, "{\\rtf"}},                                 {"rtf", "doc"}},
+    {"ole2",   {{0, bytes("\xd0\xcf\x11\xe0\xa1\xb1\x1a\xe1", 8)}},
+                {"doc", "dot", "xls", "xlt", "ppt", "pot", "msg", "msi", "msp", "vsd", "pub", "db"}},
+    {"pe",     {{0, "MZ"}},
+                {"exe", "dll", "sys", "ocx", "cpl", "scr", "drv", "efi", "com", "mui", "ax", "tlb"}},
+    {"elf",    {{0, "\x7f" "ELF"}},                             {}},
+    {"sqlite", {{0, bytes("SQLite format 3\0", 16)}},           {"", "sqlite", "sqlite3", "db", "db3", "sqlitedb"}},
+    {"evtx",   {{0, bytes("ElfFile\0", 8)}},                    {"evtx"}},
+    {"registry", {{0, "regf"}},                                 {"", "dat", "hve", "sav"}},
+    {"pst",    {{0, "!BDN"}},                                   {"pst", "ost"}},
+    {"lnk",    {{0, bytes("L\0\0\0\x01\x14\x02\0", 8)}},        {"lnk"}},
+    {"gzip",   {{0, bytes("\x1f\x8b", 2)}},                     {"gz", "tgz", "gzip", "svgz"}},
+    {"bzip2",  {{0, "BZh"}},                                    {"bz2", "tbz", "tbz2"}},
+    {"xz",     {{0, bytes("\xfd" "7zXZ\0", 6)}},                {"xz", "txz"}},
+    {"7z",     {{0, bytes("7z\xbc\xaf\x27\x1c", 6)}},           {"7z"}},
+    {"rar",    {{0, bytes("Rar!\x1a\x07", 6)}},                 {"rar"}},
+    {"mp3",    {{0, "ID3"}},                                    {"mp3"}},
+    {"mp4",    {{4, "ftyp"}},                                   {"mp4", "m4a", "m4v", "mov", "3gp", "heic", "heif", "avif"}},
+    {"riff",   {{0, "RIFF"}},                                   {"wav", "avi", "webp", "ani"}},
+    {"ogg",    {{0, "OggS"}},                                   {"ogg", "oga", "ogv", "opus"}},
+    {"flac",   {{0, "fLaC"}},                                   {"flac"}},
+    {"xml",    {{0, "<?xml"}},                                  {}}
+  };
+  return sigs;
+}
+
+std::string sniffType(const char* data, size_t len) {
+  for (const FileSignature& sig: fileSignatures()) {
+    bool match = true;
+    for (auto& m: sig.Magic) {
+      if (len < m.first + m.second.size() || m.second.compare(0, std::string::npos, data + m.first, m.second.size())) {
+        match = false;
+        break;
+      }
+    }
+    if (match) {
+      return sig.Type;
+    }
+  }
+  return "";
+}
+
+bool extensionMismatch(const std::string& type, const std::string& name) {
+  // a leading dot, as in ".bashrc", doesn't start an extension
+  const size_t dot = name.find_last_of('.');
+  std::string ext(dot == std::string::npos || dot == 0 ? "": name.substr(dot + 1));
+  std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return std::tolower(static_cast<unsigned char>(c)); });
+
+  bool known = false;
+  for (const FileSignature& sig: fileSignatures()) {
+    if (sig.Type != type) {
+      continue;
+    }
+    known = true;
+    if (sig.Extensions.empty() || std::find(sig.Extensions.begin(), sig.Extensions.end(), ext) != sig.Extensions.end()) {
+      return false;
+    }
+  }
+  return known;
+}
@@ -0,0 +1,310 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "sqlitewriter.h"
+
+#include "enums.h"
+#include "jsonrec.h"
+#include "util.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <sqlite3.h>
+
+namespace {
+  const char* const SCHEMA =
+    "CREATE TABLE files (id TEXT, vol INTEGER, inode_vol INTEGER, path TEXT, name TEXT, short_name TEXT,"
+    " name_flags TEXT, name_type TEXT, par_addr INTEGER, meta_addr INTEGER, size INTEGER, meta_flags TEXT,"
+    " meta_type TEXT, mode INTEGER, uid INTEGER, gid INTEGER, nlink INTEGER, seq INTEGER, accessed INTEGER,"
+    " created INTEGER, metadata INTEGER, modified INTEGER, record TEXT);"
+    "CREATE TABLE inodes (id TEXT, vol INTEGER, inum INTEGER, record TEXT);"
+    "CREATE TABLE disk_map (id TEXT, offset INTEGER, record TEXT);";
+
+  const char* const INDEXES =
+    "CREATE INDEX files_id ON files (id);"
+    "CREATE INDEX files_path ON files (path, name);"
+    "CREATE INDEX files_inode ON files (inode_vol, meta_addr);"
+    "CREATE INDEX files_accessed ON files (accessed);"
+    "CREATE INDEX files_created ON files (created);"
+    "CREATE INDEX files_metadata ON files (metadata);"
+    "CREATE INDEX files_modified ON files (modified);"
+    "CREATE INDEX inodes_id ON inodes (id);"
+    "CREATE INDEX inodes_inum ON inodes (vol, inum);"
+    "CREATE INDEX disk_map_offset ON disk_map (offset);"
+    "ANALYZE;";
+
+  std::string hex(const std::string& bytes) {
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(bytes.data());
+    return bytesAsString(b, b + bytes.size());
+  }
+
+  // the hex digits of an ID from pos, as a number
+  uint64_t idField(const std::string& id, size_t pos, size_t len) {
+    return pos < id.size() ? std::strtoull(id.substr(pos, len).c_str(), nullptr, 16): 0;
+  }
+
+  // binds values in order, to a statement reset for reuse; strings must
+  // outlive the step
+  class Binder {
+  public:
+    Binder(sqlite3_stmt* stmt): Stmt(stmt), Col(0) {}
+
+    Binder& text(const std::string& s) {
+      sqlite3_bind_text(Stmt, ++Col, s.data(), s.size(), SQLITE_STATIC);
+      return *this;
+    }
+
+    Binder& integer(int64_t i) {
+      sqlite3_bind_int64(Stmt, ++Col, i);
+      return *this;
+    }
+
+    Binder& null(unsigned int n) {
+      for (unsigned int i = 0; i < n; ++i) {
+        sqlite3_bind_null(Stmt, ++Col);
+      }
+      return *this;
+    }
+
+  private:
+    sqlite3_stmt* Stmt;
+    int           Col;
+  };
+}
+
+SqliteWriter::SqliteWriter(const std::string& path, unsigned int batchSize, unsigned int maxQueuedBatches):
+  Db(nullptr), InsertFile(nullptr), InsertInode(nullptr), InsertDiskMap(nullptr),
+  BatchSize(batchSize), MaxQueuedBatches(maxQueuedBatches), Done(false)
+{
+  // a fresh database, so that nothing is left of an earlier one
+  std::remove(path.c_str());
+  std::remove((path + "-wal").c_str());
+  std::remove((path + "-shm").c_str());
+  if (sqlite3_open_v2(path.c_str(), &Db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK) {
+    const std::string msg(Db ? sqlite3_errmsg(Db): "out of memory");
+    sqlite3_close(Db);
+    throw std::runtime_error("Could not open SQLite output file " + path + ": " + msg);
+  }
+  try {
+    // a crash mid-load leaves a database to be made again, not one to save
+    exec("PRAGMA journal_mode = WAL; PRAGMA synchronous = OFF; PRAGMA temp_store = MEMORY;"
+         " PRAGMA cache_size = -262144;");
+    exec(SCHEMA);
+    const char* sql[] = {
+      "INSERT INTO files VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+      "INSERT INTO inodes VALUES (?, ?, ?, ?)",
+      "INSERT INTO disk_map VALUES (?, ?, ?)"
+    };
+    sqlite3_stmt** stmts[] = {&InsertFile, &InsertInode, &InsertDiskMap};
+    for (unsigned int i = 0; i < 3; ++i) {
+      if (sqlite3_prepare_v2(Db, sql[i], -1, stmts[i], nullptr) != SQLITE_OK) {
+        throw std::runtime_error(std::string("Could not prepare SQLite insert: ") + sqlite3_errmsg(Db));
+      }
+    }
+  }
+  catch (...) {
+    sqlite3_finalize(InsertFile);
+    sqlite3_finalize(InsertInode);
+    sqlite3_finalize(InsertDiskMap);
+    sqlite3_close(Db);
+    throw;
+  }
+  Writer = std::thread(&SqliteWriter::run, this);
+}
+
+SqliteWriter::~SqliteWriter() {
+  try {
+    close();
+  }
+  catch (std::exception& e) {
+    std::cerr << "Error writing SQLite output: " << e.what() << std::endl;
+  }
+  sqlite3_finalize(InsertFile);
+  sqlite3_finalize(InsertInode);
+  sqlite3_finalize(InsertDiskMap);
+  sqlite3_close(Db);
+}
+
+void SqliteWriter::exec(const char* sql) {
+  char* err = nullptr;
+  if (sqlite3_exec(Db, sql, nullptr, nullptr, &err) != SQLITE_OK) {
+    const std::string msg(err ? err: sqlite3_errmsg(Db));
+    sqlite3_free(err);
+    throw std::runtime_error("SQLite error: " + msg);
+  }
+}
+
+void SqliteWriter::push(const FileRecord& rec, uint32_t inodeVol) {
+  Cur.Files.push_back(std::make_pair(rec, inodeVol));
+  if (Cur.size() >= BatchSize) {
+    enqueue();
+  }
+}
+
+void SqliteWriter::pushDiskMap(const std::string& id, const std::string& line) {
+  Cur.Maps.push_back(MapRow{true, id, line});
+  if (Cur.size() >= BatchSize) {
+    enqueue();
+  }
+}
+
+void SqliteWriter::pushInode(const std::string& id, const std::string& line) {
+  Cur.Maps.push_back(MapRow{false, id, line});
+  if (Cur.size() >= BatchSize) {
+    enqueue();
+  }
+}
+
+void SqliteWriter::enqueue() {
+  std::unique_lock<std::mutex> lock(Mutex);
+  if (!queueCur(lock)) {
+    std::rethrow_exception(Error);
+  }
+}
+
+bool SqliteWriter::queueCur(std::unique_lock<std::mutex>& lock) {
+  NotFull.wait(lock, [this]{ return Queue.size() < MaxQueuedBatches || Error; });
+  if (Error) {
+    return false;
+  }
+  Queue.push_back(Batch());
+  std::swap(Queue.back(), Cur);
+  NotEmpty.notify_one();
+  return true;
+}
+
+void SqliteWriter::close() {
+  if (!Writer.joinable()) {
+    return;
+  }
+  {
+    // the writer thread is always joined, even once it has failed, so that
+    // its error is rethrown rather than the thread left running
+    std::unique_lock<std::mutex> lock(Mutex);
+    if (Cur.size()) {
+      queueCur(lock);
+    }
+    Done = true;
+    NotEmpty.notify_one();
+  }
+  Writer.join();
+  if (Error) {
+    std::rethrow_exception(Error);
+  }
+  // indexes are much faster to make in one go than to keep up while loading
+  exec(INDEXES);
+  // back to a single file, synced
+  exec("PRAGMA synchronous = FULL; PRAGMA journal_mode = DELETE;");
+}
+
+void SqliteWriter::run() {
+  try {
+    while (true) {
+      Batch batch;
+      {
+        std::unique_lock<std::mutex> lock(Mutex);
+        NotEmpty.wait(lock, [this]{ return !Queue.empty() || Done; });
+        if (Queue.empty()) {
+          return;
+        }
+        std::swap(batch, Queue.front());
+        Queue.pop_front();
+        NotFull.notify_one();
+      }
+      insert(batch);
+    }
+  }
+  catch (...) {
+    std::lock_guard<std::mutex> lock(Mutex);
+    Error = std::current_exception();
+    NotFull.notify_all();
+  }
+}
+
+void SqliteWriter::insert(const Batch& batch) {
+  exec("BEGIN");
+  try {
+    insertRows(batch);
+    exec("COMMIT");
+  }
+  catch (...) {
+    // so that the database is left with whole batches, and unlocked
+    sqlite3_reset(InsertFile);
+    sqlite3_reset(InsertInode);
+    sqlite3_reset(InsertDiskMap);
+    sqlite3_exec(Db, "ROLLBACK", nullptr, nullptr, nullptr);
+    throw;
+  }
+}
+
+void SqliteWriter::insertRows(const Batch& batch) {
+  std::stringstream buf;
+  for (auto& f: batch.Files) {
+    const FileRecord& rec(f.first);
+    buf.str(std::string());
+    writeFile(buf, rec, f.second, false);
+
+    const std::string id(hex(rec.ID)),
+                      record(buf.str());
+    std::string nameFlagsStr,
+                nameTypeStr,
+                metaFlagsStr,
+                metaTypeStr;
+    Binder b(InsertFile);
+    b.text(id).integer(rec.Fs.VolIndex).integer(f.second).text(rec.Path);
+    if (rec.HasName) {
+      nameFlagsStr = nameFlags(rec.Name.Flags);
+      nameTypeStr = nameType(rec.Name.Type);
+      b.text(rec.Name.Name).text(rec.Name.ShortName).text(nameFlagsStr).text(nameTypeStr)
+       .integer(rec.Name.ParAddr);
+    }
+    else {
+      b.null(5);
+    }
+    if (rec.HasMeta) {
+      const MetaRecord& m(rec.Meta);
+      metaFlagsStr = metaFlags(m.Flags);
+      metaTypeStr = metaType(m.Type);
+      b.integer(m.Addr).integer(m.Size).text(metaFlagsStr).text(metaTypeStr)
+       .integer(m.Mode).integer(m.Uid).integer(m.Gid).integer(m.NLink).integer(m.Seq)
+       .integer(m.Accessed.Secs).integer(m.Created.Secs).integer(m.Metadata.Secs).integer(m.Modified.Secs);
+    }
+    else if (rec.HasName) {
+      b.integer(rec.Name.MetaAddr).null(12);
+    }
+    else {
+      b.null(13);
+    }
+    b.text(record);
+    if (sqlite3_step(InsertFile) != SQLITE_DONE) {
+      throw std::runtime_error(std::string("Could not insert a file: ") + sqlite3_errmsg(Db));
+    }
+    sqlite3_reset(InsertFile);
+  }
+
+  for (const MapRow& row: batch.Maps) {
+    // the line's newline isn't kept
+    const std::string record(row.Line, 0, !row.Line.empty() && row.Line.back() == '\n' ? row.Line.size() - 1: row.Line.size());
+    sqlite3_stmt* stmt = row.DiskMap ? InsertDiskMap: InsertInode;
+    Binder b(stmt);
+    b.text(row.ID);
+    if (row.DiskMap) {
+      // type (2 hex digits), then the offset
+      b.integer(idField(row.ID, 2, 16));
+    }
+    else {
+      // type (2 hex digits), then the volume (8), then the inode number
+      b.integer(idField(row.ID, 2, 8)).integer(idField(row.ID, 10, 16));
+    }
+    b.text(record);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+      throw std::runtime_error(std::string("Could not insert a map line: ") + sqlite3_errmsg(Db));
+    }
+    sqlite3_reset(stmt);
+  }
+}
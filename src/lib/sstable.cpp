@@ -0,0 +1,421 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "sstable.h"
+
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <stdexcept>
+
+#include <zlib.h>
+
+namespace {
+  const char     MAGIC[4]    = {'F', 'S', 'S', 'T'};
+  const uint64_t FOOTER_SIZE = 40,
+                 ENTRY_SIZE  = 8; // key and value lengths
+  const uint32_t NUM_HASHES  = 7;
+
+  uint32_t getLE32(const unsigned char* buf) {
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | (static_cast<uint32_t>(buf[3]) << 24);
+  }
+
+  uint64_t getLE64(const unsigned char* buf) {
+    return getLE32(buf) | (static_cast<uint64_t>(getLE32(buf + 4)) << 32);
+  }
+
+  void putLE(std::string& s, uint64_t val, unsigned int n) {
+    for (unsigned int i = 0; i < n; ++i) {
+      s.push_back(static_cast<char>((val >> (8 * i)) & 0xFF));
+    }
+  }
+
+  void putEntry(std::string& s, const std::string& key, const std::string& value) {
+    putLE(s, key.size(), 4);
+    putLE(s, value.size(), 4);
+    s += key;
+    s += value;
+  }
+
+  std::pair<uint64_t, uint64_t> bloomHashes(const std::string& key) {
+    uint64_t h1 = 0xcbf29ce484222325ull;
+    for (const char c: key) {
+      h1 ^= static_cast<unsigned char>(c);
+      h1 *= 0x100000001b3ull;
+    }
+    const uint64_t h2 = (((h1 >> 32) | (h1 << 32)) * 0x9E3779B97F4A7C15ull) | 1;
+    return std::make_pair(h1, h2);
+  }
+
+  std::string compressBlock(const std::string& data) {
+    uLongf len = compressBound(data.size());
+    std::string ret(len, '\0');
+    if (compress2(reinterpret_cast<Bytef*>(&ret[0]), &len, reinterpret_cast<const Bytef*>(data.data()),
+                  data.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+    {
+      throw std::runtime_error("Could not compress an SSTable block");
+    }
+    ret.resize(len);
+    return ret;
+  }
+
+  bool keyLess(const std::pair<std::string, std::string>& a, const std::pair<std::string, std::string>& b) {
+    return a.first < b.first;
+  }
+
+  // reads back a spilled run, one entry at a time
+  class RunReader {
+  public:
+    RunReader(FILE* file): File(file) {}
+
+    bool next() {
+      unsigned char lens[ENTRY_SIZE];
+      const size_t got = std::fread(lens, 1, ENTRY_SIZE, File);
+      if (got == 0 && std::feof(File)) {
+        return false;
+      }
+      if (got != ENTRY_SIZE || !read(Key, getLE32(lens)) || !read(Value, getLE32(lens + 4))) {
+        throw std::runtime_error("Could not read back a sorted run");
+      }
+      return true;
+    }
+
+    std::string Key,
+                Value;
+
+  private:
+    bool read(std::string& s, uint32_t len) {
+      s.resize(len);
+      return len == 0 || std::fread(&s[0], 1, len, File) == len;
+    }
+
+    FILE* File;
+  };
+}
+
+SSTableBuilder::SSTableBuilder(std::ostream& out, ThreadPool& pool, uint64_t numEntries):
+  Out(out), Pool(pool), Offset(0), NumBlocks(0), NumEntries(0)
+{
+  // ten bits per entry, rounded up to a power of two, gives a false
+  // positive rate of about 1% or better with seven hashes
+  uint64_t bits = 64;
+  while (bits < 10 * numEntries) {
+    bits <<= 1;
+  }
+  Bloom.resize(bits / 8, 0);
+}
+
+void SSTableBuilder::add(const std::string& key, const std::string& value) {
+  if (NumEntries && key < LastKey) {
+    throw std::invalid_argument("SSTable keys must be added in order");
+  }
+  if (Buf.empty()) {
+    FirstKey = key;
+  }
+  putEntry(Buf, key, value);
+  LastKey = key;
+  ++NumEntries;
+
+  const uint64_t numBits = Bloom.size() * 8;
+  const std::pair<uint64_t, uint64_t> h(bloomHashes(key));
+  for (uint32_t i = 0; i < NUM_HASHES; ++i) {
+    const uint64_t bit = (h.first + i * h.second) & (numBits - 1);
+    Bloom[bit / 8] |= 1 << (bit % 8);
+  }
+
+  if (Buf.size() >= SSTABLE_BLOCK_SIZE) {
+    submitBlock();
+  }
+}
+
+void SSTableBuilder::submitBlock() {
+  if (Buf.empty()) {
+    return;
+  }
+  std::shared_ptr<std::string> data(new std::string);
+  data->swap(Buf);
+  Pending.push_back(Block{FirstKey, static_cast<uint32_t>(data->size()), Pool.submit([data]{ return compressBlock(*data); })});
+
+  // bound memory use, but keep every thread busy
+  drain(2 * Pool.size());
+}
+
+void SSTableBuilder::drain(size_t maxPending) {
+  while (Pending.size() > maxPending) {
+    Block& b(Pending.front());
+    const std::string compressed(b.Compressed.get());
+    Out.write(compressed.data(), compressed.size());
+
+    putLE(Index, Offset, 8);
+    putLE(Index, compressed.size(), 4);
+    putLE(Index, b.Len, 4);
+    putLE(Index, b.FirstKey.size(), 4);
+    Index += b.FirstKey;
+
+    Offset += compressed.size();
+    ++NumBlocks;
+    Pending.pop_front();
+  }
+}
+
+void SSTableBuilder::finish() {
+  submitBlock();
+  drain(0);
+
+  const uint64_t indexOffset = Offset,
+                 bloomOffset = indexOffset + Index.size();
+  std::string tail(Index);
+  putLE(tail, NUM_HASHES, 4);
+  putLE(tail, Bloom.size() * 8, 8);
+  tail.append(reinterpret_cast<const char*>(Bloom.data()), Bloom.size());
+  putLE(tail, indexOffset, 8);
+  putLE(tail, bloomOffset, 8);
+  putLE(tail, NumBlocks, 8);
+  putLE(tail, NumEntries, 8);
+  putLE(tail, SSTABLE_VERSION, 4);
+  tail.append(MAGIC, sizeof(MAGIC));
+  Out.write(tail.data(), tail.size());
+  Out.flush();
+  if (!Out) {
+    throw std::runtime_error("Could not write the SSTable");
+  }
+}
+
+/*************************************************************************/
+
+ExternalSorter::ExternalSorter(std::shared_ptr<ThreadPool> pool, size_t runBytes):
+  Pool(pool), RunBytes(runBytes), CurBytes(0), NumEntries(0), Cur(new Run) {}
+
+ExternalSorter::~ExternalSorter() {
+  while (!Spilling.empty()) {
+    try {
+      Spilled.push_back(Spilling.front().get());
+    }
+    catch (std::exception&) {
+      // already reported, or the sorter is being unwound
+    }
+    Spilling.pop_front();
+  }
+  for (FILE* f: Spilled) {
+    std::fclose(f);
+  }
+}
+
+void ExternalSorter::add(const std::string& key, const std::string& value) {
+  Cur->push_back(std::make_pair(key, value));
+  CurBytes += key.size() + value.size() + 2 * sizeof(std::string);
+  ++NumEntries;
+  if (CurBytes >= RunBytes) {
+    spill();
+  }
+}
+
+void ExternalSorter::spill() {
+  if (Cur->empty()) {
+    return;
+  }
+  std::shared_ptr<Run> run(Cur);
+  Cur.reset(new Run);
+  CurBytes = 0;
+  Spilling.push_back(Pool->submit([run]{
+    std::stable_sort(run->begin(), run->end(), keyLess);
+    FILE* file = std::tmpfile();
+    if (!file) {
+      throw std::runtime_error("Could not create a temporary file for sorting");
+    }
+    std::string buf;
+    for (auto& e: *run) {
+      putEntry(buf, e.first, e.second);
+      if (buf.size() >= 1024 * 1024) {
+        if (std::fwrite(buf.data(), 1, buf.size(), file) != buf.size()) {
+          std::fclose(file);
+          throw std::runtime_error("Could not write a sorted run");
+        }
+        buf.clear();
+      }
+    }
+    if (std::fwrite(buf.data(), 1, buf.size(), file) != buf.size() || std::fflush(file) != 0) {
+      std::fclose(file);
+      throw std::runtime_error("Could not write a sorted run");
+    }
+    std::rewind(file);
+    run->clear();
+    return file;
+  }));
+
+  // each run still in memory takes RunBytes, so only as many as there are
+  // threads to sort them
+  collectSpilled(Pool->size());
+}
+
+void ExternalSorter::collectSpilled(size_t maxPending) {
+  while (Spilling.size() > maxPending) {
+    std::future<FILE*> f(std::move(Spilling.front()));
+    Spilling.pop_front();
+    Spilled.push_back(f.get());
+  }
+}
+
+void ExternalSorter::merge(const EntrySink& sink) {
+  if (Spilled.empty() && Spilling.empty()) {
+    std::stable_sort(Cur->begin(), Cur->end(), keyLess);
+    for (auto& e: *Cur) {
+      sink(e.first, e.second);
+    }
+  }
+  else {
+    spill();
+    collectSpilled(0);
+
+    std::vector<RunReader> readers(Spilled.begin(), Spilled.end());
+    // the least key on top; for equal keys, the earlier run
+    auto later = [&readers](size_t a, size_t b) {
+      return readers[b].Key < readers[a].Key || (!(readers[a].Key < readers[b].Key) && b < a);
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heads(later);
+    for (size_t i = 0; i < readers.size(); ++i) {
+      if (readers[i].next()) {
+        heads.push(i);
+      }
+    }
+    while (!heads.empty()) {
+      const size_t i = heads.top();
+      heads.pop();
+      sink(readers[i].Key, readers[i].Value);
+      if (readers[i].next()) {
+        heads.push(i);
+      }
+    }
+    for (FILE* f: Spilled) {
+      std::fclose(f);
+    }
+    Spilled.clear();
+  }
+  Cur.reset(new Run);
+  CurBytes = 0;
+  NumEntries = 0;
+}
+
+/*************************************************************************/
+
+SSTable::SSTable(const std::string& path):
+  Path(path), File(path, "SSTable")
+{
+  const unsigned char* buf = File.data();
+  const uint64_t       len = File.size();
+  if (len < FOOTER_SIZE || std::memcmp(buf + len - 4, MAGIC, sizeof(MAGIC))
+      || getLE32(buf + len - 8) != SSTABLE_VERSION)
+  {
+    throw std::runtime_error(path + " is not an SSTable");
+  }
+  const unsigned char* footer = buf + len - FOOTER_SIZE;
+  const uint64_t indexOffset = getLE64(footer),
+                 bloomOffset = getLE64(footer + 8),
+                 numBlocks   = getLE64(footer + 16);
+  NumEntries = getLE64(footer + 24);
+  if (indexOffset > bloomOffset || bloomOffset + 12 > len - FOOTER_SIZE) {
+    throw std::runtime_error(path + " is not a valid SSTable");
+  }
+
+  uint64_t pos = indexOffset;
+  for (uint64_t i = 0; i < numBlocks; ++i) {
+    if (pos + 20 > bloomOffset || pos + 20 + getLE32(buf + pos + 16) > bloomOffset) {
+      throw std::runtime_error(path + " is not a valid SSTable");
+    }
+    BlockInfo b = {getLE64(buf + pos), getLE32(buf + pos + 8), getLE32(buf + pos + 12),
+                   std::string(reinterpret_cast<const char*>(buf) + pos + 20, getLE32(buf + pos + 16))};
+    if (b.Offset > indexOffset || b.CompressedLen > indexOffset - b.Offset) {
+      throw std::runtime_error(path + " is not a valid SSTable");
+    }
+    pos += 20 + b.FirstKey.size();
+    Blocks.push_back(b);
+  }
+
+  NumHashes = getLE32(buf + bloomOffset);
+  NumBits   = getLE64(buf + bloomOffset + 4);
+  Bits      = buf + bloomOffset + 12;
+  // the bit count must be a power of two, for the mask in mayContain()
+  if (NumBits < 8 || (NumBits & (NumBits - 1)) || NumBits / 8 != len - FOOTER_SIZE - bloomOffset - 12) {
+    throw std::runtime_error(path + " is not a valid SSTable");
+  }
+}
+
+bool SSTable::mayContain(const std::string& key) const {
+  const std::pair<uint64_t, uint64_t> h(bloomHashes(key));
+  for (uint32_t i = 0; i < NumHashes; ++i) {
+    const uint64_t bit = (h.first + i * h.second) & (NumBits - 1);
+    if (!(Bits[bit / 8] & (1 << (bit % 8)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string SSTable::readBlock(const BlockInfo& block) const {
+  std::string ret(block.Len, '\0');
+  uLongf len = block.Len;
+  if (uncompress(reinterpret_cast<Bytef*>(&ret[0]), &len, File.data() + block.Offset, block.CompressedLen) != Z_OK
+      || len != block.Len)
+  {
+    throw std::runtime_error(Path + " has a corrupt block");
+  }
+  return ret;
+}
+
+void SSTable::scanBlock(const BlockInfo& b, const std::function<bool(const std::string&, const std::string&)>& visit) const {
+  const std::string block(readBlock(b));
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(block.data());
+  std::string key,
+              value;
+  size_t pos = 0;
+  while (pos < block.size()) {
+    if (block.size() - pos < ENTRY_SIZE
+        || static_cast<uint64_t>(getLE32(data + pos)) + getLE32(data + pos + 4) > block.size() - pos - ENTRY_SIZE)
+    {
+      throw std::runtime_error(Path + " has a malformed entry");
+    }
+    const uint32_t keyLen = getLE32(data + pos),
+                   valLen = getLE32(data + pos + 4);
+    key.assign(block, pos + ENTRY_SIZE, keyLen);
+    value.assign(block, pos + ENTRY_SIZE + keyLen, valLen);
+    if (!visit(key, value)) {
+      return;
+    }
+    pos += ENTRY_SIZE + keyLen + valLen;
+  }
+}
+
+bool SSTable::get(const std::string& key, std::string& value) const {
+  if (!mayContain(key)) {
+    return false;
+  }
+  // the previous block may end with the key, if it begins this one
+  auto it = std::lower_bound(Blocks.begin(), Blocks.end(), key,
+                             [](const BlockInfo& b, const std::string& k) { return b.FirstKey < k; });
+  if (it != Blocks.begin()) {
+    --it;
+  }
+  bool found = false,
+       past  = false;
+  for (; it != Blocks.end() && !found && !past && !(key < it->FirstKey); ++it) {
+    scanBlock(*it, [&](const std::string& k, const std::string& v) {
+      if (k == key) {
+        value = v;
+        found = true;
+      }
+      past = key < k;
+      return !found && !past;
+    });
+  }
+  return found;
+}
+
+void SSTable::scan(const EntrySink& visit) const {
+  for (const BlockInfo& b: Blocks) {
+    scanBlock(b, [&visit](const std::string& k, const std::string& v) {
+      visit(k, v);
+      return true;
+    });
+  }
+}
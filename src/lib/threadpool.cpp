@@ -0,0 +1,46 @@
+/*
+Copyright (c) 2010-2015, Stroz Friedberg, LLC
+*/
+
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(unsigned int numThreads): Stop(false) {
+  if (numThreads == 0) {
+    numThreads = 1;
+  }
+  for (unsigned int i = 0; i < numThreads; ++i) {
+    Threads.emplace_back(&ThreadPool::run, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(Mutex);
+    Stop = true;
+  }
+  NotEmpty.notify_all();
+  for (auto& t: Threads) {
+    t.join();
+  }
+}
+
+unsigned int ThreadPool::defaultThreads() {
+  const unsigned int n = std::thread::hardware_concurrency();
+  return n ? n: 1;
+}
+
+void ThreadPool::run() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(Mutex);
+      NotEmpty.wait(lock, [this]{ return Stop || !Tasks.empty(); });
+      if (Tasks.empty()) {
+        return; // Stop, and nothing left to do
+      }
+      task = std::move(Tasks.front());
+      Tasks.pop_front();
+    }
+    task(); // exceptions are captured by the packaged_task's future
+  }
+}
@@ -8,6 +8,7 @@ Copyright (c) 2010-2015, Stroz Friedberg, LLC
 #include <ctime>
 #include <sstream>
 #include <iomanip>
+#include <stdexcept>
 
 #include "enums.h"
 #include "jsonhelp.h"
@@ -139,6 +140,18 @@ unsigned int vintDecode(uint64_t& val, const unsigned char* buf) {
   }
 }
 
+unsigned int vintSize(unsigned char firstByte) {
+  if (firstByte < 241) {
+    return 1;
+  }
+  else if (firstByte < 249) {
+    return 2;
+  }
+  else {
+    return firstByte - 246; // 249 -> 3, ..., 255 -> 9
+  }
+}
+
 std::string appendVarint(const std::string& base, const unsigned int val) {
   unsigned char encoded[9];
   auto bytes = vintEncode(encoded, val);
@@ -206,6 +219,28 @@ std::string bytesAsString(const unsigned char* idBeg, const unsigned char* idEnd
   return buf.str();
 }
 
+inline unsigned char hexNibble(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  throw std::invalid_argument("bytesFromString given a non-hex character");
+}
+
+std::string bytesFromString(const std::string& hex) {
+  std::string ret;
+  ret.reserve(hex.size() / 2);
+  for (std::string::size_type i = 0; i + 1 < hex.size(); i += 2) {
+    ret.push_back(static_cast<char>((hexNibble(hex[i]) << 4) | hexNibble(hex[i + 1])));
+  }
+  return ret;
+}
+
 std::string makeInodeID(uint32_t volIndex, uint64_t inum) {
   std::stringstream buf;
   buf.width(2);
@@ -238,6 +273,31 @@ std::string j(const std::string& x) {
   return s;
 }
 
+std::string jEscaped(const std::string& x) {
+  std::string s("\"");
+  for (const char c: x) {
+    switch (c) {
+      case '"':  s += "\\\""; break;
+      case '\\': s += "\\\\"; break;
+      case '\n': s += "\\n"; break;
+      case '\r': s += "\\r"; break;
+      case '\t': s += "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          static const char* const HEX = "0123456789abcdef";
+          s += "\\u00";
+          s += HEX[c >> 4];
+          s += HEX[c & 0xF];
+        }
+        else {
+          s += c;
+        }
+    }
+  }
+  s += "\"";
+  return s;
+}
+
 // template<>
 // std::string j<char>(const char* x) {
 //   return j(std::string(x));
@@ -7,6 +7,11 @@ Copyright (c) 2010-2015, Stroz Friedberg, LLC
 #include "jsonhelp.h"
 #include "util.h"
 #include "enums.h"
+#include "binrec.h"
+#include "jsonrec.h"
+#include "contentstats.h"
+#include "hashing.h"
+#include "sniff.h"
 
 #include <sstream>
 #include <iomanip>
@@ -37,7 +42,7 @@ void writeSequence(std::ostream& out, ItType begin, ItType end, const std::strin
 DirInfo::DirInfo():
   Path(""), BareID(""), Level(0), Count(0) {}
 
-DirInfo DirInfo::newChild(const std::string &path) {
+DirInfo DirInfo::newChild(const std::string &path) const {
   uint32_t childLvl = childLevel();
   DirInfo  ret;
   ret.Path = path;
@@ -175,7 +180,7 @@ uint8_t ImageInfo::start() {
   Out << "{";
 
   Out << j(std::string("files")) << ":[";
-  writeSequence(std::cout, img->files().begin(), img->files().end(), ", ");
+  writeSequence(Out, img->files().begin(), img->files().end(), ", ");
   Out << "]"
       << j("description", img->desc())
       << j("size", img->size())
@@ -232,32 +237,11 @@ uint8_t ImageDumper::start() {
 }
 /*************************************************************************/
 
-TSK_WALK_RET_ENUM sumSizeWalkCallback(TSK_FS_FILE *,
-                        TSK_OFF_T,
-                        TSK_DADDR_T,
-                        char *,
-                        size_t a_len,
-                        TSK_FS_BLOCK_FLAG_ENUM,
-                        void *a_ptr)
-{
-  *(reinterpret_cast<ssize_t*>(a_ptr)) += a_len;
-  return TSK_WALK_CONT;
-}
-
-ssize_t physicalSize(const TSK_FS_FILE* file) {
-  // this uses tsk_walk with an option not to read data, in order to determine true size
-  // includes slack, so should map well to EnCase's physical size
-  ssize_t size = 0;
-  uint8_t good = tsk_fs_file_walk(const_cast<TSK_FS_FILE*>(file),
-                   TSK_FS_FILE_WALK_FLAG_ENUM(TSK_FS_FILE_WALK_FLAG_AONLY | TSK_FS_FILE_WALK_FLAG_SLACK),
-                    &sumSizeWalkCallback,
-                    &size);
-  return good == 0 ? size: 0;
-}
-
 MetadataWriter::MetadataWriter(std::ostream& out):
   FileCounter(out), Fs(0), NumUnallocated(0), DiskSize(0), MaxUnallocatedBlockSize(std::numeric_limits<uint64_t>::max()),
-  DataWritten(0), SectorSize(0), NumVols(0), InUnallocated(false), UCMode(NONE)
+  DataWritten(0), SectorSize(0), NumVols(0), InUnallocated(false), DirTable(false), MapsNeeded(true), Sniff(false), Fields(ALL_FIELDS),
+  UCMode(NONE), Format(JSON),
+  CurFs(), CurBatchLen(0)
 {
   DummyFile.name = &DummyName;
   DummyFile.meta = &DummyMeta;
@@ -317,13 +301,30 @@ MetadataWriter::MetadataWriter(std::ostream& out):
   Dirs.emplace_back(DirInfo());
 }
 
+MetadataWriter::~MetadataWriter() {
+  // formatting tasks refer to this, so they must finish first
+  for (auto& f: Formatting) {
+    f.second.wait();
+  }
+}
+
 uint8_t MetadataWriter::start() {
   DiskSize = m_img_info->size;
   SectorSize = m_img_info->sector_size;
   NumVols = 0;
   // set PartBeg and PartEnd in case there isn't a partition scheme
   resetPartitionRange();
-  return LbtTskAuto::start();
+  if (BINARY == Format && !InUnallocated) {
+    std::stringstream buf;
+    writeBinRecHeader(buf);
+    emit(buf.str());
+  }
+  if (DirTable && !InUnallocated) {
+    writeDirRecord(Dirs.front());
+  }
+  uint8_t ret = LbtTskAuto::start();
+  flushFormatted();
+  return ret;
 }
 
 std::string getPartName(const TSK_VS_PART_INFO* vs_part) {
@@ -400,7 +401,7 @@ TSK_FILTER_ENUM MetadataWriter::filterVol(const TSK_VS_PART_INFO* vs_part) {
   setPartitionRange(std::min(vs_part->start * SectorSize, DiskSize),
                     std::min((vs_part->start * vs_part->len) * SectorSize, DiskSize));
   VolName = partName;
-  Dirs.emplace_back(Dirs.back().newChild(VolName + "/"));
+  pushDir(VolName + "/", !InUnallocated); // already emitted on the first pass
   return TSK_FILTER_CONT;
 }
 
@@ -408,6 +409,10 @@ TSK_FILTER_ENUM MetadataWriter::filterFs(TSK_FS_INFO *fs) {
   using namespace boost::icl;
   setFsInfo(fs, Part ? Part->start: 0, Part ? Part->start + Part->len: m_img_info->size / m_img_info->sector_size);
 
+  const uint64_t fsBeg = fs->offset + fs->first_block * fs->block_size,
+                 fsEnd = fs->offset + (fs->last_block + 1) * fs->block_size;
+  FsExtents[NumVols] = Extent(std::min(fsBeg, DiskSize), std::min(fsEnd, DiskSize));
+
   if (InUnallocated) {
     for (unsigned i = 0; i < NumRootEntries[NumVols]; ++i) {
       Dirs.back().incCount();
@@ -415,6 +420,9 @@ TSK_FILTER_ENUM MetadataWriter::filterFs(TSK_FS_INFO *fs) {
     flushUnallocated();
     return TSK_FILTER_SKIP;
   }
+  else if (Filter && !Filter->mayMatchUnder(VolName.empty() ? "": VolName + "/")) {
+    return TSK_FILTER_SKIP;
+  }
   else {
     return TSK_FILTER_CONT;
   }
@@ -428,16 +436,18 @@ void MetadataWriter::startUnallocated() {
 }
 
 void MetadataWriter::setFsInfo(TSK_FS_INFO* fs, uint64_t startSector, uint64_t endSector) {
-  FsID = bytesAsString(fs->fs_id, &fs->fs_id[fs->fs_id_used]);
-  std::stringstream buf;
-  buf << j(std::string("fs")) << ":{"
-      << j("byteOffset", fs->offset, true)
-      << j("blockSize", fs->block_size)
-      << j("fsID", FsID)
-      << j("volName", VolName)
-      << j("volIndex", NumVols)
-      << "}";
-  FsInfo = buf.str();
+  CurFs.ByteOffset = fs->offset;
+  CurFs.BlockSize  = fs->block_size;
+  CurFs.FsID.assign(reinterpret_cast<const char*>(fs->fs_id), fs->fs_id_used);
+  CurFs.VolName    = VolName;
+  CurFs.VolIndex   = NumVols;
+  if (DirTable && EmittedFs.insert(NumVols).second) {
+    std::stringstream buf;
+    buf << "{";
+    writeFsInfo(buf, CurFs);
+    buf << "}\n";
+    emit(buf.str());
+  }
   Fs = fs; // does not take ownership
   FSBeg = PartBeg;
   FSEnd = PartEnd;
@@ -466,7 +476,7 @@ void MetadataWriter::setCurDir(const char* path) {
     // However, since TSK uses depth-first traversal, we'll have seen the entry for the directory immediately prior,
     // so we _MUST NOT_ increment the count on Dirs.back(), because then we'd be double-counting.
     // std::cerr << "new directory " << p << std::endl;
-    Dirs.emplace_back(Dirs.back().newChild(p));
+    pushDir(p, true);
   }
   else {
     // found it; pop off any children and inc the count
@@ -481,6 +491,22 @@ void MetadataWriter::setCurDir(const char* path) {
   //   << ", parentID = " << (++Dirs.rbegin() != Dirs.rend() ? (++Dirs.rbegin())->id(): "") << std::endl;
 }
 
+void MetadataWriter::pushDir(const std::string& path, bool emit) {
+  Dirs.emplace_back(Dirs.back().newChild(path));
+  if (DirTable && emit) {
+    writeDirRecord(Dirs.back());
+  }
+}
+
+void MetadataWriter::writeDirRecord(const DirInfo& dir) {
+  std::stringstream buf;
+  buf << "{\"dir\":{"
+      << j("id", dir.id(), true)
+      << j("path", dir.path())
+      << "}}\n";
+  emit(buf.str());
+}
+
 void MetadataWriter::resetPartitionRange() {
   setPartitionRange(0, DiskSize);
 }
@@ -496,12 +522,31 @@ TSK_RETVAL_ENUM MetadataWriter::processFile(TSK_FS_FILE* file, const char* path)
   setCurDir(path);
   // std::cerr << "beginning callback" << std::endl;
   try {
+    if (file && Filter && !passesFilter(file)) {
+      // counted, so that IDs don't depend on the filter, but nothing more
+      file = nullptr;
+    }
     if (file) {
-      std::stringstream buf;
-      writeFile(buf, file);
-      std::string output(buf.str());
-      Out << output << '\n';
-      DataWritten += output.size();
+      // only TSK work happens here; formatting can happen on the pool
+      PendingRecord& pending(Formatters && !Sniff ? nextPending(): Scratch);
+      pending.Literal.clear();
+      pending.InodeVol = NumVols;
+      captureFile(pending.Rec, file, needAttrs());
+      if (pending.Rec.HasMeta) {
+        recordMeta(pending.Rec, Dirs.back().newChild("").id());
+      }
+      if (Columns) {
+        Columns->push(pending.Rec);
+      }
+      if (Sqlite) {
+        Sqlite->push(pending.Rec, pending.InodeVol);
+      }
+      if (Sniff) {
+        holdForSniff(pending, file);
+      }
+      else {
+        emitRecord(pending);
+      }
     }
   }
   catch (std::exception& e) {
@@ -512,83 +557,400 @@ TSK_RETVAL_ENUM MetadataWriter::processFile(TSK_FS_FILE* file, const char* path)
   return TSK_OK;
 }
 
+bool MetadataWriter::needAttrs() const {
+  // loading attributes is most of TSK's work for a file, and skipping it
+  // is most of the savings of leaving them out
+  return MapsNeeded || NONE != UCMode || (Fields & ATTRS_FIELD);
+}
+
+namespace {
+  const size_t SNIFF_BATCH_SIZE = 4096;
+}
+
+void MetadataWriter::holdForSniff(PendingRecord& pending, const TSK_FS_FILE* file) {
+  SniffJob job;
+  job.Pending = std::move(pending);
+  job.Offset = job.Len = 0;
+
+  const FileRecord& rec(job.Pending.Rec);
+  if (rec.HasMeta && rec.Meta.Type == TSK_FS_META_TYPE_REG && rec.Meta.Size > 0 && file != &DummyFile) {
+    const TSK_FS_ATTR* a = tsk_fs_file_attr_get(const_cast<TSK_FS_FILE*>(file));
+    const uint64_t len = std::min(static_cast<uint64_t>(SectorSize ? SectorSize: 512), rec.Meta.Size);
+    if (!a || (a->flags & (TSK_FS_ATTR_COMP | TSK_FS_ATTR_ENC))) {
+      // the bytes on disk aren't the contents
+    }
+    else if (a->flags & TSK_FS_ATTR_RES) {
+      job.Pending.Rec.HasSniff = true;
+      job.Pending.Rec.Sniff.Type = sniffType(reinterpret_cast<const char*>(a->rd.buf), std::min(static_cast<uint64_t>(a->rd.buf_size), len));
+    }
+    else if (a->flags & TSK_FS_ATTR_NONRES) {
+      const TSK_FS_ATTR_RUN* run = a->nrd.run;
+      while (run && TSK_FS_ATTR_RUN_FLAG_FILLER == run->flags) {
+        run = run->next;
+      }
+      if (run && TSK_FS_ATTR_RUN_FLAG_NONE == run->flags && 0 == run->offset) {
+        job.Offset = file->fs_info->offset + run->addr * file->fs_info->block_size;
+        job.Len = len;
+      }
+    }
+  }
+  Sniffing.push_back(std::move(job));
+  if (Sniffing.size() >= SNIFF_BATCH_SIZE) {
+    flushSniffed();
+  }
+}
+
+void MetadataWriter::flushSniffed() {
+  if (Sniffing.empty()) {
+    return;
+  }
+  // read in disk order, then emit in walk order
+  std::vector<SniffJob*> reads;
+  for (SniffJob& job: Sniffing) {
+    if (job.Len) {
+      reads.push_back(&job);
+    }
+  }
+  std::sort(reads.begin(), reads.end(), [](const SniffJob* a, const SniffJob* b) { return a->Offset < b->Offset; });
+  std::vector<char> buf;
+  for (SniffJob* job: reads) {
+    buf.resize(job->Len);
+    const ssize_t rlen = tsk_img_read(m_img_info, job->Offset, &buf[0], job->Len);
+    if (rlen > 0) {
+      job->Pending.Rec.HasSniff = true;
+      job->Pending.Rec.Sniff.Type = sniffType(&buf[0], rlen);
+    }
+  }
+
+  std::vector<SniffJob> jobs;
+  jobs.swap(Sniffing);
+  for (SniffJob& job: jobs) {
+    FileRecord& rec(job.Pending.Rec);
+    if (rec.HasSniff) {
+      rec.Sniff.Mismatch = !rec.Sniff.Type.empty() && extensionMismatch(rec.Sniff.Type, rec.Name.Name);
+    }
+    PendingRecord& pending(Formatters ? nextPending(): Scratch);
+    pending = std::move(job.Pending);
+    emitRecord(pending);
+  }
+}
+
+bool MetadataWriter::passesFilter(const TSK_FS_FILE* file) {
+  if (!Filter->mayMatchUnder(Dirs.back().path())) {
+    return false;
+  }
+  // no attributes, which would make TSK load them
+  captureFile(FilterScratch, file, false);
+  return Filter->matches(FilterScratch);
+}
+
 void MetadataWriter::finishWalk() {
+  flushSniffed();
+  flushFormatted();
+  if (Columns) {
+    Columns->close();
+  }
 }
 
-void MetadataWriter::writeMetaRecord(std::ostream& out, const TSK_FS_FILE* file, const TSK_FS_INFO* fs, InodeInfo& inode) {
-  const TSK_FS_META* i = file->meta;
+void MetadataWriter::formatPending(std::ostream& out, const PendingRecord& pending) const {
+  if (!pending.Literal.empty()) {
+    out << pending.Literal;
+  }
+  else if (BINARY == Format) {
+    std::string output;
+    encodeFileRecord(output, pending.Rec);
+    writeBinRecord(out, output);
+  }
+  else {
+    writeFile(out, pending.Rec, pending.InodeVol, DirTable, Fields);
+    out << '\n';
+  }
+}
 
-  inode.Deleted = i->flags & TSK_FS_META_FLAG_UNALLOC;
+void MetadataWriter::emit(const std::string& output) {
+  // records held for sniffing come first
+  flushSniffed();
+  if (Formatters) {
+    PendingRecord& pending(nextPending());
+    pending.Literal = output;
+    emitRecord(pending);
+  }
+  else {
+    Out << output;
+    DataWritten += output.size();
+  }
+}
 
-  out << "{"
-      << j<int64_t>("addr", static_cast<int64_t>(i->addr), true)
-      << j("accessed", formatTimestamp(i->atime, i->atime_nano))
-      << j("content_len", i->content_len)
-      << j("created", formatTimestamp(i->crtime, i->crtime_nano))
-      << j("metadata", formatTimestamp(i->ctime, i->ctime_nano))
-      << j("flags", metaFlags(i->flags))
-      << j("gid", i->gid);
-  if (i->link) {
-    out << j("link", std::string(i->link));
+void MetadataWriter::emitRecord(PendingRecord& pending) {
+  if (Formatters) {
+    // pending is already in the batch
+    if (CurBatchLen == FORMAT_BATCH_SIZE) {
+      submitBatch();
+    }
   }
-  if (TSK_FS_TYPE_ISEXT(fs->ftype)) {
-    out << j("dtime", formatTimestamp(i->time2.ext2.dtime, i->time2.ext2.dtime_nano));
+  else {
+    std::stringstream buf;
+    formatPending(buf, pending);
+    const std::string output(buf.str());
+    Out << output;
+    DataWritten += output.size();
   }
-  else if (TSK_FS_TYPE_ISHFS(fs->ftype)) {
-    out << j("bkup_time", formatTimestamp(i->time2.hfs.bkup_time, i->time2.hfs.bkup_time_nano));
+}
+
+void MetadataWriter::writeDiskMap(const LineSink& sink) {
+  for (auto& fsMapInfo: AllocatedRuns) {
+    for (auto& frag: fsMapInfo.second.Runs) {
+      const uint64_t begin = frag.first.lower(),
+                     end   = frag.first.upper();
+      const std::string id(makeDiskMapID(begin));
+      std::stringstream buf;
+      buf << "{" << j("id", id, true)
+          << ",\"t\": { \"i\": { "
+          << j("b", begin, true)
+          << j("l", end - begin)
+          << ", \"f\":[";
+      bool firstFile = true;
+      for (auto& f: frag.second) {
+        InodeInfo& inode(ReverseMap[fsMapInfo.first][f.Inum]);
+        AttrInfo&  attr(inode.getOrInsertAttr(f.AttrID));
+        attr.addRun(f.Slack, Run{f.Offset + (begin - f.DRBeg), begin, end});
+
+        if (!firstFile) {
+          buf << ", ";
+        }
+        buf << "{"
+            << j("vol", fsMapInfo.first, true)
+            << j("inum", static_cast<int64_t>(f.Inum))
+            << j("attrId", f.AttrID)
+            << j("s", f.Slack)
+            << j("drbeg", f.DRBeg)
+            << j("fo", f.Offset)
+            << "}";
+        firstFile = false;
+      }
+      buf << "]}}}\n";
+      sink(id, buf.str());
+    }
+  }
+}
+
+namespace {
+  void writeRuns(std::ostream& out, const std::vector<Run>& runs) {
+    bool firstRun = true;
+    for (auto& run: runs) {
+      if (!firstRun) {
+        out << ",";
+      }
+      out << "{"
+          << j("fo", run.FileOffset, true)
+          << j("start", run.Start)
+          << j("end", run.End)
+          << "}";
+      firstRun = false;
+    }
+  }
+}
+
+void MetadataWriter::writeInodeMap(const LineSink& sink) const {
+  for (auto& fsReverseMap: ReverseMap) {
+    for (auto& inodeMap: fsReverseMap.second) {
+      const std::string id(makeInodeID(fsReverseMap.first, inodeMap.first));
+      std::stringstream buf;
+      buf << "{ \"id\":\"" << id
+          << "\", \"t\": { \"hardlinks\":[";
+
+      bool first = true;
+      for (auto& fileID: inodeMap.second.DirentIDs) {
+        if (!first) {
+          buf << ", ";
+        }
+        buf << "\"" << fileID << "\"";
+        first = false;
+      }
+      buf << "], \"attrData\":[";
+      first = true;
+      for (auto& attr: inodeMap.second.Attrs) {
+        if (!first) {
+          buf << ", ";
+        }
+        buf << "{"
+            << j("id", attr.ID, true)
+            << j("type", attr.Type)
+            << j("size", attr.Size)
+            << j("slack_size", attr.SlackSize)
+            << j("resident", attr.Resident)
+            << j("resident_data", attr.ResidentData)
+            << ",\"runs\":[";
+        writeRuns(buf, attr.Runs);
+        buf << "],\"slack_runs\":[";
+        writeRuns(buf, attr.SlackRuns);
+        buf << "]}";
+        first = false;
+      }
+      buf << "]}}\n";
+      sink(id, buf.str());
+    }
+  }
+}
+
+void MetadataWriter::writeUInt64(uint64_t val) {
+  unsigned char buf[sizeof(val)];
+  for (unsigned int i = 0; i < sizeof(val); ++i) {
+    buf[i] = (val >> (8 * i)) & 0xFF;
+  }
+  Out.write(reinterpret_cast<const char*>(buf), sizeof(buf));
+  DataWritten += sizeof(buf);
+}
+
+namespace {
+  const size_t IMAGE_READ_SIZE = 8 * 1024 * 1024;
+}
+
+void MetadataWriter::writeImage(uint64_t offset, uint64_t size, std::vector<char>& buf) {
+  uint64_t cur = 0;
+  while (cur < size) {
+    const size_t toRead = std::min(size - cur, static_cast<uint64_t>(buf.size()));
+    const ssize_t rlen = tsk_img_read(m_img_info, offset + cur, &buf[0], toRead);
+    if (rlen <= 0) {
+      // zeros in place of what couldn't be read, to keep the framing
+      std::cerr << "Could not read " << (size - cur) << " bytes at " << (offset + cur) << std::endl;
+      std::fill(buf.begin(), buf.end(), 0);
+      while (cur < size) {
+        const uint64_t n = std::min(size - cur, static_cast<uint64_t>(buf.size()));
+        Out.write(&buf[0], n);
+        cur += n;
+      }
+      break;
+    }
+    Out.write(&buf[0], rlen);
+    cur += rlen;
+  }
+  DataWritten += size;
+}
+
+void MetadataWriter::searchImage(const std::vector<Extent>& extents, std::shared_ptr<PatternMatcher> matcher,
+                                 ThreadPool& pool, const HitSink& sink)
+{
+  typedef std::vector<PatternMatcher::Hit> Hits;
+
+  // within an extent, each piece starts with the last maxLength() - 1 bytes
+  // of the one before, so hits spanning the boundary are found, and reported
+  // only by the later
+  std::deque<std::pair<uint64_t, std::future<Hits>>> jobs; // piece end, hits
+  for (const Extent& e: extents) {
+    std::shared_ptr<std::vector<char>> prev;
+    for (uint64_t off = e.first; off < e.second; off += IMAGE_READ_SIZE) {
+      const size_t len = std::min(e.second - off, static_cast<uint64_t>(IMAGE_READ_SIZE)),
+                   keep = prev ? std::min(prev->size(), matcher->maxLength() - 1): 0;
+      auto buf = std::make_shared<std::vector<char>>(keep + len);
+      if (keep) {
+        std::copy(prev->end() - keep, prev->end(), buf->begin());
+      }
+      size_t got = 0;
+      while (got < len) {
+        const ssize_t rlen = tsk_img_read(m_img_info, off + got, &(*buf)[keep + got], len - got);
+        if (rlen <= 0) {
+          // searched as zeros
+          std::cerr << "Could not read " << (len - got) << " bytes at " << (off + got) << std::endl;
+          break;
+        }
+        got += rlen;
+      }
+      jobs.push_back(std::make_pair(off + len, pool.submit([matcher, buf, off, keep]() {
+        Hits hits;
+        matcher->search(buf->data(), buf->size(), off - keep, hits, keep);
+        std::sort(hits.begin(), hits.end());
+        return hits;
+      })));
+      prev = buf;
+
+      // bounds what's held in memory, and keeps hits in order
+      while (jobs.size() > 2 * pool.size()) {
+        sink(jobs.front().second.get(), jobs.front().first);
+        jobs.pop_front();
+      }
+    }
+  }
+  for (auto& job: jobs) {
+    sink(job.second.get(), job.first);
+  }
+}
+
+PendingRecord& MetadataWriter::nextPending() {
+  if (!CurBatch) {
+    if (FreeBatches.empty()) {
+      CurBatch = std::make_shared<Batch>(FORMAT_BATCH_SIZE);
+    }
+    else {
+      CurBatch = FreeBatches.back();
+      FreeBatches.pop_back();
+    }
+    CurBatchLen = 0;
+  }
+  return (*CurBatch)[CurBatchLen++];
+}
+
+void MetadataWriter::submitBatch() {
+  if (!CurBatch) {
+    return;
+  }
+  std::shared_ptr<Batch> batch(CurBatch);
+  const size_t len = CurBatchLen;
+  CurBatch.reset();
+  CurBatchLen = 0;
+
+  Formatting.push_back(std::make_pair(batch, Formatters->submit([this, batch, len]() {
+    // formatPending only reads settings that are fixed during the walk
+    std::stringstream buf;
+    for (size_t i = 0; i < len; ++i) {
+      formatPending(buf, (*batch)[i]);
+    }
+    return buf.str();
+  })));
+
+  // bound memory use, but keep every thread busy
+  drainFormatted(2 * Formatters->size());
+}
+
+void MetadataWriter::drainFormatted(size_t maxPending) {
+  while (Formatting.size() > maxPending) {
+    // batches finish out of order, but are written in order
+    const std::string output(Formatting.front().second.get());
+    FreeBatches.push_back(Formatting.front().first);
+    Formatting.pop_front();
+
+    Out << output;
+    DataWritten += output.size();
+  }
+}
+
+void MetadataWriter::flushFormatted() {
+  if (Formatters) {
+    submitBatch();
+    drainFormatted(0);
   }
-  out << j("mode", i->mode)
-      << j("modified", formatTimestamp(i->mtime, i->mtime_nano))
-      << j("nlink", i->nlink)
-      << j("seq", i->seq)
-      << j("size", i->size)
-      << j("type", metaType(i->type))
-      << j("uid", i->uid);
+}
 
-  out << ", \"attrs\":[";
+std::vector<const TSK_FS_ATTR*> inUseAttrs(const TSK_FS_FILE* file) {
+  std::vector<const TSK_FS_ATTR*> ret;
+  const TSK_FS_META* i = file->meta;
   if ((i->attr_state & TSK_FS_META_ATTR_STUDIED) && i->attr) {
-    const TSK_FS_ATTR* lastAttr = 0;
     for (const TSK_FS_ATTR* a = i->attr->head; a; a = a->next) {
       if (a->flags & TSK_FS_ATTR_INUSE) {
-        if (lastAttr != 0) {
-          out << ", ";
-        }
-        writeAttr(out, inode, i->addr, a);
-        lastAttr = a;
+        ret.push_back(a);
       }
     }
   }
   else {
     int numAttrs = tsk_fs_file_attr_getsize(const_cast<TSK_FS_FILE*>(file));
-    if (numAttrs > 0) {
-      unsigned int num = 0;
-      for (int j = 0; j < numAttrs; ++j) {
-        const TSK_FS_ATTR* a = tsk_fs_file_attr_get_idx(const_cast<TSK_FS_FILE*>(file), j);
-        if (a && a->flags & TSK_FS_ATTR_INUSE) {
-          if (num > 0) {
-            out << ", ";
-          }
-          writeAttr(out, inode, i->addr, a);
-          ++num;
-        }
+    for (int j = 0; j < numAttrs; ++j) {
+      const TSK_FS_ATTR* a = tsk_fs_file_attr_get_idx(const_cast<TSK_FS_FILE*>(file), j);
+      if (a && a->flags & TSK_FS_ATTR_INUSE) {
+        ret.push_back(a);
       }
     }
   }
-  out << "]";
-  out << "}";
-}
-
-void MetadataWriter::writeNameRecord(std::ostream& out, const TSK_FS_NAME* n) {
-  out << "{"
-      << j("flags", nameFlags(n->flags), true)
-      << j<int64_t>("meta_addr", static_cast<int64_t>(n->meta_addr))
-      << j("meta_seq", n->meta_seq)
-      << j("name", (n->name && n->name_size ? std::string(n->name): ""))
-      << j("par_addr", n->par_addr)
-      << j("par_seq", n->par_seq)
-      << j("shrt_name", (n->shrt_name && n->shrt_name_size ? std::string(n->shrt_name): ""))
-      << j("type", nameType(n->type))
-      << "}";
+  return ret;
 }
 
 bool typeMatch(const TSK_FS_NAME_TYPE_ENUM n, const TSK_FS_META_TYPE_ENUM m) {
@@ -607,146 +969,222 @@ bool typeMatch(const TSK_FS_NAME_TYPE_ENUM n, const TSK_FS_META_TYPE_ENUM m) {
          (n == TSK_FS_NAME_TYPE_UNDEF); // no meta type for this, so give it the pedantic benefit of the doubt
 }
 
-void MetadataWriter::writeFile(std::ostream& out, const TSK_FS_FILE* file) {
-  DirInfo     fileDirEnt(Dirs.back().newChild(""));
-  std::string id(fileDirEnt.id());
+bool hasUsableMeta(const TSK_FS_FILE* file) {
+  const TSK_FS_NAME* n = file->name;
+  const TSK_FS_META* m = file->meta;
+  return m && // gotta have a pointer
+     (m->flags & TSK_FS_META_FLAG_USED) && // gotta be legit
+     (!n || n->flags & TSK_FS_NAME_FLAG_ALLOC || typeMatch(n->type, m->type)); // no sense in outputting meta if file's deleted and name and meta types don't match
+}
 
-  out << "{" << j("id", id, true)
-      << j("parent", Dirs.back().id())
-      << j("children", fileDirEnt.lastChild())
-      << ", \"t\":{ \"fsmd\":{ ";
+InodeInfo& MetadataWriter::recordInode(const FileRecord& rec, const std::string& id) {
+  InodeInfo& inode = ReverseMap[NumVols][rec.Meta.Addr];
+  inode.DirentIDs.emplace_back(id);
+  return inode;
+}
 
-  out << FsInfo
-      << j("path", Dirs.back().path());
+AttrInfo& MetadataWriter::recordAttr(InodeInfo& inode, const AttrRecord& a) {
+  AttrInfo& ai = inode.getOrInsertAttr(a.ID);
+  ai.ID   = a.ID;
+  ai.Type = a.Type;
+  ai.Size = a.Size;
 
-  TSK_FS_NAME* n = nullptr;
-  if (file->name) {
-    n = file->name;
-    out << ", \"name\":";
-    writeNameRecord(out, n);
+  if (MapsNeeded && a.Flags & TSK_FS_ATTR_RES && a.RdBufSize) {
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(a.ResidentData.data());
+    ai.Resident = true;
+    ai.ResidentData = bytesAsString(data, data + a.ResidentData.size());
   }
-  TSK_FS_META* m = file->meta;
-  if (m && // gotta have a pointer
-     (m->flags & TSK_FS_META_FLAG_USED) && // gotta be legit
-     (!n || n->flags & TSK_FS_NAME_FLAG_ALLOC || typeMatch(n->type, m->type))) // no sense in outputting meta if file's deleted and name and meta types don't match
-  {
-    InodeInfo& inode = ReverseMap[NumVols][file->meta->addr];
-    inode.DirentIDs.emplace_back(id);
+  ai.SlackSize = a.SlackSize;
+  return ai;
+}
 
-    out << ", \"meta\":";
-    writeMetaRecord(out, file, file->fs_info, inode);
+std::vector<AttrExtent> attrExtents(const AttrRecord& a, uint64_t blockSize, uint64_t fsOffset) {
+  std::vector<AttrExtent> ret;
+  uint64_t fo = 0; // file offset
+  uint64_t slackFo = 0;
+  uint64_t skipBytes = a.SkipLen;
+  const uint64_t mainSize  = (a.Flags & TSK_FS_ATTR_COMP) ? a.AllocSize: a.InitSize;
+  for (const RunRecord& curRun: a.Runs) { // filler runs aren't captured
+    // normal case - make absolute offsets
+    uint64_t beg = (curRun.Addr * blockSize) + fsOffset,
+             runEnd = beg + (curRun.Len * blockSize),
+             end = runEnd;
+    bool     trueSlack = false;
+    const bool sparse = TSK_FS_ATTR_RUN_FLAG_NONE != curRun.Flags;
+    // if skipping, advance beg and decrement skipBytes accordingly
+    if (skipBytes > 0) { // still towards beginning where skiplen is > 0
+      uint64_t toSkip = std::min(end - beg, skipBytes);
+      beg += toSkip;
+      skipBytes -= toSkip;
+    }
+    if (beg < end) { // past skipping, we're onto data
+      uint64_t bytesRemaining = mainSize - fo; // how much data left in file stream?
+      if (beg + bytesRemaining < end) {
+        end = beg + bytesRemaining; // end is now beginning of true slack
+        trueSlack = true;
+      }
+      if (beg < end) { // if false, we're fully into true slack, nothing of file left
+        ret.push_back(AttrExtent{beg, end, fo, false, sparse});
+        fo += (end - beg); // advances fo even if data run is sparse, which is critical
+      }
+      if (trueSlack) {
+        // slack at end of allocated space (yes, could have sparse slack)
+        ret.push_back(AttrExtent{end, runEnd, slackFo, true, sparse});
+        slackFo += (runEnd - end);
+      }
+    }
+  }
+  return ret;
+}
 
-    out << "}, \"__link\":\"" << makeInodeID(NumVols, file->meta->addr) << "\"";
+void MetadataWriter::markAttrRuns(TSK_INUM_T addr, const AttrRecord& a, const FsRecord& fs) {
+  for (const AttrExtent& e: attrExtents(a, fs.BlockSize, fs.ByteOffset)) {
+    if (!e.Sparse) {
+      // sparse blocks will be made available as unallocated
+      markDataRun(e.Beg, e.End, e.FileOffset, addr, a.ID, e.Slack);
+    }
   }
-  else {
-    out << "}";
+}
+
+Timestamp makeTimestamp(time_t secs, uint32_t nanos) {
+  return Timestamp{static_cast<int64_t>(secs), nanos};
+}
+
+void MetadataWriter::captureFile(FileRecord& rec, const TSK_FS_FILE* file, bool withAttrs) const {
+  DirInfo fileDirEnt(Dirs.back().newChild(""));
+
+  rec.ID       = bytesFromString(fileDirEnt.id());
+  rec.Parent   = bytesFromString(Dirs.back().id());
+  rec.Children = bytesFromString(fileDirEnt.lastChild());
+
+  rec.Fs   = CurFs;
+  rec.Path = Dirs.back().path();
+
+  rec.HasName = file->name;
+  if (file->name) {
+    captureNameRecord(rec.Name, file->name);
+  }
+  rec.HasMeta = hasUsableMeta(file);
+  if (rec.HasMeta) {
+    captureMeta(rec.Meta, file, file->fs_info, withAttrs);
   }
+  rec.HasHashes = rec.HasContentRef = rec.HasSniff = rec.HasStats = false; // only known once the contents are read
+}
 
-  out << " } }";
+void MetadataWriter::captureMeta(MetaRecord& rec, const TSK_FS_FILE* file, const TSK_FS_INFO* fs, bool withAttrs) const {
+  captureMetaRecord(rec, file, fs, withAttrs, MapsNeeded || Fields & RD_BUF_FIELD);
 }
 
-void MetadataWriter::writeAttr(std::ostream& out, InodeInfo& inode, TSK_INUM_T addr, const TSK_FS_ATTR* a) {
-  out << "{"
-      << j("flags", attrFlags(a->flags), true)
-      << j("id", a->id)
-      << j("name", a->name ? std::string(a->name): std::string(""))
-      << j("size", a->size)
-      << j("type", a->type)
-      << j("rd_buf_size", a->rd.buf_size)
-      << j("nrd_allocsize", a->nrd.allocsize)
-      << j("nrd_compsize", a->nrd.compsize)
-      << j("nrd_initsize", a->nrd.initsize)
-      << j("nrd_skiplen", a->nrd.skiplen);
+void MetadataWriter::captureAttr(AttrRecord& rec, const TSK_FS_ATTR* a, const TSK_FS_INFO* fs) const {
+  captureAttrRecord(rec, a, fs, MapsNeeded || Fields & RD_BUF_FIELD);
+}
 
-  AttrInfo& ai = inode.getOrInsertAttr(a->id);
-  ai.ID   = a->id;
-  ai.Type = a->type;
-  ai.Size = a->size;
+void captureNameRecord(NameRecord& rec, const TSK_FS_NAME* n) {
+  rec.Flags     = n->flags;
+  rec.MetaAddr  = n->meta_addr;
+  rec.MetaSeq   = n->meta_seq;
+  rec.Name      = n->name && n->name_size ? std::string(n->name): "";
+  rec.ParAddr   = n->par_addr;
+  rec.ParSeq    = n->par_seq;
+  rec.ShortName = n->shrt_name && n->shrt_name_size ? std::string(n->shrt_name): "";
+  rec.Type      = n->type;
+}
 
-  if (a->flags & TSK_FS_ATTR_RES && a->rd.buf_size && a->rd.buf) {
-    out << ", " << j(std::string("rd_buf")) << ":\"";
+void captureMetaRecord(MetaRecord& rec, const TSK_FS_FILE* file, const TSK_FS_INFO* fs, bool withAttrs, bool withResident) {
+  const TSK_FS_META* i = file->meta;
 
-    std::ostringstream resData;
-    resData << std::hex << std::setfill('0');
-    size_t numBytes = std::min(a->rd.buf_size, (size_t)a->size);
-    for (size_t i = 0; i < numBytes; ++i) {
-      resData << std::setw(2) << (unsigned int)a->rd.buf[i];
+  rec.Addr       = i->addr;
+  rec.Accessed   = makeTimestamp(i->atime, i->atime_nano);
+  rec.ContentLen = i->content_len;
+  rec.Created    = makeTimestamp(i->crtime, i->crtime_nano);
+  rec.Metadata   = makeTimestamp(i->ctime, i->ctime_nano);
+  rec.Flags      = i->flags;
+  rec.Gid        = i->gid;
+  rec.Link       = i->link ? std::string(i->link): "";
+  if (TSK_FS_TYPE_ISEXT(fs->ftype)) {
+    rec.FsTimeKind = MetaRecord::EXT_DTIME;
+    rec.FsTime     = makeTimestamp(i->time2.ext2.dtime, i->time2.ext2.dtime_nano);
+  }
+  else if (TSK_FS_TYPE_ISHFS(fs->ftype)) {
+    rec.FsTimeKind = MetaRecord::HFS_BKUPTIME;
+    rec.FsTime     = makeTimestamp(i->time2.hfs.bkup_time, i->time2.hfs.bkup_time_nano);
+  }
+  else {
+    rec.FsTimeKind = MetaRecord::NO_FS_TIME;
+  }
+  rec.Mode     = i->mode;
+  rec.Modified = makeTimestamp(i->mtime, i->mtime_nano);
+  rec.NLink    = i->nlink;
+  rec.Seq      = i->seq;
+  rec.Size     = i->size;
+  rec.Type     = i->type;
+  rec.Uid      = i->uid;
+
+  rec.Attrs.clear();
+  if (withAttrs) {
+    std::vector<const TSK_FS_ATTR*> attrs(inUseAttrs(file));
+    rec.Attrs.resize(attrs.size());
+    for (unsigned int idx = 0; idx < attrs.size(); ++idx) {
+      captureAttrRecord(rec.Attrs[idx], attrs[idx], fs, withResident);
     }
-    ai.Resident = true;
-    ai.ResidentData = resData.str();
-    out << ai.ResidentData;
-    out << "\"";
+  }
+}
+
+void captureAttrRecord(AttrRecord& rec, const TSK_FS_ATTR* a, const TSK_FS_INFO* fs, bool withResident) {
+  rec.Flags     = a->flags;
+  rec.ID        = a->id;
+  rec.Name      = a->name ? std::string(a->name): "";
+  rec.Size      = a->size;
+  rec.Type      = a->type;
+  rec.RdBufSize = a->rd.buf_size;
+  rec.AllocSize = a->nrd.allocsize;
+  rec.CompSize  = a->nrd.compsize;
+  rec.InitSize  = a->nrd.initsize;
+  rec.SkipLen   = a->nrd.skiplen;
+
+  rec.ResidentData.clear();
+  if (withResident && a->flags & TSK_FS_ATTR_RES && a->rd.buf_size && a->rd.buf) {
+    rec.ResidentData.assign(reinterpret_cast<const char*>(a->rd.buf), std::min(a->rd.buf_size, (size_t)a->size));
   }
 
+  rec.Runs.clear();
   if (a->flags & TSK_FS_ATTR_NONRES) {
-    out << ", \"nrd_runs\":[";
-    uint64_t fo = 0; // file offset
-    uint64_t slackFo = 0;
-    uint64_t skipBytes = a->nrd.skiplen; // up from 32 bits to 64 for convenience
-    const uint64_t mainSize  = (a->flags & TSK_FS_ATTR_COMP) ? a->nrd.allocsize: a->nrd.initsize;
-    // if (addr == 3240) {
-    //   std::cerr << "mainSize = " << mainSize << "\n";
-    // }
-    bool first = true;
     for (TSK_FS_ATTR_RUN* curRun = a->nrd.run; curRun; curRun = curRun->next) {
       if (TSK_FS_ATTR_RUN_FLAG_FILLER == curRun->flags) {
-        // TO-DO: check on the exact semantics of this flag
         continue;
       }
-      // normal case - make absolute offsets
-      uint64_t beg = (curRun->addr * Fs->block_size) + Fs->offset,
-               runEnd = beg + (curRun->len * Fs->block_size),
-               end = runEnd;
-      bool     trueSlack = false;
-      // if (addr == 3240) {
-      //   std::cerr << "beg = " << beg << ", end = " << end << ", len = " << (end - beg) << ", fo = " << fo << ", slackFo = " << slackFo << "\n";
-      // }
-      // if skipping, advance beg and decrement skipBytes accordingly
-      if (skipBytes > 0) { // still towards beginning where skiplen is > 0
-        uint64_t toSkip = std::min(end - beg, skipBytes);
-        beg += toSkip;
-        skipBytes -= toSkip;
-      }
-      if (beg < end) { // past skipping, we're onto data
-        uint64_t bytesRemaining = mainSize - fo; // how much data left in file stream?
-        if (beg + bytesRemaining < end) {
-          end = beg + bytesRemaining; // end is now beginning of true slack
-          trueSlack = true;
-          // if (3240 == addr) {
-          //   std::cerr << "bytesRemaining = " << bytesRemaining << ", end now =" << end << "\n";
-          // }
-        }
-        if (beg < end) { // if false, we're fully into true slack, nothing of file left
-          if (TSK_FS_ATTR_RUN_FLAG_NONE == curRun->flags) {
-            // just normal data; sparse blocks will be made available as unallocated
-            markDataRun(beg, end, fo, addr, a->id, false);
-          }
-          fo += (end - beg); // advances fo even if data run is sparse, which is critical
-        }
-        if (trueSlack) {
-          // mark slack at end of allocated space
-          if (TSK_FS_ATTR_RUN_FLAG_NONE == curRun->flags) { // but only if not sparse (yes, could have sparse slack)
-            markDataRun(end, runEnd, slackFo, addr, a->id, true);
-          }
-          slackFo += (runEnd - end);
-        }
-      }
-      // output data run as json
-      if (!first) {
-        out << ", ";
+      rec.Runs.push_back(RunRecord{curRun->addr, curRun->len, curRun->offset, static_cast<uint32_t>(curRun->flags)});
+    }
+  }
+  setAttrSizes(rec, fs->block_size, fs->offset);
+}
+
+void setAttrSizes(AttrRecord& a, uint64_t blockSize, uint64_t fsOffset) {
+  if (a.Flags & TSK_FS_ATTR_NONRES) {
+    a.PhysicalSize = a.SlackSize = 0;
+    for (const AttrExtent& e: attrExtents(a, blockSize, fsOffset)) {
+      a.PhysicalSize += e.End - e.Beg;
+      if (e.Slack) {
+        a.SlackSize += e.End - e.Beg;
       }
-      out << "{"
-          << j("addr", curRun->addr, true)
-          << j("flags", curRun->flags)
-          << j("len", curRun->len)
-          << j("offset", curRun->offset)
-          << "}";
-      first = false;
     }
-    ai.SlackSize = slackFo;
-    out << "]";
   }
-  out << "}";
+  else {
+    a.PhysicalSize = a.Size;
+    a.SlackSize = 0;
+  }
+}
+
+void MetadataWriter::recordMeta(const FileRecord& rec, const std::string& id) {
+  InodeInfo& inode = recordInode(rec, id);
+  inode.Deleted = rec.Meta.Flags & TSK_FS_META_FLAG_UNALLOC;
+
+  for (const AttrRecord& a: rec.Meta.Attrs) {
+    recordAttr(inode, a);
+    if (a.Flags & TSK_FS_ATTR_NONRES) {
+      markAttrRuns(rec.Meta.Addr, a, rec.Fs);
+    }
+  }
 }
 
 void MetadataWriter::markDataRun(uint64_t beg, uint64_t end, uint64_t offset, TSK_INUM_T addr, uint32_t attrID, bool slack) {
@@ -856,83 +1294,891 @@ void MetadataWriter::flushUnallocated() {
 /*************************************************************************/
 
 FileWriter::FileWriter(std::ostream& out):
-  MetadataWriter(out), Buffer(1024 * 1024, 0) {}
-
-void FileWriter::writeMetadata(const TSK_FS_FILE*) {
-  // std::stringstream buf;
-  // writeFile(buf, file, physicalSize);
-  // const std::string output(buf.str());
-
-  // uint64 size = output.size();
-  // Out.write((const char*)&size, sizeof(size));
-  // Out.write(output.data(), size);
-
-  // DataWritten += sizeof(size);
-  // DataWritten += output.size();
-}
-
-TSK_RETVAL_ENUM FileWriter::processFile(TSK_FS_FILE*, const char*) {
-  // std::string fp(path);
-  // fp += std::string(file->name->name);
-  // //std::cerr << "processing " << fp << std::endl;
-  // setCurDir(path);
-  // // PhysicalSize = physicalSize(file);
-  // writeMetadata(file);
-
-  // uint64 size = PhysicalSize == -1 ? 0: PhysicalSize,
-  //        cur  = 0;
-  // // std::cerr << "writing " << fp << ", size = " << size << std::endl;
-  // Out.write((const char*)&size, sizeof(size));
-  // DataWritten += sizeof(size);
-
-  // while (cur < size) {
-  //   ssize_t toRead = std::min(size - cur, (uint64)Buffer.size());
-  //   if (toRead == tsk_fs_file_read(file, cur, &Buffer[0], toRead, TSK_FS_FILE_READ_FLAG_SLACK)) {
-  //     Out.write(&Buffer[0], toRead);
-  //     cur += toRead;
-  //   }
-  //   else {
-  //     throw std::runtime_error("Had a problem reading data out of a file");
-  //   }
-  // }
-  // DataWritten += cur;
-  // std::cerr << "Done with " << fp << ", DataWritten = " << DataWritten << std::endl;
-  //std::cerr << "done processing " << fp << std::endl;
+  MetadataWriter(out), Buffer(1024 * 1024, 0), PhysicalOrder(false), ContentOutput(true), Dedup(false),
+  Stats(false), Emitted(false), FileContents(false), Deduped(false) {}
+
+FileWriter::~FileWriter() {
+  for (auto& fs: OpenFs) {
+    tsk_fs_close(fs.second);
+  }
+}
+
+TSK_RETVAL_ENUM FileWriter::processFile(TSK_FS_FILE* file, const char* path) {
+  Emitted = Deduped = false;
+  FileContents = file && hasUsableMeta(file) && file != &DummyFile;
+  MetadataWriter::processFile(file, path);
+  if (file && Emitted) { // no contents without a record
+    try {
+      if (PhysicalOrder) {
+        deferFile(file);
+      }
+      else if (ContentOutput) {
+        // the record has to be out before its contents
+        flushFormatted();
+        if (Deduped) {
+          writeUInt64(0);
+        }
+        else {
+          writeFileContents(file);
+        }
+      }
+    }
+    catch (std::exception& e) {
+      std::cerr << "Error on " << NumFiles << ": " << e.what() << std::endl;
+    }
+  }
   return TSK_OK;
 }
 
-void FileWriter::processUnallocatedFile(TSK_FS_FILE* ) {
-//   std::string fp(DirCounts.back().first);
-//   fp += std::string(file->name->name);
-//   // std::cerr << "processing " << fp << std::endl;
-
-//   writeMetadata(file);
-
-//   Out.write((const char*)&physicalSize, sizeof(physicalSize));
-//   DataWritten += sizeof(physicalSize);
-
-//   uint64 bytesToWrite = 0;
-//   auto bytes = Fs->block_size;
-
-//   for (auto run = file->meta->attr->head->nrd.run; run; run = run->next) {
-//     auto blockOffset = run->addr;
-//     auto endBlock = run->addr + run->len;
-//     while (blockOffset < endBlock) {
-// //      auto toRead = std::min(endBlock - blockOffset, maxBlocks);
-//       if (bytes == tsk_fs_read_block(Fs, blockOffset, &Buffer[0], bytes)) {
-//         Out.write(&Buffer[0], bytes);
-//         ++blockOffset;
-//         bytesToWrite += bytes;
-//         // std::cerr << "wrote block " << blockOffset << std::endl;
-//       }
-//     }
-//   }
-//   DataWritten += bytesToWrite;
-//   if (bytesToWrite != physicalSize) {
-//     std::stringstream buf;
-//     buf << "Did not write out expected amount of unallocated data for " << file->name->name << 
-//       ". Physical size: " << physicalSize << ", Bytes Written: " << bytesToWrite;
-//     throw std::runtime_error(buf.str());
-//   }
-//   // std::cerr << "done processing " << fp << std::endl;
+void FileWriter::emitRecord(PendingRecord& pending) {
+  if (pending.Literal.empty()) {
+    Emitted = true;
+    if (PhysicalOrder) {
+      // held until finishWalk, along with where to find the contents
+      LastPending = pending;
+      return;
+    }
+    if (Dedup && ContentOutput && FileContents) {
+      Deduped = dedupContents(pending, true);
+    }
+  }
+  MetadataWriter::emitRecord(pending);
+}
+
+void FileWriter::finishWalk() {
+  if (PhysicalOrder) {
+    writeDeferred();
+  }
+  MetadataWriter::finishWalk();
+}
+
+void FileWriter::writeFileContents(TSK_FS_FILE* file) {
+  if (!hasUsableMeta(file) || (file == &DummyFile && !InUnallocated)) {
+    // no contents for directory entries without metadata, nor for volumes
+    writeUInt64(0);
+  }
+  else if (file == &DummyFile) {
+    // unallocated "files" are a single run, made by makeUnallocatedDataRun
+    const TSK_FS_ATTR_RUN* run = file->meta->attr->head->nrd.run;
+    writeRun(Fs, run->addr, run->len, file->name->name);
+  }
+  else {
+    writeContents(file);
+  }
+}
+
+void FileWriter::deferFile(TSK_FS_FILE* file) {
+  DeferredFile d;
+  d.Pending = std::move(LastPending);
+  d.Contents = DeferredFile::NONE;
+  d.DiskOffset = 0;
+  d.FsOffset = Fs ? Fs->offset: 0;
+  d.FsType = Fs ? Fs->ftype: TSK_FS_TYPE_DETECT;
+  d.Addr = d.Len = 0;
+  if (!hasUsableMeta(file) || (file == &DummyFile && !InUnallocated)) {
+    // sorts first, in walk order
+  }
+  else if (file == &DummyFile) {
+    const TSK_FS_ATTR_RUN* run = file->meta->attr->head->nrd.run;
+    d.Contents = DeferredFile::UNALLOCATED;
+    d.Addr = run->addr;
+    d.Len = run->len;
+    d.DiskOffset = Fs->offset + run->addr * Fs->block_size;
+  }
+  else {
+    d.Contents = DeferredFile::FILE;
+    d.Addr = file->meta->addr;
+    // sort by the file's first allocated block; resident files sort first
+    const TSK_FS_ATTR* a = tsk_fs_file_attr_get(file);
+    if (a && (a->flags & TSK_FS_ATTR_NONRES)) {
+      for (TSK_FS_ATTR_RUN* curRun = a->nrd.run; curRun; curRun = curRun->next) {
+        if (TSK_FS_ATTR_RUN_FLAG_NONE == curRun->flags) {
+          d.DiskOffset = Fs->offset + curRun->addr * Fs->block_size;
+          break;
+        }
+      }
+    }
+  }
+  Deferred.push_back(std::move(d));
+}
+
+namespace {
+  typedef std::unique_ptr<TSK_FS_FILE, void(*)(TSK_FS_FILE*)> FilePtr;
+
+  const uint64_t WHOLE_FILE_HASH_MAX = 16 * 1024 * 1024,  // larger files are hashed piece by piece
+                 HASH_BYTES_MAX      = 256 * 1024 * 1024; // read but not yet hashed
+}
+
+void FileWriter::writeDeferred() {
+  std::stable_sort(Deferred.begin(), Deferred.end(),
+    [](const DeferredFile& a, const DeferredFile& b) { return a.DiskOffset < b.DiskOffset; });
+
+  RecordIndex index;
+  if (HashPool) {
+    hashDeferred(index);
+  }
+  else {
+    for (DeferredFile& d: Deferred) {
+      writeDeferredFile(d, index);
+    }
+  }
+  Deferred.clear();
+
+  if (!ContentOutput) {
+    return;
+  }
+  // trailer: the index, then the index's position as 8 bytes
+  const uint64_t indexPos = DataWritten;
+  std::stringstream buf;
+  buf << "{\"index\":[";
+  bool first = true;
+  for (auto& entry: index) {
+    if (!first) {
+      buf << ",";
+    }
+    buf << "{" << j("id", entry.first, true) << j("pos", entry.second) << "}";
+    first = false;
+  }
+  buf << "]}\n";
+  const std::string output(buf.str());
+  Out << output;
+  DataWritten += output.size();
+  writeUInt64(indexPos);
+}
+
+void FileWriter::writeDeferredFile(DeferredFile& d, RecordIndex& index, const std::vector<char>* contents) {
+  const FileRecord& rec(d.Pending.Rec);
+  const std::string id(bytesAsString(reinterpret_cast<const unsigned char*>(rec.ID.data()),
+                                     reinterpret_cast<const unsigned char*>(rec.ID.data() + rec.ID.size())));
+  index.push_back(std::make_pair(id, DataWritten));
+
+  const bool known = rec.HasHashes && !rec.Hashes.Known.empty();
+  const bool deduped = Dedup && ContentOutput && !known && d.Contents != DeferredFile::NONE
+                       && dedupContents(d.Pending, d.Contents == DeferredFile::FILE);
+
+  std::stringstream buf;
+  formatPending(buf, d.Pending);
+  const std::string output(buf.str());
+  Out << output;
+  DataWritten += output.size();
+
+  if (ContentOutput) {
+    try {
+      if (known || deduped) {
+        // left out, with the record tagged instead
+        writeUInt64(0);
+      }
+      else if (contents && d.Contents != DeferredFile::NONE) {
+        writeUInt64(contents->size());
+        Out.write(contents->data(), contents->size());
+        DataWritten += contents->size();
+      }
+      else {
+        switch (d.Contents) {
+          case DeferredFile::NONE:
+            writeUInt64(0);
+            break;
+          case DeferredFile::UNALLOCATED:
+            writeRun(openFs(d.FsOffset, d.FsType), d.Addr, d.Len, "unallocated");
+            break;
+          case DeferredFile::FILE:
+            {
+              FilePtr file(tsk_fs_file_open_meta(openFs(d.FsOffset, d.FsType), 0, d.Addr), tsk_fs_file_close);
+              if (!file) {
+                writeUInt64(0);
+                throw std::runtime_error("Could not reopen file to read its contents");
+              }
+              writeContents(file.get());
+            }
+            break;
+        }
+      }
+    }
+    catch (std::exception& e) {
+      std::cerr << "Error on " << id << ": " << e.what() << std::endl;
+    }
+  }
+  d.Pending = PendingRecord(); // done with it, so free it
+}
+
+bool FileWriter::dedupContents(PendingRecord& pending, bool fileContents) {
+  FileRecord& rec(pending.Rec);
+  const auto inode = std::make_pair(pending.InodeVol, rec.Meta.Addr);
+  const bool hashed = rec.HasHashes && rec.Hashes.Size > 0;
+
+  auto inodeItr = fileContents ? WrittenInodes.find(inode): WrittenInodes.end();
+  if (inodeItr != WrittenInodes.end()) {
+    rec.HasContentRef = true;
+    rec.ContentRef = ContentRefRecord{inodeItr->second, "inode"};
+    return true;
+  }
+  auto digestItr = hashed ? WrittenDigests.find(rec.Hashes.SHA256): WrittenDigests.end();
+  if (digestItr != WrittenDigests.end()) {
+    rec.HasContentRef = true;
+    rec.ContentRef = ContentRefRecord{digestItr->second, "sha256"};
+    return true;
+  }
+
+  // these contents get written, so later copies can refer to this record
+  if (fileContents) {
+    WrittenInodes.insert(std::make_pair(inode, rec.ID));
+  }
+  if (hashed) {
+    WrittenDigests.insert(std::make_pair(rec.Hashes.SHA256, rec.ID));
+  }
+  return false;
+}
+
+void FileWriter::hashDeferred(RecordIndex& index) {
+  // the reads happen here, in disk order, while the pool hashes what's
+  // been read; records are written in the same order as their hashes finish
+  std::deque<HashJob> jobs;
+  uint64_t held = 0;
+  for (DeferredFile& d: Deferred) {
+    jobs.push_back(HashJob{&d, 0, std::future<HashRecord>(), std::future<StatsRecord>(), nullptr});
+    if (d.Contents != DeferredFile::NONE) {
+      try {
+        startHash(jobs.back());
+      }
+      catch (std::exception& e) {
+        std::cerr << "Error hashing " << d.Pending.Rec.Path << ": " << e.what() << std::endl;
+      }
+    }
+    held += jobs.back().Len;
+
+    // bound memory use, but keep every thread busy
+    while (jobs.size() > 4 * HashPool->size() || held > HASH_BYTES_MAX) {
+      held -= jobs.front().Len;
+      finishHash(jobs.front(), index);
+      jobs.pop_front();
+    }
+  }
+  while (!jobs.empty()) {
+    finishHash(jobs.front(), index);
+    jobs.pop_front();
+  }
+}
+
+void FileWriter::startHash(HashJob& job) {
+  const DeferredFile& d(*job.File);
+  TSK_FS_INFO* fs = openFs(d.FsOffset, d.FsType);
+
+  FilePtr file(nullptr, tsk_fs_file_close);
+  AttrRecord attr = AttrRecord();
+  uint64_t hashSize = 0, // what's hashed
+           readSize = 0; // what's read; with contents output, that's everything written
+  if (d.Contents == DeferredFile::UNALLOCATED) {
+    hashSize = readSize = d.Len * fs->block_size;
+  }
+  else {
+    file.reset(tsk_fs_file_open_meta(fs, 0, d.Addr));
+    if (!file) {
+      throw std::runtime_error("Could not reopen file to read its contents");
+    }
+    const TSK_FS_ATTR* a = tsk_fs_file_attr_get(file.get());
+    if (a && file->meta) {
+      captureAttr(attr, a, fs);
+      // slack is left out, as hasher.py does
+      hashSize = std::min(attr.PhysicalSize, static_cast<uint64_t>(file->meta->size));
+      readSize = ContentOutput ? attr.PhysicalSize: hashSize;
+    }
+  }
+
+  auto read = [&](uint64_t size, const ContentSink& sink) {
+    const uint64_t got = file ? readContents(file.get(), attr, size, sink): readRun(fs, d.Addr, size, sink);
+    if (got < size) {
+      throw std::runtime_error("Had a problem reading data out of a file");
+    }
+  };
+
+  if (readSize <= WHOLE_FILE_HASH_MAX) {
+    // hashed in one go, alongside other files
+    std::shared_ptr<std::vector<char>> data(new std::vector<char>());
+    data->reserve(readSize);
+    read(readSize, [&data](const char* buf, size_t len) { data->insert(data->end(), buf, buf + len); });
+    job.Len = readSize;
+    if (ContentOutput) {
+      job.Contents = data;
+    }
+    job.Hashes = HashPool->submit([this, data, hashSize]{
+      // KnownSets is fixed by now, and lookups don't modify the sets
+      HashRecord ret(hashData(data->data(), hashSize));
+      ret.Known = findKnown(KnownSets, ret);
+      return ret;
+    });
+
+    if (Stats) {
+      job.Stats = HashPool->submit([data, hashSize]{ return statsData(data->data(), hashSize); });
+    }
+  }
+  else {
+    // too big to hold, so the digests share the file's pieces instead, and
+    // contents are read again when written
+    Hasher hasher;
+    ContentStats stats;
+    ThreadPool& pool(*HashPool);
+    const bool withStats = Stats;
+    read(hashSize, [&hasher, &stats, &pool, withStats](const char* buf, size_t len) {
+      std::future<void> counted;
+      if (withStats) {
+        counted = pool.submit([&stats, buf, len]{ stats.update(buf, len); });
+      }
+      hasher.update(buf, len, pool);
+      if (counted.valid()) {
+        counted.get();
+      }
+    });
+    std::promise<HashRecord> done;
+    HashRecord hashes(hasher.finish());
+    hashes.Known = findKnown(KnownSets, hashes);
+    done.set_value(hashes);
+    job.Hashes = done.get_future();
+    if (Stats) {
+      std::promise<StatsRecord> counted;
+      counted.set_value(stats.finish());
+      job.Stats = counted.get_future();
+    }
+  }
+}
+
+void FileWriter::finishHash(HashJob& job, RecordIndex& index) {
+  FileRecord& rec(job.File->Pending.Rec);
+  if (job.Hashes.valid()) {
+    try {
+      rec.Hashes = job.Hashes.get();
+      rec.HasHashes = true;
+    }
+    catch (std::exception& e) {
+      std::cerr << "Error hashing " << rec.Path << ": " << e.what() << std::endl;
+    }
+  }
+  if (job.Stats.valid()) {
+    rec.Stats = job.Stats.get();
+    rec.HasStats = true;
+  }
+  writeDeferredFile(*job.File, index, job.Contents.get());
+  job.Contents.reset();
+}
+
+TSK_FS_INFO* FileWriter::openFs(uint64_t offset, TSK_FS_TYPE_ENUM type) {
+  // the walk has closed its filesystems by now, so open our own
+  auto itr = OpenFs.find(offset);
+  if (itr == OpenFs.end()) {
+    TSK_FS_INFO* fs = tsk_fs_open_img(m_img_info, offset, type);
+    if (!fs) {
+      throw std::runtime_error("Could not reopen filesystem to read contents");
+    }
+    itr = OpenFs.insert(std::make_pair(offset, fs)).first;
+  }
+  return itr->second;
+}
+
+void FileWriter::writeContents(TSK_FS_FILE* file) {
+  // contents and slack of the default attribute, sized from its runs
+  const TSK_FS_ATTR* a = tsk_fs_file_attr_get(file);
+  AttrRecord attr = AttrRecord();
+  if (a) {
+    captureAttr(attr, a, file->fs_info);
+  }
+  const uint64_t size = a ? attr.PhysicalSize: 0;
+  writeUInt64(size);
+  const uint64_t got = readContents(file, attr, size, [this](const char* buf, size_t len) { Out.write(buf, len); });
+  DataWritten += size;
+  if (got < size) {
+    // keep the stream framed, and carry on with the next file
+    padContents(size - got);
+    throw std::runtime_error("Had a problem reading data out of a file");
+  }
+}
+
+uint64_t FileWriter::readContents(TSK_FS_FILE* file, const AttrRecord& attr, uint64_t size, const ContentSink& sink) {
+  // reads end at run boundaries, so each is one contiguous read of the disk
+  std::vector<uint64_t> runEnds;
+  if ((attr.Flags & TSK_FS_ATTR_NONRES) && !(attr.Flags & TSK_FS_ATTR_COMP)) {
+    for (const RunRecord& r: attr.Runs) {
+      runEnds.push_back((r.Offset + r.Len) * file->fs_info->block_size);
+    }
+  }
+  auto nextEnd = runEnds.begin();
+
+  uint64_t cur = 0;
+  while (cur < size) {
+    while (nextEnd != runEnds.end() && *nextEnd <= cur) {
+      ++nextEnd;
+    }
+    uint64_t toRead = std::min(size - cur, static_cast<uint64_t>(Buffer.size()));
+    if (nextEnd != runEnds.end()) {
+      toRead = std::min(toRead, *nextEnd - cur);
+    }
+    const ssize_t rlen = tsk_fs_file_read(file, cur, &Buffer[0], toRead, TSK_FS_FILE_READ_FLAG_SLACK);
+    if (rlen <= 0) {
+      break;
+    }
+    sink(&Buffer[0], rlen);
+    cur += rlen;
+  }
+  return cur;
+}
+
+void FileWriter::writeRun(TSK_FS_INFO* fs, TSK_DADDR_T addr, TSK_DADDR_T len, const char* name) {
+  const uint64_t size = len * fs->block_size;
+  writeUInt64(size);
+  const uint64_t got = readRun(fs, addr, size, [this](const char* buf, size_t n) { Out.write(buf, n); });
+  DataWritten += size;
+  if (got < size) {
+    padContents(size - got);
+    std::stringstream buf;
+    buf << "Did not write out expected amount of unallocated data for " << name
+      << ". Physical size: " << size << ", Bytes Written: " << got;
+    throw std::runtime_error(buf.str());
+  }
+}
+
+uint64_t FileWriter::readRun(TSK_FS_INFO* fs, TSK_DADDR_T addr, uint64_t size, const ContentSink& sink) {
+  uint64_t cur = 0;
+  while (cur < size) {
+    const uint64_t toRead = std::min(size - cur, static_cast<uint64_t>(Buffer.size()));
+    const ssize_t rlen = tsk_fs_read(fs, addr * fs->block_size + cur, &Buffer[0], toRead);
+    if (rlen <= 0) {
+      break;
+    }
+    sink(&Buffer[0], rlen);
+    cur += rlen;
+  }
+  return cur;
+}
+
+void FileWriter::padContents(uint64_t len) {
+  std::fill(Buffer.begin(), Buffer.end(), 0);
+  while (len) {
+    const uint64_t n = std::min(len, static_cast<uint64_t>(Buffer.size()));
+    Out.write(&Buffer[0], n);
+    len -= n;
+  }
+}
+/*************************************************************************/
+
+namespace {
+  void appendExtent(std::vector<MetadataWriter::Extent>& extents, uint64_t beg, uint64_t end) {
+    if (beg >= end) {
+      return;
+    }
+    if (!extents.empty() && extents.back().second == beg) {
+      extents.back().second = end;
+    }
+    else {
+      extents.push_back(MetadataWriter::Extent(beg, end));
+    }
+  }
+}
+
+RecordVisitor::RecordVisitor(std::ostream& out, const Visit& visit):
+  MetadataWriter(out), Callback(visit), Stopped(false) {}
+
+TSK_FILTER_ENUM RecordVisitor::filterVol(const TSK_VS_PART_INFO* vs_part) {
+  return Stopped ? TSK_FILTER_STOP: MetadataWriter::filterVol(vs_part);
+}
+
+TSK_FILTER_ENUM RecordVisitor::filterFs(TSK_FS_INFO* fs) {
+  return Stopped ? TSK_FILTER_STOP: MetadataWriter::filterFs(fs);
+}
+
+TSK_RETVAL_ENUM RecordVisitor::processFile(TSK_FS_FILE* file, const char* path) {
+  if (Stopped) {
+    return TSK_STOP;
+  }
+  MetadataWriter::processFile(file, path);
+  return Stopped ? TSK_STOP: TSK_OK;
+}
+
+void RecordVisitor::emitRecord(PendingRecord& pending) {
+  if (pending.Literal.empty() && !Stopped) {
+    Stopped = !Callback(pending.Rec);
+  }
+}
+
+CatalogWriter::CatalogWriter(std::ostream& out, const std::vector<std::string>& files):
+  MetadataWriter(out), Files(files)
+{
+  // the fs and dir records are kept in sequence, for --dir-table output
+  DirTable = true;
+}
+
+uint8_t CatalogWriter::start() {
+  if (!InUnallocated) {
+    std::stringstream buf;
+    buf << *getImage(Files);
+    Builder.add(CATALOG_INFO, "info", buf.str());
+  }
+  return MetadataWriter::start();
+}
+
+void CatalogWriter::finishWalk() {
+  MetadataWriter::finishWalk();
+  // the disk map first, so the inode map has the runs
+  writeDiskMap([this](const std::string& id, const std::string& line) {
+    Builder.add(CATALOG_DISK_MAP, id, line);
+  });
+  writeInodeMap([this](const std::string& id, const std::string& line) {
+    Builder.add(CATALOG_INODES, id, line);
+  });
+}
+
+void CatalogWriter::emit(const std::string& output) {
+  Builder.add(CATALOG_RECORDS, "", output);
+}
+
+void CatalogWriter::emitRecord(PendingRecord& pending) {
+  if (!pending.Literal.empty()) {
+    emit(pending.Literal);
+    return;
+  }
+  const FileRecord& rec(pending.Rec);
+  const std::string id(bytesAsString(reinterpret_cast<const unsigned char*>(rec.ID.data()),
+                                     reinterpret_cast<const unsigned char*>(rec.ID.data()) + rec.ID.size()));
+  if (CatalogedFs.insert(rec.Fs.VolIndex).second) {
+    std::stringstream buf;
+    buf << "{";
+    writeFsInfo(buf, rec.Fs);
+    buf << "}";
+    Builder.add(CATALOG_FILESYSTEMS, std::to_string(rec.Fs.VolIndex), buf.str());
+  }
+  Builder.add(CATALOG_RECORDS, id, encodeCatalogRecord(rec, pending.InodeVol));
+  if (rec.HasName) {
+    Builder.add(CATALOG_PATHS, rec.Path + rec.Name.Name, id);
+  }
+}
+
+void SSTableWriter::setSortPool(std::shared_ptr<ThreadPool> pool) {
+  SortPool = pool;
+  Sorter.reset(new ExternalSorter(pool));
+}
+
+void SSTableWriter::add(const std::string& id, const std::string& json) {
+  if (!Sorter) {
+    throw std::runtime_error("SSTableWriter needs a sort pool");
+  }
+  Sorter->add(id, !json.empty() && json.back() == '\n' ? json.substr(0, json.size() - 1): json);
+}
+
+void SSTableWriter::emitRecord(PendingRecord& pending) {
+  const FileRecord& rec(pending.Rec);
+  std::stringstream buf;
+  writeFile(buf, rec, pending.InodeVol, false);
+  add(bytesAsString(reinterpret_cast<const unsigned char*>(rec.ID.data()),
+                    reinterpret_cast<const unsigned char*>(rec.ID.data()) + rec.ID.size()),
+      buf.str());
+}
+
+void SSTableWriter::finishWalk() {
+  MetadataWriter::finishWalk();
+  // the disk map first, so the inode map has the runs
+  writeDiskMap([this](const std::string& id, const std::string& line) { add(id, line); });
+  writeInodeMap([this](const std::string& id, const std::string& line) { add(id, line); });
+
+  SSTableBuilder builder(Out, *SortPool, Sorter->size());
+  Sorter->merge([&builder](const std::string& key, const std::string& value) { builder.add(key, value); });
+  builder.finish();
+}
+
+SpaceWriter::SpaceWriter(std::ostream& out, SPACE space):
+  MetadataWriter(out), Space(space), Buffer(IMAGE_READ_SIZE, 0) {}
+
+void SpaceWriter::emitRecord(PendingRecord&) {
+  // the walk is only for the disk map
+}
+
+void SpaceWriter::finishWalk() {
+  MetadataWriter::finishWalk();
+  for (auto& fs: FsExtents) {
+    const FsMap& runs(AllocatedRuns[fs.first].Runs);
+    const std::vector<Extent> extents(UNALLOCATED == Space ?
+      unallocatedExtents(runs, fs.second.first, fs.second.second): slackExtents(runs));
+    for (const Extent& e: extents) {
+      writeExtent(fs.first, e);
+    }
+  }
+}
+
+std::vector<MetadataWriter::Extent> SpaceWriter::unallocatedExtents(const FsMap& runs, uint64_t fsBeg, uint64_t fsEnd) {
+  std::vector<Extent> ret;
+  uint64_t cur = fsBeg;
+  for (auto& frag: runs) {
+    appendExtent(ret, cur, std::min(frag.first.lower(), fsEnd));
+    cur = std::max(cur, frag.first.upper());
+  }
+  appendExtent(ret, cur, fsEnd);
+  return ret;
+}
+
+std::vector<MetadataWriter::Extent> SpaceWriter::slackExtents(const FsMap& runs) {
+  std::vector<Extent> ret;
+  for (auto& frag: runs) {
+    // where a file's data and another's slack overlap, it's not slack
+    if (std::all_of(frag.second.begin(), frag.second.end(), [](const AttrRunInfo& a) { return a.Slack; })) {
+      appendExtent(ret, frag.first.lower(), frag.first.upper());
+    }
+  }
+  return ret;
+}
+
+void SpaceWriter::writeExtent(uint32_t volIndex, const Extent& extent) {
+  const uint64_t size = extent.second - extent.first;
+  std::stringstream buf;
+  buf << "{" << j("space", std::string(UNALLOCATED == Space ? "unallocated": "slack"), true)
+      << j("volIndex", volIndex)
+      << j("byteOffset", extent.first)
+      << j("size", size)
+      << "}\n";
+  const std::string output(buf.str());
+  Out << output;
+  DataWritten += output.size();
+  writeUInt64(size);
+
+  writeImage(extent.first, size, Buffer);
+}
+/*************************************************************************/
+
+SearchWriter::SearchWriter(std::ostream& out): MetadataWriter(out) {}
+
+void SearchWriter::emitRecord(PendingRecord&) {
+  // the walk is only for the disk map
+}
+
+void SearchWriter::finishWalk() {
+  MetadataWriter::finishWalk();
+  if (!Matcher || !SearchPool) {
+    return;
+  }
+  searchImage(std::vector<Extent>(1, Extent(0, DiskSize)), Matcher, *SearchPool,
+    [this](const std::vector<PatternMatcher::Hit>& hits, uint64_t) { writeHits(hits); });
+}
+
+void SearchWriter::writeHits(const std::vector<PatternMatcher::Hit>& hits) {
+  for (const PatternMatcher::Hit& hit: hits) {
+    std::stringstream buf;
+    buf << std::boolalpha << "{" << j("pattern", Matcher->patterns()[hit.Pattern], true)
+        << j("byteOffset", hit.Offset);
+
+    // a hit in a filesystem belongs to the files whose runs hold its first
+    // byte; if there are none, it's in unallocated space
+    auto fs = std::find_if(FsExtents.begin(), FsExtents.end(),
+      [&hit](const std::pair<const uint32_t, Extent>& e) { return e.second.first <= hit.Offset && hit.Offset < e.second.second; });
+    if (fs != FsExtents.end()) {
+      buf << j("volIndex", fs->first) << ",\"owners\":[";
+      const FsMap& runs(AllocatedRuns[fs->first].Runs);
+      auto frag = runs.find(hit.Offset);
+      if (frag != runs.end()) {
+        bool first = true;
+        for (const AttrRunInfo& a: frag->second) {
+          buf << (first ? "": ",") << "{"
+              << j<int64_t>("inum", static_cast<int64_t>(a.Inum), true)
+              << j("attrId", a.AttrID)
+              << j("fileOffset", a.Offset + (hit.Offset - a.DRBeg))
+              << j("slack", a.Slack)
+              << j("__link", makeInodeID(fs->first, a.Inum))
+              << "}";
+          first = false;
+        }
+      }
+      buf << "]";
+    }
+    buf << "}\n";
+    const std::string output(buf.str());
+    Out << output;
+    DataWritten += output.size();
+  }
+}
+/*************************************************************************/
+
+CarveWriter::CarveWriter(std::ostream& out):
+  MetadataWriter(out), ContentOutput(false), Buffer(IMAGE_READ_SIZE, 0) {}
+
+void CarveWriter::emitRecord(PendingRecord&) {
+  // the walk is only for the disk map
+}
+
+void CarveWriter::finishWalk() {
+  MetadataWriter::finishWalk();
+  if (!CarvePool) {
+    return;
+  }
+  std::vector<VolExtent> unallocated;
+  for (auto& fs: FsExtents) {
+    for (const Extent& e: SpaceWriter::unallocatedExtents(AllocatedRuns[fs.first].Runs, fs.second.first, fs.second.second)) {
+      unallocated.push_back(VolExtent(fs.first, e));
+    }
+  }
+  std::sort(unallocated.begin(), unallocated.end(),
+    [](const VolExtent& a, const VolExtent& b) { return a.second.first < b.second.first; });
+  std::vector<Extent> extents;
+  for (const VolExtent& e: unallocated) {
+    extents.push_back(e.second);
+  }
+
+  // each extent is carved as soon as it's been searched, so only its hits
+  // are held
+  auto cur = unallocated.begin();
+  std::vector<PatternMatcher::Hit> hits;
+  searchImage(extents, Carve.matcher(), *CarvePool,
+    [&](const std::vector<PatternMatcher::Hit>& pieceHits, uint64_t searchedTo) {
+      hits.insert(hits.end(), pieceHits.begin(), pieceHits.end());
+      for (; cur != unallocated.end() && cur->second.second <= searchedTo; ++cur) {
+        carveExtent(*cur, hits);
+        hits.clear();
+      }
+    });
+}
+
+void CarveWriter::carveExtent(const VolExtent& extent, const std::vector<PatternMatcher::Hit>& hits) {
+  const std::vector<CarvedObject> objects(Carve.carve(hits, extent.second.first, extent.second.second,
+    [this](uint64_t offset, size_t len) { return readImage(offset, len); }));
+  for (const CarvedObject& obj: objects) {
+    std::stringstream buf;
+    buf << std::boolalpha << "{" << j("type", obj.Type, true)
+        << j("volIndex", extent.first)
+        << j("byteOffset", obj.Offset)
+        << j("size", obj.Size)
+        << j("complete", obj.Complete)
+        << "}\n";
+    const std::string output(buf.str());
+    Out << output;
+    DataWritten += output.size();
+    if (ContentOutput) {
+      writeUInt64(obj.Size);
+      writeImage(obj.Offset, obj.Size, Buffer);
+    }
+  }
+}
+
+std::string CarveWriter::readImage(uint64_t offset, size_t len) {
+  std::string ret(len, '\0');
+  const ssize_t rlen = tsk_img_read(m_img_info, offset, &ret[0], len);
+  ret.resize(rlen > 0 ? rlen: 0);
+  return ret;
+}
+/*************************************************************************/
+
+BlockMapWriter::BlockMapWriter(std::ostream& out):
+  MetadataWriter(out), RegionSize(64 * 1024) {}
+
+void BlockMapWriter::emitRecord(PendingRecord&) {
+  // the walk is only for the disk map
+}
+
+void BlockMapWriter::finishWalk() {
+  MetadataWriter::finishWalk();
+  if (!ClassifyPool) {
+    return;
+  }
+  std::vector<uint8_t> regions((DiskSize + RegionSize - 1) / RegionSize, 0);
+  for (auto& fs: FsExtents) {
+    markRegions(AllocatedRuns[fs.first].Runs, fs.second.first, fs.second.second, RegionSize, regions);
+  }
+  classifyImage(regions);
+
+  writeSummary(regions);
+  writeUInt64(regions.size());
+  Out.write(reinterpret_cast<const char*>(regions.data()), regions.size());
+  DataWritten += regions.size();
+}
+
+void BlockMapWriter::markRegions(const FsMap& runs, uint64_t fsBeg, uint64_t fsEnd,
+                                 uint64_t regionSize, std::vector<uint8_t>& regions)
+{
+  auto mark = [&regions, regionSize](uint64_t beg, uint64_t end, uint8_t flag) {
+    end = std::min(end, regions.size() * regionSize);
+    if (beg < end) {
+      for (uint64_t r = beg / regionSize; r <= (end - 1) / regionSize; ++r) {
+        regions[r] |= flag;
+      }
+    }
+  };
+  for (auto& frag: runs) {
+    // as in SpaceWriter, it's slack only if it's no file's data
+    const bool slack = std::all_of(frag.second.begin(), frag.second.end(), [](const AttrRunInfo& a) { return a.Slack; });
+    mark(frag.first.lower(), frag.first.upper(), slack ? REGION_SLACK: REGION_ALLOCATED);
+  }
+  for (const Extent& e: SpaceWriter::unallocatedExtents(runs, fsBeg, fsEnd)) {
+    mark(e.first, e.second, REGION_UNALLOCATED);
+  }
+}
+
+void BlockMapWriter::classifyImage(std::vector<uint8_t>& regions) {
+  typedef std::vector<uint8_t> Classes;
+
+  // pieces are whole regions, so each is classified by a single job
+  const uint64_t regionSize = RegionSize,
+                 pieceSize  = std::max<uint64_t>(1, IMAGE_READ_SIZE / regionSize) * regionSize;
+  ThreadPool& pool(*ClassifyPool);
+
+  std::deque<std::pair<uint64_t, std::future<Classes>>> jobs; // first region, classes
+  auto finish = [&regions](std::pair<uint64_t, std::future<Classes>>& job) {
+    const Classes classes(job.second.get());
+    for (size_t i = 0; i < classes.size(); ++i) {
+      regions[job.first + i] |= classes[i];
+    }
+  };
+  for (uint64_t off = 0; off < DiskSize; off += pieceSize) {
+    const size_t len = std::min(DiskSize - off, pieceSize);
+    auto buf = std::make_shared<std::vector<char>>(len);
+    size_t got = 0;
+    while (got < len) {
+      const ssize_t rlen = tsk_img_read(m_img_info, off + got, &(*buf)[got], len - got);
+      if (rlen <= 0) {
+        std::cerr << "Could not read " << (len - got) << " bytes at " << (off + got) << std::endl;
+        break;
+      }
+      got += rlen;
+    }
+    jobs.push_back(std::make_pair(off / regionSize, pool.submit([buf, got, regionSize]() {
+      Classes classes;
+      for (size_t r = 0; r < buf->size(); r += regionSize) {
+        const size_t n = std::min(buf->size() - r, static_cast<size_t>(regionSize));
+        classes.push_back(r + n <= got ? classifyBlock(buf->data() + r, n): UNREADABLE_BLOCK);
+      }
+      return classes;
+    })));
+
+    // bounds what's held in memory
+    while (jobs.size() > 2 * pool.size()) {
+      finish(jobs.front());
+      jobs.pop_front();
+    }
+  }
+  for (auto& job: jobs) {
+    finish(job);
+  }
+}
+
+void BlockMapWriter::writeSummary(const std::vector<uint8_t>& regions) {
+  enum { TOTAL, ALLOCATED, SLACK, UNALLOCATED, OUTSIDE, NUM_COUNTS };
+  uint64_t counts[NUM_BLOCK_CLASSES][NUM_COUNTS] = {{0}};
+  for (uint8_t r: regions) {
+    uint64_t* c = counts[r & REGION_CLASS_MASK];
+    ++c[TOTAL];
+    c[ALLOCATED]   += (r & REGION_ALLOCATED) ? 1: 0;
+    c[SLACK]       += (r & REGION_SLACK) ? 1: 0;
+    c[UNALLOCATED] += (r & REGION_UNALLOCATED) ? 1: 0;
+    c[OUTSIDE]     += (r & ~REGION_CLASS_MASK) ? 0: 1;
+  }
+
+  std::stringstream buf;
+  buf << "{" << j("regionSize", RegionSize, true)
+      << j("diskSize", DiskSize)
+      << j<uint64_t>("regions", regions.size())
+      << ",\"classes\":{";
+  for (unsigned int c = 0; c < NUM_BLOCK_CLASSES; ++c) {
+    buf << (c ? ",": "") << "\"" << blockClassName(static_cast<BlockClass>(c)) << "\":{"
+        << j("regions", counts[c][TOTAL], true)
+        << j("allocated", counts[c][ALLOCATED])
+        << j("slack", counts[c][SLACK])
+        << j("unallocated", counts[c][UNALLOCATED])
+        << j("outside", counts[c][OUTSIDE])
+        << "}";
+  }
+  buf << "}}\n";
+  const std::string output(buf.str());
+  Out << output;
+  DataWritten += output.size();
 }
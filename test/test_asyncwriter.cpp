@@ -0,0 +1,64 @@
+#include <scope/test.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "asyncwriter.h"
+
+SCOPE_TEST(testSpscRing) {
+  SpscRing<int> ring(3);
+  SCOPE_ASSERT_EQUAL(4u, ring.capacity());
+
+  int val = 0;
+  SCOPE_ASSERT(!ring.tryPop(val));
+  for (int i = 0; i < 4; ++i) {
+    SCOPE_ASSERT(ring.tryPush(i));
+  }
+  SCOPE_ASSERT(!ring.tryPush(4));
+  SCOPE_ASSERT(ring.tryPop(val));
+  SCOPE_ASSERT_EQUAL(0, val);
+  SCOPE_ASSERT(ring.tryPush(4));
+  for (int i = 1; i < 5; ++i) {
+    SCOPE_ASSERT(ring.tryPop(val));
+    SCOPE_ASSERT_EQUAL(i, val);
+  }
+  SCOPE_ASSERT(!ring.tryPop(val));
+}
+
+SCOPE_TEST(testAsyncWriterStreambuf) {
+  const char* path = "test_asyncwriter.tmp";
+  const int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  SCOPE_ASSERT(fd >= 0);
+
+  std::stringstream expected;
+  AsyncWriterStats stats;
+  {
+    // small chunks and few of them, so the walk side has to wait
+    AsyncWriterStreambuf buf(fd, 100, 4);
+    std::ostream out(&buf);
+    for (unsigned int i = 0; i < 10000; ++i) {
+      out << "{\"record\":" << i << "}\n";
+      expected << "{\"record\":" << i << "}\n";
+    }
+    out.flush();
+    buf.close();
+    stats = buf.stats();
+  }
+  ::close(fd);
+
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  std::stringstream actual;
+  actual << file.rdbuf();
+  file.close();
+  std::remove(path);
+
+  SCOPE_ASSERT_EQUAL(expected.str(), actual.str());
+  SCOPE_ASSERT_EQUAL(expected.str().size(), stats.Bytes);
+  SCOPE_ASSERT(stats.Chunks >= expected.str().size() / 100);
+  SCOPE_ASSERT(stats.Writes > 0);
+  SCOPE_ASSERT(stats.Writes <= stats.Chunks);
+}
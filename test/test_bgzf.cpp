@@ -0,0 +1,75 @@
+#include <scope/test.h>
+
+#include <sstream>
+#include <stdexcept>
+
+#include "bgzf.h"
+
+namespace {
+  std::string decompressAll(const std::string& compressed, unsigned int& numBlocks) {
+    std::string ret;
+    const unsigned char* buf = reinterpret_cast<const unsigned char*>(compressed.data());
+    size_t pos = 0;
+    numBlocks = 0;
+    while (pos < compressed.size()) {
+      pos += bgzfDecompressBlock(ret, buf + pos, compressed.size() - pos);
+      ++numBlocks;
+    }
+    return ret;
+  }
+}
+
+SCOPE_TEST(testBgzfBlockRoundTrip) {
+  const std::string data("the quick brown fox jumps over the lazy dog, the quick brown fox");
+  const std::string block(bgzfCompressBlock(data.data(), data.size(), 6));
+  std::string out;
+  SCOPE_ASSERT_EQUAL(block.size(), bgzfDecompressBlock(out, reinterpret_cast<const unsigned char*>(block.data()), block.size()));
+  SCOPE_ASSERT_EQUAL(data, out);
+
+  std::string eof;
+  bgzfDecompressBlock(eof, reinterpret_cast<const unsigned char*>(bgzfEofBlock().data()), bgzfEofBlock().size());
+  SCOPE_ASSERT(eof.empty());
+}
+
+SCOPE_TEST(testBgzfCorrupt) {
+  const std::string data("some data to compress");
+  std::string block(bgzfCompressBlock(data.data(), data.size(), 6));
+  block[block.size() - 5] ^= 0x01; // crc
+  std::string out;
+  SCOPE_ASSERT_THROWS(bgzfDecompressBlock(out, reinterpret_cast<const unsigned char*>(block.data()), block.size()), std::runtime_error);
+  SCOPE_ASSERT_THROWS(bgzfDecompressBlock(out, reinterpret_cast<const unsigned char*>(block.data()), 10), std::runtime_error);
+}
+
+SCOPE_TEST(testBgzfStreambuf) {
+  std::string expected;
+  unsigned int seed = 1;
+  for (unsigned int i = 0; i < 3 * BGZF_MAX_BLOCK_DATA + 100; ++i) {
+    seed = seed * 1103515245 + 12345;
+    expected.push_back(i % 7 ? 'a' + (i % 26): static_cast<char>(seed >> 16));
+  }
+
+  std::stringstream sink;
+  ThreadPool pool(2);
+  {
+    BgzfStreambuf zbuf(sink.rdbuf(), pool);
+    std::ostream out(&zbuf);
+    out.write(expected.data(), 1000);
+    out << std::flush;
+    out.write(expected.data() + 1000, expected.size() - 1000);
+    zbuf.close();
+
+    SCOPE_ASSERT_EQUAL(4u, zbuf.index().size());
+    SCOPE_ASSERT_EQUAL(0u, zbuf.index()[0].first);
+    SCOPE_ASSERT_EQUAL(BGZF_MAX_BLOCK_DATA, zbuf.index()[1].second);
+
+    std::stringstream gzi;
+    zbuf.writeIndex(gzi);
+    SCOPE_ASSERT_EQUAL(8u + 3 * 16, gzi.str().size());
+  }
+
+  const std::string compressed(sink.str());
+  unsigned int numBlocks = 0;
+  SCOPE_ASSERT_EQUAL(expected, decompressAll(compressed, numBlocks));
+  SCOPE_ASSERT_EQUAL(5u, numBlocks); // flush doesn't cut a block; EOF block at end
+  SCOPE_ASSERT_EQUAL(bgzfEofBlock(), compressed.substr(compressed.size() - bgzfEofBlock().size()));
+}
@@ -0,0 +1,165 @@
+#include <scope/test.h>
+
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "binrec.h"
+#include "util.h"
+
+FileRecord makeTestRecord() {
+  FileRecord rec;
+  rec.ID = std::string("\x00\x01\x00", 3);
+  rec.Parent = std::string("\x00\x00", 2);
+  rec.Children = std::string("\x00\x02\x00\x00", 4);
+  rec.Fs = FsRecord{1048576, 4096, std::string("\xf7\xc7\xb6\x28", 4), "part-0-0", 1};
+  rec.Path = "part-0-0/Documents/";
+
+  rec.HasName = true;
+  rec.Name = NameRecord{1, 9839041, 2, "SANS-talk.html", 5, 0, "SANS-T~2.HTM", 5};
+
+  rec.HasMeta = true;
+  MetaRecord& m(rec.Meta);
+  m.Addr = 9839041;
+  m.Accessed = Timestamp{1344312000, 0};
+  m.ContentLen = 8;
+  m.Created = Timestamp{1340828653, 840000000};
+  m.Metadata = Timestamp{-1, 5};
+  m.Flags = 5;
+  m.Gid = 0;
+  m.Link = "";
+  m.FsTimeKind = MetaRecord::EXT_DTIME;
+  m.FsTime = Timestamp{7, 8};
+  m.Mode = 511;
+  m.Modified = Timestamp{1340828652, 0};
+  m.NLink = 1;
+  m.Seq = 0;
+  m.Size = 4061;
+  m.Type = 1;
+  m.Uid = 1000;
+
+  AttrRecord a;
+  a.Flags = 3;
+  a.ID = 0;
+  a.Type = 128;
+  a.Size = 4061;
+  a.RdBufSize = 0;
+  a.AllocSize = 4096;
+  a.CompSize = 0;
+  a.InitSize = 4061;
+  a.SkipLen = 0;
+  a.PhysicalSize = 4096;
+  a.SlackSize = 35;
+  a.Runs.push_back(RunRecord{1531152, 8, 0, 0});
+  a.Runs.push_back(RunRecord{std::numeric_limits<uint64_t>::max(), 1, 8, 2});
+  m.Attrs.push_back(a);
+
+  a.Name = "Zone.Identifier";
+  a.Flags = 5;
+  a.ResidentData = std::string("[ZoneTransfer]\x00\xff", 16);
+  a.Runs.clear();
+  m.Attrs.push_back(a);
+  return rec;
+}
+
+SCOPE_TEST(testBinRecRoundTrip) {
+  const FileRecord rec(makeTestRecord());
+
+  std::string payload;
+  encodeFileRecord(payload, rec);
+
+  FileRecord out;
+  const unsigned char* beg = reinterpret_cast<const unsigned char*>(payload.data());
+  SCOPE_ASSERT(beg + payload.size() == decodeFileRecord(out, beg, beg + payload.size()));
+
+  SCOPE_ASSERT_EQUAL(rec.ID, out.ID);
+  SCOPE_ASSERT_EQUAL(rec.Parent, out.Parent);
+  SCOPE_ASSERT_EQUAL(rec.Children, out.Children);
+  SCOPE_ASSERT_EQUAL(rec.Fs.FsID, out.Fs.FsID);
+  SCOPE_ASSERT_EQUAL(rec.Fs.VolName, out.Fs.VolName);
+  SCOPE_ASSERT_EQUAL(1u, out.Fs.VolIndex);
+  SCOPE_ASSERT_EQUAL(rec.Path, out.Path);
+  SCOPE_ASSERT(out.HasName);
+  SCOPE_ASSERT_EQUAL("SANS-talk.html", out.Name.Name);
+  SCOPE_ASSERT_EQUAL("SANS-T~2.HTM", out.Name.ShortName);
+  SCOPE_ASSERT_EQUAL(5u, out.Name.Type);
+  SCOPE_ASSERT(out.HasMeta);
+  SCOPE_ASSERT_EQUAL(-1, out.Meta.Metadata.Secs);
+  SCOPE_ASSERT_EQUAL(840000000u, out.Meta.Created.Nanos);
+  SCOPE_ASSERT_EQUAL(7, out.Meta.FsTime.Secs);
+  SCOPE_ASSERT_EQUAL(4061u, out.Meta.Size);
+  SCOPE_ASSERT_EQUAL(1000u, out.Meta.Uid);
+  SCOPE_ASSERT_EQUAL(2u, out.Meta.Attrs.size());
+  SCOPE_ASSERT_EQUAL(4096u, out.Meta.Attrs[0].PhysicalSize);
+  SCOPE_ASSERT_EQUAL(35u, out.Meta.Attrs[0].SlackSize);
+  SCOPE_ASSERT_EQUAL(2u, out.Meta.Attrs[0].Runs.size());
+  SCOPE_ASSERT_EQUAL(std::numeric_limits<uint64_t>::max(), out.Meta.Attrs[0].Runs[1].Addr);
+  SCOPE_ASSERT_EQUAL(2u, out.Meta.Attrs[0].Runs[1].Flags);
+  SCOPE_ASSERT_EQUAL(rec.Meta.Attrs[1].ResidentData, out.Meta.Attrs[1].ResidentData);
+  SCOPE_ASSERT_EQUAL("Zone.Identifier", out.Meta.Attrs[1].Name);
+}
+
+SCOPE_TEST(testBinRecTruncated) {
+  std::string payload;
+  encodeFileRecord(payload, makeTestRecord());
+
+  FileRecord out;
+  const unsigned char* beg = reinterpret_cast<const unsigned char*>(payload.data());
+  SCOPE_ASSERT_THROWS(decodeFileRecord(out, beg, beg + payload.size() - 1), std::runtime_error);
+}
+
+SCOPE_TEST(testBinRecBadCount) {
+  FileRecord rec(makeTestRecord());
+  rec.Meta.Attrs.resize(1);
+  rec.Meta.Attrs[0].Runs.clear();
+  FileRecord noAttrs(rec);
+  noAttrs.Meta.Attrs.clear();
+
+  // each ends with a count of 0, of runs or of attrs; make it huge
+  unsigned char huge[MAX_VINT_SIZE];
+  const std::string hugeCount(reinterpret_cast<const char*>(huge), vintEncode(huge, std::numeric_limits<uint64_t>::max() / 2));
+  for (const FileRecord* r: {&rec, &noAttrs}) {
+    std::string payload;
+    encodeFileRecord(payload, *r);
+    SCOPE_ASSERT_EQUAL('\0', payload.back());
+    payload.pop_back();
+    payload += hugeCount;
+
+    FileRecord out;
+    const unsigned char* beg = reinterpret_cast<const unsigned char*>(payload.data());
+    SCOPE_ASSERT_THROWS(decodeFileRecord(out, beg, beg + payload.size()), std::runtime_error);
+  }
+}
+
+SCOPE_TEST(testBinRecStream) {
+  std::stringstream buf;
+  writeBinRecHeader(buf);
+
+  FileRecord rec(makeTestRecord()),
+             noMeta(makeTestRecord());
+  noMeta.HasMeta = false;
+
+  std::string payload;
+  encodeFileRecord(payload, rec);
+  writeBinRecord(buf, payload);
+  payload.clear();
+  encodeFileRecord(payload, noMeta);
+  writeBinRecord(buf, payload);
+
+  BinRecReader reader(buf);
+  SCOPE_ASSERT_EQUAL(BINREC_VERSION, reader.version());
+  SCOPE_ASSERT_EQUAL(binRecSchema(), reader.schema());
+
+  FileRecord out;
+  SCOPE_ASSERT(reader.next(out));
+  SCOPE_ASSERT(out.HasMeta);
+  SCOPE_ASSERT(reader.next(out));
+  SCOPE_ASSERT(!out.HasMeta);
+  SCOPE_ASSERT_EQUAL("SANS-talk.html", out.Name.Name);
+  SCOPE_ASSERT(!reader.next(out));
+}
+
+SCOPE_TEST(testBinRecBadMagic) {
+  std::stringstream buf("{\"id\":\"00\"}\n");
+  SCOPE_ASSERT_THROWS(BinRecReader reader(buf), std::runtime_error);
+}
@@ -0,0 +1,36 @@
+#include <scope/test.h>
+
+#include <string>
+
+#include "fsrip.h"
+
+namespace {
+  int countRecord(const SF_RECORD*, void* user) {
+    ++*static_cast<unsigned int*>(user);
+    return 0;
+  }
+}
+
+SCOPE_TEST(testCApiOpenFailure) {
+  SCOPE_ASSERT(!sf_open_img(nullptr, 0));
+  SCOPE_ASSERT_EQUAL("no evidence files given", std::string(sf_last_error()));
+
+  const char* segments[] = {"no/such/image.E01"};
+  SCOPE_ASSERT(!sf_open_img(segments, 1));
+  SCOPE_ASSERT_EQUAL("could not open the evidence files", std::string(sf_last_error()));
+}
+
+SCOPE_TEST(testCApiNullHandle) {
+  char buf[512];
+  SF_VOLUME vol;
+  unsigned int count = 0;
+  SCOPE_ASSERT_EQUAL(0u, sf_img_size(nullptr));
+  SCOPE_ASSERT_EQUAL(0u, sf_img_sector_size(nullptr));
+  SCOPE_ASSERT_EQUAL(0u, sf_num_volumes(nullptr));
+  SCOPE_ASSERT_EQUAL(-1, sf_img_read(nullptr, 0, buf, sizeof(buf)));
+  SCOPE_ASSERT_EQUAL(-1, sf_get_volume(nullptr, 0, &vol));
+  SCOPE_ASSERT_EQUAL(-1, sf_walk(nullptr, countRecord, &count));
+  SCOPE_ASSERT_EQUAL(0u, count);
+  SCOPE_ASSERT_EQUAL("no image or callback", std::string(sf_last_error()));
+  sf_close_img(nullptr);
+}
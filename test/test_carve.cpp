@@ -0,0 +1,69 @@
+#include <scope/test.h>
+
+#include <algorithm>
+#include <string>
+
+#include "carve.h"
+
+namespace {
+  void put(std::string& data, size_t pos, const std::string& bytes) {
+    data.replace(pos, bytes.size(), bytes);
+  }
+
+  std::string makeUnallocated() {
+    std::string data(1200, 'x');
+    // a PNG
+    put(data, 10, std::string("\x89PNG\r\n\x1a\n", 8));
+    put(data, 38, std::string("IEND\xae\x42\x60\x82", 8));
+    // a JPEG, then one without its end
+    put(data, 100, std::string("\xff\xd8\xff\xe0", 4));
+    put(data, 150, std::string("\xff\xd9", 2));
+    put(data, 200, std::string("\xff\xd8\xff\xe1", 4));
+    // a docx: a local file header for [Content_Types].xml, another entry,
+    // and the end of central directory record, with a 3 byte comment
+    put(data, 400, std::string("PK\x03\x04", 4));
+    put(data, 426, std::string("\x13\x00", 2));
+    put(data, 430, "[Content_Types].xml");
+    put(data, 480, std::string("PK\x03\x04", 4));
+    put(data, 520, std::string("PK\x05\x06", 4));
+    put(data, 540, std::string("\x03\x00", 2));
+    // a SQLite database of 2 512 byte pages, which doesn't fit
+    put(data, 700, std::string("SQLite format 3\0", 16));
+    put(data, 716, std::string("\x02\x00", 2));
+    put(data, 728, std::string("\x00\x00\x00\x02", 4));
+    return data;
+  }
+}
+
+SCOPE_TEST(testCarverObjects) {
+  const std::string data(makeUnallocated());
+  Carver carver;
+  std::vector<PatternMatcher::Hit> hits;
+  carver.matcher()->search(data.data(), data.size(), 0, hits);
+  std::sort(hits.begin(), hits.end());
+
+  const std::vector<CarvedObject> objs(carver.carve(hits, 0, data.size(),
+    [&data](uint64_t offset, size_t len) { return data.substr(offset, len); }));
+  SCOPE_ASSERT_EQUAL(5u, objs.size());
+
+  SCOPE_ASSERT_EQUAL("png", objs[0].Type);
+  SCOPE_ASSERT_EQUAL(10u, objs[0].Offset);
+  SCOPE_ASSERT_EQUAL(36u, objs[0].Size);
+  SCOPE_ASSERT(objs[0].Complete);
+
+  SCOPE_ASSERT_EQUAL("jpeg", objs[1].Type);
+  SCOPE_ASSERT_EQUAL(52u, objs[1].Size);
+  SCOPE_ASSERT(objs[1].Complete);
+  SCOPE_ASSERT_EQUAL(200u, objs[2].Offset);
+  SCOPE_ASSERT_EQUAL(1000u, objs[2].Size); // to the end of the extent
+  SCOPE_ASSERT(!objs[2].Complete);
+
+  SCOPE_ASSERT_EQUAL("ooxml", objs[3].Type);
+  SCOPE_ASSERT_EQUAL(400u, objs[3].Offset);
+  SCOPE_ASSERT_EQUAL(145u, objs[3].Size);
+  SCOPE_ASSERT(objs[3].Complete);
+
+  SCOPE_ASSERT_EQUAL("sqlite", objs[4].Type);
+  SCOPE_ASSERT_EQUAL(500u, objs[4].Size);
+  SCOPE_ASSERT(!objs[4].Complete);
+}
@@ -0,0 +1,114 @@
+#include <scope/test.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "binrec.h"
+#include "catalog.h"
+#include "jsonrec.h"
+
+FileRecord makeTestRecord(); // test_binrec.cpp
+
+namespace {
+  std::vector<SegmentIdentity> testSegments() {
+    return std::vector<SegmentIdentity>{SegmentIdentity{"image.E01", 1024, 1400000000},
+                                        SegmentIdentity{"image.E02", 512, 1400000001}};
+  }
+}
+
+SCOPE_TEST(testCatalogLookups) {
+  CatalogBuilder builder;
+  builder.add(CATALOG_INODES, "c", "3");
+  builder.add(CATALOG_INODES, "a", "1");
+  builder.add(CATALOG_INODES, "", "unkeyed");
+  builder.add(CATALOG_INODES, "b", "2");
+  builder.add(CATALOG_INODES, "a", "1 again");
+  builder.add(CATALOG_DISK_MAP, "a", "disk");
+  SCOPE_ASSERT_EQUAL(4u, builder.size(CATALOG_INODES));
+
+  const std::string path("test_catalog.tmp");
+  builder.write(path, testSegments());
+  {
+    Catalog catalog(path);
+    SCOPE_ASSERT(catalog.current(testSegments()));
+    std::vector<SegmentIdentity> changed(testSegments());
+    changed[1].Modified += 1;
+    SCOPE_ASSERT(!catalog.current(changed));
+    changed.pop_back();
+    SCOPE_ASSERT(!catalog.current(changed));
+
+    SCOPE_ASSERT_EQUAL(4u, catalog.size(CATALOG_INODES));
+    SCOPE_ASSERT_EQUAL(0u, catalog.size(CATALOG_RECORDS));
+
+    const std::vector<CatalogEntry> as(catalog.find(CATALOG_INODES, "a"));
+    SCOPE_ASSERT_EQUAL(2u, as.size());
+    SCOPE_ASSERT_EQUAL("1", as[0].value());
+    SCOPE_ASSERT_EQUAL("1 again", as[1].value());
+    SCOPE_ASSERT_EQUAL("2", catalog.find(CATALOG_INODES, "b").front().value());
+    SCOPE_ASSERT_EQUAL("3", catalog.find(CATALOG_INODES, "c").front().value());
+    SCOPE_ASSERT(catalog.find(CATALOG_INODES, "").empty());
+    SCOPE_ASSERT(catalog.find(CATALOG_INODES, "d").empty());
+    SCOPE_ASSERT_EQUAL("disk", catalog.find(CATALOG_DISK_MAP, "a").front().value());
+
+    std::string values;
+    catalog.scan(CATALOG_INODES, [&values](const CatalogEntry& e) { values += e.value() + ","; });
+    SCOPE_ASSERT_EQUAL("3,1,unkeyed,2,1 again,", values);
+  }
+  std::remove(path.c_str());
+}
+
+SCOPE_TEST(testCatalogRecords) {
+  FileRecord rec(makeTestRecord());
+  const std::string id("000100");
+
+  CatalogBuilder builder;
+  builder.add(CATALOG_RECORDS, "", "{\"fs\":{}}\n");
+  builder.add(CATALOG_RECORDS, id, encodeCatalogRecord(rec, 3));
+  const std::string path("test_catalog_records.tmp");
+  builder.write(path, testSegments());
+  {
+    Catalog catalog(path);
+    FileRecord decoded;
+    uint32_t   inodeVol = 0;
+    decodeCatalogRecord(catalog.find(CATALOG_RECORDS, id).front(), decoded, inodeVol);
+    SCOPE_ASSERT_EQUAL(3u, inodeVol);
+    SCOPE_ASSERT_EQUAL(rec.Path, decoded.Path);
+    SCOPE_ASSERT_EQUAL(rec.Name.Name, decoded.Name.Name);
+    SCOPE_ASSERT_EQUAL(2u, decoded.Meta.Attrs.size());
+
+    std::stringstream expected;
+    writeFile(expected, rec, 3, false);
+    expected << '\n';
+    std::stringstream plain;
+    writeCatalogRecords(plain, catalog, false, false, ALL_FIELDS);
+    SCOPE_ASSERT_EQUAL(expected.str(), plain.str());
+
+    std::stringstream dirTable;
+    writeCatalogRecords(dirTable, catalog, false, true, ALL_FIELDS);
+    SCOPE_ASSERT_EQUAL(0u, dirTable.str().find("{\"fs\":{}}\n{"));
+
+    std::stringstream binary;
+    writeCatalogRecords(binary, catalog, true, false, ALL_FIELDS);
+    BinRecReader reader(binary);
+    FileRecord fromBinary;
+    SCOPE_ASSERT(reader.next(fromBinary));
+    SCOPE_ASSERT_EQUAL(rec.Name.Name, fromBinary.Name.Name);
+    SCOPE_ASSERT(!reader.next(fromBinary));
+  }
+  std::remove(path.c_str());
+}
+
+SCOPE_TEST(testCatalogInvalid) {
+  const std::string path("test_catalog_bad.tmp");
+  {
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+    file << "FSHS not a catalog";
+  }
+  SCOPE_ASSERT_THROWS(Catalog{path}, std::runtime_error);
+  std::remove(path.c_str());
+  SCOPE_ASSERT_THROWS(Catalog{path}, std::runtime_error);
+
+  SCOPE_ASSERT_THROWS(segmentIdentities(std::vector<std::string>{path}), std::runtime_error);
+}
@@ -0,0 +1,68 @@
+#include <scope/test.h>
+
+#include <string>
+
+#include "contentstats.h"
+
+SCOPE_TEST(testContentStatsUniform) {
+  std::string all;
+  for (unsigned int c = 0; c < 256; ++c) {
+    all += static_cast<char>(c);
+  }
+  const StatsRecord s(statsData(all.data(), all.size()));
+  SCOPE_ASSERT_EQUAL(256u, s.Size);
+  SCOPE_ASSERT(7.999 < s.Entropy && s.Entropy < 8.001);
+  SCOPE_ASSERT_EQUAL(1.0 / 256, s.ZeroRatio);
+  SCOPE_ASSERT_EQUAL(98.0 / 256, s.TextRatio); // 95 printable, and tab, LF, CR
+  SCOPE_ASSERT_EQUAL(std::string(16, '\x10'), s.Histogram); // 255/16, rounded
+}
+
+SCOPE_TEST(testContentStatsPieces) {
+  ContentStats stats;
+  const std::string zeros(1001, '\0');
+  stats.update(zeros.data(), zeros.size());
+  StatsRecord s(stats.finish());
+  SCOPE_ASSERT_EQUAL(0.0, s.Entropy);
+  SCOPE_ASSERT_EQUAL(1.0, s.ZeroRatio);
+  SCOPE_ASSERT_EQUAL(0.0, s.TextRatio);
+  SCOPE_ASSERT_EQUAL('\xff', s.Histogram[0]);
+
+  // the same as all at once, whatever the piece boundaries
+  const std::string text("hello, world\n");
+  stats.update(text.data(), 3);
+  stats.update(text.data() + 3, text.size() - 3);
+  s = stats.finish();
+  const StatsRecord whole(statsData((zeros + text).data(), zeros.size() + text.size()));
+  SCOPE_ASSERT_EQUAL(whole.Size, s.Size);
+  SCOPE_ASSERT_EQUAL(whole.Entropy, s.Entropy);
+  SCOPE_ASSERT_EQUAL(whole.Histogram, s.Histogram);
+  SCOPE_ASSERT_EQUAL(13.0 / 1014, s.TextRatio);
+
+  SCOPE_ASSERT_EQUAL(0u, statsData("", 0).Size);
+}
+
+SCOPE_TEST(testClassifyBlock) {
+  SCOPE_ASSERT_EQUAL(ZERO_BLOCK, classifyBlock(std::string(4096, '\0').data(), 4096));
+  SCOPE_ASSERT_EQUAL(CONSTANT_BLOCK, classifyBlock(std::string(4096, '\xf6').data(), 4096));
+
+  std::string text;
+  while (text.size() < 4096) {
+    text += "The quick brown fox jumps over the lazy dog.\r\n";
+  }
+  SCOPE_ASSERT_EQUAL(TEXT_BLOCK, classifyBlock(text.data(), text.size()));
+
+  std::string noise;
+  uint32_t x = 2463534242u;
+  while (noise.size() < 65536) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    noise += static_cast<char>(x >> 24);
+  }
+  SCOPE_ASSERT_EQUAL(HIGH_ENTROPY_BLOCK, classifyBlock(noise.data(), noise.size()));
+
+  std::string sparse(4096, '\0');
+  sparse[100] = '\x01';
+  sparse[2000] = '\x80';
+  SCOPE_ASSERT_EQUAL(LOW_ENTROPY_BLOCK, classifyBlock(sparse.data(), sparse.size()));
+}
@@ -0,0 +1,67 @@
+#include <scope/test.h>
+
+#include <stdexcept>
+
+#include "filter.h"
+#include "tsk.h"
+
+namespace {
+  FileRecord makeFilterTestRecord() {
+    FileRecord rec;
+    rec.Path = "part-0-0/Users/bob/";
+    rec.HasName = true;
+    rec.Name = NameRecord{TSK_FS_NAME_FLAG_ALLOC, 5, 1, "Report.DOCX", 2, 0, "", TSK_FS_NAME_TYPE_REG};
+    rec.HasMeta = true;
+    rec.Meta.Flags = TSK_FS_META_FLAG_ALLOC | TSK_FS_META_FLAG_USED;
+    rec.Meta.Size = 20000;
+    rec.Meta.Type = TSK_FS_META_TYPE_REG;
+    rec.Meta.Modified = Timestamp{1325419200, 0}; // 2012-01-01T12:00:00Z
+    rec.Meta.Accessed = rec.Meta.Created = rec.Meta.Metadata = Timestamp{0, 0};
+    return rec;
+  }
+}
+
+SCOPE_TEST(testFilterTerms) {
+  const FileRecord rec(makeFilterTestRecord());
+  SCOPE_ASSERT(FileFilter("path = 'part-*/users/**.docx'").matches(rec));
+  SCOPE_ASSERT(!FileFilter("path = part-*/Users/*.docx").matches(rec)); // * stops at /
+  SCOPE_ASSERT(FileFilter("name = *.docx and type = reg").matches(rec));
+  SCOPE_ASSERT(FileFilter("name ~ ^Report").matches(rec));
+  SCOPE_ASSERT(!FileFilter("name !~ DOCX$").matches(rec));
+  SCOPE_ASSERT(FileFilter("size > 10K and size <= 20000").matches(rec));
+  SCOPE_ASSERT(!FileFilter("size >= 1M").matches(rec));
+  SCOPE_ASSERT(FileFilter("modified >= 2012-01-01 and modified < 2012-01-01T12:00:01Z").matches(rec));
+  SCOPE_ASSERT(!FileFilter("modified > 1325419200").matches(rec));
+  SCOPE_ASSERT(FileFilter("allocated and not deleted").matches(rec));
+  SCOPE_ASSERT(FileFilter("type = Folder or (deleted or size = 20000)").matches(rec));
+  SCOPE_ASSERT(FileFilter("type != 'Named Pipe'").matches(rec));
+}
+
+SCOPE_TEST(testFilterWithoutMeta) {
+  FileRecord rec(makeFilterTestRecord());
+  rec.HasMeta = false;
+  SCOPE_ASSERT(!FileFilter("size >= 0").matches(rec));
+  SCOPE_ASSERT(FileFilter("not size >= 0").matches(rec));
+}
+
+SCOPE_TEST(testFilterSyntaxErrors) {
+  SCOPE_ASSERT_THROWS(FileFilter("colour = red"), std::invalid_argument);
+  SCOPE_ASSERT_THROWS(FileFilter("size ~ 5"), std::invalid_argument);
+  SCOPE_ASSERT_THROWS(FileFilter("size > lots"), std::invalid_argument);
+  SCOPE_ASSERT_THROWS(FileFilter("(allocated"), std::invalid_argument);
+  SCOPE_ASSERT_THROWS(FileFilter("allocated deleted"), std::invalid_argument);
+  SCOPE_ASSERT_THROWS(FileFilter("name ~ '['"), std::invalid_argument);
+  SCOPE_ASSERT_THROWS(FileFilter("modified > 2012-13-01"), std::invalid_argument);
+}
+
+SCOPE_TEST(testFilterPruning) {
+  const FileFilter f("path = 'part-0-0/Users/**' and size > 0");
+  SCOPE_ASSERT(f.mayMatchUnder("part-0-0/"));
+  SCOPE_ASSERT(f.mayMatchUnder("part-0-0/users/bob/"));
+  SCOPE_ASSERT(!f.mayMatchUnder("part-0-0/Windows/"));
+  SCOPE_ASSERT(!f.mayMatchUnder("part-0-1/"));
+
+  const FileFilter either("path = 'part-0-0/Users/**' or name = *.exe");
+  SCOPE_ASSERT(either.mayMatchUnder("part-0-0/Windows/"));
+  SCOPE_ASSERT(FileFilter("not path = 'part-0-0/Users/**'").mayMatchUnder("part-0-0/Windows/"));
+}
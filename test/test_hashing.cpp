@@ -0,0 +1,44 @@
+#include <scope/test.h>
+
+#include <string>
+
+#include "hashing.h"
+#include "util.h"
+
+namespace {
+  std::string hex(const std::string& bytes) {
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(bytes.data());
+    return bytesAsString(b, b + bytes.size());
+  }
+}
+
+SCOPE_TEST(testHashDataKnownDigests) {
+  const HashRecord h(hashData("abc", 3));
+  SCOPE_ASSERT_EQUAL(3u, h.Size);
+  SCOPE_ASSERT_EQUAL("900150983cd24fb0d6963f7d28e17f72", hex(h.MD5));
+  SCOPE_ASSERT_EQUAL("a9993e364706816aba3e25717850c26c9cd0d89d", hex(h.SHA1));
+  SCOPE_ASSERT_EQUAL("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", hex(h.SHA256));
+
+  const HashRecord empty(hashData("", 0));
+  SCOPE_ASSERT_EQUAL(0u, empty.Size);
+  SCOPE_ASSERT_EQUAL("d41d8cd98f00b204e9800998ecf8427e", hex(empty.MD5));
+}
+
+SCOPE_TEST(testHasherPiecesOnPool) {
+  std::string data;
+  for (unsigned int i = 0; i < 100000; ++i) {
+    data += static_cast<char>(i * 7);
+  }
+  const HashRecord whole(hashData(data.data(), data.size()));
+
+  ThreadPool pool(3);
+  Hasher hasher;
+  for (size_t off = 0; off < data.size(); off += 4096) {
+    hasher.update(data.data() + off, std::min(data.size() - off, static_cast<size_t>(4096)), pool);
+  }
+  const HashRecord pieces(hasher.finish());
+  SCOPE_ASSERT_EQUAL(whole.Size, pieces.Size);
+  SCOPE_ASSERT_EQUAL(hex(whole.MD5), hex(pieces.MD5));
+  SCOPE_ASSERT_EQUAL(hex(whole.SHA1), hex(pieces.SHA1));
+  SCOPE_ASSERT_EQUAL(hex(whole.SHA256), hex(pieces.SHA256));
+}
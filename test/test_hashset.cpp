@@ -0,0 +1,102 @@
+#include <scope/test.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "hashset.h"
+#include "hashing.h"
+
+SCOPE_TEST(testHashSetLookups) {
+  std::vector<std::string> digests;
+  for (unsigned int i = 0; i < 5000; ++i) {
+    const std::string data(std::to_string(i));
+    digests.push_back(hashData(data.data(), data.size()).SHA1);
+  }
+  digests.push_back(digests.front()); // duplicates are dropped
+
+  const std::string path("test_hashset.tmp");
+  HashSet::write(path, digests);
+  {
+    HashSet set(path, "test");
+    SCOPE_ASSERT_EQUAL(5000u, set.size());
+    SCOPE_ASSERT_EQUAL(20u, set.digestLength());
+    for (const std::string& d: digests) {
+      SCOPE_ASSERT(set.contains(d));
+    }
+    unsigned int found = 0;
+    for (unsigned int i = 5000; i < 10000; ++i) {
+      const std::string data(std::to_string(i));
+      found += set.contains(hashData(data.data(), data.size()).SHA1);
+    }
+    SCOPE_ASSERT_EQUAL(0u, found);
+    SCOPE_ASSERT(!set.contains(digests[0].substr(0, 16))); // wrong length
+  }
+  std::remove(path.c_str());
+}
+
+SCOPE_TEST(testFindKnown) {
+  const HashRecord known(hashData("abc", 3)),
+                   unknown(hashData("abd", 3));
+  const std::string md5Path("test_hashset_md5.tmp"),
+                    sha256Path("test_hashset_sha256.tmp");
+  HashSet::write(md5Path, std::vector<std::string>{unknown.SHA1.substr(0, 16)});
+  HashSet::write(sha256Path, std::vector<std::string>{known.SHA256});
+  {
+    HashSets sets;
+    sets.push_back(std::make_shared<HashSet>(md5Path, "md5s"));
+    sets.push_back(std::make_shared<HashSet>(sha256Path, "sha256s"));
+    SCOPE_ASSERT_EQUAL("sha256s", findKnown(sets, known));
+    SCOPE_ASSERT_EQUAL("", findKnown(sets, unknown));
+  }
+  std::remove(md5Path.c_str());
+  std::remove(sha256Path.c_str());
+}
+
+SCOPE_TEST(testHashSetRejectsOtherFiles) {
+  const std::string path("test_hashset_bad.tmp");
+  {
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    std::fputs("not a hash set", f);
+    std::fclose(f);
+  }
+  SCOPE_ASSERT_THROWS(HashSet(path, "bad"), std::runtime_error);
+  std::remove(path.c_str());
+}
+
+SCOPE_TEST(testHashSetRejectsBadFanout) {
+  const std::string path("test_hashset_fanout.tmp");
+  std::vector<std::string> digests;
+  for (unsigned int i = 0; i < 100; ++i) {
+    const std::string data(std::to_string(i));
+    digests.push_back(hashData(data.data(), data.size()).SHA1);
+  }
+  HashSet::write(path, digests);
+  // the fanout entry for the last prefix, before the count, points past the
+  // digests
+  {
+    std::FILE* f = std::fopen(path.c_str(), "r+b");
+    std::fseek(f, 32 + 65535 * 8, SEEK_SET);
+    const unsigned char past[8] = {0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0};
+    std::fwrite(past, 1, sizeof(past), f);
+    std::fclose(f);
+  }
+  SCOPE_ASSERT_THROWS(HashSet(path, "bad"), std::runtime_error);
+  std::remove(path.c_str());
+}
+
+SCOPE_TEST(testHashSetRejectsHugeCount) {
+  const std::string path("test_hashset_count.tmp");
+  HashSet::write(path, std::vector<std::string>{hashData("abc", 3).SHA1});
+  // a count that overflows when multiplied by the digest length, to the
+  // size the file really has
+  {
+    std::FILE* f = std::fopen(path.c_str(), "r+b");
+    std::fseek(f, 16, SEEK_SET);
+    const unsigned char count[8] = {0x01, 0, 0, 0, 0, 0, 0, 0x40};
+    std::fwrite(count, 1, sizeof(count), f);
+    std::fclose(f);
+  }
+  SCOPE_ASSERT_THROWS(HashSet(path, "bad"), std::runtime_error);
+  std::remove(path.c_str());
+}
@@ -0,0 +1,84 @@
+#include <scope/test.h>
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "httpserver.h"
+
+SCOPE_TEST(testReadRequestHead) {
+  std::istringstream in("GET /fsrip/img1/sectors?start=0&end=8&name=a+b%2Fc HTTP/1.1\r\n"
+                        "Host: localhost\r\n"
+                        "Range:  bytes=0-99 \r\n"
+                        "\r\n"
+                        "body");
+  HttpRequest req;
+  SCOPE_ASSERT(readRequestHead(in, req));
+  SCOPE_ASSERT_EQUAL("GET", req.Method);
+  SCOPE_ASSERT_EQUAL("/fsrip/img1/sectors", req.Target);
+  SCOPE_ASSERT_EQUAL("8", req.Query["end"]);
+  SCOPE_ASSERT_EQUAL("a b/c", req.Query["name"]);
+  SCOPE_ASSERT_EQUAL("bytes=0-99", req.header("RANGE"));
+  SCOPE_ASSERT_EQUAL("", req.header("content-length"));
+  SCOPE_ASSERT(req.keepAlive());
+
+  // the body is left for the caller
+  std::string rest;
+  std::getline(in, rest);
+  SCOPE_ASSERT_EQUAL("body", rest);
+
+  SCOPE_ASSERT(!readRequestHead(in, req));
+
+  std::istringstream bad("GET /\r\n\r\n");
+  SCOPE_ASSERT_THROWS(readRequestHead(bad, req), std::invalid_argument);
+  SCOPE_ASSERT_THROWS(urlDecode("%zz"), std::invalid_argument);
+  SCOPE_ASSERT_EQUAL("a+b c", urlDecode("a+b%20c"));
+}
+
+SCOPE_TEST(testErrorResponse) {
+  const HttpResponse resp(errorResponse(400, "could not open \"C:\\case\\img.E01\"\n"));
+  SCOPE_ASSERT_EQUAL(400u, resp.Status);
+  SCOPE_ASSERT_EQUAL("{\"error\":\"could not open \\\"C:\\\\case\\\\img.E01\\\"\\n\"}", resp.Body);
+}
+
+SCOPE_TEST(testParseRange) {
+  uint64_t beg = 0, end = 0;
+  SCOPE_ASSERT_EQUAL(SATISFIABLE_RANGE, parseRange("bytes=10-19", 100, beg, end));
+  SCOPE_ASSERT_EQUAL(10u, beg);
+  SCOPE_ASSERT_EQUAL(20u, end);
+  SCOPE_ASSERT_EQUAL(SATISFIABLE_RANGE, parseRange("bytes=90-", 100, beg, end));
+  SCOPE_ASSERT_EQUAL(100u, end);
+  SCOPE_ASSERT_EQUAL(SATISFIABLE_RANGE, parseRange("bytes=-30", 100, beg, end));
+  SCOPE_ASSERT_EQUAL(70u, beg);
+  SCOPE_ASSERT_EQUAL(SATISFIABLE_RANGE, parseRange("bytes=50-1000", 100, beg, end));
+  SCOPE_ASSERT_EQUAL(100u, end);
+
+  SCOPE_ASSERT_EQUAL(UNSATISFIABLE_RANGE, parseRange("bytes=100-", 100, beg, end));
+  SCOPE_ASSERT_EQUAL(NO_RANGE, parseRange("", 100, beg, end));
+  SCOPE_ASSERT_EQUAL(NO_RANGE, parseRange("bytes=0-1,5-6", 100, beg, end));
+  SCOPE_ASSERT_EQUAL(NO_RANGE, parseRange("bytes=9-3", 100, beg, end));
+  SCOPE_ASSERT_EQUAL(NO_RANGE, parseRange("lines=1-2", 100, beg, end));
+}
+
+SCOPE_TEST(testRangeResponse) {
+  const std::string data("0123456789");
+  const RangeReader read = [&data](uint64_t offset, uint64_t len, const HttpResponse::Sink& sink) {
+    return sink(data.data() + offset, len);
+  };
+  HttpRequest req;
+  req.Headers["range"] = "bytes=2-4";
+  HttpResponse resp(rangeResponse(req, data.size(), "application/octet-stream", read));
+  SCOPE_ASSERT_EQUAL(206u, resp.Status);
+  SCOPE_ASSERT_EQUAL(3u, resp.ContentLength);
+
+  std::string body;
+  SCOPE_ASSERT(resp.Writer([&body](const char* buf, size_t len) { body.append(buf, len); return true; }));
+  SCOPE_ASSERT_EQUAL("234", body);
+
+  const std::string head(responseHead(resp, true));
+  SCOPE_ASSERT_EQUAL(0u, head.find("HTTP/1.1 206 Partial Content\r\nContent-Length: 3\r\n"));
+  SCOPE_ASSERT(head.find("Content-Range: bytes 2-4/10\r\n") != std::string::npos);
+
+  req.Headers["range"] = "bytes=20-";
+  SCOPE_ASSERT_EQUAL(416u, rangeResponse(req, data.size(), "application/octet-stream", read).Status);
+}
@@ -0,0 +1,41 @@
+#include <scope/test.h>
+
+#include <stdexcept>
+#include <string>
+
+#include "imageservice.h"
+
+SCOPE_TEST(testParseSegments) {
+  const std::vector<std::string> segs(ImageService::parseSegments(
+    "{\"segments\" : [\"C:\\\\cases\\\\img.E01\", \"/mnt/img.E02\", \"caf\\u00e9\"]}"));
+  SCOPE_ASSERT_EQUAL(3u, segs.size());
+  SCOPE_ASSERT_EQUAL("C:\\cases\\img.E01", segs[0]);
+  SCOPE_ASSERT_EQUAL("/mnt/img.E02", segs[1]);
+  SCOPE_ASSERT_EQUAL("caf\xc3\xa9", segs[2]);
+
+  SCOPE_ASSERT_THROWS(ImageService::parseSegments("{\"segments\":[]}"), std::invalid_argument);
+  SCOPE_ASSERT_THROWS(ImageService::parseSegments("{\"files\":[\"a\"]}"), std::invalid_argument);
+  SCOPE_ASSERT_THROWS(ImageService::parseSegments("{\"segments\":[\"a\" \"b\"]}"), std::invalid_argument);
+}
+
+SCOPE_TEST(testImageServiceRoutes) {
+  ImageService service;
+  HttpRequest req;
+  req.Method = "GET";
+  req.Target = "/fsrip/image/case1";
+  SCOPE_ASSERT_EQUAL(404u, service.handle(req).Status);
+  req.Target = "/fsrip/case1/volumes";
+  SCOPE_ASSERT_EQUAL(404u, service.handle(req).Status);
+  req.Target = "/other";
+  SCOPE_ASSERT_EQUAL(404u, service.handle(req).Status);
+
+  req.Method = "POST";
+  req.Target = "/fsrip/image/case1";
+  SCOPE_ASSERT_EQUAL(405u, service.handle(req).Status);
+  req.Target = "/fsrip/case1/0/dir/Windows";
+  SCOPE_ASSERT_EQUAL(405u, service.handle(req).Status);
+
+  req.Method = "DELETE";
+  req.Target = "/fsrip/image/case1";
+  SCOPE_ASSERT_EQUAL(404u, service.handle(req).Status);
+}
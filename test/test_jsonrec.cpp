@@ -0,0 +1,127 @@
+#include <scope/test.h>
+
+#include <sstream>
+
+#include "jsonrec.h"
+#include "tsk.h"
+
+namespace {
+  FileRecord makeJsonTestRecord() {
+    FileRecord rec;
+    rec.ID = std::string("\x00\x01\x00", 3);
+    rec.Parent = std::string("\x00", 1);
+    rec.Children = std::string("\x00\x02\x00\x00", 4);
+    rec.Fs = FsRecord{32256, 4096, std::string("\xf7\xc7", 2), "part-0-0", 1};
+    rec.Path = "part-0-0/";
+
+    rec.HasName = true;
+    rec.Name = NameRecord{TSK_FS_NAME_FLAG_ALLOC, 5, 1, "a.txt", 2, 0, "", TSK_FS_NAME_TYPE_REG};
+
+    rec.HasMeta = true;
+    MetaRecord& m(rec.Meta);
+    m.Addr = 5;
+    m.Accessed = m.Created = m.Metadata = m.Modified = Timestamp{0, 0};
+    m.ContentLen = 0;
+    m.Flags = TSK_FS_META_FLAG_ALLOC | TSK_FS_META_FLAG_USED;
+    m.Gid = m.Uid = 0;
+    m.FsTimeKind = MetaRecord::NO_FS_TIME;
+    m.Mode = 420;
+    m.NLink = 1;
+    m.Seq = 0;
+    m.Size = 3;
+    m.Type = TSK_FS_META_TYPE_REG;
+
+    AttrRecord a;
+    a.Flags = TSK_FS_ATTR_INUSE | TSK_FS_ATTR_RES;
+    a.ID = 0;
+    a.Type = 128;
+    a.Size = 3;
+    a.RdBufSize = 3;
+    a.AllocSize = a.CompSize = a.InitSize = a.SkipLen = 0;
+    a.PhysicalSize = 3;
+    a.SlackSize = 0;
+    a.ResidentData = "abc";
+    m.Attrs.push_back(a);
+    return rec;
+  }
+}
+
+SCOPE_TEST(testWriteFileJson) {
+  const FileRecord rec(makeJsonTestRecord());
+  std::stringstream buf;
+  writeFile(buf, rec, 1, false);
+  SCOPE_ASSERT_EQUAL("{\"id\":\"000100\",\"parent\":\"00\",\"children\":\"00020000\", \"t\":{ \"fsmd\":{ "
+    "\"fs\":{\"byteOffset\":32256,\"blockSize\":4096,\"fsID\":\"f7c7\",\"volName\":\"part-0-0\",\"volIndex\":1},\"path\":\"part-0-0/\", "
+    "\"name\":{\"flags\":\"Allocated\",\"meta_addr\":5,\"meta_seq\":1,\"name\":\"a.txt\",\"par_addr\":2,\"par_seq\":0,\"shrt_name\":\"\",\"type\":\"File\"}, "
+    "\"meta\":{\"addr\":5,\"accessed\":\"1970-01-01T00:00:00Z\",\"content_len\":0,\"created\":\"1970-01-01T00:00:00Z\",\"metadata\":\"1970-01-01T00:00:00Z\","
+    "\"flags\":\"Allocated, Used\",\"gid\":0,\"mode\":420,\"modified\":\"1970-01-01T00:00:00Z\",\"nlink\":1,\"seq\":0,\"size\":3,\"type\":\"File\",\"uid\":0, "
+    "\"attrs\":[{\"flags\":\"In Use, Resident\",\"id\":0,\"name\":\"\",\"size\":3,\"type\":128,\"rd_buf_size\":3,\"nrd_allocsize\":0,\"nrd_compsize\":0,"
+    "\"nrd_initsize\":0,\"nrd_skiplen\":0,\"physical_size\":3,\"slack_size\":0, \"rd_buf\":\"616263\"}]}}, \"__link\":\"01000000010000000000000005\" } }", buf.str());
+}
+
+SCOPE_TEST(testWriteFileJsonHashes) {
+  FileRecord rec(makeJsonTestRecord());
+  rec.HasHashes = true;
+  rec.Hashes = HashRecord{3, std::string("\x01\x02", 2), std::string("\x03", 1), std::string("\xff", 1), "nsrl"};
+  std::stringstream buf;
+  writeFile(buf, rec, 1, false);
+  const std::string result(buf.str());
+  // inside fsmd, after meta
+  const std::string tail("\"slack_size\":0, \"rd_buf\":\"616263\"}]}, \"hashes\":{\"size\":3,\"md5\":\"0102\",\"sha1\":\"03\",\"sha256\":\"ff\",\"known\":\"nsrl\"}}, "
+    "\"__link\":\"01000000010000000000000005\" } }");
+  SCOPE_ASSERT_EQUAL(tail, result.substr(result.size() - tail.size()));
+}
+
+SCOPE_TEST(testWriteFileJsonDirTable) {
+  FileRecord rec(makeJsonTestRecord());
+  rec.HasMeta = false;
+  std::stringstream buf;
+  writeFile(buf, rec, 1, true);
+  SCOPE_ASSERT_EQUAL("{\"id\":\"000100\",\"parent\":\"00\",\"children\":\"00020000\", \"t\":{ \"fsmd\":{ \"volIndex\":1, "
+    "\"name\":{\"flags\":\"Allocated\",\"meta_addr\":5,\"meta_seq\":1,\"name\":\"a.txt\",\"par_addr\":2,\"par_seq\":0,\"shrt_name\":\"\",\"type\":\"File\"}} } }", buf.str());
+}
+
+SCOPE_TEST(testWriteFileJsonFields) {
+  const FileRecord rec(makeJsonTestRecord());
+  std::stringstream buf;
+  writeFile(buf, rec, 1, false, parseFields("path,name"));
+  SCOPE_ASSERT_EQUAL("{\"id\":\"000100\",\"parent\":\"00\",\"children\":\"00020000\", \"t\":{ \"fsmd\":{ \"path\":\"part-0-0/\", "
+    "\"name\":{\"flags\":\"Allocated\",\"meta_addr\":5,\"meta_seq\":1,\"name\":\"a.txt\",\"par_addr\":2,\"par_seq\":0,\"shrt_name\":\"\",\"type\":\"File\"}}, "
+    "\"__link\":\"01000000010000000000000005\" } }", buf.str());
+
+  // attrs without meta, and without resident data
+  buf.str("");
+  writeFile(buf, rec, 1, false, parseFields("attrs"));
+  SCOPE_ASSERT_EQUAL("{\"id\":\"000100\",\"parent\":\"00\",\"children\":\"00020000\", \"t\":{ \"fsmd\":{ \"meta\":{\"attrs\":[{\"flags\":\"In Use, Resident\",\"id\":0,\"name\":\"\",\"size\":3,\"type\":128,\"rd_buf_size\":3,\"nrd_allocsize\":0,\"nrd_compsize\":0,"
+    "\"nrd_initsize\":0,\"nrd_skiplen\":0,\"physical_size\":3,\"slack_size\":0}]}}, \"__link\":\"01000000010000000000000005\" } }", buf.str());
+}
+
+SCOPE_TEST(testParseFields) {
+  SCOPE_ASSERT_EQUAL(unsigned(NAME_FIELD | META_FIELD), parseFields("name,meta"));
+  SCOPE_ASSERT_EQUAL(unsigned(ATTRS_FIELD | RUNS_FIELD), parseFields("runs"));
+  SCOPE_ASSERT_EQUAL(unsigned(ALL_FIELDS), parseFields("fs,path,name,meta,attrs,runs,rd_buf"));
+  SCOPE_ASSERT_THROWS(parseFields("name,bogus"), std::invalid_argument);
+  SCOPE_ASSERT_THROWS(parseFields(""), std::invalid_argument);
+}
+
+SCOPE_TEST(testWriteFileJsonSniff) {
+  FileRecord rec(makeJsonTestRecord());
+  rec.HasSniff = true;
+  rec.Sniff = SniffRecord{"jpeg", true};
+  std::stringstream buf;
+  writeFile(buf, rec, 1, false, parseFields("name"));
+  const std::string result(buf.str());
+  const std::string tail("\"type\":\"File\"}, \"sniff\":{\"type\":\"jpeg\",\"mismatch\":true}}, \"__link\":\"01000000010000000000000005\" } }");
+  SCOPE_ASSERT_EQUAL(tail, result.substr(result.size() - tail.size()));
+}
+
+SCOPE_TEST(testWriteFileJsonStats) {
+  FileRecord rec(makeJsonTestRecord());
+  rec.HasStats = true;
+  rec.Stats = StatsRecord{4, 1.5, 0.5, 0.25, std::string(15, '\0') + "\xff"};
+  std::stringstream buf;
+  writeFile(buf, rec, 1, false, parseFields("name"));
+  const std::string result(buf.str());
+  const std::string tail("\"stats\":{\"size\":4,\"entropy\":1.5,\"zero_ratio\":0.5,\"text_ratio\":0.25,\"histogram\":\"000000000000000000000000000000ff\"}}, \"__link\":\"01000000010000000000000005\" } }");
+  SCOPE_ASSERT_EQUAL(tail, result.substr(result.size() - tail.size()));
+}
@@ -0,0 +1,63 @@
+#include <scope/test.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "search.h"
+
+namespace {
+  std::vector<PatternMatcher::Hit> find(const PatternMatcher& m, const std::string& data, size_t reportFrom = 0) {
+    std::vector<PatternMatcher::Hit> hits;
+    m.search(data.data(), data.size(), 100, hits, reportFrom);
+    std::sort(hits.begin(), hits.end());
+    return hits;
+  }
+}
+
+SCOPE_TEST(testPatternMatcherOverlaps) {
+  const std::vector<std::string> patterns{"he", "she", "his", "hers"};
+  PatternMatcher m(patterns);
+  SCOPE_ASSERT_EQUAL(4u, m.maxLength());
+
+  // "she" contains "he", and "hers" overlaps both
+  const std::vector<PatternMatcher::Hit> hits(find(m, "ushers"));
+  SCOPE_ASSERT_EQUAL(3u, hits.size());
+  SCOPE_ASSERT_EQUAL(101u, hits[0].Offset);
+  SCOPE_ASSERT_EQUAL(1u, hits[0].Pattern);
+  SCOPE_ASSERT_EQUAL(102u, hits[1].Offset);
+  SCOPE_ASSERT_EQUAL(0u, hits[1].Pattern);
+  SCOPE_ASSERT_EQUAL(102u, hits[2].Offset);
+  SCOPE_ASSERT_EQUAL(3u, hits[2].Pattern);
+
+  SCOPE_ASSERT(find(m, "hi hs").empty());
+}
+
+SCOPE_TEST(testPatternMatcherBinaryAndCase) {
+  const std::vector<std::string> patterns{std::string("\x00\xff", 2), "MZ"};
+  PatternMatcher exact(patterns);
+  SCOPE_ASSERT_EQUAL(1u, find(exact, std::string("ab\x00\xffmz", 6)).size());
+
+  PatternMatcher folded(patterns, true);
+  const std::vector<PatternMatcher::Hit> hits(find(folded, std::string("ab\x00\xffmz Mz", 9)));
+  SCOPE_ASSERT_EQUAL(3u, hits.size());
+  SCOPE_ASSERT_EQUAL(104u, hits[1].Offset);
+  SCOPE_ASSERT_EQUAL(107u, hits[2].Offset);
+}
+
+SCOPE_TEST(testPatternMatcherReportFrom) {
+  const std::vector<std::string> patterns{"abc", "b"};
+  PatternMatcher m(patterns);
+  // the first 2 bytes are the end of the previous piece: its "b" was
+  // reported there, but the "abc" ending here is new
+  const std::vector<PatternMatcher::Hit> hits(find(m, "abcb", 2));
+  SCOPE_ASSERT_EQUAL(2u, hits.size());
+  SCOPE_ASSERT_EQUAL(100u, hits[0].Offset);
+  SCOPE_ASSERT_EQUAL(0u, hits[0].Pattern);
+  SCOPE_ASSERT_EQUAL(103u, hits[1].Offset);
+}
+
+SCOPE_TEST(testPatternMatcherBadPatterns) {
+  SCOPE_ASSERT_THROWS(PatternMatcher(std::vector<std::string>()), std::invalid_argument);
+  SCOPE_ASSERT_THROWS(PatternMatcher(std::vector<std::string>{"a", ""}), std::invalid_argument);
+}
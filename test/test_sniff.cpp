@@ -0,0 +1,30 @@
+#include <scope/test.h>
+
+#include <string>
+
+#include "sniff.h"
+
+SCOPE_TEST(testSniffType) {
+  SCOPE_ASSERT_EQUAL("jpeg", sniffType("\xff\xd8\xff\xe0\x00\x10JFIF", 10));
+  SCOPE_ASSERT_EQUAL("pdf", sniffType("%PDF-1.4", 8));
+  SCOPE_ASSERT_EQUAL("mp4", sniffType("\x00\x00\x00\x18" "ftypmp42", 12));
+  SCOPE_ASSERT_EQUAL("", sniffType("hello, world", 12));
+  SCOPE_ASSERT_EQUAL("", sniffType("%PD", 3)); // too short
+
+  std::string docx("PK\x03\x04", 4);
+  docx.resize(30, '\0');
+  SCOPE_ASSERT_EQUAL("zip", sniffType(docx.data(), docx.size()));
+  docx += "[Content_Types].xml";
+  SCOPE_ASSERT_EQUAL("ooxml", sniffType(docx.data(), docx.size()));
+}
+
+SCOPE_TEST(testExtensionMismatch) {
+  SCOPE_ASSERT(!extensionMismatch("jpeg", "IMG_0001.JPG"));
+  SCOPE_ASSERT(extensionMismatch("jpeg", "budget.xls"));
+  SCOPE_ASSERT(extensionMismatch("pe", "notes"));
+  SCOPE_ASSERT(!extensionMismatch("sqlite", "History"));
+  SCOPE_ASSERT(!extensionMismatch("elf", "libc.so.6")); // any extension will do
+  SCOPE_ASSERT(!extensionMismatch("zip", "report.docx"));
+  SCOPE_ASSERT(extensionMismatch("pdf", ".pdf")); // a hidden file, not an extension
+  SCOPE_ASSERT(!extensionMismatch("unknown", "a.txt"));
+}
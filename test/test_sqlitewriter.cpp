@@ -0,0 +1,67 @@
+#include <scope/test.h>
+
+#include <cstdio>
+#include <string>
+
+#include <sqlite3.h>
+
+#include "sqlitewriter.h"
+
+FileRecord makeTestRecord(); // test_binrec.cpp
+
+namespace {
+  // the first column of the first row, as text
+  std::string queryOne(sqlite3* db, const std::string& sql) {
+    sqlite3_stmt* stmt = nullptr;
+    std::string ret;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW
+        && sqlite3_column_text(stmt, 0))
+    {
+      ret = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    return ret;
+  }
+}
+
+SCOPE_TEST(testSqliteWriter) {
+  const std::string path("test_sqlitewriter.tmp");
+  FileRecord rec(makeTestRecord());
+  {
+    // small batches, so that several transactions are needed
+    SqliteWriter writer(path, 2);
+    writer.push(rec, 3);
+    FileRecord nameless(rec);
+    nameless.HasName = false;
+    writer.push(nameless, 3);
+    writer.pushDiskMap("02000000000000a000", "{\"id\":\"02000000000000a000\"}\n");
+    writer.pushInode("0100000003000000000000002a", "{ \"id\":\"0100000003000000000000002a\"}\n");
+    writer.close();
+  }
+  sqlite3* db = nullptr;
+  SCOPE_ASSERT_EQUAL(SQLITE_OK, sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr));
+
+  SCOPE_ASSERT_EQUAL("2", queryOne(db, "SELECT COUNT(*) FROM files"));
+  SCOPE_ASSERT_EQUAL(rec.Name.Name, queryOne(db, "SELECT name FROM files WHERE rowid = 1"));
+  SCOPE_ASSERT_EQUAL("3", queryOne(db, "SELECT inode_vol FROM files WHERE rowid = 1"));
+  SCOPE_ASSERT_EQUAL(std::to_string(rec.Meta.Modified.Secs), queryOne(db, "SELECT modified FROM files WHERE rowid = 1"));
+  SCOPE_ASSERT_EQUAL("{", queryOne(db, "SELECT substr(record, 1, 1) FROM files WHERE rowid = 1"));
+  SCOPE_ASSERT_EQUAL("", queryOne(db, "SELECT name FROM files WHERE rowid = 2"));
+  SCOPE_ASSERT_EQUAL(std::to_string(rec.Meta.Addr), queryOne(db, "SELECT meta_addr FROM files WHERE rowid = 2"));
+
+  SCOPE_ASSERT_EQUAL("40960", queryOne(db, "SELECT offset FROM disk_map"));
+  SCOPE_ASSERT_EQUAL("{\"id\":\"02000000000000a000\"}", queryOne(db, "SELECT record FROM disk_map"));
+  SCOPE_ASSERT_EQUAL("3", queryOne(db, "SELECT vol FROM inodes"));
+  SCOPE_ASSERT_EQUAL("42", queryOne(db, "SELECT inum FROM inodes"));
+
+  // made after the load
+  SCOPE_ASSERT_EQUAL("10", queryOne(db, "SELECT COUNT(*) FROM sqlite_master WHERE type = 'index'"));
+  // and back to a single file
+  SCOPE_ASSERT_EQUAL("delete", queryOne(db, "PRAGMA journal_mode"));
+  sqlite3_close(db);
+  std::remove(path.c_str());
+}
+
+SCOPE_TEST(testSqliteWriterBadPath) {
+  SCOPE_ASSERT_THROWS(SqliteWriter("no/such/dir/out.db"), std::runtime_error);
+}
@@ -0,0 +1,101 @@
+#include <scope/test.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "sstable.h"
+
+namespace {
+  std::string keyOf(unsigned int i) {
+    std::stringstream buf;
+    buf.width(8);
+    buf.fill('0');
+    buf << std::hex << i;
+    return buf.str();
+  }
+
+  void writeTable(const std::string& path, ExternalSorter& sorter, ThreadPool& pool) {
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+    SSTableBuilder builder(file, pool, sorter.size());
+    sorter.merge([&builder](const std::string& key, const std::string& value) { builder.add(key, value); });
+    builder.finish();
+  }
+}
+
+SCOPE_TEST(testExternalSorterMerge) {
+  auto pool = std::make_shared<ThreadPool>(2);
+  // small runs, so that several are spilled and merged
+  ExternalSorter sorter(pool, 256);
+  for (unsigned int i = 0; i < 100; ++i) {
+    sorter.add(keyOf((i * 37) % 50), std::to_string(i));
+  }
+  SCOPE_ASSERT_EQUAL(100u, sorter.size());
+
+  std::vector<std::pair<std::string, std::string>> entries;
+  sorter.merge([&entries](const std::string& key, const std::string& value) {
+    entries.push_back(std::make_pair(key, value));
+  });
+  SCOPE_ASSERT_EQUAL(100u, entries.size());
+  SCOPE_ASSERT_EQUAL(0u, sorter.size());
+  for (unsigned int i = 1; i < entries.size(); ++i) {
+    SCOPE_ASSERT(!(entries[i].first < entries[i - 1].first));
+  }
+  // each key was added twice, and its entries keep the order they came in
+  SCOPE_ASSERT_EQUAL(keyOf(0), entries[0].first);
+  SCOPE_ASSERT_EQUAL("0", entries[0].second);
+  SCOPE_ASSERT_EQUAL("50", entries[1].second);
+}
+
+SCOPE_TEST(testSSTableRoundTrip) {
+  auto pool = std::make_shared<ThreadPool>(2);
+  ExternalSorter sorter(pool, 64 * 1024);
+  // enough to fill several blocks
+  for (unsigned int i = 0; i < 20000; ++i) {
+    sorter.add(keyOf(19999 - i), "value of " + std::to_string(19999 - i));
+  }
+  const std::string path("test_sstable.tmp");
+  writeTable(path, sorter, *pool);
+  {
+    SSTable table(path);
+    SCOPE_ASSERT_EQUAL(20000u, table.size());
+
+    std::string value;
+    SCOPE_ASSERT(table.get(keyOf(0), value));
+    SCOPE_ASSERT_EQUAL("value of 0", value);
+    SCOPE_ASSERT(table.get(keyOf(12345), value));
+    SCOPE_ASSERT_EQUAL("value of 12345", value);
+    SCOPE_ASSERT(table.get(keyOf(19999), value));
+    SCOPE_ASSERT_EQUAL("value of 19999", value);
+    SCOPE_ASSERT(!table.get(keyOf(20000), value));
+    SCOPE_ASSERT(!table.get("", value));
+
+    unsigned int n = 0;
+    bool inOrder = true;
+    table.scan([&](const std::string& key, const std::string&) {
+      inOrder = inOrder && key == keyOf(n);
+      ++n;
+    });
+    SCOPE_ASSERT_EQUAL(20000u, n);
+    SCOPE_ASSERT(inOrder);
+  }
+  std::remove(path.c_str());
+}
+
+SCOPE_TEST(testSSTableInvalid) {
+  ThreadPool pool(1);
+  std::stringstream out;
+  SSTableBuilder builder(out, pool, 2);
+  builder.add("b", "1");
+  SCOPE_ASSERT_THROWS(builder.add("a", "2"), std::invalid_argument);
+
+  const std::string path("test_sstable_bad.tmp");
+  {
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+    file << "FSCT not an sstable";
+  }
+  SCOPE_ASSERT_THROWS(SSTable{path}, std::runtime_error);
+  std::remove(path.c_str());
+  SCOPE_ASSERT_THROWS(SSTable{path}, std::runtime_error);
+}
@@ -0,0 +1,25 @@
+#include <scope/test.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "threadpool.h"
+
+SCOPE_TEST(testThreadPoolResults) {
+  ThreadPool pool(3);
+  SCOPE_ASSERT_EQUAL(3u, pool.size());
+
+  std::vector<std::future<int>> results;
+  for (int i = 0; i < 100; ++i) {
+    results.push_back(pool.submit([i]{ return i * i; }));
+  }
+  for (int i = 0; i < 100; ++i) {
+    SCOPE_ASSERT_EQUAL(i * i, results[i].get());
+  }
+}
+
+SCOPE_TEST(testThreadPoolException) {
+  ThreadPool pool(1);
+  std::future<int> f(pool.submit([]() -> int { throw std::runtime_error("boom"); }));
+  SCOPE_ASSERT_THROWS(f.get(), std::runtime_error);
+}
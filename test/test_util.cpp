@@ -162,3 +162,22 @@ SCOPE_TEST(testNullDecode) {
 SCOPE_TEST(testFormatTimestamp) {
   SCOPE_ASSERT_EQUAL("1970-01-01T00:00:00.5Z", formatTimestamp(0, 500000000));
 }
+
+SCOPE_TEST(testVintSize) {
+  unsigned char buf[9];
+  uint64_t i = 0;
+  do {
+    i <<= 1;
+    ++i;
+    unsigned int encBytes = vintEncode(buf, i);
+    SCOPE_ASSERT_EQUAL(encBytes, vintSize(buf[0]));
+  } while (i != std::numeric_limits<uint64_t>::max());
+}
+
+SCOPE_TEST(testBytesFromString) {
+  const unsigned char raw[] = {0x00, 0x01, 0xab, 0xff};
+  const std::string hex(bytesAsString(raw, raw + 4));
+  SCOPE_ASSERT_EQUAL("0001abff", hex);
+  SCOPE_ASSERT_EQUAL(std::string(reinterpret_cast<const char*>(raw), 4), bytesFromString(hex));
+  SCOPE_ASSERT_EQUAL(std::string("\xAB", 1), bytesFromString("AB"));
+}
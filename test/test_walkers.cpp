@@ -2,6 +2,9 @@
 
 #include "walkers.h"
 
+#include <algorithm>
+#include <sstream>
+
 SCOPE_TEST(testDirInfoNewChild) {
   DirInfo gpa;
 
@@ -81,3 +84,243 @@ SCOPE_TEST(testAttrRunInfoSort) {
 
   SCOPE_ASSERT(set.begin() == first); // but doesn't matter
 }
+
+namespace {
+  std::string walkNames(std::shared_ptr<ThreadPool> pool, bool sniff = false) {
+    std::stringstream out;
+    MetadataWriter walker(out);
+    walker.setFormatterPool(pool);
+    walker.setSniff(sniff);
+    walker.setDirTable(true); // dir records are interleaved with file records
+
+    std::vector<std::string> names;
+    for (unsigned int i = 0; i < 3 * FORMAT_BATCH_SIZE + 7; ++i) {
+      names.push_back("file" + std::to_string(i));
+    }
+    for (unsigned int i = 0; i < names.size(); ++i) {
+      TSK_FS_NAME name = TSK_FS_NAME();
+      name.name = name.shrt_name = const_cast<char*>(names[i].c_str());
+      name.name_size = name.shrt_name_size = names[i].size();
+      name.meta_addr = i;
+      name.type = TSK_FS_NAME_TYPE_REG;
+      name.flags = TSK_FS_NAME_FLAG_ALLOC;
+
+      TSK_FS_FILE file = TSK_FS_FILE();
+      file.name = &name;
+      walker.processFile(&file, i % 10 ? "dir/": "");
+    }
+    walker.finishWalk();
+    return out.str();
+  }
+
+  // an allocated entry named n, walked times times at the root; with meta,
+  // the name points to it
+  void processName(MetadataWriter& walker, const std::string& n, TSK_FS_NAME_TYPE_ENUM type, unsigned int times,
+                   TSK_FS_META* meta = nullptr, TSK_FS_INFO* fs = nullptr)
+  {
+    TSK_FS_NAME name = TSK_FS_NAME();
+    name.name = name.shrt_name = const_cast<char*>(n.c_str());
+    name.name_size = name.shrt_name_size = n.size();
+    name.type = type;
+    name.flags = TSK_FS_NAME_FLAG_ALLOC;
+    name.meta_addr = meta ? meta->addr: 0;
+
+    TSK_FS_FILE file = TSK_FS_FILE();
+    file.name = &name;
+    file.meta = meta;
+    file.fs_info = fs;
+    for (unsigned int i = 0; i < times; ++i) {
+      walker.processFile(&file, "");
+    }
+  }
+
+  // a directory with no meta
+  void processDir(MetadataWriter& walker, unsigned int times) {
+    processName(walker, "dir", TSK_FS_NAME_TYPE_DIR, times);
+  }
+
+  // [beg, end) as a run of inode inum's data or slack
+  void markRun(FsMap& runs, uint64_t beg, uint64_t end, uint64_t inum, bool slack) {
+    runs += std::make_pair(boost::icl::discrete_interval<uint64_t>::right_open(beg, end),
+                           AttrSet{{AttrRunInfo{inum, 0, slack, beg, 0}}});
+  }
+}
+
+SCOPE_TEST(testParallelFormattingOrder) {
+  const std::string expected(walkNames(std::shared_ptr<ThreadPool>()));
+  // 775 files, and "dir/" is entered 78 times
+  SCOPE_ASSERT_EQUAL(775 + 78, std::count(expected.begin(), expected.end(), '\n'));
+
+  SCOPE_ASSERT_EQUAL(expected, walkNames(std::make_shared<ThreadPool>(4)));
+}
+
+SCOPE_TEST(testSniffKeepsOrder) {
+  // records held for sniffing still come out in order with the dir records
+  const std::string expected(walkNames(std::shared_ptr<ThreadPool>()));
+  SCOPE_ASSERT_EQUAL(expected, walkNames(std::shared_ptr<ThreadPool>(), true));
+  SCOPE_ASSERT_EQUAL(expected, walkNames(std::make_shared<ThreadPool>(4), true));
+}
+
+SCOPE_TEST(testFileWriterFramesEntriesWithoutMeta) {
+  std::stringstream out;
+  FileWriter walker(out);
+  processDir(walker, 2);
+
+  // JSON record line, then a zero size and no contents, for each
+  const std::string result(out.str());
+  const size_t firstEnd = result.find('\n');
+  SCOPE_ASSERT(firstEnd != std::string::npos);
+  SCOPE_ASSERT_EQUAL(std::string(8, '\0'), result.substr(firstEnd + 1, 8));
+  SCOPE_ASSERT_EQUAL('{', result[firstEnd + 9]);
+  SCOPE_ASSERT_EQUAL(std::string(8, '\0'), result.substr(result.size() - 8));
+}
+
+SCOPE_TEST(testFileWriterPhysicalOrderIndex) {
+  std::stringstream out;
+  FileWriter walker(out);
+  walker.setPhysicalOrder(true);
+  processDir(walker, 2);
+  SCOPE_ASSERT(out.str().empty()); // held until the walk is done
+
+  walker.finishWalk();
+  const std::string result(out.str());
+  const size_t recLen = result.find('\n') + 1;
+
+  // two records with zero sizes, the index, and the index's position
+  uint64_t indexPos = 0;
+  for (unsigned int i = 0; i < 8; ++i) {
+    indexPos |= static_cast<uint64_t>(static_cast<unsigned char>(result[result.size() - 8 + i])) << (8 * i);
+  }
+  SCOPE_ASSERT_EQUAL(2 * (recLen + 8), indexPos);
+  SCOPE_ASSERT_EQUAL("{\"index\":[{\"id\":\"000000\",\"pos\":0},{\"id\":\"000001\",\"pos\":" + std::to_string(recLen + 8) + "}]}\n",
+                     result.substr(indexPos, result.size() - 8 - indexPos));
+}
+
+SCOPE_TEST(testFileWriterHashingWritesRecordsOnly) {
+  std::stringstream out;
+  FileWriter walker(out);
+  walker.setPhysicalOrder(true);
+  walker.setContentOutput(false);
+  walker.setHashPool(std::make_shared<ThreadPool>(2));
+  processDir(walker, 2);
+  walker.finishWalk();
+
+  // two JSON lines, with no sizes or index, and nothing to hash
+  const std::string result(out.str());
+  SCOPE_ASSERT_EQUAL(2, std::count(result.begin(), result.end(), '\n'));
+  SCOPE_ASSERT_EQUAL('\n', result[result.size() - 1]);
+  SCOPE_ASSERT_EQUAL('{', result[result.find('\n') + 1]);
+  SCOPE_ASSERT_EQUAL(std::string::npos, result.find("hashes"));
+}
+
+SCOPE_TEST(testFileWriterDedupsInodes) {
+  std::stringstream out;
+  FileWriter walker(out);
+  walker.setDedup(true);
+
+  TSK_FS_META meta = TSK_FS_META();
+  meta.flags = static_cast<TSK_FS_META_FLAG_ENUM>(TSK_FS_META_FLAG_ALLOC | TSK_FS_META_FLAG_USED);
+  meta.type = TSK_FS_META_TYPE_REG;
+  meta.addr = 5;
+
+  TSK_FS_INFO fs = TSK_FS_INFO();
+  // the same inode, through two names
+  processName(walker, "a.txt", TSK_FS_NAME_TYPE_REG, 2, &meta, &fs);
+
+  // the second record refers to the first, which has the contents
+  const std::string result(out.str());
+  const size_t secondBeg = result.find('\n') + 9;
+  SCOPE_ASSERT_EQUAL(std::string::npos, result.substr(0, secondBeg).find("content_ref"));
+  SCOPE_ASSERT(result.find("\"content_ref\":{\"id\":\"000000\",\"by\":\"inode\"}", secondBeg) != std::string::npos);
+  SCOPE_ASSERT_EQUAL(std::string(8, '\0'), result.substr(result.size() - 8));
+}
+
+SCOPE_TEST(testFilterKeepsIDs) {
+  std::stringstream out;
+  MetadataWriter walker(out);
+  walker.setFilter(std::make_shared<FileFilter>("name = keep*"));
+
+  processName(walker, "skip", TSK_FS_NAME_TYPE_REG, 1);
+  processName(walker, "keep", TSK_FS_NAME_TYPE_REG, 1);
+  walker.finishWalk();
+
+  // one record, with the ID it would have had without the filter
+  const std::string result(out.str());
+  SCOPE_ASSERT_EQUAL(1, std::count(result.begin(), result.end(), '\n'));
+  SCOPE_ASSERT_EQUAL(0u, result.find("{\"id\":\"000001\""));
+  SCOPE_ASSERT(result.find("\"name\":\"keep\"") != std::string::npos);
+}
+
+SCOPE_TEST(testAttrSizesFromRuns) {
+  AttrRecord a = AttrRecord();
+  a.Flags = TSK_FS_ATTR_INUSE | TSK_FS_ATTR_NONRES;
+  a.Size = a.InitSize = 5000;
+  a.AllocSize = 3 * 4096;
+  a.Runs.push_back(RunRecord{10, 1, 0, TSK_FS_ATTR_RUN_FLAG_NONE});
+  a.Runs.push_back(RunRecord{20, 2, 1, TSK_FS_ATTR_RUN_FLAG_NONE});
+
+  const std::vector<AttrExtent> extents(attrExtents(a, 4096, 512));
+  SCOPE_ASSERT_EQUAL(3u, extents.size());
+  SCOPE_ASSERT_EQUAL(10 * 4096 + 512, extents[0].Beg);
+  SCOPE_ASSERT_EQUAL(11 * 4096 + 512, extents[0].End);
+  SCOPE_ASSERT(!extents[0].Slack);
+  SCOPE_ASSERT_EQUAL(20 * 4096 + 512, extents[1].Beg);
+  SCOPE_ASSERT_EQUAL(20 * 4096 + 512 + 904, extents[1].End);
+  SCOPE_ASSERT_EQUAL(4096u, extents[1].FileOffset);
+  SCOPE_ASSERT(extents[2].Slack);
+  SCOPE_ASSERT_EQUAL(0u, extents[2].FileOffset);
+  SCOPE_ASSERT_EQUAL(22 * 4096 + 512, extents[2].End);
+
+  setAttrSizes(a, 4096, 512);
+  SCOPE_ASSERT_EQUAL(3 * 4096u, a.PhysicalSize);
+  SCOPE_ASSERT_EQUAL(3 * 4096u - 5000, a.SlackSize);
+
+  a.Flags = TSK_FS_ATTR_INUSE | TSK_FS_ATTR_RES;
+  setAttrSizes(a, 4096, 512);
+  SCOPE_ASSERT_EQUAL(5000u, a.PhysicalSize);
+  SCOPE_ASSERT_EQUAL(0u, a.SlackSize);
+}
+
+SCOPE_TEST(testSpaceExtents) {
+  FsMap runs;
+  markRun(runs, 1000, 2000, 1, false);
+  markRun(runs, 2000, 2500, 1, true);
+  markRun(runs, 2500, 3000, 2, true);  // adjacent slack of another file
+  markRun(runs, 4000, 5000, 3, false);
+  markRun(runs, 4500, 4600, 4, true);  // overlaps data, so isn't slack
+  markRun(runs, 5000, 5100, 3, true);
+
+  const std::vector<MetadataWriter::Extent> slack(SpaceWriter::slackExtents(runs));
+  SCOPE_ASSERT_EQUAL(2u, slack.size());
+  SCOPE_ASSERT_EQUAL(2000u, slack[0].first);
+  SCOPE_ASSERT_EQUAL(3000u, slack[0].second);
+  SCOPE_ASSERT_EQUAL(5000u, slack[1].first);
+  SCOPE_ASSERT_EQUAL(5100u, slack[1].second);
+
+  const std::vector<MetadataWriter::Extent> unalloc(SpaceWriter::unallocatedExtents(runs, 512, 8192));
+  SCOPE_ASSERT_EQUAL(3u, unalloc.size());
+  SCOPE_ASSERT_EQUAL(512u, unalloc[0].first);
+  SCOPE_ASSERT_EQUAL(1000u, unalloc[0].second);
+  SCOPE_ASSERT_EQUAL(3000u, unalloc[1].first);
+  SCOPE_ASSERT_EQUAL(4000u, unalloc[1].second);
+  SCOPE_ASSERT_EQUAL(5100u, unalloc[2].first);
+  SCOPE_ASSERT_EQUAL(8192u, unalloc[2].second);
+}
+
+SCOPE_TEST(testBlockMapRegions) {
+  FsMap runs;
+  markRun(runs, 1024, 2048, 1, false);
+  markRun(runs, 2048, 2560, 1, true);
+  markRun(runs, 4096, 5120, 2, false);
+
+  // 1KB regions; the filesystem is [1024, 6144), and the disk is 7KB
+  std::vector<uint8_t> regions(7, 0);
+  BlockMapWriter::markRegions(runs, 1024, 6144, 1024, regions);
+  SCOPE_ASSERT_EQUAL(0, regions[0]);
+  SCOPE_ASSERT_EQUAL(BlockMapWriter::REGION_ALLOCATED, regions[1]);
+  SCOPE_ASSERT_EQUAL(BlockMapWriter::REGION_SLACK | BlockMapWriter::REGION_UNALLOCATED, regions[2]);
+  SCOPE_ASSERT_EQUAL(BlockMapWriter::REGION_UNALLOCATED, regions[3]);
+  SCOPE_ASSERT_EQUAL(BlockMapWriter::REGION_ALLOCATED, regions[4]);
+  SCOPE_ASSERT_EQUAL(BlockMapWriter::REGION_UNALLOCATED, regions[5]);
+  SCOPE_ASSERT_EQUAL(0, regions[6]);
+}